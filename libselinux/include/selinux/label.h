@@ -8,6 +8,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
 #include <selinux/selinux.h>
 
@@ -54,8 +55,12 @@ struct selabel_handle;
 #define SELABEL_OPT_SUBSET	4
 /* require a hash calculation on spec files */
 #define SELABEL_OPT_DIGEST	5
+/* match the regular expressions of a spec file node together (file backend, boolean value) */
+#define SELABEL_OPT_COMBINE_REGEX	6
+/* count matches and regex evaluations of each spec for selabel_profile_dump() (file backend, boolean value) */
+#define SELABEL_OPT_PROFILE	7
 /* total number of options */
-#define SELABEL_NOPT		6
+#define SELABEL_NOPT		8
 
 /*
  * Label operations
@@ -166,6 +171,56 @@ extern enum selabel_cmp_result selabel_cmp(const struct selabel_handle *h1,
  */
 extern void selabel_stats(struct selabel_handle *handle);
 
+/**
+ * selabel_profile_dump - write the lookup profile of a handle.
+ * @handle: specifies backend instance to query, opened with SELABEL_OPT_PROFILE
+ * @fp: specifies the stream to write the profile to
+ *
+ * Write the counters recorded by the lookups of all threads so far as
+ * tab separated records, one per line.
+ *
+ * Returns %0 on success, -%1 with @errno set on failure.
+ */
+extern int selabel_profile_dump(struct selabel_handle *handle, FILE *fp);
+
+/* Omit the precompiled regular expressions from the compiled output */
+#define SELABEL_COMPILE_NO_PRECOMPREGEX	1
+/* Log how long each phase of the compilation took */
+#define SELABEL_COMPILE_TIMES	2
+
+/**
+ * selabel_file_compile - Compile a file contexts specification into the
+ *			  binary format loaded by the file backend.
+ * @path: the text based file contexts file to compile
+ * @out_path: output file, or NULL to append ".bin" to @path
+ * @validate: optional function checking each context, returning < 0 if
+ *	      the context is invalid
+ * @arg: argument passed through to @validate
+ * @flags: bitwise or of SELABEL_COMPILE_* flags
+ *
+ * The output is written to a temporary file which is renamed over
+ * @out_path on success.
+ * Return %0 on success, -%1 with @errno set on failure.
+ */
+extern int selabel_file_compile(const char *path, const char *out_path,
+				int (*validate)(const char *context, void *arg),
+				void *arg, unsigned int flags);
+
+/**
+ * selabel_file_compile_parallel - Compile a file contexts specification,
+ *				   optionally using more threads.
+ * @nthreads: the number of threads compiling the regular expressions
+ *	      (0 = use number of CPUs)
+ *
+ * Same as selabel_file_compile(3), but compiles the regular expressions
+ * with multiple threads.  @validate is only called from the calling thread
+ * and the output does not depend on @nthreads.
+ */
+extern int selabel_file_compile_parallel(const char *path, const char *out_path,
+					 int (*validate)(const char *context, void *arg),
+					 void *arg, unsigned int flags,
+					 size_t nthreads);
+
 /*
  * Type codes used by specific backends
  */
@@ -6,6 +6,7 @@
 #include <sys/types.h>
 #include <stddef.h>
 #include <stdarg.h>
+#include <time.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -128,6 +129,13 @@ extern int selinux_restorecon_parallel(const char *pathname,
  */
 #define SELINUX_RESTORECON_COUNT_ERRORS			0x20000
 
+/*
+ * Only check files whose inode changed at or after the time set by
+ * selinux_restorecon_set_changed_since(3). Directory digests are
+ * neither checked nor written.
+ */
+#define SELINUX_RESTORECON_CHANGED_SINCE		0x40000
+
 /**
  * selinux_restorecon_set_sehandle - Set the global fc handle.
  * @hndl: specifies handle to set as the global fc handle.
@@ -164,6 +172,14 @@ extern void selinux_restorecon_set_exclude_list(const char **exclude_list);
  */
 extern int selinux_restorecon_set_alt_rootpath(const char *alt_rootpath);
 
+/**
+ * selinux_restorecon_set_changed_since - Set the cutoff for
+ *					  SELINUX_RESTORECON_CHANGED_SINCE.
+ * @changed_since: files whose status change time (st_ctime) is older
+ *		   than this are not checked.
+ */
+extern void selinux_restorecon_set_changed_since(const struct timespec *changed_since);
+
 /**
  * selinux_restorecon_xattr - Read/remove security.sehash xattr entries.
  * @pathname: specifies directory path to check.
@@ -408,3 +408,13 @@ void selabel_stats(struct selabel_handle *rec)
 {
 	rec->func_stats(rec);
 }
+
+int selabel_profile_dump(struct selabel_handle *rec, FILE *fp)
+{
+	if (!rec->func_profile_dump) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	return rec->func_profile_dump(rec, fp);
+}
@@ -11,9 +11,9 @@
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h>
-#include <fnmatch.h>
 #include "callbacks.h"
 #include "label_internal.h"
+#include "label_key.h"
 
 /*
  * Regular database object's security context interface
@@ -81,6 +81,7 @@ typedef struct spec {
 typedef struct catalog {
 	unsigned int	nspec;	/* number of specs in use */
 	unsigned int	limit;	/* physical limitation of specs[] */
+	struct key_index index;	/* index of specs[] for db_lookup() */
 	spec_t		specs[0];
 } catalog_t;
 
@@ -188,6 +189,7 @@ db_close(struct selabel_handle *rec)
 		free(spec->lr.ctx_trans);
 		__pthread_mutex_destroy(&spec->lr.lock);
 	}
+	key_index_destroy(&catalog->index);
 	free(catalog);
 }
 
@@ -199,23 +201,19 @@ db_lookup(struct selabel_handle *rec, const char *key, int type)
 {
 	catalog_t      *catalog = (catalog_t *)rec->data;
 	spec_t	       *spec;
-	unsigned int	i;
-
-	for (i = 0; i < catalog->nspec; i++) {
-		spec = &catalog->specs[i];
-
-		if (spec->type != type)
-			continue;
-		if (!fnmatch(spec->key, key, 0)) {
-			spec->matches++;
+	int		i;
 
-			return &spec->lr;
-		}
+	i = key_index_lookup(&catalog->index, key, type);
+	if (i < 0) {
+		/* No found */
+		errno = ENOENT;
+		return NULL;
 	}
 
-	/* No found */
-	errno = ENOENT;
-	return NULL;
+	spec = &catalog->specs[i];
+	spec->matches++;
+
+	return &spec->lr;
 }
 
 /*
@@ -232,6 +230,7 @@ db_stats(struct selabel_handle *rec)
 
 	selinux_log(SELINUX_INFO, "%u entries, %u matches made\n",
 		    catalog->nspec, total);
+	key_index_stats(&catalog->index);
 }
 
 /*
@@ -258,6 +257,7 @@ db_init(const struct selinux_opt *opts, unsigned nopts,
 		return NULL;
 	catalog->limit = 32;
 	catalog->nspec = 0;
+	memset(&catalog->index, 0, sizeof(catalog->index));
 
 	/*
 	 * Process arguments
@@ -341,6 +341,19 @@ db_init(const struct selinux_opt *opts, unsigned nopts,
 			goto out_error;
 	}
 
+	/*
+	 * Index the entries for db_lookup()
+	 */
+	for (i = 0; i < catalog->nspec; i++) {
+		spec_t	       *spec = &catalog->specs[i];
+
+		if (key_index_add(&catalog->index, i, spec->type, spec->key,
+				  false) < 0)
+			goto out_error;
+	}
+	if (key_index_build(&catalog->index) < 0)
+		goto out_error;
+
 	if (digest_add_specfile(rec->digest, filp, NULL, sb.st_size, path) < 0)
 		goto out_error;
 
@@ -361,6 +374,7 @@ out_error:
 		free(spec->lr.ctx_trans);
 		__pthread_mutex_destroy(&spec->lr.lock);
 	}
+	key_index_destroy(&catalog->index);
 	free(catalog);
 	fclose(filp);
 
@@ -14,8 +14,10 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/types.h>
@@ -50,6 +52,7 @@ void free_spec_node(struct spec_node *node)
 		free(lspec->regex_str);
 	}
 	free(node->literal_specs);
+	free(node->literal_hash);
 
 	for (uint32_t i = 0; i < node->regex_specs_num; i++) {
 		struct regex_spec *rspec = &node->regex_specs[i];
@@ -64,9 +67,14 @@ void free_spec_node(struct spec_node *node)
 			continue;
 
 		free(rspec->regex_str);
+		free(rspec->req_literal);
 	}
 	free(node->regex_specs);
 
+	for (uint32_t i = 0; i < node->regex_groups_num; i++)
+		regex_data_free(node->regex_groups[i].regex);
+	free(node->regex_groups);
+
 	for (uint32_t i = 0; i < node->children_num; i++)
 		free_spec_node(&node->children[i]);
 	free(node->children);
@@ -102,6 +110,202 @@ void sort_spec_node(struct spec_node *node, struct spec_node *parent)
 		sort_spec_node(&node->children[i], node);
 }
 
+/*
+ * (Re)build the literal hash tables of a sorted tree, unless they are up to
+ * date, e.g. when loaded from a compiled file that was not merged with others.
+ */
+int build_literal_hash(struct spec_node *node)
+{
+	if (node->literal_hash_specs != node->literal_specs_num || !node->literal_hash) {
+		free(node->literal_hash);
+		node->literal_hash = NULL;
+		node->literal_hash_size = 0;
+		node->literal_hash_specs = 0;
+
+		if (node->literal_specs_num >= LITERAL_HASH_MIN) {
+			uint32_t size = 1, mask;
+
+			/* Keep the load factor at or below 1/2 */
+			while (size < node->literal_specs_num) {
+				if (size > UINT32_MAX / 4)
+					return -1;
+				size <<= 1;
+			}
+			size <<= 1;
+			mask = size - 1;
+
+			node->literal_hash = calloc(size, sizeof(uint32_t));
+			if (!node->literal_hash)
+				return -1;
+
+			for (uint32_t i = 0; i < node->literal_specs_num; i++) {
+				const char *match = node->literal_specs[i].literal_match;
+				uint32_t slot;
+
+				/* Only the first of equal literal matches is indexed */
+				if (i > 0 && strcmp(node->literal_specs[i - 1].literal_match, match) == 0)
+					continue;
+
+				slot = literal_hash(match, strlen(match)) & mask;
+				while (node->literal_hash[slot] != 0)
+					slot = (slot + 1) & mask;
+				node->literal_hash[slot] = i + 1;
+			}
+
+			node->literal_hash_size = size;
+			node->literal_hash_specs = node->literal_specs_num;
+		}
+	}
+
+	for (uint32_t i = 0; i < node->children_num; i++) {
+		if (build_literal_hash(&node->children[i]) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Whether a regular expression can be placed into an alternation with others
+ * and still match exactly the same paths.  A top-level '|' binds weaker than
+ * the ^...$ anchors added by compile_regex(), and backreferences, quoting,
+ * option settings and verbs depend on their position in the whole pattern.
+ */
+static bool regex_is_combinable(const char *regex)
+{
+	uint32_t depth = 0;
+	bool in_class = false;
+	const char *p;
+
+	for (p = regex; *p; p++) {
+		if (*p == '\\') {
+			p++;
+			if (*p == '\0' || strchr("QEcgk0123456789", *p))
+				return false;
+			continue;
+		}
+
+		if (in_class) {
+			if (p[0] == '[' && p[1] == ':') {
+				p = strstr(p + 2, ":]");
+				if (!p)
+					return false;
+				p++;
+			} else if (*p == ']') {
+				in_class = false;
+			}
+			continue;
+		}
+
+		switch (*p) {
+		case '[':
+			in_class = true;
+			/* a leading ']' (after an optional '^') is literal */
+			if (p[1] == '^')
+				p++;
+			if (p[1] == ']')
+				p++;
+			break;
+		case '(':
+			if (p[1] == '*')
+				return false;
+			if (p[1] == '?' && !(p[2] == ':' || p[2] == '=' || p[2] == '!' ||
+					     (p[2] == '<' && (p[3] == '=' || p[3] == '!'))))
+				return false;
+			depth++;
+			break;
+		case ')':
+			if (depth == 0)
+				return false;
+			depth--;
+			break;
+		case '|':
+			if (depth == 0)
+				return false;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return depth == 0 && !in_class;
+}
+
+static int add_regex_group(struct spec_node *node, uint32_t first, uint32_t last)
+{
+	struct regex_group *group;
+	struct regex_data *regex;
+	struct regex_error_data error_data;
+	char *pattern, *cp;
+	size_t len = sizeof("^(?:)$");
+	int rc;
+
+	for (uint32_t i = first; i <= last; i++)
+		len += strlen(node->regex_specs[i].regex_str) + sizeof("|(*MARK:4294967295)(?:)");
+
+	pattern = malloc(len);
+	if (!pattern)
+		return -1;
+
+	/* Later specifications take precedence, so try them first. */
+	cp = pattern + sprintf(pattern, "^(?:");
+	for (uint32_t i = last + 1; i > first; i--)
+		cp += sprintf(cp, "%s(*MARK:%u)(?:%s)", i == last + 1 ? "" : "|",
+			      i - 1, node->regex_specs[i - 1].regex_str);
+	strcpy(cp, ")$");
+
+	rc = regex_prepare_data(&regex, pattern, &error_data);
+	free(pattern);
+	if (rc < 0) {
+		/* e.g. too large for the regex library; match the run one by one */
+		return 0;
+	}
+
+	regex_jit_compile(regex);
+
+	group = realloc(node->regex_groups, (node->regex_groups_num + 1) * sizeof(*group));
+	if (!group) {
+		regex_data_free(regex);
+		return -1;
+	}
+
+	group[node->regex_groups_num++] = (struct regex_group) {
+		.regex = regex,
+		.first = first,
+		.last = last,
+	};
+	node->regex_groups = group;
+
+	return 0;
+}
+
+/*
+ * Combine runs of regex specifications of each node into single expressions,
+ * so a lookup which misses all of them costs one regex match per run.
+ */
+static int build_regex_groups(struct spec_node *node)
+{
+	uint32_t first = 0;
+
+	for (uint32_t i = 0; i <= node->regex_specs_num; i++) {
+		bool end_run = i == node->regex_specs_num ||
+			       !regex_is_combinable(node->regex_specs[i].regex_str);
+
+		if (end_run || i - first == REGEX_GROUP_MAX) {
+			if (i - first > 1 && add_regex_group(node, first, i - 1) < 0)
+				return -1;
+			first = end_run ? i + 1 : i;
+		}
+	}
+
+	for (uint32_t i = 0; i < node->children_num; i++) {
+		if (build_regex_groups(&node->children[i]) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
 /*
  * Warn about duplicate specifications.
  */
@@ -253,9 +457,15 @@ static int merge_mmap_spec_nodes(struct spec_node *restrict dest, struct spec_no
 			dest->literal_specs       = source->literal_specs;
 			dest->literal_specs_num   = source->literal_specs_num;
 			dest->literal_specs_alloc = source->literal_specs_alloc;
+			dest->literal_hash        = source->literal_hash;
+			dest->literal_hash_size   = source->literal_hash_size;
+			dest->literal_hash_specs  = source->literal_hash_specs;
 			source->literal_specs       = NULL;
 			source->literal_specs_num   = 0;
 			source->literal_specs_alloc = 0;
+			source->literal_hash        = NULL;
+			source->literal_hash_size   = 0;
+			source->literal_hash_specs  = 0;
 		}
 	}
 
@@ -571,11 +781,11 @@ static int load_mmap_literal_spec(struct mmap_area *mmap_area, bool validating,
 }
 
 static int load_mmap_regex_spec(struct mmap_area *mmap_area, bool validating, bool do_load_precompregex,
-				uint8_t inputno,
+				uint32_t version, uint8_t inputno,
 				struct regex_spec *rspec, const struct context_array *ctx_array)
 {
 	uint32_t data_u32, ctx_id, lineno;
-	uint16_t data_u16, regex_len;
+	uint16_t data_u16, regex_len, literal_len;
 	uint8_t data_u8;
 	int rc;
 
@@ -649,6 +859,8 @@ static int load_mmap_regex_spec(struct mmap_area *mmap_area, bool validating, bo
 	if (rspec->prefix_len > strlen(rspec->regex_str))
 		return -1;
 
+	rspec->partial_prefix_len = regex_partial_prefix_len(rspec->regex_str);
+
 
 	/*
 	 * Read file kind
@@ -659,11 +871,44 @@ static int load_mmap_regex_spec(struct mmap_area *mmap_area, bool validating, bo
 	rspec->file_kind = data_u8;
 
 
+	/*
+	 * Read required literal
+	 */
+	if (version >= SELINUX_COMPILED_FCONTEXT_REQ_LITERAL) {
+		rc = next_entry(&data_u16, mmap_area, sizeof(uint16_t));
+		if (rc < 0)
+			return -1;
+		literal_len = be16toh(data_u16);
+
+		if (literal_len == 1)
+			return -1;
+
+		if (literal_len > 0) {
+			rspec->req_literal = mmap_area->next_addr;
+			rc = next_entry(NULL, mmap_area, literal_len);
+			if (rc < 0)
+				return -1;
+
+			if (rspec->req_literal[literal_len - 1] != '\0' ||
+			    strlen(rspec->req_literal) != (size_t)literal_len - 1)
+				return -1;
+
+			rspec->req_literal_len = literal_len - 1;
+		}
+
+		rc = next_entry(&data_u8, mmap_area, sizeof(uint8_t));
+		if (rc < 0)
+			return -1;
+		if (data_u8 > 1 || (data_u8 && literal_len == 0))
+			return -1;
+		rspec->req_literal_at_start = data_u8;
+	}
+
+
 	/*
 	 * Read pcre regex related data
 	 */
-	rc = regex_load_mmap(mmap_area, &rspec->regex, do_load_precompregex,
-			     &rspec->regex_compiled);
+	rc = regex_skip_mmap(mmap_area, &rspec->regex_serialized, do_load_precompregex);
 	if (rc < 0)
 		return -1;
 
@@ -674,7 +919,8 @@ static int load_mmap_regex_spec(struct mmap_area *mmap_area, bool validating, bo
 }
 
 static int load_mmap_spec_node(struct mmap_area *mmap_area, const char *path, bool validating, bool do_load_precompregex,
-			       struct spec_node *node, bool is_root, uint8_t inputno, const struct context_array *ctx_array)
+			       uint32_t version, struct spec_node *node, bool is_root, uint8_t inputno,
+			       const struct context_array *ctx_array)
 {
 	uint32_t data_u32, lspec_num, rspec_num, children_num;
 	uint16_t data_u16, stem_len;
@@ -738,6 +984,41 @@ static int load_mmap_spec_node(struct mmap_area *mmap_area, const char *path, bo
 		}
 	}
 
+	if (version >= SELINUX_COMPILED_FCONTEXT_LITERAL_HASH) {
+		uint32_t hash_size;
+
+		rc = next_entry(&data_u32, mmap_area, sizeof(uint32_t));
+		if (rc < 0)
+			return -1;
+		hash_size = be32toh(data_u32);
+
+		/* Power of two, only for nodes with literal specs */
+		if ((hash_size & (hash_size - 1)) != 0 || (hash_size > 0 && lspec_num == 0))
+			return -1;
+
+		if (hash_size > 0) {
+			if (entry_size_check(mmap_area, hash_size, sizeof(uint32_t)))
+				return -1;
+
+			node->literal_hash = calloc(hash_size, sizeof(uint32_t));
+			if (!node->literal_hash)
+				return -1;
+
+			for (uint32_t i = 0; i < hash_size; i++) {
+				rc = next_entry(&data_u32, mmap_area, sizeof(uint32_t));
+				if (rc < 0)
+					return -1;
+				node->literal_hash[i] = be32toh(data_u32);
+
+				if (node->literal_hash[i] > lspec_num)
+					return -1;
+			}
+
+			node->literal_hash_size  = hash_size;
+			node->literal_hash_specs = lspec_num;
+		}
+	}
+
 
 	/*
 	 * Read regex specs
@@ -751,7 +1032,12 @@ static int load_mmap_spec_node(struct mmap_area *mmap_area, const char *path, bo
 		return -1;
 
 	if (rspec_num > 0) {
-		if (entry_size_check(mmap_area, rspec_num, sizeof(uint32_t) + 3 * sizeof(uint16_t) + 4 * sizeof(char)))
+		size_t rspec_min_size = sizeof(uint32_t) + 3 * sizeof(uint16_t) + 4 * sizeof(char);
+
+		if (version >= SELINUX_COMPILED_FCONTEXT_REQ_LITERAL)
+			rspec_min_size += sizeof(uint16_t) + sizeof(uint8_t);
+
+		if (entry_size_check(mmap_area, rspec_num, rspec_min_size))
 			return -1;
 
 		node->regex_specs = calloc(rspec_num, sizeof(struct regex_spec));
@@ -762,7 +1048,8 @@ static int load_mmap_spec_node(struct mmap_area *mmap_area, const char *path, bo
 		node->regex_specs_alloc = rspec_num;
 
 		for (uint32_t i = 0; i < rspec_num; i++) {
-			rc = load_mmap_regex_spec(mmap_area, validating, do_load_precompregex, inputno, &node->regex_specs[i], ctx_array);
+			rc = load_mmap_regex_spec(mmap_area, validating, do_load_precompregex, version, inputno,
+						  &node->regex_specs[i], ctx_array);
 			if (rc)
 				return -1;
 		}
@@ -794,7 +1081,8 @@ static int load_mmap_spec_node(struct mmap_area *mmap_area, const char *path, bo
 		node->children_alloc = children_num;
 
 		for (uint32_t i = 0; i < children_num; i++) {
-			rc = load_mmap_spec_node(mmap_area, path, validating, do_load_precompregex, &node->children[i], false, inputno, ctx_array);
+			rc = load_mmap_spec_node(mmap_area, path, validating, do_load_precompregex, version,
+						 &node->children[i], false, inputno, ctx_array);
 			if (rc)
 				return -1;
 
@@ -823,7 +1111,7 @@ FUZZ_EXTERN int load_mmap(FILE *fp, const size_t len, struct selabel_handle *rec
 	char *addr = NULL, *str_buf = NULL;
 	struct mmap_area *mmap_area = NULL;
 	uint64_t data_u64, num_specs;
-	uint32_t data_u32, pcre_ver_len, pcre_arch_len;
+	uint32_t data_u32, version, pcre_ver_len, pcre_arch_len;
 	const char *reg_arch, *reg_version;
 	bool reg_version_matches = false, reg_arch_matches = false;
 
@@ -856,10 +1144,14 @@ FUZZ_EXTERN int load_mmap(FILE *fp, const size_t len, struct selabel_handle *rec
 
 	/* check if this version is higher than we understand */
 	rc = next_entry(&data_u32, mmap_area, sizeof(uint32_t));
-	if (rc < 0 || be32toh(data_u32) != SELINUX_COMPILED_FCONTEXT_TREE_LAYOUT) {
+	if (rc < 0)
+		goto err;
+	version = be32toh(data_u32);
+	if (version < SELINUX_COMPILED_FCONTEXT_TREE_LAYOUT || version > SELINUX_COMPILED_FCONTEXT_MAX_VERS) {
 		COMPAT_LOG(SELINUX_WARNING,
-				"%s:  Unsupported compiled fcontext version %d, supported is version %d\n",
-				path, be32toh(data_u32), SELINUX_COMPILED_FCONTEXT_TREE_LAYOUT);
+				"%s:  Unsupported compiled fcontext version %u, supported are versions %d to %d\n",
+				path, version, SELINUX_COMPILED_FCONTEXT_TREE_LAYOUT,
+				SELINUX_COMPILED_FCONTEXT_MAX_VERS);
 		goto err;
 	}
 
@@ -969,7 +1261,7 @@ end_arch_check:
 
 	rc = load_mmap_spec_node(mmap_area, path, rec->validating,
 				 reg_version_matches && reg_arch_matches,
-				 root, true,
+				 version, root, true,
 				 inputno,
 				 &ctx_array);
 	if (rc)
@@ -1378,6 +1670,265 @@ static char *selabel_sub_key(const struct saved_data *data, const char *key, siz
 	return ptr;
 }
 
+/*
+ * Lookup profiling (SELABEL_OPT_PROFILE)
+ *
+ * Every thread counts into its own buffer, found through a one entry thread
+ * local cache, so lookups take no lock and only the owning thread writes a
+ * counter.  selabel_profile_dump() sums the buffers of all threads up.
+ */
+
+/* Counters of a specification */
+struct spec_profile {
+	uint64_t matches;			/* lookups it matched */
+	uint64_t regex_evals;			/* evaluations of its regex */
+	uint64_t regex_ns;			/* time spent evaluating its regex */
+};
+
+/* Counters of one thread */
+struct profile_thread {
+	struct profile_thread *next;
+	const void *owner;			/* address of the thread's profile_cache */
+	uint64_t lookups;
+	uint64_t depth[SPEC_NODE_MAX_DEPTH + 1];	/* lookups by depth of the deepest node */
+	uint64_t nodes;				/* nodes walked */
+	uint64_t group_evals;			/* evaluations of combined regexes */
+	uint64_t group_ns;			/* time spent evaluating them */
+	struct spec_profile specs[];		/* indexed by spec_node.profile_id */
+};
+
+struct profile {
+	pthread_mutex_t lock;			/* protects the list of threads */
+	struct profile_thread *threads;
+	uint64_t id;				/* unique across handles */
+	uint32_t nspecs;
+};
+
+static uint64_t profile_last_id;
+
+static __thread struct {
+	uint64_t id;
+	struct profile_thread *pt;
+} profile_cache;
+
+static void profile_assign_ids(struct spec_node *node, uint32_t *next)
+{
+	node->profile_id = *next;
+	*next += node->literal_specs_num + node->regex_specs_num;
+
+	for (uint32_t i = 0; i < node->children_num; i++)
+		profile_assign_ids(&node->children[i], next);
+}
+
+static int profile_init(struct saved_data *data)
+{
+	struct profile *p;
+	uint32_t nspecs = 0;
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return -1;
+
+	profile_assign_ids(data->root, &nspecs);
+	p->nspecs = nspecs;
+	__pthread_mutex_init(&p->lock, NULL);
+#ifdef __ATOMIC_RELAXED
+	p->id = __atomic_add_fetch(&profile_last_id, 1, __ATOMIC_RELAXED);
+#else
+#error "Please use a compiler that supports __atomic builtins"
+#endif
+
+	data->profile = p;
+	return 0;
+}
+
+static void profile_fini(struct profile *p)
+{
+	struct profile_thread *pt, *next;
+
+	if (!p)
+		return;
+
+	for (pt = p->threads; pt; pt = next) {
+		next = pt->next;
+		free(pt);
+	}
+	__pthread_mutex_destroy(&p->lock);
+	free(p);
+}
+
+/* The counters of the calling thread, or NULL if they cannot be allocated */
+static struct profile_thread *profile_thread_get(struct profile *p)
+{
+	struct profile_thread *pt;
+
+	if (likely(profile_cache.id == p->id))
+		return profile_cache.pt;
+
+	__pthread_mutex_lock(&p->lock);
+	for (pt = p->threads; pt; pt = pt->next) {
+		if (pt->owner == &profile_cache)
+			break;
+	}
+	if (!pt) {
+		pt = calloc(1, sizeof(*pt) + p->nspecs * sizeof(struct spec_profile));
+		if (pt) {
+			pt->owner = &profile_cache;
+			pt->next = p->threads;
+			p->threads = pt;
+		}
+	}
+	__pthread_mutex_unlock(&p->lock);
+
+	if (pt) {
+		profile_cache.id = p->id;
+		profile_cache.pt = pt;
+	}
+	return pt;
+}
+
+/* Only the owning thread writes its counters, selabel_profile_dump() reads them */
+static inline void profile_add(uint64_t *counter, uint64_t n)
+{
+#ifdef __ATOMIC_RELAXED
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+#else
+#error "Please use a compiler that supports __atomic builtins"
+#endif
+}
+
+static inline uint64_t profile_read(const uint64_t *counter)
+{
+	return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t profile_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static struct profile_thread *profile_lookup(struct profile *p, const struct spec_node *node)
+{
+	struct profile_thread *pt = profile_thread_get(p);
+	uint32_t depth = 0;
+
+	if (!pt)
+		return NULL;
+
+	for (; node->parent && depth < SPEC_NODE_MAX_DEPTH; node = node->parent)
+		depth++;
+
+	profile_add(&pt->lookups, 1);
+	profile_add(&pt->depth[depth], 1);
+	return pt;
+}
+
+static int profile_regex_match(struct spec_profile *sp, struct regex_data *regex, const char *key, bool partial)
+{
+	uint64_t start = profile_now();
+	int rc = regex_match(regex, key, partial);
+
+	profile_add(&sp->regex_evals, 1);
+	profile_add(&sp->regex_ns, profile_now() - start);
+	return rc;
+}
+
+static int profile_regex_match_mark(struct profile_thread *pt, struct regex_data *regex, const char *key, uint32_t *mark)
+{
+	uint64_t start = profile_now();
+	int rc = regex_match_mark(regex, key, mark);
+
+	profile_add(&pt->group_evals, 1);
+	profile_add(&pt->group_ns, profile_now() - start);
+	return rc;
+}
+
+static void profile_dump_node(const struct spec_node *node, const struct spec_profile *sums, FILE *fp)
+{
+	const struct spec_profile *sp = &sums[node->profile_id];
+
+	for (uint32_t i = 0; i < node->literal_specs_num; i++, sp++) {
+		const struct literal_spec *lspec = &node->literal_specs[i];
+
+		fprintf(fp, "spec\tliteral\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%s\t%s\t%s\n",
+			sp->matches, sp->regex_evals, sp->regex_ns,
+			file_kind_to_string(lspec->file_kind), lspec->regex_str, lspec->lr.ctx_raw);
+	}
+
+	for (uint32_t i = 0; i < node->regex_specs_num; i++, sp++) {
+		const struct regex_spec *rspec = &node->regex_specs[i];
+
+		fprintf(fp, "spec\tregex\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%s\t%s\t%s\n",
+			sp->matches, sp->regex_evals, sp->regex_ns,
+			file_kind_to_string(rspec->file_kind), rspec->regex_str, rspec->lr.ctx_raw);
+	}
+
+	for (uint32_t i = 0; i < node->children_num; i++)
+		profile_dump_node(&node->children[i], sums, fp);
+}
+
+/*
+ * Write the profile as tab separated records:
+ *   selabel_profile  <format version>
+ *   lookups          <lookups>
+ *   depth            <depth of the deepest node>  <lookups>
+ *   nodes            <nodes walked>
+ *   combined         <evaluations of combined regexes>  <nanoseconds>
+ *   spec             literal|regex  <matches>  <regex evaluations>  <nanoseconds>
+ *                    <file kind>  <regex>  <context>
+ */
+static int profile_dump(struct selabel_handle *rec, FILE *fp)
+{
+	const struct saved_data *data = (const struct saved_data *)rec->data;
+	struct profile *p = data->profile;
+	struct profile_thread *pt;
+	struct spec_profile *sums;
+	uint64_t lookups = 0, depth[SPEC_NODE_MAX_DEPTH + 1] = {}, nodes = 0, group_evals = 0, group_ns = 0;
+
+	if (!p) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	sums = calloc(p->nspecs + 1, sizeof(*sums));
+	if (!sums)
+		return -1;
+
+	__pthread_mutex_lock(&p->lock);
+	for (pt = p->threads; pt; pt = pt->next) {
+		lookups += profile_read(&pt->lookups);
+		for (uint32_t d = 0; d <= SPEC_NODE_MAX_DEPTH; d++)
+			depth[d] += profile_read(&pt->depth[d]);
+		nodes += profile_read(&pt->nodes);
+		group_evals += profile_read(&pt->group_evals);
+		group_ns += profile_read(&pt->group_ns);
+
+		for (uint32_t i = 0; i < p->nspecs; i++) {
+			sums[i].matches += profile_read(&pt->specs[i].matches);
+			sums[i].regex_evals += profile_read(&pt->specs[i].regex_evals);
+			sums[i].regex_ns += profile_read(&pt->specs[i].regex_ns);
+		}
+	}
+	__pthread_mutex_unlock(&p->lock);
+
+	fprintf(fp, "selabel_profile\t1\n");
+	fprintf(fp, "lookups\t%" PRIu64 "\n", lookups);
+	for (uint32_t d = 0; d <= SPEC_NODE_MAX_DEPTH; d++)
+		fprintf(fp, "depth\t%u\t%" PRIu64 "\n", d, depth[d]);
+	fprintf(fp, "nodes\t%" PRIu64 "\n", nodes);
+	fprintf(fp, "combined\t%" PRIu64 "\t%" PRIu64 "\n", group_evals, group_ns);
+	profile_dump_node(data->root, sums, fp);
+
+	free(sums);
+
+	if (fflush(fp) == EOF || ferror(fp))
+		return -1;
+	return 0;
+}
+
 static void closef(struct selabel_handle *rec);
 
 static int init(struct selabel_handle *rec, const struct selinux_opt *opts,
@@ -1386,7 +1937,7 @@ static int init(struct selabel_handle *rec, const struct selinux_opt *opts,
 	struct saved_data *data = rec->data;
 	const char *path = NULL;
 	const char *prefix = NULL;
-	int status = -1, baseonly = 0;
+	int status = -1, baseonly = 0, combine_regex = 0, profile = 0;
 
 	/* Process arguments */
 	while (n) {
@@ -1401,6 +1952,12 @@ static int init(struct selabel_handle *rec, const struct selinux_opt *opts,
 		case SELABEL_OPT_BASEONLY:
 			baseonly = !!opts[n].value;
 			break;
+		case SELABEL_OPT_COMBINE_REGEX:
+			combine_regex = !!opts[n].value;
+			break;
+		case SELABEL_OPT_PROFILE:
+			profile = !!opts[n].value;
+			break;
 		case SELABEL_OPT_UNUSED:
 		case SELABEL_OPT_VALIDATE:
 		case SELABEL_OPT_DIGEST:
@@ -1481,6 +2038,22 @@ static int init(struct selabel_handle *rec, const struct selinux_opt *opts,
 	if (!rec->validating || !baseonly)
 		sort_specs(data);
 
+	status = build_literal_hash(data->root);
+	if (status)
+		goto finish;
+
+	if (combine_regex) {
+		status = build_regex_groups(data->root);
+		if (status)
+			goto finish;
+	}
+
+	if (profile) {
+		status = profile_init(data);
+		if (status)
+			goto finish;
+	}
+
 	digest_gen_hash(rec->digest);
 
 	status = 0;
@@ -1509,6 +2082,8 @@ static void closef(struct selabel_handle *rec)
 	free_spec_node(data->root);
 	free(data->root);
 
+	profile_fini(data->profile);
+
 	area = data->mmap_areas;
 	while (area) {
 		munmap(area->addr, area->len);
@@ -1568,6 +2143,31 @@ static uint32_t search_literal_spec(const struct literal_spec *array, uint32_t s
 	return (uint32_t)-1;
 }
 
+/*
+ * Find the first literal specification matching key completely, or return
+ * (uint32_t)-1.  The probing is bounded, as a table loaded from a compiled
+ * file is not guaranteed to have an empty slot.
+ */
+static uint32_t lookup_literal_hash(const struct spec_node *node, const char *key, size_t key_len)
+{
+	uint32_t mask = node->literal_hash_size - 1;
+	uint32_t slot = literal_hash(key, key_len) & mask;
+
+	for (uint32_t probes = 0; probes < node->literal_hash_size; probes++) {
+		uint32_t entry = node->literal_hash[slot];
+
+		if (entry == 0)
+			break;
+
+		if (strcmp(node->literal_specs[entry - 1].literal_match, key) == 0)
+			return entry - 1;
+
+		slot = (slot + 1) & mask;
+	}
+
+	return (uint32_t)-1;
+}
+
 FUZZ_EXTERN void free_lookup_result(struct lookup_result *result)
 {
 	struct lookup_result *tmp;
@@ -1579,6 +2179,50 @@ FUZZ_EXTERN void free_lookup_result(struct lookup_result *result)
 	}
 }
 
+/*
+ * Whether the path contains the literal required by the regex specification,
+ * i.e. whether it is worth running the regex against it.  Only valid for
+ * complete matches; a partial match may stop before the literal.
+ */
+static inline bool regex_spec_may_match(const struct regex_spec *rspec, const char *key, size_t key_len)
+{
+	if (!rspec->req_literal)
+		return true;
+
+	if (key_len < rspec->req_literal_len)
+		return false;
+
+	if (rspec->req_literal_at_start)
+		return memcmp(key, rspec->req_literal, rspec->req_literal_len) == 0;
+
+	return memmem(key, key_len, rspec->req_literal, rspec->req_literal_len) != NULL;
+}
+
+/*
+ * Whether the literal prefix of the regex specification decides a partial
+ * match of the path without running the regex: a path diverging from it
+ * cannot match, and a path it starts with matches partially.
+ */
+static inline bool regex_spec_partial_decided(const struct regex_spec *rspec, const char *key, size_t key_len, int *rc)
+{
+	size_t len = rspec->partial_prefix_len;
+
+	if (len == 0)
+		return false;
+
+	if (key_len < len) {
+		*rc = memcmp(key, rspec->regex_str, key_len) == 0 ? REGEX_MATCH_PARTIAL : REGEX_NO_MATCH;
+		return true;
+	}
+
+	if (memcmp(key, rspec->regex_str, len) != 0) {
+		*rc = REGEX_NO_MATCH;
+		return true;
+	}
+
+	return false;
+}
+
 /**
  * lookup_check_node() - Try to find a file context definition in the given node or parents.
  * @node:      The deepest specification node to match against. Parent nodes are successively
@@ -1589,27 +2233,39 @@ FUZZ_EXTERN void free_lookup_result(struct lookup_result *result)
  * @find_all:  Whether to find all file context definitions or just the most specific.
  * @buf:       A pre-allocated buffer for a potential result to avoid allocating it on the heap or
  *             NULL. Mututal exclusive with @find_all.
+ * @pt:        The counters of the calling thread to profile the lookup in, or NULL.
  *
  * Return: A pointer to a file context definition if a match was found. If @find_all was specified
  *         its a linked list of all results. If @buf was specified it is returned on a match found.
  *         NULL is returned in case of no match found.
  */
 static struct lookup_result *lookup_check_node(struct spec_node *node, const char *key, uint8_t file_kind,
-					       bool partial, bool find_all, struct lookup_result *buf)
+					       bool partial, bool find_all, struct lookup_result *buf,
+					       struct profile_thread *pt)
 {
 	struct lookup_result *result = NULL;
 	struct lookup_result **next = &result;
 	struct lookup_result *child_regex_match = NULL;
 	uint8_t child_regex_match_inputno = 0;  /* initialize to please GCC */
 	uint32_t child_regex_match_lineno = 1;  /* initialize to please GCC */
+	struct spec_profile *child_regex_match_sp = NULL;
 	size_t key_len = strlen(key);
 
 	assert(!(find_all && buf != NULL));
 
 	for (struct spec_node *n = node; n; n = n->parent) {
 
+		if (unlikely(pt))
+			profile_add(&pt->nodes, 1);
+
 		if (n == node) {
-			uint32_t literal_idx = search_literal_spec(n->literal_specs, n->literal_specs_num, key, key_len, partial);
+			uint32_t literal_idx;
+
+			if (!partial && n->literal_hash)
+				literal_idx = lookup_literal_hash(n, key, key_len);
+			else
+				literal_idx = search_literal_spec(n->literal_specs, n->literal_specs_num, key, key_len, partial);
+
 			if (literal_idx != (uint32_t)-1) {
 				do {
 					struct literal_spec *lspec = &n->literal_specs[literal_idx];
@@ -1622,6 +2278,8 @@ static struct lookup_result *lookup_check_node(struct spec_node *node, const cha
 #else
 #error "Please use a compiler that supports __atomic builtins"
 #endif
+						if (unlikely(pt))
+							profile_add(&pt->specs[n->profile_id + literal_idx].matches, 1);
 
 						if (strcmp(lspec->lr.ctx_raw, "<<none>>") == 0) {
 							errno = ENOENT;
@@ -1659,9 +2317,13 @@ static struct lookup_result *lookup_check_node(struct spec_node *node, const cha
 			}
 		}
 
+		uint32_t group_idx = n->regex_groups_num;
+		uint32_t known_match = UINT32_MAX;
+
 		for (uint32_t i = n->regex_specs_num; i > 0; i--) {
 			/* search in reverse order */
 			struct regex_spec *rspec = &n->regex_specs[i - 1];
+			struct spec_profile *sp = NULL;
 			const char *errbuf = NULL;
 			int rc;
 
@@ -1670,16 +2332,54 @@ static struct lookup_result *lookup_check_node(struct spec_node *node, const cha
 			     (rspec->inputno == child_regex_match_inputno && rspec->lineno < child_regex_match_lineno)))
 				break;
 
+			if (!partial && group_idx > 0 && n->regex_groups[group_idx - 1].last == i - 1) {
+				const struct regex_group *group = &n->regex_groups[--group_idx];
+				uint32_t mark;
+
+				if (unlikely(pt))
+					rc = profile_regex_match_mark(pt, group->regex, key, &mark);
+				else
+					rc = regex_match_mark(group->regex, key, &mark);
+				if (rc == REGEX_NO_MATCH) {
+					/* continue below the run */
+					i = group->first + 1;
+					continue;
+				}
+
+				if (rc == REGEX_MATCH && mark >= group->first && mark <= i - 1) {
+					known_match = mark;
+					if (mark < i - 1) {
+						/* the specs above the mark do not match, continue at it */
+						i = mark + 2;
+						continue;
+					}
+				}
+
+				/* otherwise match the run one by one */
+			}
+
 			if (file_kind != LABEL_FILE_KIND_ALL && rspec->file_kind != LABEL_FILE_KIND_ALL && file_kind != rspec->file_kind)
 				continue;
 
-			if (compile_regex(rspec, &errbuf) < 0) {
-				COMPAT_LOG(SELINUX_ERROR, "Failed to compile regular expression '%s':  %s\n",
-					   rspec->regex_str, errbuf);
-				goto fail;
-			}
+			if (i - 1 == known_match) {
+				rc = REGEX_MATCH;
+			} else if (!partial && !regex_spec_may_match(rspec, key, key_len)) {
+				rc = REGEX_NO_MATCH;
+			} else if (partial && regex_spec_partial_decided(rspec, key, key_len, &rc)) {
+				/* decided by the literal prefix */
+			} else {
+				if (compile_regex(rspec, &errbuf) < 0) {
+					COMPAT_LOG(SELINUX_ERROR, "Failed to compile regular expression '%s':  %s\n",
+						   rspec->regex_str, errbuf);
+					goto fail;
+				}
 
-			rc = regex_match(rspec->regex, key, partial);
+				if (unlikely(pt))
+					rc = profile_regex_match(&pt->specs[n->profile_id + n->literal_specs_num + i - 1],
+								 rspec->regex, key, partial);
+				else
+					rc = regex_match(rspec->regex, key, partial);
+			}
 			if (rc == REGEX_MATCH || (partial && rc == REGEX_MATCH_PARTIAL)) {
 				struct lookup_result *r;
 
@@ -1689,9 +2389,13 @@ static struct lookup_result *lookup_check_node(struct spec_node *node, const cha
 #else
 #error "Please use a compiler that supports __atomic builtins"
 #endif
+					if (unlikely(pt))
+						sp = &pt->specs[n->profile_id + n->literal_specs_num + i - 1];
 				}
 
 				if (strcmp(rspec->lr.ctx_raw, "<<none>>") == 0) {
+					if (unlikely(sp))
+						profile_add(&sp->matches, 1);
 					errno = ENOENT;
 					goto fail;
 				}
@@ -1719,9 +2423,13 @@ static struct lookup_result *lookup_check_node(struct spec_node *node, const cha
 					child_regex_match = r;
 					child_regex_match_inputno = rspec->inputno;
 					child_regex_match_lineno = rspec->lineno;
+					child_regex_match_sp = sp;
 					goto parent_node;
 				}
 
+				if (unlikely(sp))
+					profile_add(&sp->matches, 1);
+
 				*next = r;
 				next = &r->next;
 
@@ -1740,8 +2448,12 @@ static struct lookup_result *lookup_check_node(struct spec_node *node, const cha
 		continue;
 	}
 
-	if (child_regex_match)
+	if (child_regex_match) {
+		/* only the match a parent node did not override counts */
+		if (unlikely(child_regex_match_sp))
+			profile_add(&child_regex_match_sp->matches, 1);
 		return child_regex_match;
+	}
 
 	if (!result)
 		errno = ENOENT;
@@ -1846,41 +2558,29 @@ static uint8_t mode_to_file_kind(int type) {
 	}
 }
 
-// Finds all the matches of |key| in the given context. Returns the result in
-// the allocated array and updates the match count. If match_count is NULL,
-// stops early once the 1st match is found.
-FUZZ_EXTERN struct lookup_result *lookup_all(struct selabel_handle *rec,
-				 const char *key,
-				 int type,
-				 bool partial,
-				 bool find_all,
-				 struct lookup_result *buf)
+/*
+ * Remove duplicate and trailing slashes from |key| and apply the path
+ * substitutions.  Returns the key to look up, which may be one of the strings
+ * returned through |clean_key| and |sub| that the caller has to free, or NULL
+ * on error.
+ */
+static const char *normalize_key(const struct saved_data *data, const char *key,
+				 char **clean_key_out, char **sub_out)
 {
-	struct saved_data *data = (struct saved_data *)rec->data;
-	struct lookup_result *result = NULL;
-	struct spec_node *node;
 	size_t len;
-	uint8_t file_kind = mode_to_file_kind(type);
 	char *clean_key = NULL;
 	const char *prev_slash, *next_slash;
 	unsigned int sofar = 0;
-	char *sub = NULL;
-
-	if (unlikely(!key)) {
-		errno = EINVAL;
-		goto finish;
-	}
+	char *sub;
 
-	if (unlikely(!data->num_specs)) {
-		errno = ENOENT;
-		goto finish;
-	}
+	*clean_key_out = NULL;
+	*sub_out = NULL;
 
 	/* Remove duplicate slashes */
 	if (unlikely(next_slash = strstr(key, "//"))) {
 		clean_key = (char *) malloc(strlen(key) + 1);
 		if (!clean_key)
-			goto finish;
+			return NULL;
 		prev_slash = key;
 		while (next_slash) {
 			memcpy(clean_key + sofar, prev_slash, next_slash - prev_slash);
@@ -1895,8 +2595,9 @@ FUZZ_EXTERN struct lookup_result *lookup_all(struct selabel_handle *rec,
 	/* remove trailing slash */
 	len = strlen(key);
 	if (unlikely(len == 0)) {
+		free(clean_key);
 		errno = EINVAL;
-		goto finish;
+		return NULL;
 	}
 
 	if (unlikely(len > 1 && key[len - 1] == '/')) {
@@ -1904,7 +2605,7 @@ FUZZ_EXTERN struct lookup_result *lookup_all(struct selabel_handle *rec,
 		if (!clean_key) {
 			clean_key = (char *) malloc(len);
 			if (!clean_key)
-				goto finish;
+				return NULL;
 
 			memcpy(clean_key, key, len - 1);
 		}
@@ -1914,13 +2615,55 @@ FUZZ_EXTERN struct lookup_result *lookup_all(struct selabel_handle *rec,
 		len--;
 	}
 
+	*clean_key_out = clean_key;
+
 	sub = selabel_sub_key(data, key, len);
-	if (sub)
+	if (sub) {
+		*sub_out = sub;
 		key = sub;
+	}
+
+	return key;
+}
+
+// Finds all the matches of |key| in the given context. Returns the result in
+// the allocated array and updates the match count. If match_count is NULL,
+// stops early once the 1st match is found.
+FUZZ_EXTERN struct lookup_result *lookup_all(struct selabel_handle *rec,
+				 const char *key,
+				 int type,
+				 bool partial,
+				 bool find_all,
+				 struct lookup_result *buf)
+{
+	struct saved_data *data = (struct saved_data *)rec->data;
+	struct lookup_result *result = NULL;
+	struct spec_node *node;
+	struct profile_thread *pt = NULL;
+	uint8_t file_kind = mode_to_file_kind(type);
+	char *clean_key = NULL;
+	char *sub = NULL;
+
+	if (unlikely(!key)) {
+		errno = EINVAL;
+		goto finish;
+	}
+
+	if (unlikely(!data->num_specs)) {
+		errno = ENOENT;
+		goto finish;
+	}
+
+	key = normalize_key(data, key, &clean_key, &sub);
+	if (!key)
+		goto finish;
 
 	node = lookup_find_deepest_node(data->root, key);
 
-	result = lookup_check_node(node, key, file_kind, partial, find_all, buf);
+	if (unlikely(data->profile))
+		pt = profile_lookup(data->profile, node);
+
+	result = lookup_check_node(node, key, file_kind, partial, find_all, buf, pt);
 
 finish:
 	free(clean_key);
@@ -1989,34 +2732,119 @@ oom:
 	return false;
 }
 
-static bool hash_all_partial_matches(struct selabel_handle *rec, const char *key, uint8_t *digest)
+static inline void hash_partial_match(Sha1Context *context, const char *regex_str,
+				      uint8_t file_kind, const char *ctx_raw)
 {
-	assert(digest);
+	Sha1Update(context, regex_str, strlen(regex_str) + 1);
+	Sha1Update(context, &file_kind, sizeof(file_kind));
+	Sha1Update(context, ctx_raw, strlen(ctx_raw) + 1);
+}
 
-	struct lookup_result *matches = lookup_all(rec, key, 0, true, true, NULL);
-	if (!matches) {
-		return false;
+/*
+ * Hash all partial matches of |key| in the order lookup_check_node() finds
+ * them with |partial| and |find_all| set, without collecting them in a list.
+ * Returns the number of matches, or -1 on error.
+ */
+static int hash_partial_matches_node(struct spec_node *node, const char *key, Sha1Context *context)
+{
+	size_t key_len = strlen(key);
+	uint32_t literal_idx;
+	int matches = 0;
+
+	literal_idx = search_literal_spec(node->literal_specs, node->literal_specs_num, key, key_len, true);
+	if (literal_idx != (uint32_t)-1) {
+		do {
+			struct literal_spec *lspec = &node->literal_specs[literal_idx];
+
+#ifdef __ATOMIC_RELAXED
+			__atomic_store_n(&lspec->any_matches, true, __ATOMIC_RELAXED);
+#else
+#error "Please use a compiler that supports __atomic builtins"
+#endif
+
+			if (strcmp(lspec->lr.ctx_raw, "<<none>>") == 0)
+				return -1;
+
+			hash_partial_match(context, lspec->regex_str, lspec->file_kind, lspec->lr.ctx_raw);
+			matches++;
+
+			literal_idx++;
+		} while (literal_idx < node->literal_specs_num &&
+			 strncmp(node->literal_specs[literal_idx].literal_match, key, key_len) == 0);
 	}
 
-	Sha1Context context;
-	Sha1Initialise(&context);
+	for (struct spec_node *n = node; n; n = n->parent) {
+		for (uint32_t i = n->regex_specs_num; i > 0; i--) {
+			/* search in reverse order */
+			struct regex_spec *rspec = &n->regex_specs[i - 1];
+			const char *errbuf = NULL;
+			int rc;
+
+			if (!regex_spec_partial_decided(rspec, key, key_len, &rc)) {
+				if (compile_regex(rspec, &errbuf) < 0) {
+					COMPAT_LOG(SELINUX_ERROR, "Failed to compile regular expression '%s':  %s\n",
+						   rspec->regex_str, errbuf);
+					return -1;
+				}
+
+				rc = regex_match(rspec->regex, key, true);
+			}
+
+			if (rc == REGEX_NO_MATCH)
+				continue;
+
+			if (rc != REGEX_MATCH && rc != REGEX_MATCH_PARTIAL)
+				return -1;
+
+			if (rc == REGEX_MATCH) {
+#ifdef __ATOMIC_RELAXED
+				__atomic_store_n(&rspec->any_matches, true, __ATOMIC_RELAXED);
+#else
+#error "Please use a compiler that supports __atomic builtins"
+#endif
+			}
 
-	for (const struct lookup_result *m = matches; m; m = m->next) {
-		const char* regex_str = m->regex_str;
-		uint8_t file_kind = m->file_kind;
-		const char* ctx_raw = m->lr->ctx_raw;
+			if (strcmp(rspec->lr.ctx_raw, "<<none>>") == 0)
+				return -1;
 
-		Sha1Update(&context, regex_str, strlen(regex_str) + 1);
-		Sha1Update(&context, &file_kind, sizeof(file_kind));
-		Sha1Update(&context, ctx_raw, strlen(ctx_raw) + 1);
+			hash_partial_match(context, rspec->regex_str, rspec->file_kind, rspec->lr.ctx_raw);
+			matches++;
+		}
 	}
 
+	return matches;
+}
+
+static bool hash_all_partial_matches(struct selabel_handle *rec, const char *key, uint8_t *digest)
+{
+	assert(digest);
+
+	struct saved_data *data = (struct saved_data *)rec->data;
+	char *clean_key = NULL, *sub = NULL;
+	Sha1Context context;
 	SHA1_HASH sha1_hash;
+	bool status = false;
+
+	if (!key || !data->num_specs)
+		return false;
+
+	key = normalize_key(data, key, &clean_key, &sub);
+	if (!key)
+		goto out;
+
+	Sha1Initialise(&context);
+
+	if (hash_partial_matches_node(lookup_find_deepest_node(data->root, key), key, &context) <= 0)
+		goto out;
+
 	Sha1Finalise(&context, &sha1_hash);
 	memcpy(digest, sha1_hash.bytes, SHA1_HASH_SIZE);
+	status = true;
 
-	free_lookup_result(matches);
-	return true;
+out:
+	free(clean_key);
+	free(sub);
+	return status;
 }
 
 static struct selabel_lookup_rec *lookup(struct selabel_handle *rec,
@@ -2096,10 +2924,46 @@ out:
 	return lr;
 }
 
-static void spec_node_stats(const struct spec_node *node)
+/* Summary of the literal hash tables of all nodes */
+struct literal_hash_stats {
+	uint32_t nodes;
+	size_t slots;
+	size_t entries;
+	uint32_t max_probes;
+};
+
+static void literal_hash_node_stats(const struct spec_node *node, struct literal_hash_stats *lhs)
+{
+	uint32_t mask = node->literal_hash_size - 1;
+
+	lhs->nodes++;
+	lhs->slots += node->literal_hash_size;
+
+	for (uint32_t slot = 0; slot < node->literal_hash_size; slot++) {
+		uint32_t entry = node->literal_hash[slot];
+		const char *match;
+		uint32_t probes = 1;
+
+		if (entry == 0)
+			continue;
+
+		lhs->entries++;
+
+		/* Distance from the home slot of the entry */
+		match = node->literal_specs[entry - 1].literal_match;
+		probes += (slot - literal_hash(match, strlen(match))) & mask;
+		if (probes > lhs->max_probes)
+			lhs->max_probes = probes;
+	}
+}
+
+static void spec_node_stats(const struct spec_node *node, struct literal_hash_stats *lhs)
 {
 	bool any_matches;
 
+	if (node->literal_hash)
+		literal_hash_node_stats(node, lhs);
+
 	for (uint32_t i = 0; i < node->literal_specs_num; i++) {
 		const struct literal_spec *lspec = &node->literal_specs[i];
 
@@ -2137,14 +3001,19 @@ static void spec_node_stats(const struct spec_node *node)
 	}
 
 	for (uint32_t i = 0; i < node->children_num; i++)
-		spec_node_stats(&node->children[i]);
+		spec_node_stats(&node->children[i], lhs);
 }
 
 static void stats(struct selabel_handle *rec)
 {
 	const struct saved_data *data = (const struct saved_data *)rec->data;
+	struct literal_hash_stats lhs = {};
+
+	spec_node_stats(data->root, &lhs);
 
-	spec_node_stats(data->root);
+	COMPAT_LOG(SELINUX_INFO,
+		   "%u literal hash tables with %zu entries in %zu slots, at most %u probes per lookup\n",
+		   lhs.nodes, lhs.entries, lhs.slots, lhs.max_probes);
 }
 
 static inline const char* fmt_stem(const char *stem)
@@ -2466,6 +3335,7 @@ int selabel_file_init(struct selabel_handle *rec,
 	rec->data = data;
 	rec->func_close = &closef;
 	rec->func_stats = &stats;
+	rec->func_profile_dump = &profile_dump;
 	rec->func_lookup = &lookup;
 	rec->func_partial_match = &partial_match;
 	rec->func_get_digests_all_partial_matches = &get_digests_all_partial_matches;
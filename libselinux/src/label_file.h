@@ -33,9 +33,12 @@
 #define SELINUX_COMPILED_FCONTEXT_PREFIX_LEN	4
 #define SELINUX_COMPILED_FCONTEXT_REGEX_ARCH	5
 #define SELINUX_COMPILED_FCONTEXT_TREE_LAYOUT	6
+#define SELINUX_COMPILED_FCONTEXT_REQ_LITERAL	7
+
+#define SELINUX_COMPILED_FCONTEXT_LITERAL_HASH	8
 
 #define SELINUX_COMPILED_FCONTEXT_MAX_VERS \
-	SELINUX_COMPILED_FCONTEXT_TREE_LAYOUT
+	SELINUX_COMPILED_FCONTEXT_LITERAL_HASH
 
 /* Required selinux_restorecon and selabel_get_digests_all_partial_matches() */
 #define RESTORECON_PARTIAL_MATCH_DIGEST  "security.sehash"
@@ -80,9 +83,14 @@ struct regex_spec {
 	struct selabel_lookup_rec lr;		/* contexts for lookup result */
 	char *regex_str;			/* original regular expression string for diagnostics */
 	struct regex_data *regex;		/* backend dependent regular expression data */
+	const void *regex_serialized;		/* precompiled regex in the mmap'ed file, or NULL */
 	pthread_mutex_t regex_lock;		/* lock for lazy compilation of regex */
+	char *req_literal;			/* literal contained in every match, or NULL */
 	uint32_t lineno;			/* Line number in source file */
 	uint16_t prefix_len;			/* length of fixed path prefix */
+	uint16_t req_literal_len;		/* length of the required literal */
+	bool req_literal_at_start;		/* whether every match starts with the literal */
+	uint16_t partial_prefix_len;		/* length of the verbatim regex prefix every match starts with */
 	uint8_t inputno;			/* Input number of source file */
 	uint8_t file_kind;			/* file type */
 	bool regex_compiled;			/* whether the regex is compiled */
@@ -101,6 +109,19 @@ struct literal_spec {
 	bool from_mmap;				/* whether this spec is from an mmap of the data */
 };
 
+/*
+ * A run of regex specifications of a node matched by one combined expression,
+ * which reports the highest matching index through its (*MARK) verbs
+ */
+struct regex_group {
+	struct regex_data *regex;		/* alternation of the specs, last spec first */
+	uint32_t first;				/* index of the first regex spec in the run */
+	uint32_t last;				/* index of the last regex spec in the run */
+};
+
+/* Maximum number of regex specifications combined into one expression */
+#define REGEX_GROUP_MAX 64
+
 /*
  * Max depth of specification nodes
  *
@@ -124,12 +145,28 @@ struct spec_node {
 	struct literal_spec *literal_specs;
 	uint32_t literal_specs_num, literal_specs_alloc;
 
+	/*
+	 * Open addressing hash table of the literal specifications for complete
+	 * matches, holding the 1-based index of the first specification of each
+	 * literal match or 0 for an empty slot (NULL for small nodes), and the
+	 * number of literal specifications it was built for
+	 */
+	uint32_t *literal_hash;
+	uint32_t literal_hash_size, literal_hash_specs;
+
 	/*
 	 * Array of regular expression specifications (order preserved from input)
 	 */
 	struct regex_spec *regex_specs;
 	uint32_t regex_specs_num, regex_specs_alloc;
 
+	/*
+	 * Array of combined regex specification runs (ordered by index),
+	 * only built with SELABEL_OPT_COMBINE_REGEX
+	 */
+	struct regex_group *regex_groups;
+	uint32_t regex_groups_num;
+
 	/*
 	 * Array of child nodes (ordered alphabetically)
 	 */
@@ -141,6 +178,12 @@ struct spec_node {
 
 	/* whether this node is from an mmap of the data */
 	bool from_mmap;
+
+	/*
+	 * index of the counters of the first literal specification, followed
+	 * by those of the regex specifications (SELABEL_OPT_PROFILE only)
+	 */
+	uint32_t profile_id;
 };
 
 /* Where we map the file in during selabel_open() */
@@ -152,6 +195,8 @@ struct mmap_area {
 	struct mmap_area *next;
 };
 
+struct profile;
+
 /* Our stored configuration */
 struct saved_data {
 	/* Root specification node */
@@ -173,10 +218,14 @@ struct saved_data {
 	 */
 	struct selabel_sub *subs;
 	uint32_t subs_num, subs_alloc;
+
+	/* Lookup counters, NULL unless SELABEL_OPT_PROFILE */
+	struct profile *profile;
 };
 
 void free_spec_node(struct spec_node *node);
 void sort_spec_node(struct spec_node *node, struct spec_node *parent);
+int build_literal_hash(struct spec_node *node);
 
 static inline mode_t string_to_file_kind(const char *mode)
 {
@@ -286,6 +335,276 @@ static bool regex_has_meta_chars(const char *regex, size_t *prefix_len, const ch
 	return false;
 }
 
+/* Return the end of the character class starting at p, or NULL */
+static const char *regex_skip_class(const char *p)
+{
+	p++;
+	/* a leading ']' (after an optional '^') is literal */
+	if (*p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+
+	for (; *p != '\0'; p++) {
+		if (*p == '\\') {
+			if (*++p == '\0')
+				return NULL;
+		} else if (p[0] == '[' && p[1] == ':') {
+			p = strstr(p + 2, ":]");
+			if (!p)
+				return NULL;
+			p++;
+		} else if (*p == ']') {
+			return p + 1;
+		}
+	}
+
+	return NULL;
+}
+
+/* Return the end of the group starting at p, or NULL */
+static const char *regex_skip_group(const char *p)
+{
+	unsigned int depth = 0;
+
+	while (*p != '\0') {
+		switch (*p) {
+		case '\\':
+			if (*++p == '\0')
+				return NULL;
+			p++;
+			break;
+		case '[':
+			p = regex_skip_class(p);
+			if (!p)
+				return NULL;
+			break;
+		case '(':
+			/* verbs like (*ACCEPT) can end the match inside the group */
+			if (p[1] == '*')
+				return NULL;
+			depth++;
+			p++;
+			break;
+		case ')':
+			p++;
+			if (--depth == 0)
+				return p;
+			break;
+		default:
+			p++;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Find the longest run of literal characters that every path matched by the
+ * regular expression contains, so lookups can reject paths without running
+ * the regex.  Only plain and escaped punctuation characters outside of groups
+ * and classes, and not made optional by a quantifier, count.  Expressions too
+ * involved to tell, e.g. with top-level alternatives, yield no literal.
+ *
+ * Return 0 with *literal set to a newly allocated string or NULL, or -1 on
+ * allocation failure.
+ */
+static int regex_required_literal(const char *regex, char **literal, uint16_t *literal_len, bool *at_start)
+{
+	const char *p = regex;
+	char *buf;
+	size_t out = 0, run_start = 0, best_start = 0, best_len = 0;
+	bool run_at_start = true, best_at_start = false;
+
+	*literal = NULL;
+	*literal_len = 0;
+	*at_start = false;
+
+	buf = malloc(strlen(regex) + 1);
+	if (!buf)
+		return -1;
+
+	while (*p != '\0') {
+		const char *q;
+		bool is_literal = false, optional = false, repeated = false;
+		char c = '\0';
+
+		switch (*p) {
+		case '\\':
+			if (p[1] == '\0')
+				goto none;
+			if (isalnum((unsigned char)p[1])) {
+				/* escapes spanning several characters or quoting */
+				if (strchr("xopNPgkcQE0123456789", p[1]))
+					goto none;
+				/* otherwise a character type or an assertion */
+			} else {
+				is_literal = true;
+				c = p[1];
+			}
+			q = p + 2;
+			break;
+		case '[':
+			q = regex_skip_class(p);
+			if (!q)
+				goto none;
+			break;
+		case '(':
+			if (p[1] == '?' && !(p[2] == ':' || p[2] == '=' || p[2] == '!' ||
+					     p[2] == '>' || p[2] == '|' ||
+					     (p[2] == '<' && (p[3] == '=' || p[3] == '!'))))
+				goto none;
+			q = regex_skip_group(p);
+			if (!q)
+				goto none;
+			break;
+		case '.':
+		case '^':
+		case '$':
+		case ']':
+		case '}':
+			q = p + 1;
+			break;
+		case '|':
+		case ')':
+		case '{':
+		case '?':
+		case '*':
+		case '+':
+			goto none;
+		default:
+			is_literal = true;
+			c = *p;
+			q = p + 1;
+			break;
+		}
+
+		/* quantifier of the atom */
+		switch (*q) {
+		case '?':
+		case '*':
+			optional = true;
+			q++;
+			break;
+		case '+':
+			repeated = true;
+			q++;
+			break;
+		case '{':
+			if (!isdigit((unsigned char)q[1]))
+				goto none;
+			optional = strtoul(q + 1, NULL, 10) == 0;
+			repeated = true;
+			q += strspn(q + 1, "0123456789,") + 1;
+			if (*q != '}')
+				goto none;
+			q++;
+			break;
+		default:
+			break;
+		}
+		/* lazy or possessive quantifier */
+		if ((optional || repeated) && (*q == '?' || *q == '+'))
+			q++;
+
+		if (is_literal && !optional)
+			buf[out++] = c;
+
+		if (!is_literal || optional || repeated) {
+			if (out - run_start > best_len) {
+				best_start = run_start;
+				best_len = out - run_start;
+				best_at_start = run_at_start;
+			}
+			run_start = out;
+			run_at_start = false;
+		}
+
+		p = q;
+	}
+
+	if (out - run_start > best_len) {
+		best_start = run_start;
+		best_len = out - run_start;
+		best_at_start = run_at_start;
+	}
+
+	/* a single character hardly rejects anything */
+	if (best_len < 2 || best_len >= UINT16_MAX)
+		goto none;
+
+	memmove(buf, buf + best_start, best_len);
+	buf[best_len] = '\0';
+
+	*literal = buf;
+	*literal_len = best_len;
+	*at_start = best_at_start;
+	return 0;
+
+none:
+	free(buf);
+	return 0;
+}
+
+/*
+ * Length of the leading run of plain characters of the regular expression,
+ * which every path it matches, even partially, has to start with.  Escapes
+ * end the run, so it can be compared to paths verbatim.  Expressions with
+ * top-level alternatives, or too involved to tell, yield 0.
+ */
+static uint16_t regex_partial_prefix_len(const char *regex)
+{
+	unsigned int depth = 0;
+	size_t len;
+	const char *p;
+
+	for (len = 0; regex[len] != '\0'; len++) {
+		if (strchr(".^$?*+|[]{}()\\", regex[len]))
+			break;
+	}
+
+	/* the last character of the run might be quantified */
+	if (len > 0 && (regex[len] == '?' || regex[len] == '*' || regex[len] == '{'))
+		len--;
+
+	for (p = regex + len; *p != '\0'; p++) {
+		switch (*p) {
+		case '\\':
+			/* quoting could hide a '|' */
+			if (*++p == '\0' || *p == 'Q')
+				return 0;
+			break;
+		case '[':
+			p = regex_skip_class(p);
+			if (!p)
+				return 0;
+			p--;
+			break;
+		case '(':
+			/* so do comments and extended mode set by options */
+			if (p[1] == '*' ||
+			    (p[1] == '?' && !(p[2] == ':' || p[2] == '=' || p[2] == '!' || p[2] == '>' ||
+					      (p[2] == '<' && (p[3] == '=' || p[3] == '!')))))
+				return 0;
+			depth++;
+			break;
+		case ')':
+			if (depth > 0)
+				depth--;
+			break;
+		case '|':
+			if (depth == 0)
+				return 0;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return len < UINT16_MAX ? len : 0;
+}
+
 static int regex_simplify(const char *regex, size_t len, char **out, const char *path, unsigned int lineno)
 {
 	char *result, *p;
@@ -388,6 +707,22 @@ static inline void sort_specs(struct saved_data *data)
 	sort_spec_node(data->root, NULL);
 }
 
+/* Minimum number of literal specifications of a node to index them by hash */
+#define LITERAL_HASH_MIN 8
+
+/* FNV-1a, independent of the byte order to be stored in the compiled format */
+static inline uint32_t literal_hash(const char *key, size_t key_len)
+{
+	uint32_t hash = 2166136261U;
+
+	for (size_t i = 0; i < key_len; i++) {
+		hash ^= (unsigned char)key[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
 static inline int compile_regex(struct regex_spec *spec, const char **errbuf)
 {
 	const char *reg_buf;
@@ -430,6 +765,15 @@ static inline int compile_regex(struct regex_spec *spec, const char **errbuf)
 		return 0;
 	}
 
+	/*
+	 * Load a precompiled regex only now, so that processes do not spend
+	 * time and private memory on the ones they never use.  If this fails
+	 * compile it from the source instead.
+	 */
+	if (spec->regex_serialized &&
+	    regex_load_serialized(spec->regex_serialized, &spec->regex) == 0)
+		goto done;
+
 	reg_buf = spec->regex_str;
 	/* Anchor the regular expression. */
 	len = strlen(reg_buf);
@@ -463,7 +807,7 @@ static inline int compile_regex(struct regex_spec *spec, const char **errbuf)
 		return -1;
 	}
 
-	/* Done. */
+done:
 #ifdef __ATOMIC_RELAXED
 	__atomic_store_n(&spec->regex_compiled, true, __ATOMIC_RELEASE);
 #else
@@ -521,7 +865,10 @@ static int insert_spec(const struct selabel_handle *rec, struct saved_data *data
 	if (has_meta) {
 		struct spec_node *node = data->root;
 		const char *p = regex;
+		char *req_literal;
 		uint32_t id;
+		uint16_t req_literal_len;
+		bool req_literal_at_start;
 		int depth = 0, rc;
 
 		while (depth < SPEC_NODE_MAX_DEPTH) {
@@ -596,8 +943,16 @@ static int insert_spec(const struct selabel_handle *rec, struct saved_data *data
 			depth++;
 		}
 
+		rc = regex_required_literal(regex, &req_literal, &req_literal_len, &req_literal_at_start);
+		if (rc) {
+			free(regex);
+			free(context);
+			return -1;
+		}
+
 		rc = GROW_ARRAY(node->regex_specs);
 		if (rc) {
+			free(req_literal);
 			free(regex);
 			free(context);
 			return -1;
@@ -608,6 +963,10 @@ static int insert_spec(const struct selabel_handle *rec, struct saved_data *data
 		node->regex_specs[id] = (struct regex_spec) {
 			.regex_str = regex,
 			.prefix_len = prefix_len,
+			.req_literal = req_literal,
+			.req_literal_len = req_literal_len,
+			.req_literal_at_start = req_literal_at_start,
+			.partial_prefix_len = regex_partial_prefix_len(regex),
 			.regex_compiled = false,
 			.regex_lock = PTHREAD_MUTEX_INITIALIZER,
 			.file_kind = file_kind,
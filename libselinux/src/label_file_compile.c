@@ -0,0 +1,862 @@
+/*
+ * Compilation of file contexts specifications into the binary format
+ * loaded by the file backend.
+ */
+
+#include <assert.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <selinux/label.h>
+
+#include "avc_sidtab.h"
+#include "callbacks.h"
+#include "label_internal.h"
+#include "label_file.h"
+#include "regex.h"
+#include "selinux_internal.h"
+
+
+static int literal_spec_to_sidtab(const struct literal_spec *lspec, struct sidtab *stab)
+{
+	security_id_t dummy;
+
+	return sidtab_context_to_sid(stab, lspec->lr.ctx_raw, &dummy);
+}
+
+static int regex_spec_to_sidtab(const struct regex_spec *rspec, struct sidtab *stab)
+{
+	security_id_t dummy;
+
+	return sidtab_context_to_sid(stab, rspec->lr.ctx_raw, &dummy);
+}
+
+static int spec_node_to_sidtab(const struct spec_node *node, struct sidtab *stab)
+{
+	int rc;
+
+	for (uint32_t i = 0; i < node->literal_specs_num; i++) {
+		rc = literal_spec_to_sidtab(&node->literal_specs[i], stab);
+		if (rc)
+			return rc;
+	}
+
+	for (uint32_t i = 0; i < node->regex_specs_num; i++) {
+		rc = regex_spec_to_sidtab(&node->regex_specs[i], stab);
+		if (rc)
+			return rc;
+	}
+
+	for (uint32_t i = 0; i < node->children_num; i++) {
+		rc = spec_node_to_sidtab(&node->children[i], stab);
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
+
+static int create_sidtab(const struct saved_data *data, struct sidtab *stab)
+{
+	int rc;
+
+	rc = sidtab_init(stab);
+	if (rc < 0)
+		return rc;
+
+	return spec_node_to_sidtab(data->root, stab);
+}
+
+
+/*
+ * File Format
+ *
+ * The format uses network byte-order.
+ *
+ * u32     - magic number
+ * u32     - version
+ * u32     - length of upcoming pcre version EXCLUDING nul
+ * [char]  - pcre version string EXCLUDING nul
+ * u32     - length of upcoming pcre architecture EXCLUDING nul
+ * [char]  - pcre architecture string EXCLUDING nul
+ * u64     - number of total specifications
+ * u32     - number of upcoming context definitions
+ * [Ctx]   - array of context definitions
+ * Node    - root node
+ *
+ * Context Definition Format (Ctx)
+ *
+ * u16     - length of upcoming raw context EXCLUDING nul
+ * [char]  - char array of the raw context EXCLUDING nul
+ *
+ * Node Format
+ *
+ * u16     - length of upcoming stem INCLUDING nul
+ * [char]  - stem char array INCLUDING nul
+ * u32     - number of upcoming literal specifications
+ * [LSpec] - array of literal specifications
+ * u32     - number of upcoming literal hash table slots, a power of two or 0
+ * [u32]   - literal hash table, see below
+ * u32     - number of upcoming regular expression specifications
+ * [RSpec] - array of regular expression specifications
+ * u32     - number of upcoming child nodes
+ * [Node]  - array of child nodes
+ *
+ * Literal Specification Format (LSpec)
+ *
+ * u32     - context table index for raw context (1-based)
+ * u16     - length of upcoming regex_str INCLUDING nul
+ * [char]  - char array of the original regex string including the stem INCLUDING nul
+ * u16     - length of upcoming literal match INCLUDING nul
+ * [char]  - char array of the simplified literal match INCLUDING nul
+ * u8      - file kind (LABEL_FILE_KIND_*)
+ *
+ * Literal Hash Table
+ *
+ * Open addressing table with linear probing over the literal specifications
+ * of the node, keyed by the 32-bit FNV-1a hash of the literal match.  Each
+ * slot holds the 1-based index of the first literal specification with that
+ * literal match, or 0 if it is empty.
+ *
+ * Regular Expression Specification Format (RSpec)
+ *
+ * u32     - context table index for raw context (1-based)
+ * u32     - line number in source file
+ * u16     - length of upcoming regex_str INCLUDING nul
+ * [char]  - char array of the original regex string including the stem INCLUDING nul
+ * u16     - length of the fixed path prefix
+ * u8      - file kind (LABEL_FILE_KIND_*)
+ * u16     - length of upcoming required literal INCLUDING nul, 0 if there is none
+ * [char]  - char array of the literal every match contains INCLUDING nul
+ * u8      - whether every match starts with the required literal
+ * [Regex] - serialized pattern of regex, subject to underlying regex library
+ */
+
+
+static int security_id_compare(const void *a, const void *b)
+{
+	const struct security_id *sid_a = a, *sid_b = b;
+
+	return (sid_a->id > sid_b->id) - (sid_a->id < sid_b->id);
+}
+
+static int write_sidtab(FILE *bin_file, const struct sidtab *stab)
+{
+	struct security_id *sids;
+	uint32_t data_u32, index;
+	uint16_t data_u16;
+	size_t len;
+
+	/* write number of entries */
+	data_u32 = htobe32(stab->nel);
+	len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+
+	if (stab->nel == 0)
+		return 0;
+
+	/* sort entries by id */
+	sids = calloc(stab->nel, sizeof(*sids));
+	if (!sids)
+		return -1;
+	index = 0;
+	for (unsigned i = 0; i < SIDTAB_SIZE; i++) {
+		const struct sidtab_node *cur = stab->htable[i];
+
+		while (cur) {
+			sids[index++] = cur->sid_s;
+			cur = cur->next;
+		}
+	}
+	assert(index == stab->nel);
+	qsort(sids, stab->nel, sizeof(struct security_id), security_id_compare);
+
+	/* write raw contexts sorted by id */
+	for (uint32_t i = 0; i < stab->nel; i++) {
+		const char *ctx = sids[i].ctx;
+		size_t ctx_len = strlen(ctx);
+
+		if (ctx_len == 0 || ctx_len >= UINT16_MAX) {
+			free(sids);
+			return -2;
+		}
+		data_u16 = htobe16(ctx_len);
+		len = fwrite(&data_u16, sizeof(uint16_t), 1, bin_file);
+		if (len != 1) {
+			free(sids);
+			return -1;
+		}
+		len = fwrite(ctx, sizeof(char), ctx_len, bin_file);
+		if (len != ctx_len) {
+			free(sids);
+			return -1;
+		}
+	}
+
+	free(sids);
+	return 0;
+}
+
+static int write_literal_spec(FILE *bin_file, const struct literal_spec *lspec, const struct sidtab *stab)
+{
+	const struct security_id *sid;
+	const char *orig_regex, *literal_match;
+	size_t orig_regex_len, literal_match_len;
+	uint32_t data_u32;
+	uint16_t data_u16;
+	uint8_t data_u8;
+	size_t len;
+
+	/* write raw context sid */
+	sid = sidtab_context_lookup(stab, lspec->lr.ctx_raw);
+	assert(sid); /* should be set via create_sidtab() */
+	data_u32 = htobe32(sid->id);
+	len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+
+	/* write original regex string */
+	orig_regex = lspec->regex_str;
+	orig_regex_len = strlen(orig_regex);
+	if (orig_regex_len == 0 || orig_regex_len >= UINT16_MAX)
+		return -2;
+	orig_regex_len += 1;
+	data_u16 = htobe16(orig_regex_len);
+	len = fwrite(&data_u16, sizeof(uint16_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+	len = fwrite(orig_regex, sizeof(char), orig_regex_len, bin_file);
+	if (len != orig_regex_len)
+		return -1;
+
+	/* write literal match string */
+	literal_match = lspec->literal_match;
+	literal_match_len = strlen(literal_match);
+	if (literal_match_len == 0 || literal_match_len >= UINT16_MAX)
+		return -2;
+	literal_match_len += 1;
+	data_u16 = htobe16(literal_match_len);
+	len = fwrite(&data_u16, sizeof(uint16_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+	len = fwrite(literal_match, sizeof(char), literal_match_len, bin_file);
+	if (len != literal_match_len)
+		return -1;
+
+	/* write file kind */
+	data_u8 = lspec->file_kind;
+	len = fwrite(&data_u8, sizeof(uint8_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+
+	return 0;
+}
+
+static int write_regex_spec(FILE *bin_file, bool do_write_precompregex, const struct regex_spec *rspec, const struct sidtab *stab)
+{
+	const struct security_id *sid;
+	const char *regex;
+	size_t regex_len, literal_len;
+	uint32_t data_u32;
+	uint16_t data_u16;
+	uint8_t data_u8;
+	size_t len;
+	int rc;
+
+	/* write raw context sid */
+	sid = sidtab_context_lookup(stab, rspec->lr.ctx_raw);
+	assert(sid); /* should be set via create_sidtab() */
+	data_u32 = htobe32(sid->id);
+	len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+
+	/* write line number */
+	data_u32 = htobe32(rspec->lineno);
+	len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+
+	/* write regex string */
+	regex = rspec->regex_str;
+	regex_len = strlen(regex);
+	if (regex_len == 0 || regex_len >= UINT16_MAX)
+		return -2;
+	regex_len += 1;
+	data_u16 = htobe16(regex_len);
+	len = fwrite(&data_u16, sizeof(uint16_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+	len = fwrite(regex, sizeof(char), regex_len, bin_file);
+	if (len != regex_len)
+		return -1;
+
+	/* write prefix length */
+	data_u16 = htobe16(rspec->prefix_len);
+	len = fwrite(&data_u16, sizeof(uint16_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+
+	/* write file kind */
+	data_u8 = rspec->file_kind;
+	len = fwrite(&data_u8, sizeof(uint8_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+
+	/* write required literal */
+	literal_len = rspec->req_literal ? rspec->req_literal_len + 1 : 0;
+	data_u16 = htobe16(literal_len);
+	len = fwrite(&data_u16, sizeof(uint16_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+	if (literal_len) {
+		len = fwrite(rspec->req_literal, sizeof(char), literal_len, bin_file);
+		if (len != literal_len)
+			return -1;
+	}
+	data_u8 = rspec->req_literal_at_start;
+	len = fwrite(&data_u8, sizeof(uint8_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+
+	/* Write serialized regex */
+	rc = regex_writef(rspec->regex, bin_file, do_write_precompregex);
+	if (rc < 0)
+		return rc;
+
+	return 0;
+}
+
+static int write_spec_node(FILE *bin_file, bool do_write_precompregex, const struct spec_node *node, const struct sidtab *stab)
+{
+	size_t stem_len;
+	uint32_t data_u32;
+	uint16_t data_u16;
+	size_t len;
+	int rc;
+
+	stem_len = node->stem_len;
+	if ((stem_len == 0 && node->parent) || stem_len >= UINT16_MAX)
+		return -2;
+	stem_len += 1;
+	data_u16 = htobe16(stem_len);
+	len = fwrite(&data_u16, sizeof(uint16_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+	len = fwrite(node->stem ?: "", sizeof(char), stem_len, bin_file);
+	if (len != stem_len)
+		return -1;
+
+	/* write number of literal specs */
+	data_u32 = htobe32(node->literal_specs_num);
+	len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+
+	/* write literal specs */
+	for (uint32_t i = 0; i < node->literal_specs_num; i++) {
+		rc = write_literal_spec(bin_file, &node->literal_specs[i], stab);
+		if (rc)
+			return rc;
+	}
+
+	/* write literal hash table */
+	data_u32 = htobe32(node->literal_hash_size);
+	len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+
+	for (uint32_t i = 0; i < node->literal_hash_size; i++) {
+		data_u32 = htobe32(node->literal_hash[i]);
+		len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+		if (len != 1)
+			return -1;
+	}
+
+	/* write number of regex specs */
+	data_u32 = htobe32(node->regex_specs_num);
+	len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+
+	/* write regex specs */
+	for (uint32_t i = 0; i < node->regex_specs_num; i++) {
+		rc = write_regex_spec(bin_file, do_write_precompregex, &node->regex_specs[i], stab);
+		if (rc)
+			return rc;
+	}
+
+	/* write number of child nodes */
+	data_u32 = htobe32(node->children_num);
+	len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+	if (len != 1)
+		return -1;
+
+	/* write child nodes */
+	for (uint32_t i = 0; i < node->children_num; i++) {
+		rc = write_spec_node(bin_file, do_write_precompregex, &node->children[i], stab);
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
+
+static int write_binary_file(const struct saved_data *data, const struct sidtab *stab,
+			     int fd, const char *path, bool do_write_precompregex)
+{
+	FILE *bin_file;
+	const char *reg_arch, *reg_version;
+	size_t len, reg_arch_len, reg_version_len;
+	uint64_t data_u64;
+	uint32_t data_u32;
+	int rc;
+
+	bin_file = fdopen(fd, "we");
+	if (!bin_file) {
+		selinux_log(SELINUX_ERROR, "failed to open %s: %m\n", path);
+		close(fd);
+		return -1;
+	}
+
+	/* write some magic number */
+	data_u32 = htobe32(SELINUX_MAGIC_COMPILED_FCONTEXT);
+	len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+	if (len != 1)
+		goto err_write;
+
+	/* write the version */
+	data_u32 = htobe32(SELINUX_COMPILED_FCONTEXT_MAX_VERS);
+	len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+	if (len != 1)
+		goto err_write;
+
+	/* write version of the regex back-end */
+	reg_version = regex_version();
+	if (!reg_version)
+		goto err_check;
+	reg_version_len = strlen(reg_version);
+	if (reg_version_len == 0 || reg_version_len >= UINT32_MAX)
+		goto err_check;
+	data_u32 = htobe32(reg_version_len);
+	len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+	if (len != 1)
+		goto err_write;
+	len = fwrite(reg_version, sizeof(char), reg_version_len, bin_file);
+	if (len != reg_version_len)
+		goto err_write;
+
+	/* write regex arch string */
+	reg_arch = regex_arch_string();
+	if (!reg_arch)
+		goto err_check;
+	reg_arch_len = strlen(reg_arch);
+	if (reg_arch_len == 0 || reg_arch_len >= UINT32_MAX)
+		goto err_check;
+	data_u32 = htobe32(reg_arch_len);
+	len = fwrite(&data_u32, sizeof(uint32_t), 1, bin_file);
+	if (len != 1)
+		goto err_write;
+	len = fwrite(reg_arch, sizeof(char), reg_arch_len, bin_file);
+	if (len != reg_arch_len)
+		goto err_write;
+
+	/* write number of total specifications */
+	data_u64 = htobe64(data->num_specs);
+	len = fwrite(&data_u64, sizeof(uint64_t), 1, bin_file);
+	if (len != 1)
+		goto err_write;
+
+	/* write context table */
+	rc = write_sidtab(bin_file, stab);
+	if (rc)
+		goto err;
+
+	rc = write_spec_node(bin_file, do_write_precompregex, data->root, stab);
+	if (rc)
+		goto err;
+
+out:
+	if (fclose(bin_file) && rc == 0) {
+		selinux_log(SELINUX_ERROR, "failed to close %s: %m\n", path);
+		rc = -1;
+	}
+	return rc;
+
+err_check:
+	rc = -2;
+	goto err;
+
+err_write:
+	rc = -1;
+	goto err;
+
+err:
+	selinux_log(SELINUX_ERROR,
+		    "failed to compile file context specifications: %s\n",
+		    (rc == -3) ? "regex serialization failure" :
+		    ((rc == -2) ? "invalid fcontext specification" : "write failure"));
+	goto out;
+}
+
+/*
+ * The specifications are read without rec->validating set, so that
+ * process_line() neither compiles the regular expressions nor validates
+ * the contexts via the global callbacks.  Validate the contexts here with
+ * the caller supplied function instead, which need not be thread safe.
+ */
+static int validate_spec_node(const struct spec_node *node, const char *path,
+			      int (*validate)(const char *context, void *arg),
+			      void *arg)
+{
+	const char *ctx;
+	int rc;
+
+	for (uint32_t i = 0; i < node->literal_specs_num; i++) {
+		ctx = node->literal_specs[i].lr.ctx_raw;
+		if (strcmp(ctx, "<<none>>") == 0)
+			continue;
+
+		if (validate(ctx, arg) < 0) {
+			selinux_log(SELINUX_ERROR,
+				    "%s: line %u has invalid context %s\n",
+				    path, node->literal_specs[i].lr.lineno, ctx);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	for (uint32_t i = 0; i < node->regex_specs_num; i++) {
+		const struct regex_spec *rspec = &node->regex_specs[i];
+
+		ctx = rspec->lr.ctx_raw;
+		if (strcmp(ctx, "<<none>>") == 0)
+			continue;
+
+		if (validate(ctx, arg) < 0) {
+			selinux_log(SELINUX_ERROR,
+				    "%s: line %u has invalid context %s\n",
+				    path, rspec->lineno, ctx);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	for (uint32_t i = 0; i < node->children_num; i++) {
+		rc = validate_spec_node(&node->children[i], path, validate, arg);
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
+
+/* Regular expressions to compile, shared by the compiling threads */
+struct compile_state {
+	struct regex_spec **specs;
+	uint32_t specs_num;
+	uint32_t next;		/* next spec to compile */
+	uint32_t failed;	/* lowest spec failing to compile, or UINT32_MAX */
+};
+
+static void collect_regex_specs(struct spec_node *node, struct compile_state *state)
+{
+	for (uint32_t i = 0; i < node->regex_specs_num; i++)
+		state->specs[state->specs_num++] = &node->regex_specs[i];
+
+	for (uint32_t i = 0; i < node->children_num; i++)
+		collect_regex_specs(&node->children[i], state);
+}
+
+static void *compile_thread(void *arg)
+{
+	struct compile_state *state = arg;
+	uint32_t i, failed;
+
+#ifdef __ATOMIC_RELAXED
+	while ((i = __atomic_fetch_add(&state->next, 1, __ATOMIC_RELAXED)) < state->specs_num) {
+		/* Errors past the first one would not be reported anyway */
+		failed = __atomic_load_n(&state->failed, __ATOMIC_RELAXED);
+		if (i > failed)
+			break;
+
+		/* compile_regex() formats the error message into a static buffer */
+		if (compile_regex(state->specs[i], NULL) == 0)
+			continue;
+
+		while (i < failed &&
+		       !__atomic_compare_exchange_n(&state->failed, &failed, i, false,
+						    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			;
+	}
+#else
+#error "Please use a compiler that supports __atomic builtins"
+#endif
+
+	return NULL;
+}
+
+/*
+ * Compile the regular expressions of all specifications with nthreads
+ * threads.  The serialized regular expressions do not depend on which
+ * thread compiled them, so neither does the output file.
+ */
+static int compile_spec_regexes(struct saved_data *data, const char *path, size_t nthreads)
+{
+	struct compile_state state = { .failed = UINT32_MAX };
+	struct regex_spec *rspec;
+	const char *errbuf = NULL;
+
+	if (data->num_specs == 0)
+		return 0;
+
+	state.specs = calloc(data->num_specs, sizeof(*state.specs));
+	if (!state.specs)
+		return -1;
+
+	collect_regex_specs(data->root, &state);
+
+	if (!__pthread_supported) {
+		if (nthreads != 1) {
+			nthreads = 1;
+			selinux_log(SELINUX_WARNING,
+				"Threading functionality not available, falling back to 1 thread.");
+		}
+	} else if (nthreads == 0) {
+		long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+
+		if (nproc > 0) {
+			nthreads = nproc;
+		} else {
+			nthreads = 1;
+			selinux_log(SELINUX_WARNING,
+				"Unable to detect CPU count, falling back to 1 thread.");
+		}
+	}
+	if (nthreads > state.specs_num)
+		nthreads = state.specs_num ?: 1;
+
+	if (nthreads == 1) {
+		compile_thread(&state);
+	} else {
+		size_t i;
+		pthread_t self = pthread_self();
+		pthread_t *threads;
+
+		threads = calloc(nthreads - 1, sizeof(*threads));
+		if (!threads) {
+			free(state.specs);
+			return -1;
+		}
+
+		/* Start (nthreads - 1) threads, the main thread takes part too */
+		for (i = 0; i < nthreads - 1; i++) {
+			/* The other threads do the job if one fails to start */
+			if (pthread_create(&threads[i], NULL, compile_thread, &state))
+				threads[i] = self;
+		}
+
+		compile_thread(&state);
+
+		for (i = 0; i < nthreads - 1; i++) {
+			if (pthread_equal(threads[i], self))
+				continue;
+			pthread_join(threads[i], NULL);
+		}
+		free(threads);
+	}
+
+	if (state.failed != UINT32_MAX) {
+		/* Compile it once more to get the error message */
+		rspec = state.specs[state.failed];
+		if (compile_regex(rspec, &errbuf) < 0)
+			selinux_log(SELINUX_ERROR,
+				    "%s:  line %u has invalid regex %s:  %s\n",
+				    path, rspec->lineno, rspec->regex_str, errbuf);
+		free(state.specs);
+		errno = EINVAL;
+		return -1;
+	}
+
+	free(state.specs);
+	return 0;
+}
+
+/* Log the time since *start as that of phase, then restart it */
+static void log_phase_time(bool enabled, const char *phase, struct timespec *start)
+{
+	struct timespec now;
+
+	if (!enabled)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	selinux_log(SELINUX_INFO, "%s: %.3f ms\n", phase,
+		    (double)(now.tv_sec - start->tv_sec) * 1e3 +
+		    (double)(now.tv_nsec - start->tv_nsec) / 1e6);
+	*start = now;
+}
+
+static int process_file(struct selabel_handle *rec, const char *path)
+{
+	uint32_t line_num = 0;
+	int rc = 0;
+	char *line_buf = NULL;
+	size_t line_len = 0;
+	ssize_t nread;
+	FILE *context_file;
+
+	context_file = fopen(path, "re");
+	if (!context_file) {
+		selinux_log(SELINUX_ERROR, "Error opening %s: %m\n", path);
+		return -1;
+	}
+
+	while ((nread = getline(&line_buf, &line_len, context_file)) > 0) {
+		rc = process_line(rec, path, NULL, line_buf, nread, 0, ++line_num);
+		if (rc)
+			break;
+	}
+
+	free(line_buf);
+	fclose(context_file);
+	return rc;
+}
+
+int selabel_file_compile_parallel(const char *path, const char *out_path,
+				  int (*validate)(const char *context, void *arg),
+				  void *arg, unsigned int flags, size_t nthreads)
+{
+	char stack_path[PATH_MAX + 1];
+	char *tmp = NULL;
+	size_t len;
+	int fd, rc;
+	struct stat buf;
+	struct selabel_handle rec = {};
+	struct saved_data data = {};
+	struct sidtab stab = {};
+	struct timespec start;
+	bool times = flags & SELABEL_COMPILE_TIMES;
+
+	if (stat(path, &buf) < 0)
+		return -1;
+
+	if (times)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+	data.root = calloc(1, sizeof(*data.root));
+	if (!data.root)
+		return -1;
+
+	/* Dummy handle for process_line() */
+	rec.backend = SELABEL_CTX_FILE;
+	rec.data = &data;
+
+	rc = process_file(&rec, path);
+	if (rc < 0)
+		goto err;
+	log_phase_time(times, "parse", &start);
+
+	if (validate) {
+		rc = validate_spec_node(data.root, path, validate, arg);
+		if (rc < 0)
+			goto err;
+		log_phase_time(times, "validate", &start);
+	}
+
+	rc = compile_spec_regexes(&data, path, nthreads);
+	if (rc < 0)
+		goto err;
+	log_phase_time(times, "compile", &start);
+
+	sort_specs(&data);
+	log_phase_time(times, "sort", &start);
+
+	rc = build_literal_hash(data.root);
+	if (rc < 0)
+		goto err;
+	log_phase_time(times, "literal hash", &start);
+
+	rc = create_sidtab(&data, &stab);
+	if (rc < 0)
+		goto err;
+	log_phase_time(times, "sidtab", &start);
+
+	if (out_path)
+		rc = snprintf(stack_path, sizeof(stack_path), "%s", out_path);
+	else
+		rc = snprintf(stack_path, sizeof(stack_path), "%s.bin", path);
+
+	if (rc < 0 || (size_t)rc >= sizeof(stack_path)) {
+		errno = ENAMETOOLONG;
+		goto err;
+	}
+	len = rc;
+
+	tmp = malloc(len + 7);
+	if (!tmp)
+		goto err;
+
+	rc = snprintf(tmp, len + 7, "%sXXXXXX", stack_path);
+	if (rc < 0 || (size_t)rc >= len + 7)
+		goto err;
+
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		selinux_log(SELINUX_ERROR, "mkstemp %s failed: %m\n", tmp);
+		goto err;
+	}
+
+	rc = fchmod(fd, buf.st_mode);
+	if (rc < 0) {
+		selinux_log(SELINUX_ERROR, "fchmod %s failed: %m\n", tmp);
+		close(fd);
+		goto err_unlink;
+	}
+
+	rc = write_binary_file(&data, &stab, fd, tmp,
+			       !(flags & SELABEL_COMPILE_NO_PRECOMPREGEX));
+	if (rc < 0)
+		goto err_unlink;
+
+	rc = rename(tmp, stack_path);
+	if (rc < 0) {
+		selinux_log(SELINUX_ERROR, "rename %s -> %s failed: %m\n",
+			    tmp, stack_path);
+		goto err_unlink;
+	}
+	log_phase_time(times, "write", &start);
+
+	rc = 0;
+out:
+	sidtab_destroy(&stab);
+	free_spec_node(data.root);
+	free(data.root);
+	free(tmp);
+	return rc;
+
+err_unlink:
+	unlink(tmp);
+err:
+	rc = -1;
+	goto out;
+}
+
+int selabel_file_compile(const char *path, const char *out_path,
+			 int (*validate)(const char *context, void *arg),
+			 void *arg, unsigned int flags)
+{
+	return selabel_file_compile_parallel(path, out_path, validate, arg,
+					     flags, 1);
+}
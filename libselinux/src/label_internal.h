@@ -86,6 +86,7 @@ struct selabel_handle {
 						   const char *key, int type);
 	void (*func_close) (struct selabel_handle *h);
 	void (*func_stats) (struct selabel_handle *h);
+	int (*func_profile_dump) (struct selabel_handle *h, FILE *fp);
 	bool (*func_partial_match) (struct selabel_handle *h, const char *key);
 	bool (*func_get_digests_all_partial_matches) (struct selabel_handle *h,
 						      const char *key,
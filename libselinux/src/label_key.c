@@ -0,0 +1,303 @@
+/*
+ * Index for the key based labeling backends.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include "callbacks.h"
+#include "label_key.h"
+
+#define KEY_HASH_BASIS	2166136261U
+#define KEY_HASH_PRIME	16777619U
+
+/* A specification added to the index, but not yet grouped */
+struct key_pending {
+	const char *key;
+	uint32_t len;
+	uint32_t hash;
+	int type;
+	unsigned int spec;
+	bool glob;
+};
+
+static inline uint32_t key_hash_step(uint32_t hash, char c)
+{
+	return (hash ^ (unsigned char)c) * KEY_HASH_PRIME;
+}
+
+static inline uint32_t key_hash_type(uint32_t hash, int type)
+{
+	return (hash ^ (uint32_t)type) * KEY_HASH_PRIME;
+}
+
+int key_index_add(struct key_index *idx, unsigned int spec, int type,
+		  const char *key, bool literal)
+{
+	struct key_pending *p;
+	uint32_t i, hash = KEY_HASH_BASIS;
+
+	if (idx->npending == idx->pending_alloc) {
+		unsigned int alloc = idx->pending_alloc ?
+				     2 * idx->pending_alloc : 32;
+
+		p = reallocarray(idx->pending, alloc, sizeof(*p));
+		if (!p)
+			return -1;
+		idx->pending = p;
+		idx->pending_alloc = alloc;
+	}
+
+	p = &idx->pending[idx->npending++];
+	p->key = key;
+	p->len = literal ? strlen(key) : strcspn(key, "*?[\\");
+	p->glob = key[p->len] != '\0';
+	p->type = type;
+	p->spec = spec;
+
+	for (i = 0; i < p->len; i++)
+		hash = key_hash_step(hash, key[i]);
+	p->hash = key_hash_type(hash, type);
+
+	return 0;
+}
+
+static int pending_cmp(const void *A, const void *B)
+{
+	const struct key_pending *a = A, *b = B;
+	int rc;
+
+	if (a->glob != b->glob)
+		return a->glob ? 1 : -1;
+	if (a->hash != b->hash)
+		return a->hash < b->hash ? -1 : 1;
+	if (a->type != b->type)
+		return a->type < b->type ? -1 : 1;
+	if (a->len != b->len)
+		return a->len < b->len ? -1 : 1;
+	rc = memcmp(a->key, b->key, a->len);
+	if (rc)
+		return rc;
+	if (a->spec != b->spec)
+		return a->spec < b->spec ? -1 : 1;
+	return 0;
+}
+
+static inline bool group_is(const struct key_group *g, const char *key,
+			    uint32_t len, uint32_t hash, int type)
+{
+	return g->hash == hash && g->type == type && g->len == len &&
+	       !memcmp(g->key, key, len);
+}
+
+static const struct key_group *table_find(const struct key_table *t,
+					  const char *key, uint32_t len,
+					  uint32_t hash, int type)
+{
+	uint32_t i, slot;
+
+	if (!t->ngroups)
+		return NULL;
+
+	for (i = hash & t->mask; (slot = t->slots[i]); i = (i + 1) & t->mask) {
+		if (group_is(&t->groups[slot - 1], key, len, hash, type))
+			return &t->groups[slot - 1];
+	}
+
+	return NULL;
+}
+
+static int table_fill(struct key_table *t)
+{
+	uint32_t i, j, size = 1;
+
+	if (!t->ngroups)
+		return 0;
+
+	/* Keep the load factor at or below 1/2 */
+	while (size < 2 * t->ngroups)
+		size <<= 1;
+
+	t->slots = calloc(size, sizeof(*t->slots));
+	if (!t->slots)
+		return -1;
+	t->mask = size - 1;
+
+	for (i = 0; i < t->ngroups; i++) {
+		for (j = t->groups[i].hash & t->mask; t->slots[j];
+		     j = (j + 1) & t->mask)
+			;
+		t->slots[j] = i + 1;
+	}
+
+	return 0;
+}
+
+static inline bool pending_same(const struct key_pending *a,
+				const struct key_pending *b)
+{
+	return a->glob == b->glob && a->hash == b->hash &&
+	       a->type == b->type && a->len == b->len &&
+	       !memcmp(a->key, b->key, a->len);
+}
+
+static struct key_group *new_group(struct key_table *t,
+				   const struct key_pending *p,
+				   unsigned int first)
+{
+	struct key_group *g = &t->groups[t->ngroups++];
+
+	g->key = p->key;
+	g->len = p->len;
+	g->hash = p->hash;
+	g->type = p->type;
+	g->first = first;
+	g->count = 0;
+	return g;
+}
+
+static int len_cmp(const void *A, const void *B)
+{
+	uint32_t a = *(const uint32_t *)A, b = *(const uint32_t *)B;
+
+	return (a > b) - (a < b);
+}
+
+int key_index_build(struct key_index *idx)
+{
+	const struct key_pending *p, *prev = NULL;
+	struct key_group *g = NULL;
+	unsigned int i, n, nglobs = 0;
+
+	qsort(idx->pending, idx->npending, sizeof(*idx->pending), pending_cmp);
+
+	for (i = 0; i < idx->npending; i++)
+		nglobs += idx->pending[i].glob;
+
+	idx->literals.groups = calloc(idx->npending - nglobs + 1,
+				      sizeof(struct key_group));
+	idx->prefixes.groups = calloc(nglobs + 1, sizeof(struct key_group));
+	idx->globs = calloc(nglobs + 1, sizeof(struct key_glob));
+	if (!idx->literals.groups || !idx->prefixes.groups || !idx->globs)
+		return -1;
+
+	/*
+	 * Sorting put the specifications of each group next to each other
+	 * and in file order, so a literal key's group keeps the first one.
+	 */
+	for (i = 0; i < idx->npending; i++) {
+		p = &idx->pending[i];
+
+		if (!p->glob) {
+			if (!prev || !pending_same(p, prev))
+				new_group(&idx->literals, p, p->spec);
+		} else {
+			if (!prev || !pending_same(p, prev))
+				g = new_group(&idx->prefixes, p, idx->nglobs);
+			idx->globs[idx->nglobs].pattern = p->key;
+			idx->globs[idx->nglobs].spec = p->spec;
+			idx->nglobs++;
+			g->count++;
+		}
+		prev = p;
+	}
+
+	if (table_fill(&idx->literals) || table_fill(&idx->prefixes))
+		return -1;
+
+	idx->prefix_lens = calloc(idx->prefixes.ngroups + 1, sizeof(uint32_t));
+	if (!idx->prefix_lens)
+		return -1;
+	for (i = 0; i < idx->prefixes.ngroups; i++)
+		idx->prefix_lens[i] = idx->prefixes.groups[i].len;
+	qsort(idx->prefix_lens, idx->prefixes.ngroups, sizeof(uint32_t),
+	      len_cmp);
+	for (i = 0, n = 0; i < idx->prefixes.ngroups; i++) {
+		if (!n || idx->prefix_lens[n - 1] != idx->prefix_lens[i])
+			idx->prefix_lens[n++] = idx->prefix_lens[i];
+	}
+	idx->nprefix_lens = n;
+
+	free(idx->pending);
+	idx->pending = NULL;
+	idx->npending = idx->pending_alloc = 0;
+
+	return 0;
+}
+
+/* Lower *best to the first glob of group g matching key before it. */
+static void match_globs(const struct key_index *idx, const struct key_group *g,
+			const char *key, unsigned int *best)
+{
+	const struct key_glob *glob = &idx->globs[g->first];
+	const struct key_glob *end = glob + g->count;
+
+	for (; glob < end && glob->spec < *best; glob++) {
+		if (!fnmatch(glob->pattern, key, 0)) {
+			*best = glob->spec;
+			return;
+		}
+	}
+}
+
+int key_index_lookup(const struct key_index *idx, const char *key, int type)
+{
+	const struct key_group *g;
+	unsigned int best = UINT_MAX, l = 0;
+	uint32_t i, hash = KEY_HASH_BASIS;
+	size_t len = strlen(key);
+
+	if (len > UINT32_MAX)
+		return -1;
+
+	for (i = 0; i < len; i++)
+		hash = key_hash_step(hash, key[i]);
+	g = table_find(&idx->literals, key, len, key_hash_type(hash, type),
+		       type);
+	if (g)
+		best = g->first;
+
+	/* Try the globs whose prefix the key starts with, shortest first */
+	hash = KEY_HASH_BASIS;
+	for (i = 0; l < idx->nprefix_lens && idx->prefix_lens[l] <= len; i++) {
+		if (idx->prefix_lens[l] == i) {
+			g = table_find(&idx->prefixes, key, i,
+				       key_hash_type(hash, type), type);
+			if (g)
+				match_globs(idx, g, key, &best);
+			l++;
+		}
+		if (i < len)
+			hash = key_hash_step(hash, key[i]);
+	}
+
+	return best == UINT_MAX ? -1 : (int)best;
+}
+
+void key_index_stats(const struct key_index *idx)
+{
+	unsigned int i, largest = 0;
+
+	for (i = 0; i < idx->prefixes.ngroups; i++) {
+		if (idx->prefixes.groups[i].count > largest)
+			largest = idx->prefixes.groups[i].count;
+	}
+
+	selinux_log(SELINUX_INFO,
+		    "%u literal keys, %u globs in %u prefix groups of %u lengths, at most %u globs per group\n",
+		    idx->literals.ngroups, idx->nglobs, idx->prefixes.ngroups,
+		    idx->nprefix_lens, largest);
+}
+
+void key_index_destroy(struct key_index *idx)
+{
+	free(idx->pending);
+	free(idx->literals.groups);
+	free(idx->literals.slots);
+	free(idx->prefixes.groups);
+	free(idx->prefixes.slots);
+	free(idx->globs);
+	free(idx->prefix_lens);
+	memset(idx, 0, sizeof(*idx));
+}
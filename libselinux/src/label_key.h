@@ -0,0 +1,71 @@
+#ifndef _SELABEL_KEY_H_
+#define _SELABEL_KEY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Index over the specifications of the key based backends (X, media and
+ * db), which look up the first specification in file order whose type
+ * matches and whose key equals or, for globs, fnmatch(3)es the key.
+ *
+ * Literal keys are found through a hash table. Globs are grouped by type
+ * and by the literal prefix before their first wildcard, so a lookup only
+ * tries the globs whose prefix the key starts with.
+ */
+
+/* Specifications sharing a type and a literal key or glob prefix */
+struct key_group {
+	const char *key;
+	uint32_t len;		/* length of the key or glob prefix */
+	uint32_t hash;
+	int type;
+	unsigned int first;	/* spec, or index of the first glob */
+	unsigned int count;	/* number of globs */
+};
+
+struct key_table {
+	struct key_group *groups;
+	unsigned int ngroups;
+	uint32_t *slots;	/* 1-based group indexes, 0 if empty */
+	uint32_t mask;
+};
+
+struct key_glob {
+	const char *pattern;
+	unsigned int spec;
+};
+
+struct key_index {
+	/* Specifications added, until the index is built */
+	struct key_pending *pending;
+	unsigned int npending, pending_alloc;
+
+	struct key_table literals;
+	struct key_table prefixes;
+
+	/* Globs of each prefix group, in file order */
+	struct key_glob *globs;
+	unsigned int nglobs;
+
+	/* Distinct glob prefix lengths, ascending */
+	uint32_t *prefix_lens;
+	unsigned int nprefix_lens;
+};
+
+/*
+ * Add specification number spec. The key must stay allocated while the
+ * index is in use. Unless literal is set, a key containing wildcards is
+ * matched with fnmatch(3).
+ */
+extern int key_index_add(struct key_index *idx, unsigned int spec, int type,
+			 const char *key, bool literal);
+/* Build the index over the specifications added, once. */
+extern int key_index_build(struct key_index *idx);
+/* Return the first matching spec, or -1 if none matches. */
+extern int key_index_lookup(const struct key_index *idx, const char *key,
+			    int type);
+extern void key_index_stats(const struct key_index *idx);
+extern void key_index_destroy(struct key_index *idx);
+
+#endif
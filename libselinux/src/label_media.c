@@ -13,6 +13,7 @@
 #include <limits.h>
 #include "callbacks.h"
 #include "label_internal.h"
+#include "label_key.h"
 
 /*
  * Internals
@@ -28,6 +29,7 @@ typedef struct spec {
 struct saved_data {
 	unsigned int nspec;
 	spec_t *spec_arr;
+	struct key_index index;
 };
 
 static int process_line(const char *path, const char *line_buf, int pass,
@@ -76,7 +78,7 @@ static int init(struct selabel_handle *rec, const struct selinux_opt *opts,
 	char *line_buf = NULL;
 	size_t line_len = 0;
 	int status = -1;
-	unsigned int lineno, pass, maxnspec;
+	unsigned int lineno, pass, maxnspec, i;
 	struct stat sb;
 
 	/* Process arguments */
@@ -145,6 +147,17 @@ static int init(struct selabel_handle *rec, const struct selinux_opt *opts,
 		}
 	}
 
+	/* A key of "*" matches any media, other keys only themselves */
+	status = -1;
+	for (i = 0; i < data->nspec; i++) {
+		const char *key = data->spec_arr[i].key;
+
+		if (key_index_add(&data->index, i, 0, key, strcmp(key, "*")))
+			goto finish;
+	}
+	if (key_index_build(&data->index))
+		goto finish;
+
 	status = digest_add_specfile(rec->digest, fp, NULL, sb.st_size, path);
 	if (status)
 		goto finish;
@@ -182,6 +195,7 @@ static void close(struct selabel_handle *rec)
 	if (spec_arr)
 	    free(spec_arr);
 
+	key_index_destroy(&data->index);
 	free(data);
 	rec->data = NULL;
 }
@@ -192,16 +206,10 @@ static struct selabel_lookup_rec *lookup(struct selabel_handle *rec,
 {
 	struct saved_data *data = (struct saved_data *)rec->data;
 	spec_t *spec_arr = data->spec_arr;
-	unsigned int i;
-
-	for (i = 0; i < data->nspec; i++) {
-		if (!strncmp(spec_arr[i].key, key, strlen(key) + 1))
-			break;
-		if (!strncmp(spec_arr[i].key, "*", 2))
-			break;
-	}
+	int i;
 
-	if (i >= data->nspec) {
+	i = key_index_lookup(&data->index, key, 0);
+	if (i < 0) {
 		/* No matching specification. */
 		errno = ENOENT;
 		return NULL;
@@ -221,6 +229,7 @@ static void stats(struct selabel_handle *rec)
 
 	selinux_log(SELINUX_INFO, "%u entries, %u matches made\n",
 		  data->nspec, total);
+	key_index_stats(&data->index);
 }
 
 int selabel_media_init(struct selabel_handle *rec,
@@ -11,9 +11,9 @@
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h>
-#include <fnmatch.h>
 #include "callbacks.h"
 #include "label_internal.h"
+#include "label_key.h"
 
 /*
  * Internals
@@ -30,6 +30,7 @@ typedef struct spec {
 struct saved_data {
 	unsigned int nspec;
 	spec_t *spec_arr;
+	struct key_index index;
 };
 
 static int process_line(const char *path, const char *line_buf, int pass,
@@ -103,7 +104,7 @@ static int init(struct selabel_handle *rec, const struct selinux_opt *opts,
 	char *line_buf = NULL;
 	size_t line_len = 0;
 	int status = -1;
-	unsigned int lineno, pass, maxnspec;
+	unsigned int lineno, pass, maxnspec, i;
 	struct stat sb;
 
 	/* Process arguments */
@@ -172,6 +173,15 @@ static int init(struct selabel_handle *rec, const struct selinux_opt *opts,
 		}
 	}
 
+	status = -1;
+	for (i = 0; i < data->nspec; i++) {
+		if (key_index_add(&data->index, i, data->spec_arr[i].type,
+				  data->spec_arr[i].key, false))
+			goto finish;
+	}
+	if (key_index_build(&data->index))
+		goto finish;
+
 	status = digest_add_specfile(rec->digest, fp, NULL, sb.st_size, path);
 	if (status)
 		goto finish;
@@ -209,6 +219,7 @@ static void close(struct selabel_handle *rec)
 	if (spec_arr)
 	    free(spec_arr);
 
+	key_index_destroy(&data->index);
 	free(data);
 	rec->data = NULL;
 }
@@ -218,16 +229,10 @@ static struct selabel_lookup_rec *lookup(struct selabel_handle *rec,
 {
 	struct saved_data *data = (struct saved_data *)rec->data;
 	spec_t *spec_arr = data->spec_arr;
-	unsigned int i;
-
-	for (i = 0; i < data->nspec; i++) {
-		if (spec_arr[i].type != type)
-			continue;
-		if (!fnmatch(spec_arr[i].key, key, 0))
-			break;
-	}
+	int i;
 
-	if (i >= data->nspec) {
+	i = key_index_lookup(&data->index, key, type);
+	if (i < 0) {
 		/* No matching specification. */
 		errno = ENOENT;
 		return NULL;
@@ -247,6 +252,7 @@ static void stats(struct selabel_handle *rec)
 
 	selinux_log(SELINUX_INFO, "%u entries, %u matches made\n",
 		  data->nspec, total);
+	key_index_stats(&data->index);
 }
 
 int selabel_x_init(struct selabel_handle *rec, const struct selinux_opt *opts,
@@ -3,6 +3,7 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "regex.h"
@@ -101,6 +102,12 @@ err:
 	return -1;
 }
 
+void regex_jit_compile(struct regex_data *regex)
+{
+	/* pcre2_match() falls back to the interpreter if this fails */
+	(void) pcre2_jit_compile(regex->regex, PCRE2_JIT_COMPLETE);
+}
+
 char const *regex_version(void)
 {
 	static char version_buf[256];
@@ -112,53 +119,60 @@ char const *regex_version(void)
 	return version_buf;
 }
 
-int regex_load_mmap(struct mmap_area *mmap_area, struct regex_data **regex,
-		    int do_load_precompregex, bool *regex_compiled)
+int regex_skip_mmap(struct mmap_area *mmap_area, const void **serialized,
+		    int do_load_precompregex)
 {
 	int rc;
 	uint32_t data_u32, entry_len;
+	const void *entry;
 
-	*regex_compiled = false;
+	*serialized = NULL;
 	rc = next_entry(&data_u32, mmap_area, sizeof(uint32_t));
 	if (rc < 0)
 		return -1;
 
 	entry_len = be32toh(data_u32);
 
+	entry = mmap_area->next_addr;
+	rc = next_entry(NULL, mmap_area, entry_len);
+	if (rc < 0)
+		return -1;
+
 	if (entry_len && do_load_precompregex) {
 		/*
 		 * this should yield exactly one because we store one pattern at
 		 * a time
 		 */
-		rc = pcre2_serialize_get_number_of_codes(mmap_area->next_addr);
+		rc = pcre2_serialize_get_number_of_codes(entry);
 		if (rc != 1)
 			return -1;
 
-		*regex = regex_data_create();
-		if (!*regex)
-			return -1;
+		*serialized = entry;
+	}
 
-		rc = pcre2_serialize_decode(&(*regex)->regex, 1,
-					    (PCRE2_SPTR)mmap_area->next_addr,
-					    NULL);
-		if (rc != 1)
-			goto err;
+	return 0;
+}
 
-#ifndef AGGRESSIVE_FREE_AFTER_REGEX_MATCH
-		(*regex)->match_data =
-		    pcre2_match_data_create_from_pattern((*regex)->regex, NULL);
-		if (!(*regex)->match_data)
-			goto err;
-#endif
+int regex_load_serialized(const void *serialized, struct regex_data **regex)
+{
+	int rc;
 
-		*regex_compiled = true;
-	}
+	*regex = regex_data_create();
+	if (!*regex)
+		return -1;
 
-	/* and skip the decoded bit */
-	rc = next_entry(NULL, mmap_area, entry_len);
-	if (rc < 0)
+	rc = pcre2_serialize_decode(&(*regex)->regex, 1,
+				    (PCRE2_SPTR)serialized, NULL);
+	if (rc != 1)
 		goto err;
 
+#ifndef AGGRESSIVE_FREE_AFTER_REGEX_MATCH
+	(*regex)->match_data =
+	    pcre2_match_data_create_from_pattern((*regex)->regex, NULL);
+	if (!(*regex)->match_data)
+		goto err;
+#endif
+
 	return 0;
 err:
 	regex_data_free(*regex);
@@ -263,6 +277,48 @@ int regex_match(struct regex_data *regex, char const *subject, int partial)
 	}
 }
 
+int regex_match_mark(struct regex_data *regex, char const *subject,
+		     uint32_t *mark)
+{
+	int rc;
+	pcre2_match_data *match_data;
+	PCRE2_SPTR name;
+	__pthread_mutex_lock(&regex->match_mutex);
+
+#ifdef AGGRESSIVE_FREE_AFTER_REGEX_MATCH
+	match_data = pcre2_match_data_create_from_pattern(
+	    regex->regex, NULL);
+	if (match_data == NULL) {
+		__pthread_mutex_unlock(&regex->match_mutex);
+		return REGEX_ERROR;
+	}
+#else
+	match_data = regex->match_data;
+#endif
+
+	rc = pcre2_match(
+	    regex->regex, (PCRE2_SPTR)subject, PCRE2_ZERO_TERMINATED, 0,
+	    0, match_data, NULL);
+	if (rc > 0) {
+		name = pcre2_get_mark(match_data);
+		if (name)
+			*mark = strtoul((const char *)name, NULL, 10);
+		else
+			rc = PCRE2_ERROR_INTERNAL;
+	}
+
+#ifdef AGGRESSIVE_FREE_AFTER_REGEX_MATCH
+	pcre2_match_data_free(match_data);
+#endif
+
+	__pthread_mutex_unlock(&regex->match_mutex);
+	if (rc > 0)
+		return REGEX_MATCH;
+	if (rc == PCRE2_ERROR_NOMATCH)
+		return REGEX_NO_MATCH;
+	return REGEX_ERROR;
+}
+
 /*
  * TODO Replace this compare function with something that actually compares the
  * regular expressions.
@@ -354,13 +410,38 @@ char const *regex_version(void)
 	return pcre_version();
 }
 
-int regex_load_mmap(struct mmap_area *mmap_area, struct regex_data **regex,
-		    int do_load_precompregex __attribute__((unused)), bool *regex_compiled)
+void regex_jit_compile(struct regex_data *regex)
+{
+#ifdef PCRE_STUDY_JIT_COMPILE
+	const char *error_buffer;
+	pcre_extra *sd;
+
+	if (!regex->owned)
+		return;
+
+	/* keep the plain study data if JIT compilation fails */
+	sd = pcre_study(regex->regex, PCRE_STUDY_JIT_COMPILE, &error_buffer);
+	if (sd) {
+		if (regex->sd)
+			pcre_free_study(regex->sd);
+		regex->sd = sd;
+	}
+#else
+	(void) regex;
+#endif
+}
+
+int regex_skip_mmap(struct mmap_area *mmap_area, const void **serialized,
+		    int do_load_precompregex __attribute__((unused)))
 {
 	int rc;
 	uint32_t data_u32, entry_len;
 	size_t info_len;
+	const void *entry = mmap_area->next_addr;
+	const pcre *regex;
+	pcre_extra lsd = { 0 };
 
+	*serialized = NULL;
 	rc = next_entry(&data_u32, mmap_area, sizeof(uint32_t));
 	if (rc < 0)
 		return -1;
@@ -369,51 +450,70 @@ int regex_load_mmap(struct mmap_area *mmap_area, struct regex_data **regex,
 	if (!entry_len)
 		return -1;
 
-	*regex = regex_data_create();
-	if (!(*regex))
-		return -1;
-
-	(*regex)->owned = 0;
-	(*regex)->regex = (pcre *)mmap_area->next_addr;
+	regex = (const pcre *)mmap_area->next_addr;
 	rc = next_entry(NULL, mmap_area, entry_len);
 	if (rc < 0)
-		goto err;
+		return -1;
 
 	/*
 	 * Check that regex lengths match. pcre_fullinfo()
 	 * also validates its magic number.
 	 */
-	rc = pcre_fullinfo((*regex)->regex, NULL, PCRE_INFO_SIZE, &info_len);
+	rc = pcre_fullinfo(regex, NULL, PCRE_INFO_SIZE, &info_len);
 	if (rc < 0 || info_len != entry_len)
-		goto err;
+		return -1;
 
 	rc = next_entry(&data_u32, mmap_area, sizeof(uint32_t));
 	if (rc < 0)
-		goto err;
+		return -1;
 
 	entry_len = be32toh(data_u32);
 
 	if (entry_len) {
-		(*regex)->lsd.study_data = (void *)mmap_area->next_addr;
-		(*regex)->lsd.flags |= PCRE_EXTRA_STUDY_DATA;
+		lsd.study_data = (void *)mmap_area->next_addr;
+		lsd.flags |= PCRE_EXTRA_STUDY_DATA;
 		rc = next_entry(NULL, mmap_area, entry_len);
 		if (rc < 0)
-			goto err;
+			return -1;
 
 		/* Check that study data lengths match. */
-		rc = pcre_fullinfo((*regex)->regex, &(*regex)->lsd,
-				   PCRE_INFO_STUDYSIZE, &info_len);
+		rc = pcre_fullinfo(regex, &lsd, PCRE_INFO_STUDYSIZE, &info_len);
 		if (rc < 0 || info_len != entry_len)
-			goto err;
+			return -1;
 	}
 
-	*regex_compiled = true;
+	*serialized = entry;
 	return 0;
+}
 
-err:
-	regex_data_free(*regex);
-	*regex = NULL;
-	return -1;
+int regex_load_serialized(const void *serialized, struct regex_data **regex)
+{
+	const char *p = serialized;
+	uint32_t data_u32, entry_len;
+
+	*regex = regex_data_create();
+	if (!(*regex))
+		return -1;
+
+	/* The lengths were checked by regex_skip_mmap(). */
+	memcpy(&data_u32, p, sizeof(uint32_t));
+	entry_len = be32toh(data_u32);
+	p += sizeof(uint32_t);
+
+	(*regex)->owned = 0;
+	(*regex)->regex = (pcre *)p;
+	p += entry_len;
+
+	memcpy(&data_u32, p, sizeof(uint32_t));
+	entry_len = be32toh(data_u32);
+	p += sizeof(uint32_t);
+
+	if (entry_len) {
+		(*regex)->lsd.study_data = (void *)p;
+		(*regex)->lsd.flags |= PCRE_EXTRA_STUDY_DATA;
+	}
+
+	return 0;
 }
 
 static inline pcre_extra *get_pcre_extra(struct regex_data *regex)
@@ -510,6 +610,35 @@ int regex_match(struct regex_data *regex, char const *subject, int partial)
 	}
 }
 
+int regex_match_mark(struct regex_data *regex, char const *subject,
+		     uint32_t *mark)
+{
+	pcre_extra extra = { 0 };
+	pcre_extra *sd = get_pcre_extra(regex);
+	unsigned char *name = NULL;
+	int rc;
+
+	/* The study data is shared, so request the mark on a private copy. */
+	if (sd)
+		extra = *sd;
+	extra.flags |= PCRE_EXTRA_MARK;
+	extra.mark = &name;
+
+	rc = pcre_exec(regex->regex, &extra, subject, strlen(subject), 0, 0,
+		       NULL, 0);
+	switch (rc) {
+	case 0:
+		if (!name)
+			return REGEX_ERROR;
+		*mark = strtoul((const char *)name, NULL, 10);
+		return REGEX_MATCH;
+	case PCRE_ERROR_NOMATCH:
+		return REGEX_NO_MATCH;
+	default:
+		return REGEX_ERROR;
+	}
+}
+
 /*
  * TODO Replace this compare function with something that actually compares the
  * regular expressions.
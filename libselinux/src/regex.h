@@ -2,6 +2,7 @@
 #define SRC_REGEX_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #ifdef USE_PCRE2
@@ -89,26 +90,45 @@ void regex_data_free(struct regex_data *regex) ;
 int regex_prepare_data(struct regex_data **regex, char const *pattern_string,
 		       struct regex_error_data *errordata) ;
 /**
- * This function loads a serialized precompiled pattern from a contiguous
- * data region given by map_area.
+ * This function translates a precompiled pattern into machine code, if the
+ * regex library supports it, to speed up matching of large patterns. Failure
+ * is not an error; the pattern is then interpreted as before.
+ *
+ * @arg regex The precompiled pattern as returned by regex_prepare_data.
+ */
+void regex_jit_compile(struct regex_data *regex) ;
+/**
+ * This function skips over a serialized precompiled pattern in a contiguous
+ * data region given by map_area and records where it is stored, so that it
+ * can be loaded with regex_load_serialized once it is needed.
  *
  * @arg map_area Description of the memory region holding a serialized
  *               representation of the precompiled pattern.
+ * @arg serialized Set to the serialized pattern, or NULL if the region holds
+ *                 none or it must not be used.
+ * @arg do_load_precompregex If non-zero precompiled patterns get used from
+ *			     the mmap region (ignored by PCRE1 back-end).
+ *
+ * @retval 0 on success
+ * @retval -1 on error
+ */
+int regex_skip_mmap(struct mmap_area *map_area,
+		    const void **serialized,
+		    int do_load_precompregex) ;
+/**
+ * This function loads a serialized precompiled pattern recorded by
+ * regex_skip_mmap. The memory region must stay mapped while the pattern
+ * is in use.
+ *
+ * @arg serialized The serialized pattern.
  * @arg regex If successful, the structure returned through *regex was allocated
  *            with regex_data_create and must be freed with regex_data_free.
- * @arg do_load_precompregex If non-zero precompiled patterns get loaded from
- *			     the mmap region (ignored by PCRE1 back-end).
- * @arg regex_compiled Set to true if a precompiled pattern was loaded
- * 		       into regex, otherwise set to false to indicate later
- *		       compilation must occur
  *
  * @retval 0 on success
  * @retval -1 on error
  */
-int regex_load_mmap(struct mmap_area *map_area,
-		    struct regex_data **regex,
-		    int do_load_precompregex,
-		    bool *regex_compiled) ;
+int regex_load_serialized(const void *serialized,
+			  struct regex_data **regex) ;
 /**
  * This function stores a precompiled regular expression to a file.
  * In the case of PCRE, it just dumps the binary representation of the
@@ -139,6 +159,21 @@ int regex_writef(struct regex_data *regex, FILE *fp,
  */
 int regex_match(struct regex_data *regex, char const *subject,
 		int partial) ;
+/**
+ * This function applies a precompiled alternation of patterns, each tagged
+ * with a (*MARK:<number>) verb, to a subject string and reports which
+ * alternative matched. Partial matching is not supported.
+ *
+ * @arg regex The precompiled pattern.
+ * @arg subject The subject string.
+ * @arg mark Set to the number of the mark of the matching alternative.
+ * @retval REGEX_MATCH if a match was found
+ * @retval REGEX_NO_MATCH if no match was found
+ * @retval REGEX_ERROR if an error was encountered during the execution of the
+ *                     regular expression or the match carried no mark
+ */
+int regex_match_mark(struct regex_data *regex, char const *subject,
+		     uint32_t *mark) ;
 /**
  * This function compares two compiled regular expressions (regex1 and regex2).
  * It compares the binary representations of the compiled patterns. It is a very
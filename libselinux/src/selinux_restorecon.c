@@ -69,6 +69,9 @@ static struct dir_xattr *dir_xattr_last;
 /* Number of errors ignored during the file tree walk. */
 static long unsigned skipped_errors;
 
+/* Cutoff for SELINUX_RESTORECON_CHANGED_SINCE. */
+static struct timespec changed_since;
+
 /* restorecon_flags for passing to restorecon_sb() */
 struct rest_flags {
 	bool nochange;
@@ -87,6 +90,7 @@ struct rest_flags {
 	bool warnonnomatch;
 	bool conflicterror;
 	bool count_errors;
+	bool changed_since;
 };
 
 static void restorecon_init(void)
@@ -406,26 +410,125 @@ oom:
  */
 
 /*
- * The hash table of associations, hashed by inode number. Chaining is used
- * for collisions, with elements ordered by inode number in each bucket.
- * Each hash bucket has a dummy header.
+ * The hash table of associations, hashed by inode number.  It is split into
+ * shards with a lock each, so threads relabeling in parallel rarely contend.
+ * Each shard is a chained hash table doubling its buckets when it gets full,
+ * and interns the contexts of its associations, which are few and shared by
+ * many inodes.
  */
-#define HASH_BITS 16
-#define HASH_BUCKETS (1 << HASH_BITS)
-#define HASH_MASK (HASH_BUCKETS-1)
+#define FILESPEC_SHARD_BITS 6
+#define FILESPEC_SHARDS (1 << FILESPEC_SHARD_BITS)
+#define FILESPEC_MIN_BUCKETS 64
+#define FILESPEC_CON_BUCKETS 64
 
 /*
  * An association between an inode and a context.
  */
 typedef struct file_spec {
 	ino_t ino;		/* inode number */
-	char *con;		/* matched context */
+	const char *con;	/* matched context, interned in the shard */
 	char *file;		/* full pathname */
 	struct file_spec *next;	/* next association in hash bucket chain */
 } file_spec_t;
 
-static file_spec_t *fl_head;
-static pthread_mutex_t fl_mutex = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * An interned context.
+ */
+struct filespec_con {
+	struct filespec_con *next;	/* next context in hash bucket chain */
+	char con[];			/* context */
+};
+
+struct filespec_shard {
+	pthread_mutex_t mutex;
+	file_spec_t **buckets;		/* chains of associations */
+	size_t nbuckets;		/* number of buckets, a power of two */
+	size_t nel;			/* number of associations */
+	struct filespec_con *cons[FILESPEC_CON_BUCKETS];	/* interned contexts */
+};
+
+static struct filespec_shard fl_shards[FILESPEC_SHARDS];
+static bool fl_initialized;
+
+static inline uint64_t filespec_hash(ino_t ino)
+{
+	/* Fibonacci hashing, taking the shard from the top bits */
+	return (uint64_t)ino * UINT64_C(0x9E3779B97F4A7C15);
+}
+
+static inline size_t filespec_bucket(uint64_t hash, size_t nbuckets)
+{
+	return (size_t)hash & (nbuckets - 1);
+}
+
+/*
+ * Set up the association hash table, before any threads use it.
+ */
+static void filespec_init(void)
+{
+	for (uint32_t i = 0; i < FILESPEC_SHARDS; i++)
+		__pthread_mutex_init(&fl_shards[i].mutex, NULL);
+	fl_initialized = true;
+}
+
+/*
+ * Return the interned copy of con in the shard, which is locked.
+ */
+static const char *filespec_intern(struct filespec_shard *shard, const char *con)
+{
+	struct filespec_con *c;
+	size_t len = strlen(con);
+	uint32_t h = 2166136261U;
+
+	/* FNV-1a */
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)con[i];
+		h *= 16777619U;
+	}
+	h &= FILESPEC_CON_BUCKETS - 1;
+
+	for (c = shard->cons[h]; c; c = c->next) {
+		if (strcmp(c->con, con) == 0)
+			return c->con;
+	}
+
+	c = malloc(sizeof(*c) + len + 1);
+	if (!c)
+		return NULL;
+	memcpy(c->con, con, len + 1);
+	c->next = shard->cons[h];
+	shard->cons[h] = c;
+
+	return c->con;
+}
+
+/*
+ * Double the buckets of the shard, which is locked.
+ */
+static int filespec_grow(struct filespec_shard *shard)
+{
+	size_t nbuckets = shard->nbuckets ? shard->nbuckets * 2 : FILESPEC_MIN_BUCKETS;
+	file_spec_t **buckets, *fl, *next;
+
+	buckets = calloc(nbuckets, sizeof(*buckets));
+	if (!buckets)
+		return -1;
+
+	for (size_t h = 0; h < shard->nbuckets; h++) {
+		for (fl = shard->buckets[h]; fl; fl = next) {
+			size_t nh = filespec_bucket(filespec_hash(fl->ino), nbuckets);
+
+			next = fl->next;
+			fl->next = buckets[nh];
+			buckets[nh] = fl;
+		}
+	}
+
+	free(shard->buckets);
+	shard->buckets = buckets;
+	shard->nbuckets = nbuckets;
+	return 0;
+}
 
 /*
  * Try to add an association between an inode and a context. If there is a
@@ -435,48 +538,49 @@ static pthread_mutex_t fl_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int filespec_add(ino_t ino, const char *con, const char *file,
 			const struct rest_flags *flags)
 {
-	file_spec_t *prevfl, *fl;
-	uint32_t h;
+	uint64_t hash = filespec_hash(ino);
+	struct filespec_shard *shard = &fl_shards[hash >> (64 - FILESPEC_SHARD_BITS)];
+	file_spec_t *fl;
+	const char *icon;
+	char *dup;
 	int ret;
 	struct stat64 sb;
 
-	__pthread_mutex_lock(&fl_mutex);
+	__pthread_mutex_lock(&shard->mutex);
 
-	if (!fl_head) {
-		fl_head = calloc(HASH_BUCKETS, sizeof(file_spec_t));
-		if (!fl_head)
-			goto oom;
-	}
+	icon = filespec_intern(shard, con);
+	if (!icon)
+		goto oom;
+
+	if (shard->nbuckets) {
+		for (fl = shard->buckets[filespec_bucket(hash, shard->nbuckets)]; fl; fl = fl->next) {
+			if (ino != fl->ino)
+				continue;
+
+			if (fl->con == icon)
+				goto unlock_1;
 
-	h = (ino + (ino >> HASH_BITS)) & HASH_MASK;
-	for (prevfl = &fl_head[h], fl = fl_head[h].next; fl;
-	     prevfl = fl, fl = fl->next) {
-		if (ino == fl->ino) {
 			ret = lstat64(fl->file, &sb);
 			if (ret < 0 || sb.st_ino != ino) {
-				freecon(fl->con);
-				free(fl->file);
-				fl->file = strdup(file);
-				if (!fl->file)
-					goto oom;
-				fl->con = strdup(con);
-				if (!fl->con)
+				dup = strdup(file);
+				if (!dup)
 					goto oom;
+				free(fl->file);
+				fl->file = dup;
+				fl->con = icon;
 				goto unlock_1;
 			}
 
-			if (strcmp(fl->con, con) == 0)
-				goto unlock_1;
-
 			selinux_log(SELINUX_ERROR,
 				"conflicting specifications for %s and %s, using %s.\n",
 				file, fl->file, fl->con);
-			free(fl->file);
-			fl->file = strdup(file);
-			if (!fl->file)
+			dup = strdup(file);
+			if (!dup)
 				goto oom;
+			free(fl->file);
+			fl->file = dup;
 
-			__pthread_mutex_unlock(&fl_mutex);
+			__pthread_mutex_unlock(&shard->mutex);
 
 			if (flags->conflicterror) {
 				selinux_log(SELINUX_ERROR,
@@ -485,37 +589,34 @@ static int filespec_add(ino_t ino, const char *con, const char *file,
 			}
 			return 1;
 		}
-
-		if (ino > fl->ino)
-			break;
 	}
 
+	if (shard->nel >= shard->nbuckets && filespec_grow(shard) < 0)
+		goto oom;
+
 	fl = malloc(sizeof(file_spec_t));
 	if (!fl)
 		goto oom;
 	fl->ino = ino;
-	fl->con = strdup(con);
-	if (!fl->con)
-		goto oom_freefl;
+	fl->con = icon;
 	fl->file = strdup(file);
 	if (!fl->file)
-		goto oom_freeflcon;
-	fl->next = prevfl->next;
-	prevfl->next = fl;
+		goto oom_freefl;
+	fl->next = shard->buckets[filespec_bucket(hash, shard->nbuckets)];
+	shard->buckets[filespec_bucket(hash, shard->nbuckets)] = fl;
+	shard->nel++;
 
-	__pthread_mutex_unlock(&fl_mutex);
+	__pthread_mutex_unlock(&shard->mutex);
 	return 0;
 
-oom_freeflcon:
-	free(fl->con);
 oom_freefl:
 	free(fl);
 oom:
-	__pthread_mutex_unlock(&fl_mutex);
+	__pthread_mutex_unlock(&shard->mutex);
 	selinux_log(SELINUX_ERROR, "%s:  Out of memory\n", __func__);
 	return -1;
 unlock_1:
-	__pthread_mutex_unlock(&fl_mutex);
+	__pthread_mutex_unlock(&shard->mutex);
 	return 1;
 }
 
@@ -526,29 +627,34 @@ unlock_1:
 static void filespec_eval(void)
 {
 	file_spec_t *fl;
-	uint32_t h;
-	size_t used, nel, len, longest;
+	size_t used, nel, nbuckets, len, longest;
 
-	if (!fl_head)
+	if (!fl_initialized)
 		return;
 
 	used = 0;
 	longest = 0;
 	nel = 0;
-	for (h = 0; h < HASH_BUCKETS; h++) {
-		len = 0;
-		for (fl = fl_head[h].next; fl; fl = fl->next)
-			len++;
-		if (len)
-			used++;
-		if (len > longest)
-			longest = len;
-		nel += len;
+	nbuckets = 0;
+	for (uint32_t i = 0; i < FILESPEC_SHARDS; i++) {
+		const struct filespec_shard *shard = &fl_shards[i];
+
+		for (size_t h = 0; h < shard->nbuckets; h++) {
+			len = 0;
+			for (fl = shard->buckets[h]; fl; fl = fl->next)
+				len++;
+			if (len)
+				used++;
+			if (len > longest)
+				longest = len;
+			nel += len;
+		}
+		nbuckets += shard->nbuckets;
 	}
 
 	selinux_log(SELINUX_INFO,
 		     "filespec hash table stats: %zu elements, %zu/%zu buckets used, longest chain length %zu\n",
-		     nel, used, HASH_BUCKETS, longest);
+		     nel, used, nbuckets, longest);
 }
 #else
 static void filespec_eval(void)
@@ -562,24 +668,41 @@ static void filespec_eval(void)
 static void filespec_destroy(void)
 {
 	file_spec_t *fl, *tmp;
-	uint32_t h;
+	struct filespec_con *c, *ctmp;
 
-	if (!fl_head)
+	if (!fl_initialized)
 		return;
 
-	for (h = 0; h < HASH_BUCKETS; h++) {
-		fl = fl_head[h].next;
-		while (fl) {
-			tmp = fl;
-			fl = fl->next;
-			freecon(tmp->con);
-			free(tmp->file);
-			free(tmp);
+	for (uint32_t i = 0; i < FILESPEC_SHARDS; i++) {
+		struct filespec_shard *shard = &fl_shards[i];
+
+		for (size_t h = 0; h < shard->nbuckets; h++) {
+			fl = shard->buckets[h];
+			while (fl) {
+				tmp = fl;
+				fl = fl->next;
+				free(tmp->file);
+				free(tmp);
+			}
+		}
+		free(shard->buckets);
+		shard->buckets = NULL;
+		shard->nbuckets = 0;
+		shard->nel = 0;
+
+		for (uint32_t h = 0; h < FILESPEC_CON_BUCKETS; h++) {
+			c = shard->cons[h];
+			while (c) {
+				ctmp = c;
+				c = c->next;
+				free(ctmp);
+			}
+			shard->cons[h] = NULL;
 		}
-		fl_head[h].next = NULL;
+
+		__pthread_mutex_destroy(&shard->mutex);
 	}
-	free(fl_head);
-	fl_head = NULL;
+	fl_initialized = false;
 }
 
 /*
@@ -635,6 +758,16 @@ static int restorecon_sb(const char *pathname, const struct stat *sb,
 	int rc;
 	const char *lookup_path = pathname;
 
+	/*
+	 * Creating, renaming, linking or relabeling a file all update its
+	 * ctime, so files with an older one have been checked before.
+	 */
+	if (flags->changed_since &&
+	    (sb->st_ctim.tv_sec < changed_since.tv_sec ||
+	     (sb->st_ctim.tv_sec == changed_since.tv_sec &&
+	      sb->st_ctim.tv_nsec < changed_since.tv_nsec)))
+		return 0;
+
 	if (rootpath) {
 		if (strncmp(rootpath, lookup_path, rootpathlen) != 0) {
 			selinux_log(SELINUX_ERROR,
@@ -1048,6 +1181,8 @@ static int selinux_restorecon_common(const char *pathname_orig,
 		    SELINUX_RESTORECON_IGNORE_DIGEST) ? true : false;
 	state.flags.count_errors = (restorecon_flags &
 		    SELINUX_RESTORECON_COUNT_ERRORS) ? true : false;
+	state.flags.changed_since = (restorecon_flags &
+		    SELINUX_RESTORECON_CHANGED_SINCE) ? true : false;
 	state.setrestorecondigest = true;
 
 	state.head = NULL;
@@ -1079,6 +1214,13 @@ static int selinux_restorecon_common(const char *pathname_orig,
 	    (restorecon_flags & SELINUX_RESTORECON_SKIP_DIGEST))
 		state.setrestorecondigest = false;
 
+	/*
+	 * Unchanged files are not checked, so a digest written now would
+	 * not vouch for the whole directory.
+	 */
+	if (state.flags.changed_since)
+		state.setrestorecondigest = false;
+
 	if (!__pthread_supported) {
 		if (nthreads != 1) {
 			nthreads = 1;
@@ -1166,6 +1308,9 @@ static int selinux_restorecon_common(const char *pathname_orig,
 		}
 	}
 
+	if (state.flags.add_assoc)
+		filespec_init();
+
 	/* Skip digest if not a directory */
 	if (!S_ISDIR(sb.st_mode))
 		state.setrestorecondigest = false;
@@ -1454,6 +1599,14 @@ int selinux_restorecon_set_alt_rootpath(const char *alt_rootpath)
 	return 0;
 }
 
+/* selinux_restorecon_set_changed_since(3) sets the cutoff for
+ * SELINUX_RESTORECON_CHANGED_SINCE.
+ */
+void selinux_restorecon_set_changed_since(const struct timespec *cutoff)
+{
+	changed_since = *cutoff;
+}
+
 /* selinux_restorecon_xattr(3)
  * Find RESTORECON_PARTIAL_MATCH_DIGEST entries.
  */
@@ -0,0 +1,202 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*  The purpose of this file is to provide unit tests of the functions in:
+ *
+ *  libselinux/src/selinux_restorecon.c
+ *
+ */
+
+#include "test_restorecon.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <selinux/selinux.h>
+#include <selinux/label.h>
+#include <selinux/restorecon.h>
+
+#define CONTEXT "system_u:object_r:restorecon_test_t:s0"
+
+/* Check the labels without changing them, as tests run unprivileged */
+#define FLAGS (SELINUX_RESTORECON_RECURSE | \
+	       SELINUX_RESTORECON_NOCHANGE | \
+	       SELINUX_RESTORECON_VERBOSE | \
+	       SELINUX_RESTORECON_SET_SPECFILE_CTX | \
+	       SELINUX_RESTORECON_SKIP_DIGEST)
+
+static char dir[] = "/tmp/restorecon-test-XXXXXX";
+static char spec_path[PATH_MAX];
+static char old_path[PATH_MAX];
+static char touched_path[PATH_MAX];
+static char new_path[PATH_MAX];
+static struct timespec cutoff;
+
+/* The messages selinux_restorecon() logged during a test */
+static char *log_buf;
+static size_t log_len;
+
+/* selinux_restorecon.c */
+static void test_restorecon_all(void);
+static void test_restorecon_changed_since(void);
+
+static int __attribute__ ((format(printf, 2, 3)))
+log_callback(int type __attribute__ ((unused)), const char *fmt, ...)
+{
+	char line[2 * PATH_MAX];
+	size_t len;
+	char *tmp;
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+
+	len = strlen(line);
+	tmp = realloc(log_buf, log_len + len + 1);
+	if (!tmp)
+		return -1;
+	log_buf = tmp;
+	memcpy(log_buf + log_len, line, len + 1);
+	log_len += len;
+
+	return 0;
+}
+
+static void clear_log(void)
+{
+	free(log_buf);
+	log_buf = NULL;
+	log_len = 0;
+}
+
+/* Returns whether selinux_restorecon() would have relabeled path */
+static int would_relabel(const char *path)
+{
+	char line[PATH_MAX + 32];
+
+	snprintf(line, sizeof(line), "Would relabel %s from", path);
+	return log_buf != NULL && strstr(log_buf, line) != NULL;
+}
+
+static int create_file(const char *path)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+	if (fd < 0)
+		return -1;
+	return close(fd);
+}
+
+int restorecon_test_init(void)
+{
+	struct selinux_opt opts[] = { { SELABEL_OPT_PATH, spec_path } };
+	union selinux_callback cb = { .func_log = log_callback };
+	struct selabel_handle *hnd;
+	FILE *f;
+
+	if (!mkdtemp(dir))
+		return -1;
+
+	snprintf(spec_path, sizeof(spec_path), "%s/file_contexts", dir);
+	snprintf(old_path, sizeof(old_path), "%s/old", dir);
+	snprintf(touched_path, sizeof(touched_path), "%s/touched", dir);
+	snprintf(new_path, sizeof(new_path), "%s/new", dir);
+
+	f = fopen(spec_path, "w");
+	if (!f)
+		return -1;
+	fprintf(f, "%s(/.*)?\t%s\n", dir, CONTEXT);
+	if (fclose(f) != 0)
+		return -1;
+
+	if (create_file(old_path) < 0 || create_file(touched_path) < 0)
+		return -1;
+
+	/*
+	 * File timestamps are taken from the coarse clock; let it move on
+	 * from the files created so far.
+	 */
+	usleep(50000);
+	clock_gettime(CLOCK_REALTIME_COARSE, &cutoff);
+
+	/* Changing the mode updates the ctime, as relabeling would */
+	if (chmod(touched_path, 0600) < 0 || create_file(new_path) < 0)
+		return -1;
+
+	hnd = selabel_open(SELABEL_CTX_FILE, opts, 1);
+	if (!hnd)
+		return -1;
+	selinux_restorecon_set_sehandle(hnd);
+	selinux_set_callback(SELINUX_CB_LOG, cb);
+
+	return 0;
+}
+
+int restorecon_test_cleanup(void)
+{
+	selinux_restorecon_set_sehandle(NULL);
+	clear_log();
+
+	if (unlink(old_path) < 0 || unlink(touched_path) < 0 ||
+	    unlink(new_path) < 0 || unlink(spec_path) < 0 || rmdir(dir) < 0)
+		return -1;
+
+	return 0;
+}
+
+int restorecon_add_tests(CU_pSuite suite)
+{
+	if (!CU_add_test(suite, "restorecon_all", test_restorecon_all) ||
+	    !CU_add_test(suite, "restorecon_changed_since",
+			 test_restorecon_changed_since))
+		return CU_get_error();
+
+	return 0;
+}
+
+/* Function selinux_restorecon */
+static void test_restorecon_all(void)
+{
+	clear_log();
+	CU_ASSERT(selinux_restorecon(dir, FLAGS) == 0);
+
+	CU_ASSERT(would_relabel(old_path));
+	CU_ASSERT(would_relabel(touched_path));
+	CU_ASSERT(would_relabel(new_path));
+}
+
+/* Function selinux_restorecon with SELINUX_RESTORECON_CHANGED_SINCE */
+static void test_restorecon_changed_since(void)
+{
+	selinux_restorecon_set_changed_since(&cutoff);
+
+	clear_log();
+	CU_ASSERT(selinux_restorecon(dir, FLAGS |
+				     SELINUX_RESTORECON_CHANGED_SINCE) == 0);
+
+	/* only files changed since the cutoff are checked */
+	CU_ASSERT(!would_relabel(old_path));
+	CU_ASSERT(would_relabel(touched_path));
+	CU_ASSERT(would_relabel(new_path));
+}
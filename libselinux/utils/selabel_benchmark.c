@@ -0,0 +1,244 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include <selinux/selinux.h>
+#include <selinux/label.h>
+
+static __attribute__ ((__noreturn__)) void usage(const char *progname)
+{
+	fprintf(stderr,
+		"usage: %s [-b backend] [-t type] [-c] [-d] [-n count] [-f file] [-p profile] pathfile\n\n"
+		"Where:\n\t"
+		"-b  The backend - \"file\" (default), \"media\", \"x\" or \"db\".\n\t"
+		"-t  Lookup type - the mode for \"file\", the object type\n\t"
+		"    for \"x\" and \"db\" (defaults to 0).\n\t"
+		"-c  Combine the regular expressions of each spec node.\n\t"
+		"-d  Compute the digest of all partial matches of each path,\n\t"
+		"    as restorecon does to check whether a directory changed.\n\t"
+		"-n  Number of passes over the paths (defaults to 1).\n\t"
+		"-f  Optional file containing the specs (defaults to\n\t"
+		"    those used by loaded policy).\n\t"
+		"-p  Profile the lookups of each spec and write the profile\n\t"
+		"    to this file, \"-\" for stdout (\"file\" backend only).\n\t"
+		"pathfile  File with one path or key to look up per line, for\n\t"
+		"    example the output of \"find / -xdev\".\n\n"
+		"Example:\n\t"
+		"%s -n 10 -f file_contexts paths\n\t"
+		"   open the \"file\" backend and look up all paths listed\n\t"
+		"   in file \"paths\" ten times, then report the lookup rate\n\t"
+		"%s -b x -t 1 -f x_contexts properties\n\t"
+		"   look up the keys in file \"properties\" as X properties\n\n",
+		progname, progname, progname);
+	exit(1);
+}
+
+/*
+ * Private dirty memory of this process in kB, or -1 if it is unknown.  Clean
+ * pages of a mapped file_contexts.bin are left out as they are shared with
+ * every other process using it.
+ */
+static long private_dirty_kb(void)
+{
+	char buf[256];
+	long total = -1, kb;
+	FILE *fp;
+
+	fp = fopen("/proc/self/smaps_rollup", "re");
+	if (!fp)
+		return -1;
+
+	while (fgets(buf, sizeof(buf), fp)) {
+		if (sscanf(buf, "Private_Dirty: %ld kB", &kb) == 1)
+			total = kb;
+	}
+
+	fclose(fp);
+	return total;
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) +
+	       (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, rc = 1, type = 0;
+	unsigned int backend = SELABEL_CTX_FILE;
+	unsigned long passes = 1, i;
+	bool digests = false;
+	uint8_t digest[20];	/* SHA1 */
+	size_t paths_num = 0, paths_alloc = 0, matched = 0, n;
+	char **paths = NULL, *line = NULL, *context, *file = NULL;
+	char *combine = NULL, *profile = NULL;
+	size_t line_len = 0;
+	ssize_t len;
+	long mem_before, mem_after;
+	double open_time, lookup_time;
+	struct timespec start;
+	FILE *fp;
+
+	struct selabel_handle *hnd;
+	struct selinux_opt selabel_option[] = {
+		{ SELABEL_OPT_PATH, NULL },
+		{ SELABEL_OPT_COMBINE_REGEX, NULL },
+		{ SELABEL_OPT_PROFILE, NULL }
+	};
+
+	while ((opt = getopt(argc, argv, "b:t:cdn:f:p:")) > 0) {
+		switch (opt) {
+		case 'b':
+			if (!strcmp(optarg, "file")) {
+				backend = SELABEL_CTX_FILE;
+			} else if (!strcmp(optarg, "media")) {
+				backend = SELABEL_CTX_MEDIA;
+			} else if (!strcmp(optarg, "x")) {
+				backend = SELABEL_CTX_X;
+			} else if (!strcmp(optarg, "db")) {
+				backend = SELABEL_CTX_DB;
+			} else {
+				fprintf(stderr, "Unknown backend: %s\n",
+					optarg);
+				usage(argv[0]);
+			}
+			break;
+		case 't':
+			type = strtol(optarg, NULL, 0);
+			break;
+		case 'c':
+			combine = (char *)1;
+			break;
+		case 'd':
+			digests = true;
+			break;
+		case 'n':
+			passes = strtoul(optarg, NULL, 0);
+			if (passes == 0)
+				usage(argv[0]);
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		case 'p':
+			profile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	/* Only the file backend combines regexes, hashes partial matches and profiles */
+	if (backend != SELABEL_CTX_FILE && (combine || digests || profile))
+		usage(argv[0]);
+
+	fp = fopen(argv[optind], "re");
+	if (!fp) {
+		fprintf(stderr, "Could not open %s: %s\n", argv[optind],
+			strerror(errno));
+		return 1;
+	}
+
+	while ((len = getline(&line, &line_len, fp)) > 0) {
+		if (line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (len == 0)
+			continue;
+
+		if (paths_num == paths_alloc) {
+			char **tmp;
+
+			paths_alloc = paths_alloc ? paths_alloc * 2 : 1024;
+			tmp = realloc(paths, paths_alloc * sizeof(*paths));
+			if (!tmp)
+				goto oom;
+			paths = tmp;
+		}
+
+		paths[paths_num] = strdup(line);
+		if (!paths[paths_num])
+			goto oom;
+		paths_num++;
+	}
+	fclose(fp);
+	fp = NULL;
+
+	selabel_option[0].value = file;
+	selabel_option[1].value = combine;
+	selabel_option[2].value = profile ? (char *)1 : NULL;
+
+	mem_before = private_dirty_kb();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	hnd = selabel_open(backend, selabel_option,
+			   backend == SELABEL_CTX_FILE ? 3 : 1);
+	open_time = elapsed(&start);
+	mem_after = private_dirty_kb();
+	if (!hnd) {
+		fprintf(stderr, "ERROR: selabel_open - Could not obtain handle:  %s\n",
+			strerror(errno));
+		goto out;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < passes; i++) {
+		for (n = 0; n < paths_num; n++) {
+			if (digests) {
+				if (selabel_hash_all_partial_matches(hnd, paths[n], digest))
+					matched++;
+			} else if (selabel_lookup_raw(hnd, &context, paths[n], type) == 0) {
+				matched++;
+				freecon(context);
+			}
+		}
+	}
+	lookup_time = elapsed(&start);
+
+	printf("selabel_open: %.3f ms\n", open_time * 1e3);
+	if (mem_before >= 0 && mem_after >= 0)
+		printf("selabel_open private dirty memory: %ld kB\n",
+		       mem_after - mem_before);
+	printf("%s: %zu (%zu matched) in %.3f s, %.0f %s/s\n",
+	       digests ? "digests" : "lookups",
+	       paths_num * passes, matched, lookup_time,
+	       lookup_time > 0 ? (double)(paths_num * passes) / lookup_time : 0.0,
+	       digests ? "directories" : "lookups");
+
+	if (profile) {
+		fp = strcmp(profile, "-") ? fopen(profile, "we") : stdout;
+		if (!fp || selabel_profile_dump(hnd, fp) < 0) {
+			fprintf(stderr, "ERROR: Could not write profile to %s: %s\n",
+				profile, strerror(errno));
+			selabel_close(hnd);
+			goto out;
+		}
+		if (fp != stdout)
+			fclose(fp);
+		fp = NULL;
+	}
+
+	selabel_close(hnd);
+	rc = 0;
+	goto out;
+
+oom:
+	fprintf(stderr, "ERROR: Out of memory\n");
+out:
+	if (fp)
+		fclose(fp);
+	for (n = 0; n < paths_num; n++)
+		free(paths[n]);
+	free(paths);
+	free(line);
+	return rc;
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <selinux/selinux.h>
+#include <selinux/label.h>
+#include <selinux/restorecon.h>
+
+/* Files per directory created with -n */
+#define FILES_PER_DIR 1000
+
+static __attribute__ ((__noreturn__)) void usage(const char *progname)
+{
+	fprintf(stderr,
+		"usage: %s [-f file] [-T nthreads] [-n files [-l links]] [-c ratio] dir\n\n"
+		"Where:\n\t"
+		"-f  Optional file containing the specs (defaults to\n\t"
+		"    those used by loaded policy).\n\t"
+		"-T  Number of threads to relabel with, 0 for the number\n\t"
+		"    of CPUs (defaults to 1).\n\t"
+		"-n  Create this many files below dir first.\n\t"
+		"-l  Number of additional hard links to each created file,\n\t"
+		"    in a separate directory tree (defaults to 0).\n\t"
+		"-c  Change the inode of one in this many files, then only\n\t"
+		"    check files changed since (defaults to checking all).\n\t"
+		"dir  Directory to check the labels of, without changing them,\n\t"
+		"    associating inodes with contexts as setfiles does.\n\n"
+		"Example:\n\t"
+		"%s -T 0 -n 500000 -l 3 /var/tmp/links\n\t"
+		"   create two million hard links to half a million files\n\t"
+		"   and report how many per second restorecon checks\n\t"
+		"%s -c 1000 /var/tmp/links\n\t"
+		"   report how fast restorecon walks it when 0.1%% changed\n\n",
+		progname, progname, progname);
+	exit(1);
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) +
+	       (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int create_tree(const char *dir, unsigned long files, unsigned long links)
+{
+	static char path[PATH_MAX], linkpath[PATH_MAX];
+	unsigned long i, l;
+	int fd;
+
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+		goto err;
+
+	for (l = 0; l <= links; l++) {
+		snprintf(path, sizeof(path), "%s/%lu", dir, l);
+		if (mkdir(path, 0755) < 0 && errno != EEXIST)
+			goto err;
+	}
+
+	for (i = 0; i < files; i++) {
+		for (l = 0; l <= links; l++) {
+			if (i % FILES_PER_DIR == 0) {
+				snprintf(path, sizeof(path), "%s/%lu/%lu", dir, l,
+					 i / FILES_PER_DIR);
+				if (mkdir(path, 0755) < 0 && errno != EEXIST)
+					goto err;
+			}
+		}
+
+		snprintf(path, sizeof(path), "%s/0/%lu/%lu", dir,
+			 i / FILES_PER_DIR, i);
+		fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0)
+			goto err;
+		close(fd);
+
+		for (l = 1; l <= links; l++) {
+			snprintf(linkpath, sizeof(linkpath), "%s/%lu/%lu/%lu", dir, l,
+				 i / FILES_PER_DIR, i);
+			if (link(path, linkpath) < 0 && errno != EEXIST) {
+				snprintf(path, sizeof(path), "%s", linkpath);
+				goto err;
+			}
+		}
+	}
+
+	return 0;
+
+err:
+	fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+	return -1;
+}
+
+static size_t entries, changed;
+static unsigned long change_ratio;
+
+static int count_entry(const char *fpath,
+		       const struct stat *sb,
+		       int typeflag,
+		       struct FTW *ftwbuf __attribute__ ((unused)))
+{
+	entries++;
+
+	/* Changing the mode updates the ctime, as relabeling would */
+	if (change_ratio && typeflag == FTW_F && entries % change_ratio == 0) {
+		if (chmod(fpath, sb->st_mode & 07777) < 0) {
+			fprintf(stderr, "Could not change %s: %s\n", fpath,
+				strerror(errno));
+			return -1;
+		}
+		changed++;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, rc;
+	unsigned long files = 0, links = 0;
+	unsigned int nthreads = 1;
+	char *file = NULL;
+	double secs;
+	struct timespec start, cutoff;
+	unsigned int flags = SELINUX_RESTORECON_RECURSE |
+			     SELINUX_RESTORECON_NOCHANGE |
+			     SELINUX_RESTORECON_ADD_ASSOC |
+			     SELINUX_RESTORECON_IGNORE_DIGEST;
+	struct selabel_handle *hnd = NULL;
+	struct selinux_opt selabel_option[] = {
+		{ SELABEL_OPT_PATH, NULL },
+		{ SELABEL_OPT_DIGEST, (char *)1 }
+	};
+
+	while ((opt = getopt(argc, argv, "f:T:n:l:c:")) > 0) {
+		switch (opt) {
+		case 'f':
+			file = optarg;
+			break;
+		case 'T':
+			nthreads = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			files = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			links = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			change_ratio = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	if (files && create_tree(argv[optind], files, links) < 0)
+		return 1;
+
+	if (change_ratio) {
+		/* Let anything created just before fall into an older tick */
+		usleep(20000);
+		clock_gettime(CLOCK_REALTIME_COARSE, &cutoff);
+		selinux_restorecon_set_changed_since(&cutoff);
+		flags |= SELINUX_RESTORECON_CHANGED_SINCE;
+	}
+
+	/* Count the entries, which also brings them into the caches */
+	if (nftw(argv[optind], count_entry, 64, FTW_PHYS) < 0) {
+		fprintf(stderr, "Could not walk %s: %s\n", argv[optind],
+			strerror(errno));
+		return 1;
+	}
+
+	if (file) {
+		selabel_option[0].value = file;
+		hnd = selabel_open(SELABEL_CTX_FILE, selabel_option, 2);
+		if (!hnd) {
+			fprintf(stderr, "ERROR: selabel_open - Could not obtain handle:  %s\n",
+				strerror(errno));
+			return 1;
+		}
+		selinux_restorecon_set_sehandle(hnd);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rc = selinux_restorecon_parallel(argv[optind], flags, nthreads);
+	secs = elapsed(&start);
+	if (rc < 0) {
+		fprintf(stderr, "ERROR: selinux_restorecon failed:  %s\n",
+			strerror(errno));
+		return 1;
+	}
+
+	printf("entries: %zu in %.3f s, %.0f entries/s\n", entries, secs,
+	       secs > 0 ? (double)entries / secs : 0.0);
+	if (change_ratio)
+		printf("changed: %zu\n", changed);
+
+	if (hnd)
+		selabel_close(hnd);
+	return 0;
+}
@@ -41,7 +41,7 @@ extern semanage_handle_t *semanage_handle_create(void);
 extern void semanage_handle_destroy(semanage_handle_t *);
 
 /* This is the type of connection to the store, for now only
- * direct is supported */
+ * direct and a local policy server are supported */
 enum semanage_connect_type {
 	SEMANAGE_CON_INVALID = 0, SEMANAGE_CON_DIRECT,
 	SEMANAGE_CON_POLSERV_LOCAL, SEMANAGE_CON_POLSERV_REMOTE
@@ -54,6 +54,14 @@ enum semanage_connect_type {
 extern void semanage_select_store(semanage_handle_t * handle, const char *path,
 				  enum semanage_connect_type storetype);
 
+/* Run a local policy server on the Unix socket at path, or at the
+ * socket given by the module-store setting if path is NULL.  The
+ * server connects to the store directly and keeps it open, taking
+ * and committing transactions for the clients whose module-store is
+ * that socket.  The handle must not be connected.  Returns 0 once the
+ * server is stopped by SIGTERM, SIGINT or SIGHUP, -1 on error. */
+extern int semanage_serve(semanage_handle_t * handle, const char *path);
+
 /* Just reload the policy */
 extern int semanage_reload_policy(semanage_handle_t * handle);
 
@@ -13,6 +13,14 @@ extern int semanage_ibendport_modify_local(semanage_handle_t *handle,
 extern int semanage_ibendport_del_local(semanage_handle_t *handle,
 					const semanage_ibendport_key_t *key);
 
+extern int semanage_ibendport_modify_local_batch(semanage_handle_t * handle,
+						 semanage_ibendport_t * const *records,
+						 unsigned int count);
+
+extern int semanage_ibendport_del_local_batch(semanage_handle_t * handle,
+					      semanage_ibendport_key_t * const *keys,
+					      unsigned int count);
+
 extern int semanage_ibendport_query_local(semanage_handle_t *handle,
 					  const semanage_ibendport_key_t *key,
 					  semanage_ibendport_t **response);
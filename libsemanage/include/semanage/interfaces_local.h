@@ -13,6 +13,14 @@ extern int semanage_iface_modify_local(semanage_handle_t * handle,
 extern int semanage_iface_del_local(semanage_handle_t * handle,
 				    const semanage_iface_key_t * key);
 
+extern int semanage_iface_modify_local_batch(semanage_handle_t * handle,
+					     semanage_iface_t * const *records,
+					     unsigned int count);
+
+extern int semanage_iface_del_local_batch(semanage_handle_t * handle,
+					  semanage_iface_key_t * const *keys,
+					  unsigned int count);
+
 extern int semanage_iface_query_local(semanage_handle_t * handle,
 				      const semanage_iface_key_t * key,
 				      semanage_iface_t ** response);
@@ -13,6 +13,14 @@ extern int semanage_port_modify_local(semanage_handle_t * handle,
 extern int semanage_port_del_local(semanage_handle_t * handle,
 				   const semanage_port_key_t * key);
 
+extern int semanage_port_modify_local_batch(semanage_handle_t * handle,
+					    semanage_port_t * const *records,
+					    unsigned int count);
+
+extern int semanage_port_del_local_batch(semanage_handle_t * handle,
+					 semanage_port_key_t * const *keys,
+					 unsigned int count);
+
 extern int semanage_port_query_local(semanage_handle_t * handle,
 				     const semanage_port_key_t * key,
 				     semanage_port_t ** response);
@@ -23,6 +23,7 @@ typedef semanage_bool_key_t record_key_t;
 #include "boolean_internal.h"
 #include "handle.h"
 #include "database.h"
+#include "utilities.h"
 #include <selinux/selinux.h>
 
 /* Key */
@@ -181,6 +182,15 @@ void semanage_bool_free(semanage_bool_t * boolean)
 }
 
 
+static unsigned int semanage_bool_key_hash(const semanage_bool_key_t * key)
+{
+
+	const char *name;
+	sepol_bool_key_unpack(key, &name);
+	return semanage_hash_str(SEMANAGE_HASH_INIT, name);
+}
+
+
 /* Record base functions */
 const record_table_t SEMANAGE_BOOL_RTABLE = {
 	.create = semanage_bool_create,
@@ -191,4 +201,5 @@ const record_table_t SEMANAGE_BOOL_RTABLE = {
 	.compare2 = semanage_bool_compare2,
 	.compare2_qsort = semanage_bool_compare2_qsort,
 	.free = semanage_bool_free,
+	.hash = semanage_bool_key_hash,
 };
@@ -20,14 +20,20 @@
  *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include <bzlib.h>
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "compressed_file.h"
 
@@ -36,6 +42,29 @@
 #define BZ2_MAGICSTR "BZh"
 #define BZ2_MAGICLEN (sizeof(BZ2_MAGICSTR)-1)
 
+#define ZSTD_MAGICSTR "\x28\xb5\x2f\xfd"
+#define ZSTD_MAGICLEN (sizeof(ZSTD_MAGICSTR)-1)
+
+static int write_plain(const char *filename, const void *data, size_t num_bytes)
+{
+	FILE *f;
+
+	if ((f = fopen(filename, "wbe")) == NULL) {
+		return -1;
+	}
+
+	if (fwrite(data, 1, num_bytes, f) < num_bytes) {
+		fclose(f);
+		return -1;
+	}
+
+	if (fclose(f) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
 /* bzip() a data to a file, returning the total number of compressed bytes
  * in the file.  Returns -1 if file could not be compressed. */
 static int bzip(semanage_handle_t *sh, const char *filename, void *data,
@@ -91,123 +120,251 @@ static int bzip(semanage_handle_t *sh, const char *filename, void *data,
 	return 0;
 }
 
-/* bunzip() a file to '*data', returning the total number of uncompressed bytes
- * in the file.  Returns -1 if file could not be decompressed. */
-static ssize_t bunzip(semanage_handle_t *sh, FILE *f, void **data)
+#ifdef USE_ZSTD
+/* Compresses data into a single zstd frame recording the content size. */
+static int zstd_compress(semanage_handle_t *sh, const char *filename, void *data,
+			 size_t num_bytes)
 {
-	BZFILE*  b = NULL;
-	size_t   nBuf;
-	uint8_t* buf = NULL;
-	size_t   size = 1<<18;
-	size_t   bufsize = size;
-	int      bzerror;
-	size_t   total = 0;
-	uint8_t* uncompress = NULL;
-	uint8_t* tmpalloc = NULL;
-	ssize_t  ret = -1;
-
-	buf = malloc(bufsize);
+	size_t bound = ZSTD_compressBound(num_bytes);
+	size_t size;
+	void *buf;
+	int ret;
+
+	buf = malloc(bound);
 	if (buf == NULL) {
-		ERR(sh, "Failure allocating memory.");
-		goto exit;
+		return -1;
 	}
 
-	/* Check if the file is bzipped */
-	bzerror = fread(buf, 1, BZ2_MAGICLEN, f);
+	size = ZSTD_compress(buf, bound, data, num_bytes, sh->conf->zstd_level);
+	if (ZSTD_isError(size)) {
+		ERR(sh, "Failure compressing %s with zstd: %s.", filename,
+		    ZSTD_getErrorName(size));
+		free(buf);
+		return -1;
+	}
 
-	if (fseek(f, 0L, SEEK_SET) == -1) {
-		ERR(sh, "Failure rewinding file.");
-		goto exit;
+	ret = write_plain(filename, buf, size);
+	free(buf);
+	return ret;
+}
+#endif
+
+/* bunzip() a buffer to '*data', returning the total number of uncompressed
+ * bytes. Returns -1 and sets '*err' if the data could not be decompressed. */
+static ssize_t bunzip(const void *in, size_t in_len, int small, void **data,
+		      const char **err)
+{
+	bz_stream strm = {};
+	size_t size = 1<<18;
+	size_t total = 0;
+	size_t avail;
+	uint8_t *uncompress = NULL;
+	uint8_t *tmpalloc = NULL;
+	int bzerror;
+	ssize_t ret = -1;
+
+	if (in_len > UINT_MAX) {
+		*err = "bz2 archive too large";
+		return -1;
+	}
+
+	if (BZ2_bzDecompressInit(&strm, 0, small) != BZ_OK) {
+		*err = "Failure opening bz2 archive";
+		return -1;
 	}
 
-	if ((bzerror != BZ2_MAGICLEN) || memcmp(buf, BZ2_MAGICSTR, BZ2_MAGICLEN)) {
+	uncompress = malloc(size);
+	if (uncompress == NULL) {
+		*err = "Failure allocating memory";
 		goto exit;
 	}
 
-	b = BZ2_bzReadOpen ( &bzerror, f, 0, sh->conf->bzip_small, NULL, 0 );
-	if ( bzerror != BZ_OK ) {
-		ERR(sh, "Failure opening bz2 archive.");
+	strm.next_in = (char *)in;
+	strm.avail_in = in_len;
+
+	do {
+		if (total == size) {
+			size *= 2;
+			tmpalloc = realloc(uncompress, size);
+			if (tmpalloc == NULL) {
+				*err = "Failure allocating memory";
+				goto exit;
+			}
+			uncompress = tmpalloc;
+		}
+
+		avail = size - total;
+		if (avail > UINT_MAX)
+			avail = UINT_MAX;
+		strm.next_out = (char *)&uncompress[total];
+		strm.avail_out = avail;
+
+		bzerror = BZ2_bzDecompress(&strm);
+		total += avail - strm.avail_out;
+
+		/* Input exhausted before the end of the stream. */
+		if (bzerror == BZ_OK && strm.avail_in == 0 && strm.avail_out != 0)
+			bzerror = BZ_UNEXPECTED_EOF;
+	} while (bzerror == BZ_OK);
+
+	if (bzerror != BZ_STREAM_END) {
+		*err = "Failure reading bz2 archive";
 		goto exit;
 	}
 
+	ret = total;
+	*data = uncompress;
+
+exit:
+	BZ2_bzDecompressEnd(&strm);
+	if (ret < 0) {
+		free(uncompress);
+	}
+	return ret;
+}
+
+#ifdef USE_ZSTD
+/* unzstd() a buffer to '*data', returning the total number of uncompressed
+ * bytes. Returns -1 and sets '*err' if the data could not be decompressed. */
+static ssize_t unzstd(const void *in, size_t in_len, void **data, const char **err)
+{
+	ZSTD_DStream *stream;
+	ZSTD_inBuffer input = { in, in_len, 0 };
+	ZSTD_outBuffer output;
+	unsigned long long content_size;
+	size_t size = 1<<18;
+	size_t total = 0;
+	size_t rc;
+	uint8_t *uncompress = NULL;
+	uint8_t *tmpalloc = NULL;
+	ssize_t ret = -1;
+
+	/* Files written by libsemanage record their size, so usually a
+	 * single allocation is enough. */
+	content_size = ZSTD_getFrameContentSize(in, in_len);
+	if (content_size != ZSTD_CONTENTSIZE_ERROR &&
+	    content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+	    content_size > 0 && content_size < SSIZE_MAX)
+		size = content_size;
+
+	stream = ZSTD_createDStream();
+	if (stream == NULL) {
+		*err = "Failure allocating memory";
+		return -1;
+	}
+	ZSTD_initDStream(stream);
+
 	uncompress = malloc(size);
 	if (uncompress == NULL) {
-		ERR(sh, "Failure allocating memory.");
+		*err = "Failure allocating memory";
 		goto exit;
 	}
 
-	while ( bzerror == BZ_OK) {
-		nBuf = BZ2_bzRead ( &bzerror, b, buf, bufsize);
-		if (( bzerror == BZ_OK ) || ( bzerror == BZ_STREAM_END )) {
-			if (total + nBuf > size) {
-				size *= 2;
-				tmpalloc = realloc(uncompress, size);
-				if (tmpalloc == NULL) {
-					ERR(sh, "Failure allocating memory.");
-					goto exit;
-				}
-				uncompress = tmpalloc;
+	for (;;) {
+		if (total == size) {
+			size *= 2;
+			tmpalloc = realloc(uncompress, size);
+			if (tmpalloc == NULL) {
+				*err = "Failure allocating memory";
+				goto exit;
 			}
-			memcpy(&uncompress[total], buf, nBuf);
-			total += nBuf;
+			uncompress = tmpalloc;
+		}
+
+		output.dst = uncompress;
+		output.size = size;
+		output.pos = total;
+
+		rc = ZSTD_decompressStream(stream, &output, &input);
+		if (ZSTD_isError(rc)) {
+			*err = "Failure reading zstd archive";
+			goto exit;
+		}
+		total = output.pos;
+
+		if (rc == 0 && input.pos == input.size)
+			break;
+
+		/* Input exhausted before the end of the frame. */
+		if (input.pos == input.size && output.pos < output.size) {
+			*err = "Failure reading zstd archive";
+			goto exit;
 		}
-	}
-	if ( bzerror != BZ_STREAM_END ) {
-		ERR(sh, "Failure reading bz2 archive.");
-		goto exit;
 	}
 
 	ret = total;
 	*data = uncompress;
 
 exit:
-	BZ2_bzReadClose ( &bzerror, b );
-	free(buf);
-	if ( ret < 0 ) {
+	ZSTD_freeDStream(stream);
+	if (ret < 0) {
 		free(uncompress);
 	}
 	return ret;
 }
+#endif
 
-int map_compressed_file(semanage_handle_t *sh, const char *path,
-			struct file_contents *contents)
+int read_compressed_file(const char *path, int bzip_small,
+			 struct file_contents *contents, const char **err)
 {
 	ssize_t size = -1;
-	void *uncompress;
-	int ret = 0, fd = -1;
-	FILE *file = NULL;
+	void *map, *uncompress = NULL;
+	struct stat sb;
+	int fd;
 
 	fd = open(path, O_RDONLY | O_CLOEXEC);
 	if (fd == -1) {
-		ERR(sh, "Unable to open %s.", path);
+		*err = "Unable to open";
 		return -1;
 	}
 
-	file = fdopen(fd, "r");
-	if (file == NULL) {
-		ERR(sh, "Unable to open %s.", path);
+	if (fstat(fd, &sb) == -1 ||
+	    (map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+	    MAP_FAILED) {
+		*err = "Unable to read";
 		close(fd);
 		return -1;
 	}
+	close(fd);
 
-	if ((size = bunzip(sh, file, &uncompress)) >= 0) {
-		contents->data = uncompress;
-		contents->len = size;
-		contents->compressed = 1;
+	if ((size_t)sb.st_size >= BZ2_MAGICLEN &&
+	    !memcmp(map, BZ2_MAGICSTR, BZ2_MAGICLEN)) {
+		size = bunzip(map, sb.st_size, bzip_small, &uncompress, err);
+	} else if ((size_t)sb.st_size >= ZSTD_MAGICLEN &&
+		   !memcmp(map, ZSTD_MAGICSTR, ZSTD_MAGICLEN)) {
+#ifdef USE_ZSTD
+		size = unzstd(map, sb.st_size, &uncompress, err);
+#else
+		*err = "zstd compressed file, but zstd support is not available";
+#endif
 	} else {
-		struct stat sb;
-		if (fstat(fd, &sb) == -1 ||
-		    (uncompress = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
-		    MAP_FAILED) {
-			ret = -1;
-		} else {
-			contents->data = uncompress;
-			contents->len = sb.st_size;
-			contents->compressed = 0;
-		}
+		contents->data = map;
+		contents->len = sb.st_size;
+		contents->compressed = 0;
+		return 0;
 	}
-	fclose(file);
-	return ret;
+
+	munmap(map, sb.st_size);
+	if (size < 0)
+		return -1;
+
+	contents->data = uncompress;
+	contents->len = size;
+	contents->compressed = 1;
+	return 0;
+}
+
+int map_compressed_file(semanage_handle_t *sh, const char *path,
+			struct file_contents *contents)
+{
+	const char *err = NULL;
+
+	if (read_compressed_file(path, sh->conf->bzip_small, contents, &err) < 0) {
+		ERR(sh, "%s %s.", err, path);
+		return -1;
+	}
+
+	return 0;
 }
 
 void unmap_compressed_file(struct file_contents *contents)
@@ -225,5 +382,20 @@ void unmap_compressed_file(struct file_contents *contents)
 int write_compressed_file(semanage_handle_t *sh, const char *path,
 			  void *data, size_t len)
 {
-	return bzip(sh, path, data, len);
+	/* Module files in the sandbox may be hard links into the active
+	 * store, so replace the file instead of writing into it. */
+	if (unlink(path) != 0 && errno != ENOENT)
+		return -1;
+
+	switch (sh->conf->compression) {
+#ifdef USE_ZSTD
+	case SEMANAGE_COMPRESS_ZSTD:
+		return zstd_compress(sh, path, data, len);
+#endif
+	case SEMANAGE_COMPRESS_NONE:
+		return write_plain(path, data, len);
+	case SEMANAGE_COMPRESS_BZIP2:
+	default:
+		return bzip(sh, path, data, len);
+	}
 }
@@ -37,7 +37,7 @@ struct file_contents {
 /**
  * Map/read a possibly-compressed file into memory.
  *
- * If the file is bzip compressed map_file will uncompress the file into
+ * If the file is compressed map_file will uncompress the file into
  * @p contents. The caller is responsible for calling
  * @ref unmap_compressed_file on @p contents on success.
  *
@@ -52,6 +52,24 @@ struct file_contents {
 int map_compressed_file(semanage_handle_t *sh, const char *path,
 			struct file_contents *contents);
 
+/**
+ * Map/read a possibly-compressed file into memory without reporting
+ * errors through a handle, so it can be used from several threads.
+ *
+ * Files compressed with bzip2 or zstd are recognized by their magic
+ * number, whatever compression the store is configured to write.
+ *
+ * @param path        path to the file
+ * @param bzip_small  whether to use the slower low memory bzip2 decoder
+ * @param contents    pointer to struct file_contents, see
+ *   @ref map_compressed_file
+ * @param err         set to a description of the failure on error
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int read_compressed_file(const char *path, int bzip_small,
+			 struct file_contents *contents, const char **err);
+
 /**
  * Destroy a previously mapped possibly-compressed file.
  *
@@ -63,7 +81,8 @@ int map_compressed_file(semanage_handle_t *sh, const char *path,
 void unmap_compressed_file(struct file_contents *contents);
 
 /**
- * Write bytes into a file, using compression if configured.
+ * Write bytes into a file, using the compression configured in
+ * semanage.conf (bzip2 by default, zstd or none).
  *
  * @param sh    semanage handle
  * @param path  path to the file
@@ -62,7 +62,8 @@ static int parse_errors;
 
 %token MODULE_STORE VERSION EXPAND_CHECK FILE_MODE SAVE_PREVIOUS SAVE_LINKED TARGET_PLATFORM COMPILER_DIR IGNORE_MODULE_CACHE STORE_ROOT OPTIMIZE_POLICY MULTIPLE_DECLS
 %token LOAD_POLICY_START SETFILES_START SEFCONTEXT_COMPILE_START DISABLE_GENHOMEDIRCON HANDLE_UNKNOWN USEPASSWD IGNOREDIRS
-%token BZIP_BLOCKSIZE BZIP_SMALL REMOVE_HLL
+%token GENHOMEDIRCON_SCALABLE
+%token BZIP_BLOCKSIZE BZIP_SMALL COMPRESSION ZSTD_LEVEL REMOVE_HLL COMPILER_JOBS
 %token VERIFY_MOD_START VERIFY_LINKED_START VERIFY_KERNEL_START BLOCK_END
 %token PROG_PATH PROG_ARGS
 %token <s> ARG
@@ -91,11 +92,15 @@ single_opt:     module_store
         |       save_linked
         |       disable_genhomedircon
         |       usepasswd
+        |       genhomedircon_scalable
         |       ignoredirs
         |       handle_unknown
 	|	bzip_blocksize
 	|	bzip_small
+	|	compression
+	|	zstd_level
 	|	remove_hll
+	|	compiler_jobs
 	|	optimize_policy
 	|	multiple_decls
         ;
@@ -238,6 +243,17 @@ usepasswd: USEPASSWD '=' ARG {
 	free($3);
  }
 
+genhomedircon_scalable: GENHOMEDIRCON_SCALABLE '=' ARG {
+	if (strcasecmp($3, "false") == 0) {
+		current_conf->genhomedircon_scalable = 0;
+	} else if (strcasecmp($3, "true") == 0) {
+		current_conf->genhomedircon_scalable = 1;
+	} else {
+		yyerror("genhomedircon-scalable can only be 'true' or 'false'");
+	}
+	free($3);
+ }
+
 ignoredirs: IGNOREDIRS '=' ARG {
 	current_conf->ignoredirs = strdup($3);
 	free($3);
@@ -279,6 +295,35 @@ bzip_small:  BZIP_SMALL '=' ARG {
 	free($3);
 }
 
+compression:  COMPRESSION '=' ARG {
+	if (strcasecmp($3, "bzip2") == 0) {
+		current_conf->compression = SEMANAGE_COMPRESS_BZIP2;
+	} else if (strcasecmp($3, "zstd") == 0) {
+#ifdef USE_ZSTD
+		current_conf->compression = SEMANAGE_COMPRESS_ZSTD;
+#else
+		yyerror("compression 'zstd' is not supported by this build of libsemanage");
+#endif
+	} else if (strcasecmp($3, "none") == 0) {
+		current_conf->compression = SEMANAGE_COMPRESS_NONE;
+	} else {
+		yyerror("compression can only be 'bzip2', 'zstd' or 'none'");
+	}
+	free($3);
+}
+
+zstd_level:  ZSTD_LEVEL '=' ARG {
+	char *endptr;
+	long value;
+	errno = 0;
+	value = strtol($3, &endptr, 10);
+	if (*endptr != '\0' || errno != 0 || value < 1 || value > 19)
+		yyerror("zstd-level can only be in the range 1-19");
+	else
+		current_conf->zstd_level = value;
+	free($3);
+}
+
 remove_hll:  REMOVE_HLL'=' ARG {
 	if (strcasecmp($3, "false") == 0) {
 		current_conf->remove_hll = 0;
@@ -290,6 +335,18 @@ remove_hll:  REMOVE_HLL'=' ARG {
 	free($3);
 }
 
+compiler_jobs:  COMPILER_JOBS '=' ARG {
+	char *endptr;
+	long value;
+	errno = 0;
+	value = strtol($3, &endptr, 10);
+	if (*endptr != '\0' || errno != 0 || value < 0 || value > 1024)
+		yyerror("compiler-jobs can only be in the range 0-1024");
+	else
+		current_conf->compiler_jobs = value;
+	free($3);
+}
+
 optimize_policy:  OPTIMIZE_POLICY '=' ARG {
 	if (strcasecmp($3, "false") == 0) {
 		current_conf->optimize_policy = 0;
@@ -337,6 +394,7 @@ command_start:
                                 parse_errors++;
                                 YYABORT;
                         }
+                        current_conf->setfiles_configured = 1;
                 }
         |       SEFCONTEXT_COMPILE_START {
                         semanage_conf_external_prog_destroy(current_conf->sefcontext_compile);
@@ -345,6 +403,7 @@ command_start:
                                 parse_errors++;
                                 YYABORT;
                         }
+                        current_conf->sefcontext_compile_configured = 1;
                 }
         ;
 
@@ -391,11 +450,15 @@ static int semanage_conf_init(semanage_conf_t * conf)
 	conf->expand_check = 1;
 	conf->handle_unknown = -1;
 	conf->usepasswd = 1;
+	conf->genhomedircon_scalable = 0;
 	conf->file_mode = 0644;
 	conf->bzip_blocksize = 9;
 	conf->bzip_small = 0;
+	conf->compression = SEMANAGE_COMPRESS_BZIP2;
+	conf->zstd_level = 3;
 	conf->ignore_module_cache = 0;
 	conf->remove_hll = 0;
+	conf->compiler_jobs = 0;
 	conf->optimize_policy = 1;
 	conf->multiple_decls = 1;
 
@@ -504,6 +567,7 @@ void semanage_conf_destroy(semanage_conf_t * conf)
 {
 	if (conf != NULL) {
 		free(conf->store_path);
+		free(conf->server_path);
 		free(conf->ignoredirs);
 		free(conf->store_root_path);
 		free(conf->compiler_directory_path);
@@ -529,9 +593,11 @@ int semanage_error(const char *msg)
  * store. The policy path will default to the active policy directory.
  * Otherwise if it begins with a forward slash interpret it as
  * an absolute path to a named socket, to which a policy server is
- * listening on the other end.	Otherwise treat it as the host name to
- * an external server; if there is a colon in the name then everything
- * after gives a port number.  The default port number is 4242.
+ * listening on the other end; the policy path then defaults to the
+ * active policy directory as for a direct store.  Otherwise treat it
+ * as the host name to an external server; if there is a colon in the
+ * name then everything after gives a port number.  The default port
+ * number is 4242.
  * Returns 0 on success, -1 if out of memory, -2 if a port number is
  * illegal.
  */
@@ -542,6 +608,8 @@ static int parse_module_store(char *arg)
 		return -1;
 	}
 	free(current_conf->store_path);
+	free(current_conf->server_path);
+	current_conf->server_path = NULL;
 	if (strcmp(arg, "direct") == 0) {
 		current_conf->store_type = SEMANAGE_CON_DIRECT;
 		current_conf->store_path =
@@ -549,7 +617,9 @@ static int parse_module_store(char *arg)
 		current_conf->server_port = -1;
 	} else if (*arg == '/') {
 		current_conf->store_type = SEMANAGE_CON_POLSERV_LOCAL;
-		current_conf->store_path = strdup(arg);
+		current_conf->store_path =
+		    strdup(basename(selinux_policy_root()));
+		current_conf->server_path = strdup(arg);
 		current_conf->server_port = -1;
 	} else {
 		char *s;
@@ -28,7 +28,8 @@ static int enter_ro(semanage_handle_t * handle, dbase_config_t * dconfig)
 		goto err;
 
 	if (!handle->is_in_transaction &&
-	    handle->conf->store_type == SEMANAGE_CON_DIRECT) {
+	    (handle->conf->store_type == SEMANAGE_CON_DIRECT ||
+	     handle->conf->store_type == SEMANAGE_CON_POLSERV_LOCAL)) {
 
 		if (semanage_get_active_lock(handle) < 0) {
 			ERR(handle, "could not get the active lock");
@@ -52,7 +53,8 @@ static inline int exit_ro(semanage_handle_t * handle)
 	int commit_num = handle->funcs->get_serial(handle);
 
 	if (!handle->is_in_transaction &&
-	    handle->conf->store_type == SEMANAGE_CON_DIRECT)
+	    (handle->conf->store_type == SEMANAGE_CON_DIRECT ||
+	     handle->conf->store_type == SEMANAGE_CON_POLSERV_LOCAL))
 		semanage_release_active_lock(handle);
 
 	return commit_num;
@@ -120,6 +122,57 @@ int dbase_del(semanage_handle_t * handle,
 	return STATUS_SUCCESS;
 }
 
+int dbase_modify_batch(semanage_handle_t * handle,
+		       dbase_config_t * dconfig,
+		       record_t * const *data, unsigned int count)
+{
+
+	const record_table_t *rtable;
+	record_key_t *key = NULL;
+	unsigned int i;
+
+	if (enter_rw(handle, dconfig) < 0)
+		return STATUS_ERR;
+
+	if (dconfig->dtable->modify_batch != NULL)
+		return dconfig->dtable->modify_batch(handle, dconfig->dbase,
+						     data, count);
+
+	rtable = dconfig->dtable->get_rtable(dconfig->dbase);
+	for (i = 0; i < count; i++) {
+		if (rtable->key_extract(handle, data[i], &key) < 0)
+			return STATUS_ERR;
+
+		if (dconfig->dtable->modify(handle, dconfig->dbase,
+					    key, data[i]) < 0) {
+			rtable->key_free(key);
+			return STATUS_ERR;
+		}
+
+		rtable->key_free(key);
+	}
+
+	return STATUS_SUCCESS;
+}
+
+int dbase_del_batch(semanage_handle_t * handle,
+		    dbase_config_t * dconfig,
+		    record_key_t * const *keys, unsigned int count)
+{
+
+	unsigned int i;
+
+	if (enter_rw(handle, dconfig) < 0)
+		return STATUS_ERR;
+
+	for (i = 0; i < count; i++) {
+		if (dconfig->dtable->del(handle, dconfig->dbase, keys[i]) < 0)
+			return STATUS_ERR;
+	}
+
+	return STATUS_SUCCESS;
+}
+
 int dbase_query(semanage_handle_t * handle,
 		dbase_config_t * dconfig,
 		const record_key_t * key, record_t ** response)
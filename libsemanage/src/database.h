@@ -52,6 +52,11 @@ typedef struct record_table {
 	/* Deallocate record resources. Must successfully handle NULL. */
 	void (*free) (record_t * rec);
 
+	/* Hash the key. Keys which compare equal to the same record
+	 * must hash to the same value. Optional, databases keep
+	 * an index of their cache by key if it is provided */
+	unsigned int (*hash) (const record_key_t * key);
+
 } record_table_t;
 
 /* DBASE interface - method table */
@@ -77,6 +82,15 @@ typedef struct dbase_table {
 		       dbase_t * dbase,
 		       const record_key_t * key, const record_t * data);
 
+	/* Same as above for count records, each under the key
+	 * extracted from it. Either all records are stored or, on
+	 * failure, none. Optional, dbase_modify_batch() calls modify
+	 * for each record if it is not provided, which keeps the
+	 * records before a failing one */
+	int (*modify_batch) (struct semanage_handle * handle,
+			     dbase_t * dbase,
+			     record_t * const *data, unsigned int count);
+
 	/* Modify the specified record in the database
 	 * if it is present. Fail if it does not yet exist
 	 */
@@ -195,6 +209,14 @@ extern int dbase_set(struct semanage_handle *handle,
 extern int dbase_del(struct semanage_handle *handle,
 		     dbase_config_t * dconfig, const record_key_t * key);
 
+extern int dbase_modify_batch(struct semanage_handle *handle,
+			      dbase_config_t * dconfig,
+			      record_t * const *data, unsigned int count);
+
+extern int dbase_del_batch(struct semanage_handle *handle,
+			   dbase_config_t * dconfig,
+			   record_key_t * const *keys, unsigned int count);
+
 extern int dbase_query(struct semanage_handle *handle,
 		       dbase_config_t * dconfig,
 		       const record_key_t * key, record_t ** response);
@@ -219,6 +219,7 @@ dbase_table_t const SEMANAGE_FILE_DTABLE = {
 	.del = (void *)dbase_llist_del,
 	.clear = (void *)dbase_llist_clear,
 	.modify = (void *)dbase_llist_modify,
+	.modify_batch = (void *)dbase_llist_modify_batch,
 	.query = (void *)dbase_llist_query,
 	.count = (void *)dbase_llist_count,
 
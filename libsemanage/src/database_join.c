@@ -294,6 +294,7 @@ const dbase_table_t SEMANAGE_JOIN_DTABLE = {
 	.del = (void *)dbase_llist_del,
 	.clear = (void *)dbase_llist_clear,
 	.modify = (void *)dbase_llist_modify,
+	.modify_batch = (void *)dbase_llist_modify_batch,
 	.query = (void *)dbase_llist_query,
 	.count = (void *)dbase_llist_count,
 
@@ -9,6 +9,7 @@ typedef struct dbase_llist dbase_t;
 #define DBASE_DEFINED
 
 #include <stdlib.h>
+#include <string.h>
 #include "debug.h"
 #include "handle.h"
 #include "database_llist.h"
@@ -33,29 +34,154 @@ int dbase_llist_needs_resync(semanage_handle_t * handle, dbase_llist_t * dbase)
 	return 0;
 }
 
-/* Helper for adding records to the cache */
-int dbase_llist_cache_prepend(semanage_handle_t * handle,
-			      dbase_llist_t * dbase, const record_t * data)
+/* Initial number of index buckets, must be a power of two */
+#define DBASE_LLIST_INDEX_MIN 64
+
+/* Helper for hashing the key of a record */
+static int dbase_llist_record_hash(semanage_handle_t * handle,
+				   dbase_llist_t * dbase,
+				   const record_t * data, unsigned int *hash)
 {
 
-	/* Initialize */
-	cache_entry_t *entry = (cache_entry_t *) malloc(sizeof(cache_entry_t));
-	if (entry == NULL)
-		goto omem;
+	record_key_t *key = NULL;
 
-	if (dbase->rtable->clone(handle, data, &entry->data) < 0)
-		goto err;
+	if (dbase->rtable->key_extract(handle, data, &key) < 0)
+		return STATUS_ERR;
+
+	*hash = dbase->rtable->hash(key);
+	dbase->rtable->key_free(key);
+	return STATUS_SUCCESS;
+}
+
+static void dbase_llist_index_insert(dbase_llist_t * dbase,
+				     cache_entry_t * entry)
+{
+
+	cache_entry_t **bucket =
+	    &dbase->index[entry->hash & (dbase->index_sz - 1)];
+
+	entry->index_next = *bucket;
+	*bucket = entry;
+}
+
+/* Rechain all entries, from the oldest to the newest */
+static void dbase_llist_index_rebuild(dbase_llist_t * dbase)
+{
+
+	cache_entry_t *ptr;
+
+	memset(dbase->index, 0, dbase->index_sz * sizeof(cache_entry_t *));
+	for (ptr = dbase->cache_tail; ptr != NULL; ptr = ptr->prev)
+		dbase_llist_index_insert(dbase, ptr);
+}
+
+static void dbase_llist_index_remove(dbase_llist_t * dbase,
+				     cache_entry_t * entry)
+{
+
+	cache_entry_t **ptr =
+	    &dbase->index[entry->hash & (dbase->index_sz - 1)];
+
+	while (*ptr != entry)
+		ptr = &(*ptr)->index_next;
+	*ptr = entry->index_next;
+}
+
+/* Grow the index to at least min_sz buckets */
+static int dbase_llist_index_grow(semanage_handle_t * handle,
+				  dbase_llist_t * dbase, unsigned int min_sz)
+{
+
+	cache_entry_t **old_index = dbase->index;
+	unsigned int i, old_sz = dbase->index_sz;
+	cache_entry_t *ptr, *next, *rev;
+
+	if (old_sz >= min_sz)
+		return STATUS_SUCCESS;
+
+	dbase->index_sz = old_sz ? old_sz : DBASE_LLIST_INDEX_MIN;
+	while (dbase->index_sz < min_sz)
+		dbase->index_sz *= 2;
+	dbase->index = calloc(dbase->index_sz, sizeof(cache_entry_t *));
+	if (dbase->index == NULL) {
+		dbase->index = old_index;
+		dbase->index_sz = old_sz;
+		ERR(handle, "out of memory");
+		return STATUS_ERR;
+	}
+
+	for (i = 0; i < old_sz; i++) {
+
+		/* Reverse the chain, so that reinserting at the
+		 * head keeps the newest entries first */
+		rev = NULL;
+		for (ptr = old_index[i]; ptr != NULL; ptr = next) {
+			next = ptr->index_next;
+			ptr->index_next = rev;
+			rev = ptr;
+		}
+
+		for (ptr = rev; ptr != NULL; ptr = next) {
+			next = ptr->index_next;
+			dbase_llist_index_insert(dbase, ptr);
+		}
+	}
+
+	free(old_index);
+	return STATUS_SUCCESS;
+}
+
+static void dbase_llist_index_free(dbase_llist_t * dbase)
+{
+
+	free(dbase->index);
+	dbase->index = NULL;
+	dbase->index_sz = 0;
+}
+
+/* Helper for linking a new entry at the head of the cache,
+ * the index must already have room for it */
+static void dbase_llist_cache_link(dbase_llist_t * dbase,
+				   cache_entry_t * entry)
+{
 
 	entry->prev = NULL;
 	entry->next = dbase->cache;
 
-	/* Link */
 	if (dbase->cache != NULL)
 		dbase->cache->prev = entry;
 	if (dbase->cache_tail == NULL)
 		dbase->cache_tail = entry;
 	dbase->cache = entry;
 	dbase->cache_sz++;
+	if (dbase->index != NULL)
+		dbase_llist_index_insert(dbase, entry);
+}
+
+/* Helper for adding records to the cache */
+int dbase_llist_cache_prepend(semanage_handle_t * handle,
+			      dbase_llist_t * dbase, const record_t * data)
+{
+
+	/* Initialize */
+	cache_entry_t *entry = (cache_entry_t *) malloc(sizeof(cache_entry_t));
+	if (entry == NULL)
+		goto omem;
+
+	if (dbase->rtable->hash != NULL) {
+		if (dbase_llist_index_grow(handle, dbase,
+					   dbase->cache_sz + 1) < 0)
+			goto err;
+
+		if (dbase_llist_record_hash(handle, dbase, data,
+					    &entry->hash) < 0)
+			goto err;
+	}
+
+	if (dbase->rtable->clone(handle, data, &entry->data) < 0)
+		goto err;
+
+	dbase_llist_cache_link(dbase, entry);
 	return STATUS_SUCCESS;
 
       omem:
@@ -73,6 +199,8 @@ void dbase_llist_drop_cache(dbase_llist_t * dbase)
 	if (dbase->cache_serial < 0)
 		return;
 
+	dbase_llist_index_free(dbase);
+
 	cache_entry_t *prev, *ptr = dbase->cache;
 	while (ptr != NULL) {
 		prev = ptr;
@@ -98,6 +226,36 @@ int dbase_llist_set_serial(semanage_handle_t * handle, dbase_llist_t * dbase)
 	return STATUS_SUCCESS;
 }
 
+/* Helper for finding the first record matching key in the cache */
+static cache_entry_t *dbase_llist_cache_find(dbase_llist_t * dbase,
+					     const record_key_t * key)
+{
+
+	cache_entry_t *ptr;
+	unsigned int hash;
+
+	if (dbase->cache == NULL)
+		return NULL;
+
+	if (dbase->index != NULL) {
+		hash = dbase->rtable->hash(key);
+		for (ptr = dbase->index[hash & (dbase->index_sz - 1)];
+		     ptr != NULL; ptr = ptr->index_next) {
+			if (ptr->hash == hash &&
+			    !dbase->rtable->compare(ptr->data, key))
+				return ptr;
+		}
+		return NULL;
+	}
+
+	for (ptr = dbase->cache; ptr != NULL; ptr = ptr->next) {
+		if (!dbase->rtable->compare(ptr->data, key))
+			return ptr;
+	}
+
+	return NULL;
+}
+
 /* Helper for finding records in the cache */
 static int dbase_llist_cache_locate(semanage_handle_t * handle,
 				    dbase_llist_t * dbase,
@@ -111,20 +269,58 @@ static int dbase_llist_cache_locate(semanage_handle_t * handle,
 	if (dbase->dtable->cache(handle, dbase) < 0)
 		goto err;
 
-	for (ptr = dbase->cache; ptr != NULL; ptr = ptr->next) {
-		if (!dbase->rtable->compare(ptr->data, key)) {
-			*entry = ptr;
-			return STATUS_SUCCESS;
-		}
-	}
+	ptr = dbase_llist_cache_find(dbase, key);
+	if (ptr == NULL)
+		return STATUS_NODATA;
 
-	return STATUS_NODATA;
+	*entry = ptr;
+	return STATUS_SUCCESS;
 
       err:
 	ERR(handle, "could not complete cache lookup");
 	return STATUS_ERR;
 }
 
+/* Helper for storing a cloned record, with the given key hash,
+ * in place of the record of a cache entry */
+static void dbase_llist_cache_store(dbase_llist_t * dbase,
+				    cache_entry_t * entry,
+				    record_t * data, unsigned int hash)
+{
+
+	dbase->rtable->free(entry->data);
+	entry->data = data;
+
+	/* The new record need not have the key it was stored under. As
+	 * its position in the new chain depends on the list order, rebuild
+	 * the index in that rare case */
+	if (dbase->index != NULL && hash != entry->hash) {
+		entry->hash = hash;
+		dbase_llist_index_rebuild(dbase);
+	}
+}
+
+/* Helper for replacing the record of a cache entry */
+static int dbase_llist_cache_replace(semanage_handle_t * handle,
+				     dbase_llist_t * dbase,
+				     cache_entry_t * entry,
+				     const record_t * data)
+{
+
+	record_t *tmp = NULL;
+	unsigned int hash = 0;
+
+	if (dbase->index != NULL &&
+	    dbase_llist_record_hash(handle, dbase, data, &hash) < 0)
+		return STATUS_ERR;
+
+	if (dbase->rtable->clone(handle, data, &tmp) < 0)
+		return STATUS_ERR;
+
+	dbase_llist_cache_store(dbase, entry, tmp, hash);
+	return STATUS_SUCCESS;
+}
+
 int dbase_llist_exists(semanage_handle_t * handle,
 		       dbase_llist_t * dbase,
 		       const record_key_t * key, int *response)
@@ -162,6 +358,88 @@ int dbase_llist_add(semanage_handle_t * handle,
 	return STATUS_ERR;
 }
 
+int dbase_llist_modify_batch(semanage_handle_t * handle,
+			     dbase_llist_t * dbase,
+			     record_t * const *data, unsigned int count)
+{
+
+	record_key_t **keys = NULL;
+	cache_entry_t **staged = NULL;
+	cache_entry_t *entry;
+	unsigned int i;
+	int status = STATUS_ERR;
+
+	/* Implemented in parent */
+	if (dbase->dtable->cache(handle, dbase) < 0)
+		goto err;
+
+	keys = calloc(count, sizeof(record_key_t *));
+	staged = calloc(count, sizeof(cache_entry_t *));
+	if (count > 0 && (keys == NULL || staged == NULL))
+		goto omem;
+
+	/* Extract the keys and clone the records before touching
+	 * the cache, so that a failure leaves it unmodified */
+	for (i = 0; i < count; i++) {
+		if (dbase->rtable->key_extract(handle, data[i], &keys[i]) < 0)
+			goto cleanup;
+
+		staged[i] = calloc(1, sizeof(cache_entry_t));
+		if (staged[i] == NULL)
+			goto omem;
+
+		if (dbase->rtable->hash != NULL)
+			staged[i]->hash = dbase->rtable->hash(keys[i]);
+
+		if (dbase->rtable->clone(handle, data[i], &staged[i]->data) < 0)
+			goto cleanup;
+	}
+
+	if (dbase->rtable->hash != NULL &&
+	    dbase_llist_index_grow(handle, dbase, dbase->cache_sz + count) < 0)
+		goto cleanup;
+
+	/* Nothing below can fail. Look each key up only now, as a batch
+	 * may contain the same key more than once */
+	for (i = 0; i < count; i++) {
+		entry = dbase_llist_cache_find(dbase, keys[i]);
+		if (entry == NULL) {
+			dbase_llist_cache_link(dbase, staged[i]);
+		} else {
+			dbase_llist_cache_store(dbase, entry, staged[i]->data,
+						staged[i]->hash);
+			free(staged[i]);
+		}
+		staged[i] = NULL;
+		dbase->modified = 1;
+	}
+
+	status = STATUS_SUCCESS;
+	goto cleanup;
+
+      omem:
+	ERR(handle, "out of memory");
+
+      cleanup:
+	for (i = 0; i < count; i++) {
+		if (keys != NULL && keys[i] != NULL)
+			dbase->rtable->key_free(keys[i]);
+		if (staged != NULL && staged[i] != NULL) {
+			if (staged[i]->data != NULL)
+				dbase->rtable->free(staged[i]->data);
+			free(staged[i]);
+		}
+	}
+	free(keys);
+	free(staged);
+	if (status == STATUS_SUCCESS)
+		return status;
+
+      err:
+	ERR(handle, "could not modify record values");
+	return STATUS_ERR;
+}
+
 int dbase_llist_set(semanage_handle_t * handle,
 		    dbase_llist_t * dbase,
 		    const record_key_t * key, const record_t * data)
@@ -177,8 +455,7 @@ int dbase_llist_set(semanage_handle_t * handle,
 		ERR(handle, "record not found in the database");
 		goto err;
 	} else {
-		dbase->rtable->free(entry->data);
-		if (dbase->rtable->clone(handle, data, &entry->data) < 0)
+		if (dbase_llist_cache_replace(handle, dbase, entry, data) < 0)
 			goto err;
 	}
 
@@ -205,8 +482,7 @@ int dbase_llist_modify(semanage_handle_t * handle,
 		if (dbase_llist_cache_prepend(handle, dbase, data) < 0)
 			goto err;
 	} else {
-		dbase->rtable->free(entry->data);
-		if (dbase->rtable->clone(handle, data, &entry->data) < 0)
+		if (dbase_llist_cache_replace(handle, dbase, entry, data) < 0)
 			goto err;
 	}
 
@@ -278,29 +554,28 @@ int dbase_llist_del(semanage_handle_t * handle __attribute__ ((unused)),
 		    dbase_llist_t * dbase, const record_key_t * key)
 {
 
-	cache_entry_t *ptr, *prev = NULL;
+	cache_entry_t *ptr = dbase_llist_cache_find(dbase, key);
 
-	for (ptr = dbase->cache; ptr != NULL; ptr = ptr->next) {
-		if (!dbase->rtable->compare(ptr->data, key)) {
-			if (prev != NULL)
-				prev->next = ptr->next;
-			else
-				dbase->cache = ptr->next;
-
-			if (ptr->next != NULL)
-				ptr->next->prev = ptr->prev;
-			else
-				dbase->cache_tail = ptr->prev;
-
-			dbase->rtable->free(ptr->data);
-			dbase->cache_sz--;
-			free(ptr);
-			dbase->modified = 1;
-			return STATUS_SUCCESS;
-		} else
-			prev = ptr;
-	}
+	if (ptr == NULL)
+		return STATUS_SUCCESS;
 
+	if (ptr->prev != NULL)
+		ptr->prev->next = ptr->next;
+	else
+		dbase->cache = ptr->next;
+
+	if (ptr->next != NULL)
+		ptr->next->prev = ptr->prev;
+	else
+		dbase->cache_tail = ptr->prev;
+
+	if (dbase->index != NULL)
+		dbase_llist_index_remove(dbase, ptr);
+
+	dbase->rtable->free(ptr->data);
+	dbase->cache_sz--;
+	free(ptr);
+	dbase->modified = 1;
 	return STATUS_SUCCESS;
 }
 
@@ -324,6 +599,7 @@ int dbase_llist_clear(semanage_handle_t * handle, dbase_llist_t * dbase)
 		}
 	}
 
+	dbase_llist_index_free(dbase);
 	dbase->cache = NULL;
 	dbase->cache_tail = NULL;
 	dbase->cache_sz = 0;
@@ -11,6 +11,10 @@ typedef struct cache_entry {
 	record_t *data;
 	struct cache_entry *prev;
 	struct cache_entry *next;
+
+	/* Index chain, only used if the record table can hash keys */
+	struct cache_entry *index_next;
+	unsigned int hash;
 } cache_entry_t;
 
 /* LLIST dbase */
@@ -24,6 +28,11 @@ typedef struct dbase_llist {
 	cache_entry_t *cache;
 	cache_entry_t *cache_tail;
 
+	/* Hash index of the cache by record key, newest entries
+	 * first in each chain, as in the list */
+	cache_entry_t **index;
+	unsigned int index_sz;
+
 	unsigned int cache_sz;
 	int cache_serial;
 	int modified;
@@ -36,6 +45,8 @@ static inline void dbase_llist_cache_init(dbase_llist_t * dbase)
 
 	dbase->cache = NULL;
 	dbase->cache_tail = NULL;
+	dbase->index = NULL;
+	dbase->index_sz = 0;
 	dbase->cache_sz = 0;
 	dbase->cache_serial = -1;
 	dbase->modified = 0;
@@ -98,6 +109,11 @@ extern int dbase_llist_modify(semanage_handle_t * handle,
 			      dbase_llist_t * dbase,
 			      const record_key_t * key, const record_t * data);
 
+extern int dbase_llist_modify_batch(semanage_handle_t * handle,
+				    dbase_llist_t * dbase,
+				    record_t * const *data,
+				    unsigned int count);
+
 extern int dbase_llist_count(semanage_handle_t * handle,
 			     dbase_llist_t * dbase, unsigned int *response);
 
@@ -26,6 +26,7 @@
 
 #include <assert.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdio_ext.h>
 #include <stdlib.h>
@@ -55,6 +56,7 @@
 #include "compressed_file.h"
 #include "modules.h"
 #include "direct_api.h"
+#include "polserv.h"
 #include "semanage_store.h"
 #include "database_policydb.h"
 #include "policy.h"
@@ -65,7 +67,6 @@
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
 static void semanage_direct_destroy(semanage_handle_t * sh);
-static int semanage_direct_disconnect(semanage_handle_t * sh);
 static int semanage_direct_begintrans(semanage_handle_t * sh);
 static int semanage_direct_commit(semanage_handle_t * sh);
 static int semanage_direct_install(semanage_handle_t * sh, char *data,
@@ -123,6 +124,28 @@ static const struct semanage_policy_table direct_funcs = {
 	.remove_key = semanage_direct_remove_key,
 };
 
+/* A local policy server connection works on the store directly, except
+ * that the transaction lock is held and the commit is done by the
+ * server. */
+static const struct semanage_policy_table polserv_funcs = {
+	.get_serial = semanage_direct_get_serial,
+	.destroy = semanage_direct_destroy,
+	.disconnect = semanage_polserv_disconnect,
+	.begin_trans = semanage_polserv_begintrans,
+	.commit = semanage_polserv_commit,
+	.install = semanage_direct_install,
+	.extract = semanage_direct_extract,
+	.install_file = semanage_direct_install_file,
+	.remove = semanage_direct_remove,
+	.list = semanage_direct_list,
+	.get_enabled = semanage_direct_get_enabled,
+	.set_enabled = semanage_direct_set_enabled,
+	.get_module_info = semanage_direct_get_module_info,
+	.list_all = semanage_direct_list_all,
+	.install_info = semanage_direct_install_info,
+	.remove_key = semanage_direct_remove_key,
+};
+
 int semanage_direct_is_managed(semanage_handle_t * sh)
 {
 	if (semanage_check_init(sh, sh->conf->store_root_path))
@@ -154,9 +177,14 @@ int semanage_direct_connect(semanage_handle_t * sh)
 
 	sh->u.direct.translock_file_fd = -1;
 	sh->u.direct.activelock_file_fd = -1;
+	sh->u.direct.server_fd = -1;
+	sh->u.direct.policydb = NULL;
 
 	/* set up function pointers */
-	sh->funcs = &direct_funcs;
+	if (sh->conf->store_type == SEMANAGE_CON_POLSERV_LOCAL)
+		sh->funcs = &polserv_funcs;
+	else
+		sh->funcs = &direct_funcs;
 
 	/* Object databases: local modifications */
 	if (user_base_file_dbase_init(sh,
@@ -337,8 +365,7 @@ static int semanage_remove_tmps(semanage_handle_t *sh)
 		return 0;
 
 	/* destroy sandbox if it exists */
-	if (semanage_remove_directory
-	    (semanage_path(SEMANAGE_TMP, SEMANAGE_TOPLEVEL)) < 0) {
+	if (semanage_remove_sandbox(sh) < 0) {
 		if (errno != ENOENT) {
 			ERR(sh, "Could not cleanly remove sandbox %s.",
 			    semanage_path(SEMANAGE_TMP, SEMANAGE_TOPLEVEL));
@@ -361,7 +388,16 @@ static int semanage_remove_tmps(semanage_handle_t *sh)
 	return 0;
 }
 
-static int semanage_direct_disconnect(semanage_handle_t *sh)
+void semanage_direct_abort(semanage_handle_t *sh)
+{
+	/* remove tmp files if no commit error */
+	(void) semanage_remove_tmps(sh);
+	semanage_release_trans_lock(sh);
+	sh->is_in_transaction = 0;
+	sh->modules_modified = 0;
+}
+
+int semanage_direct_disconnect(semanage_handle_t *sh)
 {
 	int retval = 0;
 
@@ -371,6 +407,9 @@ static int semanage_direct_disconnect(semanage_handle_t *sh)
 		semanage_release_trans_lock(sh);
 	}
 
+	sepol_policydb_free(sh->u.direct.policydb);
+	sh->u.direct.policydb = NULL;
+
 	/* Release object databases: local modifications */
 	user_base_file_dbase_release(semanage_user_base_dbase_local(sh));
 	user_extra_file_dbase_release(semanage_user_extra_dbase_local(sh));
@@ -583,69 +622,48 @@ cleanup:
 	return retval;
 }
 
-static int read_from_pipe_to_data(semanage_handle_t *sh, size_t initial_len, int fd, char **out_data_read, size_t *out_read_len)
-{
-	size_t max_len = initial_len;
-	ssize_t read_len;
-	size_t data_read_len = 0;
-	char *data_read = NULL;
-
-	if (max_len <= 0) {
-		max_len = 1;
-	}
-	data_read = malloc(max_len * sizeof(*data_read));
-	if (data_read == NULL) {
-		ERR(sh, "Failed to malloc, out of memory.");
-		return -1;
-	}
+/* A running HLL compiler. The module is written to its stdin while its
+ * stdout and stderr are collected; several compilers can be driven at
+ * once from a single poll() loop, see semanage_compile_modules().
+ */
+struct semanage_pipe_buf {
+	char *data;
+	size_t len;
+	size_t alloc;
+};
 
-	while ((read_len = read(fd, data_read + data_read_len, max_len - data_read_len)) > 0) {
-		data_read_len += read_len;
-		if (data_read_len == max_len) {
-			char *tmp;
+struct semanage_pipe_job {
+	pid_t pid;
+	int fds[3];	/* stdin (write end), stdout and stderr (read ends) */
+	const char *in_data;
+	size_t in_data_len;
+	size_t in_off;
+	struct semanage_pipe_buf out;
+	struct semanage_pipe_buf err;
+	int failed;
+};
 
-			max_len *= 2;
-			tmp = realloc(data_read, max_len);
-			if (tmp == NULL) {
-				ERR(sh, "Failed to realloc, out of memory.");
-				free(data_read);
-				return -1;
-			}
-			data_read = tmp;
-		}
+static void semanage_pipe_close(struct semanage_pipe_job *job, int which)
+{
+	if (job->fds[which] != -1) {
+		close(job->fds[which]);
+		job->fds[which] = -1;
 	}
+}
 
-	*out_read_len = data_read_len;
-	*out_data_read = data_read;
-
-	return 0;
+static int semanage_pipe_done(const struct semanage_pipe_job *job)
+{
+	return job->fds[0] == -1 && job->fds[1] == -1 && job->fds[2] == -1;
 }
 
-static int semanage_pipe_data(semanage_handle_t *sh, const char *path, const char *in_data, size_t in_data_len, char **out_data, size_t *out_data_len, char **err_data, size_t *err_data_len)
+static int semanage_pipe_start(semanage_handle_t *sh, const char *path, const char *in_data, size_t in_data_len, struct semanage_pipe_job *job)
 {
 	int input_fd[2] = {-1, -1};
 	int output_fd[2] = {-1, -1};
 	int err_fd[2] = {-1, -1};
 	pid_t pid;
-	char *data_read = NULL;
-	char *err_data_read = NULL;
 	int retval;
-	int status = 0;
-	size_t initial_len;
-	size_t data_read_len = 0;
-	size_t err_data_read_len = 0;
-	struct sigaction old_signal;
-	struct sigaction new_signal;
-	new_signal.sa_handler = SIG_IGN;
-	sigemptyset(&new_signal.sa_mask);
-	new_signal.sa_flags = 0;
-	/* This is needed in case the read end of input_fd is closed causing a SIGPIPE signal to be sent.
-	 * If SIGPIPE is not caught, the signal will cause semanage to terminate immediately. The sigaction below
-	 * creates a new_signal that ignores SIGPIPE allowing the write to exit cleanly.
-	 *
-	 * Another sigaction is called in cleanup to restore the original behavior when a SIGPIPE is received.
-	 */
-	sigaction(SIGPIPE, &new_signal, &old_signal);
+	int i;
 
 	retval = pipe2(input_fd, O_CLOEXEC);
 	if (retval == -1) {
@@ -669,147 +687,185 @@ static int semanage_pipe_data(semanage_handle_t *sh, const char *path, const cha
 		retval = -1;
 		goto cleanup;
 	} else if (pid == 0) {
-		retval = dup2(input_fd[PIPE_READ], STDIN_FILENO);
-		if (retval == -1) {
+		if (dup2(input_fd[PIPE_READ], STDIN_FILENO) == -1) {
 			ERR(sh, "Unable to dup2 input pipe.");
-			goto cleanup;
+			_exit(EXIT_FAILURE);
 		}
-		retval = dup2(output_fd[PIPE_WRITE], STDOUT_FILENO);
-		if (retval == -1) {
+		if (dup2(output_fd[PIPE_WRITE], STDOUT_FILENO) == -1) {
 			ERR(sh, "Unable to dup2 output pipe.");
-			goto cleanup;
+			_exit(EXIT_FAILURE);
 		}
-		retval = dup2(err_fd[PIPE_WRITE], STDERR_FILENO);
-		if (retval == -1) {
+		if (dup2(err_fd[PIPE_WRITE], STDERR_FILENO) == -1) {
 			ERR(sh, "Unable to dup2 error pipe.");
-			goto cleanup;
-		}
-
-		retval = close(input_fd[PIPE_WRITE]);
-		if (retval == -1) {
-			ERR(sh, "Unable to close input pipe.");
-			goto cleanup;
-		}
-		retval = close(output_fd[PIPE_READ]);
-		if (retval == -1) {
-			ERR(sh, "Unable to close output pipe.");
-			goto cleanup;
-		}
-		retval = close(err_fd[PIPE_READ]);
-		if (retval == -1) {
-			ERR(sh, "Unable to close error pipe.");
-			goto cleanup;
-		}
-		retval = execl(path, path, NULL);
-		if (retval == -1) {
-			ERR(sh, "Unable to execute %s.", path);
 			_exit(EXIT_FAILURE);
 		}
-	} else {
-		retval = close(input_fd[PIPE_READ]);
-		input_fd[PIPE_READ] = -1;
-		if (retval == -1) {
-			ERR(sh, "Unable to close read end of input pipe.");
-			goto cleanup;
-		}
 
-		retval = close(output_fd[PIPE_WRITE]);
-		output_fd[PIPE_WRITE] = -1;
-		if (retval == -1) {
-			ERR(sh, "Unable to close write end of output pipe.");
-			goto cleanup;
-		}
+		/* All other pipe ends are closed on exec. */
+		execl(path, path, NULL);
+		ERR(sh, "Unable to execute %s.", path);
+		_exit(EXIT_FAILURE);
+	}
 
-		retval = close(err_fd[PIPE_WRITE]);
-		err_fd[PIPE_WRITE] = -1;
-		if (retval == -1) {
-			ERR(sh, "Unable to close write end of error pipe.");
-			goto cleanup;
-		}
+	retval = close(input_fd[PIPE_READ]);
+	input_fd[PIPE_READ] = -1;
+	if (retval == -1) {
+		ERR(sh, "Unable to close read end of input pipe.");
+		goto cleanup_child;
+	}
 
-		retval = write_full(input_fd[PIPE_WRITE], in_data, in_data_len);
-		if (retval == -1) {
-			ERR(sh, "Failed to write data to input pipe.");
-			goto cleanup;
-		}
-		retval = close(input_fd[PIPE_WRITE]);
-		input_fd[PIPE_WRITE] = -1;
-		if (retval == -1) {
-			ERR(sh, "Unable to close write end of input pipe.");
-			goto cleanup;
-		}
+	retval = close(output_fd[PIPE_WRITE]);
+	output_fd[PIPE_WRITE] = -1;
+	if (retval == -1) {
+		ERR(sh, "Unable to close write end of output pipe.");
+		goto cleanup_child;
+	}
 
-		initial_len = 1 << 17;
-		retval = read_from_pipe_to_data(sh, initial_len, output_fd[PIPE_READ], &data_read, &data_read_len);
-		if (retval != 0) {
-			goto cleanup;
-		}
-		retval = close(output_fd[PIPE_READ]);
-		output_fd[PIPE_READ] = -1;
-		if (retval == -1) {
-			ERR(sh, "Unable to close read end of output pipe.");
-			goto cleanup;
+	retval = close(err_fd[PIPE_WRITE]);
+	err_fd[PIPE_WRITE] = -1;
+	if (retval == -1) {
+		ERR(sh, "Unable to close write end of error pipe.");
+		goto cleanup_child;
+	}
+
+	job->pid = pid;
+	job->fds[0] = input_fd[PIPE_WRITE];
+	job->fds[1] = output_fd[PIPE_READ];
+	job->fds[2] = err_fd[PIPE_READ];
+	job->in_data = in_data;
+	job->in_data_len = in_data_len;
+	job->in_off = 0;
+	job->failed = 0;
+
+	for (i = 0; i < 3; i++) {
+		if (fcntl(job->fds[i], F_SETFL, O_NONBLOCK) == -1) {
+			ERR(sh, "Unable to make pipe non-blocking.");
+			job->failed = 1;
+			semanage_pipe_close(job, 0);
+			semanage_pipe_close(job, 1);
+			semanage_pipe_close(job, 2);
+			break;
 		}
+	}
 
-		initial_len = 1 << 9;
-		retval = read_from_pipe_to_data(sh, initial_len, err_fd[PIPE_READ], &err_data_read, &err_data_read_len);
-		if (retval != 0) {
-			goto cleanup;
-		}
-		retval = close(err_fd[PIPE_READ]);
-		err_fd[PIPE_READ] = -1;
-		if (retval == -1) {
-			ERR(sh, "Unable to close read end of error pipe.");
-			goto cleanup;
-		}
+	if (job->in_data_len == 0)
+		semanage_pipe_close(job, 0);
 
-		if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status)) {
-			ERR(sh, "Child process %s did not exit cleanly.", path);
-			retval = -1;
-			goto cleanup;
-		}
-		if (WEXITSTATUS(status) != 0) {
-			ERR(sh, "Child process %s failed with code: %d.", path, WEXITSTATUS(status));
-			retval = -1;
-			goto cleanup;
-		}
-	}
+	return 0;
 
-	retval = 0;
+cleanup_child:
+	/* Closing the pipes makes the child exit; reap it. */
+	for (i = 0; i < 2; i++) {
+		if (input_fd[i] != -1)
+			close(input_fd[i]);
+		if (output_fd[i] != -1)
+			close(output_fd[i]);
+		if (err_fd[i] != -1)
+			close(err_fd[i]);
+	}
+	waitpid(pid, NULL, 0);
+	return -1;
 
 cleanup:
-	sigaction(SIGPIPE, &old_signal, NULL);
+	for (i = 0; i < 2; i++) {
+		if (input_fd[i] != -1)
+			close(input_fd[i]);
+		if (output_fd[i] != -1)
+			close(output_fd[i]);
+		if (err_fd[i] != -1)
+			close(err_fd[i]);
+	}
+	return -1;
+}
 
-	if (data_read != NULL) {
-		*out_data = data_read;
-		*out_data_len = data_read_len;
-	}
+static int semanage_pipe_read(semanage_handle_t *sh, int fd, struct semanage_pipe_buf *buf, size_t initial_len)
+{
+	ssize_t read_len;
+	char *tmp;
 
-	if (err_data_read != NULL) {
-		*err_data = err_data_read;
-		*err_data_len = err_data_read_len;
-	}
+	for (;;) {
+		if (buf->len == buf->alloc) {
+			size_t alloc = buf->alloc ? buf->alloc * 2 : initial_len;
 
-	if (output_fd[PIPE_READ] != -1) {
-		close(output_fd[PIPE_READ]);
-	}
-	if (output_fd[PIPE_WRITE] != -1) {
-		close(output_fd[PIPE_WRITE]);
-	}
-	if (err_fd[PIPE_READ] != -1) {
-		close(err_fd[PIPE_READ]);
+			tmp = realloc(buf->data, alloc);
+			if (tmp == NULL) {
+				ERR(sh, "Failed to realloc, out of memory.");
+				return -1;
+			}
+			buf->data = tmp;
+			buf->alloc = alloc;
+		}
+
+		read_len = read(fd, buf->data + buf->len, buf->alloc - buf->len);
+		if (read_len > 0) {
+			buf->len += read_len;
+		} else if (read_len == 0) {
+			return 1;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return 0;
+		} else if (errno != EINTR) {
+			ERR(sh, "Failed to read data from pipe.");
+			return -1;
+		}
 	}
-	if (err_fd[PIPE_WRITE] != -1) {
-		close(err_fd[PIPE_WRITE]);
+}
+
+/* Moves data through one of the pipes of a job after poll() reported it
+ * as ready.
+ */
+static void semanage_pipe_io(semanage_handle_t *sh, struct semanage_pipe_job *job, int which)
+{
+	ssize_t written;
+	int retval;
+
+	switch (which) {
+	case 0:
+		written = write(job->fds[0], job->in_data + job->in_off,
+				job->in_data_len - job->in_off);
+		if (written > 0) {
+			job->in_off += written;
+			if (job->in_off == job->in_data_len)
+				semanage_pipe_close(job, 0);
+		} else if (written == -1 && errno != EAGAIN &&
+			   errno != EWOULDBLOCK && errno != EINTR) {
+			ERR(sh, "Failed to write data to input pipe.");
+			job->failed = 1;
+			semanage_pipe_close(job, 0);
+		}
+		break;
+	case 1:
+		retval = semanage_pipe_read(sh, job->fds[1], &job->out, 1 << 17);
+		if (retval != 0) {
+			if (retval < 0)
+				job->failed = 1;
+			semanage_pipe_close(job, 1);
+		}
+		break;
+	case 2:
+		retval = semanage_pipe_read(sh, job->fds[2], &job->err, 1 << 9);
+		if (retval != 0) {
+			if (retval < 0)
+				job->failed = 1;
+			semanage_pipe_close(job, 2);
+		}
+		break;
 	}
-	if (input_fd[PIPE_READ] != -1) {
-		close(input_fd[PIPE_READ]);
+}
+
+/* Reaps the compiler of a job whose pipes have all been closed. */
+static int semanage_pipe_finish(semanage_handle_t *sh, const char *path, struct semanage_pipe_job *job)
+{
+	int status = 0;
+
+	if (waitpid(job->pid, &status, 0) == -1 || !WIFEXITED(status)) {
+		ERR(sh, "Child process %s did not exit cleanly.", path);
+		return -1;
 	}
-	if (input_fd[PIPE_WRITE] != -1) {
-		close(input_fd[PIPE_WRITE]);
+	if (WEXITSTATUS(status) != 0) {
+		ERR(sh, "Child process %s failed with code: %d.", path, WEXITSTATUS(status));
+		return -1;
 	}
 
-	return retval;
+	return job->failed ? -1 : 0;
 }
 
 static int semanage_direct_write_langext(semanage_handle_t *sh,
@@ -829,6 +885,13 @@ static int semanage_direct_write_langext(semanage_handle_t *sh,
 		goto cleanup;
 	}
 
+	/* The file may be hard linked into the active store. */
+	if (unlink(fn) != 0 && errno != ENOENT) {
+		ERR(sh, "Unable to replace %s module ext file.", modinfo->name);
+		ret = -1;
+		goto cleanup;
+	}
+
 	fp = fopen(fn, "we");
 	if (fp == NULL) {
 		ERR(sh, "Unable to open %s module ext file.", modinfo->name);
@@ -879,27 +942,44 @@ static void update_checksum_with_bool(Sha256Context *context, bool b)
 	Sha256Update(context, &byte, 1);
 }
 
-static int semanage_compile_module(semanage_handle_t *sh,
-				   semanage_module_info_t *modinfo,
-				   Sha256Context *context)
-{
-	char cil_path[PATH_MAX];
+/* An HLL module to be compiled to CIL. If digest is not NULL, it receives
+ * the SHA-256 of the resulting CIL.
+ */
+struct semanage_compile_job {
+	semanage_module_info_t *modinfo;
+	SHA256_HASH *digest;
+
+	char *compiler_path;
 	char hll_path[PATH_MAX];
-	char *compiler_path = NULL;
-	char *cil_data = NULL;
-	char *err_data = NULL;
-	char *start = NULL;
-	char *end = NULL;
-	int status = 0;
-	size_t cil_data_len = 0;
-	size_t err_data_len = 0;
-	struct file_contents hll_contents = {};
+	struct file_contents hll_contents;
+	struct semanage_pipe_job pipe;
+};
+
+static void semanage_compile_job_release(struct semanage_compile_job *job)
+{
+	unmap_compressed_file(&job->hll_contents);
+	job->hll_contents = (struct file_contents){};
+	free(job->pipe.out.data);
+	free(job->pipe.err.data);
+	job->pipe.out = (struct semanage_pipe_buf){};
+	job->pipe.err = (struct semanage_pipe_buf){};
+	free(job->compiler_path);
+	job->compiler_path = NULL;
+}
+
+/* Starts the compiler of a job. Returns 1 if the module is already
+ * written in CIL and there is nothing to do.
+ */
+static int semanage_compile_job_start(semanage_handle_t *sh, struct semanage_compile_job *job)
+{
+	semanage_module_info_t *modinfo = job->modinfo;
+	int status;
 
 	if (!strcasecmp(modinfo->lang_ext, "cil")) {
-		goto cleanup;
+		return 1;
 	}
 
-	status = semanage_get_hll_compiler_path(sh, modinfo->lang_ext, &compiler_path);
+	status = semanage_get_hll_compiler_path(sh, modinfo->lang_ext, &job->compiler_path);
 	if (status != 0) {
 		goto cleanup;
 	}
@@ -907,32 +987,44 @@ static int semanage_compile_module(semanage_handle_t *sh,
 	status = semanage_module_get_path(
 			sh,
 			modinfo,
-			SEMANAGE_MODULE_PATH_CIL,
-			cil_path,
-			sizeof(cil_path));
+			SEMANAGE_MODULE_PATH_HLL,
+			job->hll_path,
+			sizeof(job->hll_path));
 	if (status != 0) {
 		goto cleanup;
 	}
 
-	status = semanage_module_get_path(
-			sh,
-			modinfo,
-			SEMANAGE_MODULE_PATH_HLL,
-			hll_path,
-			sizeof(hll_path));
-	if (status != 0) {
+	status = map_compressed_file(sh, job->hll_path, &job->hll_contents);
+	if (status < 0) {
+		ERR(sh, "Unable to read file %s.", job->hll_path);
 		goto cleanup;
 	}
 
-	status = map_compressed_file(sh, hll_path, &hll_contents);
-	if (status < 0) {
-		ERR(sh, "Unable to read file %s.", hll_path);
+	status = semanage_pipe_start(sh, job->compiler_path, job->hll_contents.data,
+				     job->hll_contents.len, &job->pipe);
+	if (status != 0) {
 		goto cleanup;
 	}
 
-	status = semanage_pipe_data(sh, compiler_path, hll_contents.data,
-				    hll_contents.len, &cil_data, &cil_data_len,
-				    &err_data, &err_data_len);
+	return 0;
+
+cleanup:
+	semanage_compile_job_release(job);
+	return -1;
+}
+
+/* Collects the output of a finished compiler and stores the CIL. */
+static int semanage_compile_job_finish(semanage_handle_t *sh, struct semanage_compile_job *job)
+{
+	semanage_module_info_t *modinfo = job->modinfo;
+	char cil_path[PATH_MAX];
+	char *err_data = job->pipe.err.data;
+	size_t err_data_len = job->pipe.err.len;
+	char *start = NULL;
+	char *end = NULL;
+	int status;
+
+	status = semanage_pipe_finish(sh, job->compiler_path, &job->pipe);
 	if (err_data_len > 0) {
 		for (start = end = err_data; end < err_data + err_data_len; end++) {
 			if (*end == '\n') {
@@ -949,21 +1041,30 @@ static int semanage_compile_module(semanage_handle_t *sh,
 		goto cleanup;
 	}
 
-	if (context) {
-		update_checksum_with_len(context, cil_data_len);
-		Sha256Update(context, cil_data, cil_data_len);
+	status = semanage_module_get_path(
+			sh,
+			modinfo,
+			SEMANAGE_MODULE_PATH_CIL,
+			cil_path,
+			sizeof(cil_path));
+	if (status != 0) {
+		goto cleanup;
 	}
 
-	status = write_compressed_file(sh, cil_path, cil_data, cil_data_len);
+	if (job->digest) {
+		Sha256Calculate(job->pipe.out.data, job->pipe.out.len, job->digest);
+	}
+
+	status = write_compressed_file(sh, cil_path, job->pipe.out.data, job->pipe.out.len);
 	if (status == -1) {
 		ERR(sh, "Failed to write %s.", cil_path);
 		goto cleanup;
 	}
 
 	if (sh->conf->remove_hll == 1) {
-		status = unlink(hll_path);
+		status = unlink(job->hll_path);
 		if (status != 0) {
-			ERR(sh, "Error while removing HLL file %s.", hll_path);
+			ERR(sh, "Error while removing HLL file %s.", job->hll_path);
 			goto cleanup;
 		}
 
@@ -974,14 +1075,146 @@ static int semanage_compile_module(semanage_handle_t *sh,
 	}
 
 cleanup:
-	unmap_compressed_file(&hll_contents);
-	free(cil_data);
-	free(err_data);
-	free(compiler_path);
+	semanage_compile_job_release(job);
+	return status;
+}
+
+/* Returns how many HLL compilers may run at the same time. */
+static int semanage_compiler_jobs(semanage_handle_t *sh)
+{
+	long ncpus;
+
+	if (sh->conf->compiler_jobs > 0)
+		return sh->conf->compiler_jobs;
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 1)
+		return 1;
+	if (ncpus > INT_MAX)
+		return INT_MAX;
+
+	return ncpus;
+}
+
+/* Compiles HLL modules to CIL, running up to compiler-jobs compilers at
+ * once. The results of every job are stored in the job itself, so the
+ * order in which the compilers finish does not matter. Once a job has
+ * failed no new compilers are started, but the running ones are waited
+ * for.
+ */
+static int semanage_compile_modules(semanage_handle_t *sh,
+				    struct semanage_compile_job *jobs,
+				    int num_jobs)
+{
+	struct semanage_compile_job **running = NULL;
+	struct pollfd *pfds = NULL;
+	struct sigaction old_signal;
+	struct sigaction new_signal;
+	int max_running, num_running = 0, next = 0;
+	int i, j, n, retval, status = 0;
+
+	if (num_jobs == 0)
+		return 0;
+
+	max_running = semanage_compiler_jobs(sh);
+	if (max_running > num_jobs)
+		max_running = num_jobs;
+
+	running = calloc(max_running, sizeof(*running));
+	pfds = calloc(max_running * 3, sizeof(*pfds));
+	if (running == NULL || pfds == NULL) {
+		ERR(sh, "Out of memory!");
+		free(running);
+		free(pfds);
+		return -1;
+	}
+
+	/* This is needed in case the read end of an input pipe is closed causing a SIGPIPE signal to be sent.
+	 * If SIGPIPE is not caught, the signal will cause semanage to terminate immediately. The sigaction below
+	 * creates a new_signal that ignores SIGPIPE allowing the write to exit cleanly.
+	 *
+	 * The original behavior is restored once all compilers have finished.
+	 */
+	new_signal.sa_handler = SIG_IGN;
+	sigemptyset(&new_signal.sa_mask);
+	new_signal.sa_flags = 0;
+	sigaction(SIGPIPE, &new_signal, &old_signal);
+
+	while (num_running > 0 || (status == 0 && next < num_jobs)) {
+		while (status == 0 && num_running < max_running && next < num_jobs) {
+			retval = semanage_compile_job_start(sh, &jobs[next]);
+			if (retval < 0)
+				status = -1;
+			else if (retval == 0)
+				running[num_running++] = &jobs[next];
+			next++;
+		}
+		if (num_running == 0)
+			break;
+
+		for (i = 0, n = 0; i < num_running; i++) {
+			for (j = 0; j < 3; j++, n++) {
+				pfds[n].fd = running[i]->pipe.fds[j];
+				pfds[n].events = j == 0 ? POLLOUT : POLLIN;
+				pfds[n].revents = 0;
+			}
+		}
+
+		if (poll(pfds, n, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			ERR(sh, "Failed to wait for HLL compilers.");
+			status = -1;
+			/* Closing the pipes makes the compilers exit. */
+			for (i = 0; i < num_running; i++) {
+				running[i]->pipe.failed = 1;
+				for (j = 0; j < 3; j++)
+					semanage_pipe_close(&running[i]->pipe, j);
+			}
+		} else {
+			for (i = 0, n = 0; i < num_running; i++) {
+				for (j = 0; j < 3; j++, n++) {
+					if (pfds[n].revents)
+						semanage_pipe_io(sh, &running[i]->pipe, j);
+				}
+			}
+		}
+
+		for (i = 0; i < num_running; ) {
+			if (!semanage_pipe_done(&running[i]->pipe)) {
+				i++;
+				continue;
+			}
+			if (semanage_compile_job_finish(sh, running[i]) != 0)
+				status = -1;
+			running[i] = running[--num_running];
+		}
+	}
+
+	sigaction(SIGPIPE, &old_signal, NULL);
+
+	free(running);
+	free(pfds);
 
 	return status;
 }
 
+/* Compiles an HLL module to CIL. If digest is not NULL, it receives the
+ * SHA-256 of the resulting CIL. Modules already written in CIL are left
+ * untouched.
+ */
+static int semanage_compile_module(semanage_handle_t *sh,
+				   semanage_module_info_t *modinfo,
+				   SHA256_HASH *digest)
+{
+	struct semanage_compile_job job = {
+		.modinfo = modinfo,
+		.digest = digest,
+	};
+
+	return semanage_compile_modules(sh, &job, 1);
+}
+
 static int modinfo_cmp(const void *a, const void *b)
 {
 	const semanage_module_info_t *ma = a;
@@ -997,6 +1230,13 @@ struct extra_checksum_params {
 	int policyvers;
 };
 
+/* Compiles any HLL modules to CIL and computes the checksum of all modules.
+ * The checksum is built from the digest of every module, which is taken
+ * from the module digest index of the sandbox whenever the module file is
+ * unchanged, so only new or modified modules have to be decompressed.
+ * Modules that need compiling are compiled in parallel, see
+ * semanage_compile_modules().
+ */
 static int semanage_compile_hll_modules(semanage_handle_t *sh,
 					semanage_module_info_t *modinfos,
 					int num_modinfos,
@@ -1004,14 +1244,20 @@ static int semanage_compile_hll_modules(semanage_handle_t *sh,
 					char *cil_checksum)
 {
 	/* to be incremented when checksum input data format changes */
-	static const size_t CHECKSUM_EPOCH = 2;
+	static const size_t CHECKSUM_EPOCH = 3;
 
-	int i, status;
+	int i, status = -1;
+	int num_jobs = 0;
 	char cil_path[PATH_MAX];
 	struct stat sb;
 	Sha256Context context;
 	SHA256_HASH hash;
+	SHA256_HASH *digests = NULL;
+	uint8_t *have_digest = NULL;
+	struct semanage_compile_job *jobs = NULL;
 	struct file_contents contents = {};
+	semanage_module_digests_t *old_digests = NULL;
+	semanage_module_digests_t *new_digests = NULL;
 
 	assert(sh);
 	assert(modinfos);
@@ -1019,15 +1265,21 @@ static int semanage_compile_hll_modules(semanage_handle_t *sh,
 	/* Sort modules by name to get consistent ordering. */
 	qsort(modinfos, num_modinfos, sizeof(*modinfos), &modinfo_cmp);
 
-	Sha256Initialise(&context);
-	update_checksum_with_len(&context, CHECKSUM_EPOCH);
-	update_checksum_with_bool(&context, !!extra->disable_dontaudit);
-	update_checksum_with_bool(&context, !!extra->preserve_tunables);
-	update_checksum_with_len(&context, (size_t)extra->target_platform);
-	update_checksum_with_len(&context, (size_t)extra->policyvers);
+	digests = calloc(num_modinfos, sizeof(*digests));
+	have_digest = calloc(num_modinfos, sizeof(*have_digest));
+	jobs = calloc(num_modinfos, sizeof(*jobs));
+	if (num_modinfos > 0 && (digests == NULL || have_digest == NULL || jobs == NULL)) {
+		ERR(sh, "Out of memory!");
+		goto cleanup;
+	}
+
+	if (semanage_module_digests_read(sh, SEMANAGE_TMP, &old_digests) < 0)
+		goto cleanup;
+	if (semanage_module_digests_create(&new_digests) < 0) {
+		ERR(sh, "Out of memory!");
+		goto cleanup;
+	}
 
-	/* prefix with module count to avoid collisions */
-	update_checksum_with_len(&context, num_modinfos);
 	for (i = 0; i < num_modinfos; i++) {
 		status = semanage_module_get_path(
 				sh,
@@ -1035,38 +1287,96 @@ static int semanage_compile_hll_modules(semanage_handle_t *sh,
 				SEMANAGE_MODULE_PATH_CIL,
 				cil_path,
 				sizeof(cil_path));
-		if (status != 0)
-			return -1;
+		if (status != 0) {
+			status = -1;
+			goto cleanup;
+		}
 
 		if (!semanage_get_ignore_module_cache(sh)) {
 			status = stat(cil_path, &sb);
 			if (status == 0) {
-				status = map_compressed_file(sh, cil_path, &contents);
-				if (status < 0) {
-					ERR(sh, "Error mapping file: %s", cil_path);
-					return -1;
+				if (!semanage_module_digests_lookup(old_digests, cil_path, &sb, digests[i].bytes)) {
+					status = map_compressed_file(sh, cil_path, &contents);
+					if (status < 0) {
+						ERR(sh, "Error mapping file: %s", cil_path);
+						goto cleanup;
+					}
+
+					Sha256Calculate(contents.data, contents.len, &digests[i]);
+					unmap_compressed_file(&contents);
 				}
 
-				/* prefix with length to avoid collisions */
-				update_checksum_with_len(&context, contents.len);
-				Sha256Update(&context, contents.data, contents.len);
+				status = semanage_module_digests_add(sh, new_digests, cil_path, &sb, digests[i].bytes);
+				if (status < 0)
+					goto cleanup;
 
-				unmap_compressed_file(&contents);
+				have_digest[i] = 1;
 				continue;
 			} else if (errno != ENOENT) {
 				ERR(sh, "Unable to access %s.", cil_path);
-				return -1; //an error in the "stat" call
+				status = -1;
+				goto cleanup; //an error in the "stat" call
 			}
 		}
 
-		status = semanage_compile_module(sh, &modinfos[i], &context);
-		if (status < 0)
-			return -1;
+		/* Modules written in CIL have nothing to compile. */
+		if (strcasecmp(modinfos[i].lang_ext, "cil")) {
+			jobs[num_jobs].modinfo = &modinfos[i];
+			jobs[num_jobs].digest = &digests[i];
+			num_jobs++;
+			have_digest[i] = 1;
+		}
+	}
+
+	status = semanage_compile_modules(sh, jobs, num_jobs);
+	if (status < 0)
+		goto cleanup;
+
+	for (i = 0; i < num_jobs; i++) {
+		status = semanage_module_get_path(
+				sh,
+				jobs[i].modinfo,
+				SEMANAGE_MODULE_PATH_CIL,
+				cil_path,
+				sizeof(cil_path));
+		if (status != 0) {
+			status = -1;
+			goto cleanup;
+		}
+
+		if (stat(cil_path, &sb) == 0) {
+			status = semanage_module_digests_add(sh, new_digests, cil_path, &sb, jobs[i].digest->bytes);
+			if (status < 0)
+				goto cleanup;
+		}
+	}
+
+	Sha256Initialise(&context);
+	update_checksum_with_len(&context, CHECKSUM_EPOCH);
+	update_checksum_with_bool(&context, !!extra->disable_dontaudit);
+	update_checksum_with_bool(&context, !!extra->preserve_tunables);
+	update_checksum_with_len(&context, (size_t)extra->target_platform);
+	update_checksum_with_len(&context, (size_t)extra->policyvers);
+
+	/* prefix with module count to avoid collisions */
+	update_checksum_with_len(&context, num_modinfos);
+	for (i = 0; i < num_modinfos; i++) {
+		if (have_digest[i])
+			Sha256Update(&context, digests[i].bytes, sizeof(digests[i].bytes));
 	}
 	Sha256Finalise(&context, &hash);
 
 	semanage_hash_to_checksum_string(hash.bytes, cil_checksum);
-	return 0;
+
+	status = semanage_module_digests_write(sh, SEMANAGE_TMP, new_digests);
+
+cleanup:
+	semanage_module_digests_destroy(old_digests);
+	semanage_module_digests_destroy(new_digests);
+	free(jobs);
+	free(have_digest);
+	free(digests);
+	return status < 0 ? -1 : 0;
 }
 
 static int semanage_compare_checksum(semanage_handle_t *sh, const char *reference)
@@ -1144,6 +1454,58 @@ static int copy_file_if_exists(semanage_handle_t *sh, const char *src, const cha
 /* Commits all changes in sandbox to the actual kernel policy.
  * Returns commit number on success, -1 on error.
  */
+static int semanage_same_file(const struct stat *a, const struct stat *b)
+{
+	return a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+	    a->st_size == b->st_size &&
+	    a->st_mtim.tv_sec == b->st_mtim.tv_sec &&
+	    a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+static void semanage_drop_policydb(semanage_handle_t *sh)
+{
+	sepol_policydb_free(sh->u.direct.policydb);
+	sh->u.direct.policydb = NULL;
+}
+
+/* Returns the policy kept from the last commit if the active store
+ * was not changed by anyone else since, NULL otherwise. */
+static sepol_policydb_t *semanage_take_policydb(semanage_handle_t *sh)
+{
+	sepol_policydb_t *policydb = sh->u.direct.policydb;
+	struct stat linked, kernel;
+
+	sh->u.direct.policydb = NULL;
+	if (policydb == NULL)
+		return NULL;
+
+	if (stat(semanage_path(SEMANAGE_ACTIVE, SEMANAGE_LINKED), &linked) == 0 &&
+	    stat(semanage_path(SEMANAGE_ACTIVE, SEMANAGE_STORE_KERNEL), &kernel) == 0 &&
+	    semanage_same_file(&linked, &sh->u.direct.policydb_linked) &&
+	    semanage_same_file(&kernel, &sh->u.direct.policydb_kernel))
+		return policydb;
+
+	sepol_policydb_free(policydb);
+	return NULL;
+}
+
+/* Keeps the committed policy for the next commit, taking ownership of
+ * *policydb. */
+static void semanage_keep_policydb(semanage_handle_t *sh,
+				   sepol_policydb_t **policydb)
+{
+	semanage_drop_policydb(sh);
+
+	if (stat(semanage_path(SEMANAGE_ACTIVE, SEMANAGE_LINKED),
+		 &sh->u.direct.policydb_linked) != 0 ||
+	    stat(semanage_path(SEMANAGE_ACTIVE, SEMANAGE_STORE_KERNEL),
+		 &sh->u.direct.policydb_kernel) != 0)
+		return;
+
+	sh->u.direct.policydb = *policydb;
+	*policydb = NULL;
+}
+
 static int semanage_direct_commit(semanage_handle_t * sh)
 {
 	char **mod_filenames = NULL;
@@ -1160,7 +1522,7 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 	char modules_checksum[CHECKSUM_CONTENT_SIZE + 1 /* '\0' */];
 	struct extra_checksum_params extra;
 
-	int do_rebuild, do_write_kernel, do_install;
+	int do_rebuild, do_write_kernel, do_install, kernel_modified;
 	int fcontexts_modified, ports_modified, seusers_modified,
 		disable_dontaudit, preserve_tunables, ibpkeys_modified,
 		ibendports_modified;
@@ -1200,6 +1562,14 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 			goto cleanup;
 	}
 
+	/* Local changes to components that live in the kernel policy. */
+	kernel_modified = ports_modified | ibpkeys_modified |
+		ibendports_modified |
+		bools->dtable->is_modified(bools->dbase) |
+		ifaces->dtable->is_modified(ifaces->dbase) |
+		nodes->dtable->is_modified(nodes->dbase) |
+		users->dtable->is_modified(users_base->dbase);
+
 	/* Rebuild if explicitly requested or any module changes occurred. */
 	do_rebuild = sh->do_rebuild | sh->modules_modified;
 
@@ -1331,6 +1701,8 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 	 * any required files are missing, rebuild the policy.
 	 */
 	if (do_rebuild) {
+		semanage_drop_policydb(sh);
+
 		/* =================== Module expansion =============== */
 
 		retval = semanage_get_cil_paths(sh, modinfos, num_modinfos, &mod_filenames);
@@ -1421,14 +1793,23 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 		if (retval < 0)
 			goto cleanup;
 	} else {
-		/* Load the existing linked policy, w/o local changes */
-		retval = sepol_policydb_create(&out);
-		if (retval < 0)
-			goto cleanup;
+		/* Merging the unchanged local components again into the
+		 * policy kept from the last commit gives the same policy. */
+		if (!kernel_modified && !sh->check_ext_changes)
+			out = semanage_take_policydb(sh);
+		else
+			semanage_drop_policydb(sh);
+
+		if (out == NULL) {
+			/* Load the existing linked policy, w/o local changes */
+			retval = sepol_policydb_create(&out);
+			if (retval < 0)
+				goto cleanup;
 
-		retval = semanage_read_policydb(sh, out, SEMANAGE_LINKED);
-		if (retval < 0)
-			goto cleanup;
+			retval = semanage_read_policydb(sh, out, SEMANAGE_LINKED);
+			if (retval < 0)
+				goto cleanup;
+		}
 
 		path = semanage_path(SEMANAGE_TMP, SEMANAGE_SEUSERS_LINKED);
 		if (stat(path, &sb) == 0) {
@@ -1478,12 +1859,7 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 	 * that live under /etc/selinux (kernel policy, seusers, file contexts)
 	 * will be modified.
 	 */
-	do_write_kernel = do_rebuild | sh->check_ext_changes |
-		ports_modified | ibpkeys_modified | ibendports_modified |
-		bools->dtable->is_modified(bools->dbase) |
-		ifaces->dtable->is_modified(ifaces->dbase) |
-		nodes->dtable->is_modified(nodes->dbase) |
-		users->dtable->is_modified(users_base->dbase);
+	do_write_kernel = do_rebuild | sh->check_ext_changes | kernel_modified;
 	do_install = do_write_kernel | seusers_modified | fcontexts_modified;
 
 	/* Attach our databases to the policydb we just created or loaded. */
@@ -1611,14 +1987,27 @@ static int semanage_direct_commit(semanage_handle_t * sh)
                                See /etc/selinux/semanage.conf if you need to enable it.");
         }
 
+	/* validate the file contexts against out while it is still around */
+	if (do_install) {
+		retval = semanage_validate_and_compile_fcontexts(sh, out);
+		if (retval < 0)
+			goto cleanup;
+	}
+
 	/* free out, if we don't free it before calling semanage_install_sandbox
-	 * then fork() may fail on low memory machines */
-	sepol_policydb_free(out);
-	out = NULL;
+	 * then fork() may fail on low memory machines; a policy server keeps
+	 * it for the next commit instead */
+	if (!sh->u.direct.keep_policydb) {
+		sepol_policydb_free(out);
+		out = NULL;
+	}
 
 	if (do_install)
 		retval = semanage_install_sandbox(sh);
 
+	if (retval >= 0 && out != NULL)
+		semanage_keep_policydb(sh, &out);
+
 cleanup:
 	for (i = 0; i < num_modinfos; i++) {
 		semanage_module_info_destroy(sh, &modinfos[i]);
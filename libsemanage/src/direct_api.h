@@ -20,8 +20,11 @@
 #ifndef _SEMANAGE_DIRECT_API_H_
 #define _SEMANAGE_DIRECT_API_H_
 
+#include <sys/stat.h>
+
 /* Circular dependency */
 struct semanage_handle;
+struct sepol_policydb;
 
 /* Direct component of handle */
 struct semanage_direct_handle {
@@ -29,10 +32,28 @@ struct semanage_direct_handle {
 	/* Locking */
 	int activelock_file_fd;
 	int translock_file_fd;
+
+	/* Connection to a local policy server, -1 if none */
+	int server_fd;
+
+	/* Linked policy with the local changes of the last commit merged
+	 * in, kept between transactions when keep_policydb is set.  It is
+	 * valid while the active linked and kernel policies are still the
+	 * files described by policydb_linked and policydb_kernel. */
+	int keep_policydb;
+	struct sepol_policydb *policydb;
+	struct stat policydb_linked;
+	struct stat policydb_kernel;
 };
 
 int semanage_direct_connect(struct semanage_handle *sh);
 
+int semanage_direct_disconnect(struct semanage_handle *sh);
+
+/* Removes the sandbox and releases the transaction lock of a
+ * transaction that will not be committed. */
+void semanage_direct_abort(struct semanage_handle *sh);
+
 int semanage_direct_is_managed(struct semanage_handle *sh);
 
 int semanage_direct_access_check(struct semanage_handle *sh);
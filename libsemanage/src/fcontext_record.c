@@ -8,6 +8,7 @@ typedef struct semanage_fcontext_key record_key_t;
 #include <string.h>
 #include "fcontext_internal.h"
 #include "debug.h"
+#include "utilities.h"
 
 struct semanage_fcontext {
 
@@ -287,6 +288,14 @@ void semanage_fcontext_free(semanage_fcontext_t * fcontext)
 }
 
 
+static unsigned int semanage_fcontext_key_hash(const semanage_fcontext_key_t * key)
+{
+
+	unsigned int hash = semanage_hash_str(SEMANAGE_HASH_INIT, key->expr);
+	return semanage_hash_bytes(hash, &key->type, sizeof(key->type));
+}
+
+
 /* Record base functions */
 const record_table_t SEMANAGE_FCONTEXT_RTABLE = {
 	.create = semanage_fcontext_create,
@@ -297,4 +306,5 @@ const record_table_t SEMANAGE_FCONTEXT_RTABLE = {
 	.compare2 = semanage_fcontext_compare2,
 	.compare2_qsort = semanage_fcontext_compare2_qsort,
 	.free = semanage_fcontext_free,
+	.hash = semanage_fcontext_key_hash,
 };
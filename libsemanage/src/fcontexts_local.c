@@ -31,6 +31,24 @@ int semanage_fcontext_del_local(semanage_handle_t * handle,
 	return dbase_del(handle, dconfig, key);
 }
 
+int semanage_fcontext_modify_local_batch(semanage_handle_t * handle,
+					 semanage_fcontext_t * const *records,
+					 unsigned int count)
+{
+
+	dbase_config_t *dconfig = semanage_fcontext_dbase_local(handle);
+	return dbase_modify_batch(handle, dconfig, records, count);
+}
+
+int semanage_fcontext_del_local_batch(semanage_handle_t * handle,
+				      semanage_fcontext_key_t * const *keys,
+				      unsigned int count)
+{
+
+	dbase_config_t *dconfig = semanage_fcontext_dbase_local(handle);
+	return dbase_del_batch(handle, dconfig, keys, count);
+}
+
 int semanage_fcontext_query_local(semanage_handle_t * handle,
 				  const semanage_fcontext_key_t * key,
 				  semanage_fcontext_t ** response)
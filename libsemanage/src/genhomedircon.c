@@ -52,6 +52,9 @@
 #include <regex.h>
 #include <grp.h>
 #include <search.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <time.h>
 
 /* paths used in get_home_dirs() */
 #define PATH_ETC_USERADD "/etc/default/useradd"
@@ -73,6 +76,9 @@
 #define COMMENT_USER_HOME_CONTEXT "\n\n#\n# Home Context for user %s" \
 			"\n#\n\n"
 
+#define COMMENT_USERS_HOME_CONTEXT "\n\n#\n# Home Context for users %s" \
+			"\n#\n\n"
+
 /* placeholders used in the template file
    which are searched for and replaced */
 #define TEMPLATE_HOME_ROOT "HOME_ROOT"
@@ -93,6 +99,27 @@
 
 #define CONTEXT_NONE "<<none>>"
 
+/* Users are looked up and written by up to GENHOMEDIRCON_MAX_THREADS
+ * threads, with at least GENHOMEDIRCON_MIN_USERS users each. Each of
+ * them writes GENHOMEDIRCON_ROUND users at a time before the output is
+ * flushed. */
+#define GENHOMEDIRCON_MAX_THREADS 8
+#define GENHOMEDIRCON_MIN_USERS 64
+#define GENHOMEDIRCON_ROUND 1024
+
+/* most users matched by one entry when collapsing users */
+#define GENHOMEDIRCON_COLLAPSE_MAX 64
+
+#define GENHOMEDIRCON_CACHE_SIZE 64
+
+enum {
+	USER_PENDING,	/* not looked up yet */
+	USER_FOUND,
+	USER_MISSING,	/* not in the password file */
+	USER_SKIPPED,	/* home directory is / or ignored */
+	USER_FAILED	/* the lookup failed */
+};
+
 typedef struct user_entry {
 	char *name;
 	char *uid;
@@ -103,22 +130,68 @@ typedef struct user_entry {
 	char *level;
 	char *login;
 	char *homedir_role;
+	char *conflict;	/* another group the user was mapped by */
+	int state;
 	struct user_entry *next;
 } genhomedircon_user_entry_t;
 
+typedef struct {
+	const char *text;	/* NULL for a placeholder */
+	size_t len;
+	unsigned int field;	/* the placeholder's value */
+} tpl_segment_t;
+
+typedef struct {
+	tpl_segment_t *segs;
+	unsigned int nsegs;
+	unsigned int fields;	/* bitmask of the placeholders used */
+} tpl_line_t;
+
+typedef struct {
+	tpl_line_t *lines;
+	unsigned int nlines;
+} genhomedircon_tpl_t;
+
 typedef struct {
 	const char *fcfilepath;
 	int usepasswd;
+	int collapse;
 	const char *homedir_template_path;
 	genhomedircon_user_entry_t *fallback;
 	semanage_handle_t *h_semanage;
 	sepol_policydb_t *policydb;
+	genhomedircon_tpl_t homedir_tpl;
+	genhomedircon_tpl_t homeroot_tpl;
+	genhomedircon_tpl_t username_tpl;
+	genhomedircon_tpl_t user_tpl;
+	pthread_mutex_t lock;	/* held by the workers to use h_semanage */
+	unsigned int nusers;	/* users written */
 } genhomedircon_settings_t;
 
 typedef struct {
-	const char *search_for;
-	const char *replace_with;
-} replacement_pair_t;
+	char *data;
+	size_t len;
+	size_t alloc;
+} genhomedircon_buf_t;
+
+typedef struct ctx_cache {
+	char *key;	/* template context, sename, level and role */
+	size_t key_len;
+	char *context;	/* context to write, NULL to leave the line out */
+	struct ctx_cache *next;
+} genhomedircon_ctx_cache_t;
+
+typedef struct {
+	genhomedircon_settings_t *s;
+	genhomedircon_user_entry_t **users;
+	unsigned int start;
+	unsigned int end;
+	int retval;
+	genhomedircon_buf_t out;	/* lines written for the users */
+	genhomedircon_buf_t line;	/* line being written */
+	genhomedircon_buf_t key;
+	genhomedircon_ctx_cache_t *cache[GENHOMEDIRCON_CACHE_SIZE];
+} genhomedircon_worker_t;
 
 typedef struct {
 	const char *dir;
@@ -504,10 +577,38 @@ static int USER_CONTEXT_PRED(const char *string)
 	return strstr(string, TEMPLATE_USER) != NULL;
 }
 
-static int STR_COMPARATOR(const void *a, const void *b)
-{
-	return strcmp((const char *) a, (const char *) b);
-}
+/* Template lines are split once into literal text and placeholders, so
+ * that writing them for a user only has to append the pieces instead
+ * of rebuilding the whole line for every placeholder. */
+enum {
+	FIELD_HOME_ROOT,
+	FIELD_HOME_DIR,
+	FIELD_USER,
+	FIELD_USERNAME,
+	FIELD_USERID,
+	FIELD_ROLE,
+	FIELD_MAX
+};
+
+static const char *const field_names[FIELD_MAX] = {
+	[FIELD_HOME_ROOT] = TEMPLATE_HOME_ROOT,
+	[FIELD_HOME_DIR] = TEMPLATE_HOME_DIR,
+	[FIELD_USER] = TEMPLATE_USER,
+	[FIELD_USERNAME] = TEMPLATE_USERNAME,
+	[FIELD_USERID] = TEMPLATE_USERID,
+	[FIELD_ROLE] = TEMPLATE_ROLE,
+};
+
+/* The placeholders of each kind of template line, in the order in
+ * which they are substituted */
+static const int homeroot_fields[] = { FIELD_HOME_ROOT, -1 };
+static const int homedir_fields[] = { FIELD_HOME_DIR, FIELD_ROLE, -1 };
+static const int username_fields[] = {
+	FIELD_USERNAME, FIELD_USERID, FIELD_ROLE, -1
+};
+static const int user_fields[] = { FIELD_USER, FIELD_ROLE, -1 };
+
+#define FIELD_BIT(field) (1U << (field))
 
 /* make_template
  * @param	s	  the settings holding the paths to various files
@@ -531,22 +632,181 @@ static semanage_list_t *make_template(genhomedircon_settings_t * s,
 	return template_data;
 }
 
-static char *replace_all(const char *str, const replacement_pair_t * repl)
+/* Splits the literal segments of line at every occurrence of the
+ * placeholder of field. */
+static int tpl_split(tpl_line_t *line, unsigned int field)
 {
-	char *retval, *retval2;
+	const char *name = field_names[field];
+	size_t nlen = strlen(name);
+	tpl_segment_t *segs;
+	const char *p, *end;
+	unsigned int i;
+
+	for (i = 0; i < line->nsegs; i++) {
+		if (line->segs[i].text == NULL)
+			continue;
+
+		p = memmem(line->segs[i].text, line->segs[i].len, name, nlen);
+		if (p == NULL)
+			continue;
+
+		segs = realloc(line->segs, (line->nsegs + 2) * sizeof(*segs));
+		if (segs == NULL)
+			return STATUS_ERR;
+		line->segs = segs;
+
+		memmove(&segs[i + 3], &segs[i + 1],
+			(line->nsegs - i - 1) * sizeof(*segs));
+		line->nsegs += 2;
+
+		end = segs[i].text + segs[i].len;
+		segs[i].len = p - segs[i].text;
+		segs[i + 1].text = NULL;
+		segs[i + 1].len = 0;
+		segs[i + 1].field = field;
+		segs[i + 2].text = p + nlen;
+		segs[i + 2].len = end - (p + nlen);
+		segs[i + 2].field = 0;
+
+		line->fields |= FIELD_BIT(field);
+		/* continue with the rest after the placeholder */
+		i++;
+	}
+
+	return STATUS_SUCCESS;
+}
+
+static void tpl_destroy(genhomedircon_tpl_t *tpl)
+{
+	unsigned int i;
+
+	for (i = 0; i < tpl->nlines; i++)
+		free(tpl->lines[i].segs);
+	free(tpl->lines);
+	tpl->lines = NULL;
+	tpl->nlines = 0;
+}
+
+/* tpl_compile
+ * @param	tpl	the template to fill in
+ * @param	list	template lines, which must outlive tpl
+ * @param	fields	placeholders to substitute, terminated by -1
+ * @return	0 on success
+ */
+static int tpl_compile(genhomedircon_tpl_t *tpl, const semanage_list_t *list,
+		       const int *fields)
+{
+	const semanage_list_t *l;
+	tpl_line_t *line;
+	unsigned int n = 0;
 	int i;
 
-	if (!str || !repl)
-		return NULL;
+	for (l = list; l; l = l->next)
+		n++;
+
+	tpl->nlines = 0;
+	tpl->lines = calloc(n ? n : 1, sizeof(*tpl->lines));
+	if (tpl->lines == NULL)
+		return STATUS_ERR;
 
-	retval = strdup(str);
-	for (i = 0; retval != NULL && repl[i].search_for; i++) {
-		retval2 = semanage_str_replace(repl[i].search_for,
-					       repl[i].replace_with, retval, 0);
-		free(retval);
-		retval = retval2;
+	for (l = list; l; l = l->next) {
+		line = &tpl->lines[tpl->nlines++];
+		line->segs = malloc(sizeof(*line->segs));
+		if (line->segs == NULL)
+			goto err;
+		line->segs[0].text = l->data;
+		line->segs[0].len = strlen(l->data);
+		line->segs[0].field = 0;
+		line->nsegs = 1;
+
+		for (i = 0; fields[i] >= 0; i++) {
+			if (tpl_split(line, fields[i]) < 0)
+				goto err;
+		}
 	}
-	return retval;
+
+	return STATUS_SUCCESS;
+
+err:
+	tpl_destroy(tpl);
+	return STATUS_ERR;
+}
+
+static int buf_append(genhomedircon_buf_t *buf, const char *str, size_t len)
+{
+	size_t alloc;
+	char *data;
+
+	if (buf->len + len + 1 > buf->alloc) {
+		alloc = buf->alloc ? buf->alloc : 256;
+		while (alloc < buf->len + len + 1)
+			alloc *= 2;
+		data = realloc(buf->data, alloc);
+		if (data == NULL)
+			return STATUS_ERR;
+		buf->data = data;
+		buf->alloc = alloc;
+	}
+
+	memcpy(buf->data + buf->len, str, len);
+	buf->len += len;
+	buf->data[buf->len] = '\0';
+
+	return STATUS_SUCCESS;
+}
+
+static int buf_puts(genhomedircon_buf_t *buf, const char *str)
+{
+	return buf_append(buf, str, strlen(str));
+}
+
+static int buf_printf(genhomedircon_buf_t *buf, const char *fmt, ...)
+	__attribute__ ((format(printf, 2, 3)));
+
+static int buf_printf(genhomedircon_buf_t *buf, const char *fmt, ...)
+{
+	char *str = NULL;
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vasprintf(&str, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return STATUS_ERR;
+
+	len = buf_append(buf, str, len);
+	free(str);
+	return len;
+}
+
+static void buf_destroy(genhomedircon_buf_t *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->len = buf->alloc = 0;
+}
+
+/* Appends line with its placeholders replaced by values to buf. */
+static int tpl_render(genhomedircon_buf_t *buf, const tpl_line_t *line,
+		      const char *const *values)
+{
+	const tpl_segment_t *seg;
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < line->nsegs; i++) {
+		seg = &line->segs[i];
+		if (seg->text)
+			rc = buf_append(buf, seg->text, seg->len);
+		else
+			rc = buf_puts(buf, values[seg->field]);
+		if (rc < 0)
+			return STATUS_ERR;
+	}
+
+	/* make sure an empty line is still a string */
+	return buf_append(buf, "", 0);
 }
 
 static const char *extract_context(const char *line)
@@ -574,16 +834,11 @@ static const char *extract_context(const char *line)
 	return p;
 }
 
-static int check_line(genhomedircon_settings_t * s, const char *line)
+static int check_context(genhomedircon_settings_t * s, const char *ctx_str)
 {
 	sepol_context_t *ctx_record = NULL;
-	const char *ctx_str;
 	int result;
 
-	ctx_str = extract_context(line);
-	if (!ctx_str)
-		return STATUS_ERR;
-
 	result = sepol_context_from_string(s->h_semanage->sepolh,
 					   ctx_str, &ctx_record);
 	if (result == STATUS_SUCCESS && ctx_record != NULL) {
@@ -594,166 +849,294 @@ static int check_line(genhomedircon_settings_t * s, const char *line)
 	return result;
 }
 
-static int write_replacements(genhomedircon_settings_t * s, FILE * out,
-			      const semanage_list_t * tpl,
-			      const replacement_pair_t *repl)
+static int check_line(genhomedircon_settings_t * s, const char *line)
 {
-	char *line;
+	const char *ctx_str;
 
-	for (; tpl; tpl = tpl->next) {
-		line = replace_all(tpl->data, repl);
-		if (!line)
-			goto fail;
-		if (check_line(s, line) == STATUS_SUCCESS) {
-			if (fprintf(out, "%s\n", line) < 0)
-				goto fail;
+	ctx_str = extract_context(line);
+	if (!ctx_str)
+		return STATUS_ERR;
+
+	return check_context(s, ctx_str);
+}
+
+/* compute_context
+ * @param	s	settings structure
+ * @param	old_ctx	context of a template line
+ * @param	user	the user the line is written for
+ * @param	result	set to the context to write instead, or NULL if
+ *			the line must be left out
+ * @return	0 on success
+ */
+static int compute_context(genhomedircon_settings_t *s, const char *old_ctx,
+			   const genhomedircon_user_entry_t *user,
+			   char **result)
+{
+	sepol_handle_t *sepolh = s->h_semanage->sepolh;
+	sepol_context_t *context = NULL;
+	char *new_context_str = NULL;
+
+	*result = NULL;
+
+	if (strcmp(old_ctx, CONTEXT_NONE) == 0) {
+		if (check_context(s, old_ctx) == STATUS_SUCCESS) {
+			*result = strdup(old_ctx);
+			if (*result == NULL)
+				return STATUS_ERR;
 		}
-		free(line);
+		return STATUS_SUCCESS;
 	}
+
+	if (sepol_context_from_string(sepolh, old_ctx, &context) < 0)
+		goto fail;
+
+	if (sepol_context_set_user(sepolh, context, user->sename) < 0)
+		goto fail;
+
+	if (sepol_policydb_mls_enabled(s->policydb) &&
+	    sepol_context_set_mls(sepolh, context, user->level) < 0)
+		goto fail;
+
+	if (user->homedir_role &&
+	    sepol_context_set_role(sepolh, context, user->homedir_role) < 0)
+		goto fail;
+
+	if (sepol_context_to_string(sepolh, context, &new_context_str) < 0)
+		goto fail;
+
+	sepol_context_free(context);
+
+	if (check_context(s, new_context_str) == STATUS_SUCCESS)
+		*result = new_context_str;
+	else
+		free(new_context_str);
+
 	return STATUS_SUCCESS;
 
-      fail:
-	free(line);
+fail:
+	sepol_context_free(context);
 	return STATUS_ERR;
 }
 
-static int write_contexts(genhomedircon_settings_t *s, FILE *out,
-			  semanage_list_t *tpl, const replacement_pair_t *repl,
-			  const genhomedircon_user_entry_t *user)
+/* Most lines differ between users only in their path, so the contexts
+ * computed for a template context, SELinux user, level and role are
+ * kept by each worker. */
+static int lookup_context(genhomedircon_worker_t *w, const char *old_ctx,
+			  const genhomedircon_user_entry_t *user,
+			  const char **result)
 {
-	char *line, *temp;
-	sepol_context_t *context;
-	char *new_context_str;
-
-	for (; tpl; tpl = tpl->next) {
-		context = NULL;
-		new_context_str = NULL;
-		line = replace_all(tpl->data, repl);
-		if (!line) {
-			goto fail;
-		}
+	genhomedircon_settings_t *s = w->s;
+	genhomedircon_ctx_cache_t *e;
+	genhomedircon_buf_t *key = &w->key;
+	unsigned int hash;
+	char *ctx = NULL;
+	int rc;
+
+	key->len = 0;
+	if (buf_append(key, old_ctx, strlen(old_ctx) + 1) < 0 ||
+	    buf_append(key, user->sename, strlen(user->sename) + 1) < 0 ||
+	    buf_append(key, user->level, strlen(user->level) + 1) < 0 ||
+	    (user->homedir_role &&
+	     buf_puts(key, user->homedir_role) < 0))
+		return STATUS_ERR;
 
-		const char *old_context_str = extract_context(line);
-		if (!old_context_str) {
-			goto fail;
+	hash = semanage_hash_bytes(SEMANAGE_HASH_INIT, key->data, key->len) %
+		GENHOMEDIRCON_CACHE_SIZE;
+	for (e = w->cache[hash]; e; e = e->next) {
+		if (e->key_len == key->len &&
+		    memcmp(e->key, key->data, key->len) == 0) {
+			*result = e->context;
+			return STATUS_SUCCESS;
 		}
+	}
 
-		if (strcmp(old_context_str, CONTEXT_NONE) == 0) {
-			if (check_line(s, line) == STATUS_SUCCESS &&
-			    fprintf(out, "%s\n", line) < 0) {
-				goto fail;
-			}
-			free(line);
-			continue;
-		}
+	/* the handle is shared by all workers */
+	pthread_mutex_lock(&s->lock);
+	rc = compute_context(s, old_ctx, user, &ctx);
+	pthread_mutex_unlock(&s->lock);
+	if (rc < 0)
+		return STATUS_ERR;
 
-		sepol_handle_t *sepolh = s->h_semanage->sepolh;
+	e = malloc(sizeof(*e));
+	if (e == NULL || (e->key = malloc(key->len)) == NULL) {
+		free(e);
+		free(ctx);
+		return STATUS_ERR;
+	}
+	memcpy(e->key, key->data, key->len);
+	e->key_len = key->len;
+	e->context = ctx;
+	e->next = w->cache[hash];
+	w->cache[hash] = e;
 
-		if (sepol_context_from_string(sepolh, old_context_str,
-					      &context) < 0) {
-			goto fail;
-		}
+	*result = ctx;
+	return STATUS_SUCCESS;
+}
 
-		if (sepol_context_set_user(sepolh, context, user->sename) < 0) {
-			goto fail;
-		}
+static void worker_destroy(genhomedircon_worker_t *w)
+{
+	genhomedircon_ctx_cache_t *e, *next;
+	unsigned int i;
 
-		if (sepol_policydb_mls_enabled(s->policydb) &&
-		    sepol_context_set_mls(sepolh, context, user->level) < 0) {
-			goto fail;
+	for (i = 0; i < GENHOMEDIRCON_CACHE_SIZE; i++) {
+		for (e = w->cache[i]; e; e = next) {
+			next = e->next;
+			free(e->key);
+			free(e->context);
+			free(e);
 		}
+		w->cache[i] = NULL;
+	}
+	buf_destroy(&w->out);
+	buf_destroy(&w->line);
+	buf_destroy(&w->key);
+}
 
-		if (user->homedir_role &&
-		    sepol_context_set_role(sepolh, context, user->homedir_role) < 0) {
-			goto fail;
-		}
+static int flush_worker(genhomedircon_worker_t *w, FILE *out)
+{
+	if (w->out.len > 0 && fwrite(w->out.data, w->out.len, 1, out) != 1)
+		return STATUS_ERR;
+	w->out.len = 0;
+	return STATUS_SUCCESS;
+}
 
-		if (sepol_context_to_string(sepolh, context,
-					    &new_context_str) < 0) {
-			goto fail;
-		}
+static void set_values(const char **values,
+		       const genhomedircon_user_entry_t *user)
+{
+	values[FIELD_HOME_ROOT] = NULL;
+	values[FIELD_HOME_DIR] = user->home;
+	values[FIELD_USER] = user->name;
+	values[FIELD_USERNAME] = user->name;
+	values[FIELD_USERID] = user->uid;
+	values[FIELD_ROLE] = user->prefix;
+}
 
-		temp = semanage_str_replace(old_context_str, new_context_str,
-					    line, 1);
-		if (!temp) {
-			goto fail;
-		}
-		free(line);
-		line = temp;
+/* Appends a template line for user to the worker's output, with the
+ * SELinux user, level and role of the user in its context. Lines whose
+ * resulting context is not valid in the policy are left out. */
+static int write_context_line(genhomedircon_worker_t *w,
+			      const tpl_line_t *line,
+			      const genhomedircon_user_entry_t *user)
+{
+	const char *values[FIELD_MAX];
+	const char *old_ctx, *new_ctx;
 
-		if (check_line(s, line) == STATUS_SUCCESS) {
-			if (fprintf(out, "%s\n", line) < 0)
-				goto fail;
-		}
+	set_values(values, user);
 
-		free(line);
-		sepol_context_free(context);
-		free(new_context_str);
-	}
+	w->line.len = 0;
+	if (tpl_render(&w->line, line, values) < 0)
+		return STATUS_ERR;
+
+	old_ctx = extract_context(w->line.data);
+	if (!old_ctx)
+		return STATUS_ERR;
+
+	if (lookup_context(w, old_ctx, user, &new_ctx) < 0)
+		return STATUS_ERR;
+	if (new_ctx == NULL)
+		return STATUS_SUCCESS;
+
+	if (buf_append(&w->out, w->line.data, old_ctx - w->line.data) < 0 ||
+	    buf_puts(&w->out, new_ctx) < 0 ||
+	    buf_append(&w->out, "\n", 1) < 0)
+		return STATUS_ERR;
 
 	return STATUS_SUCCESS;
-fail:
-	free(line);
-	sepol_context_free(context);
-	free(new_context_str);
-	return STATUS_ERR;
 }
 
-static int write_home_dir_context(genhomedircon_settings_t * s, FILE * out,
-				  semanage_list_t * tpl, const genhomedircon_user_entry_t *user)
+/* write_contexts
+ * @param	w	worker to append the lines to
+ * @param	tpl	template lines
+ * @param	user	user to write the lines for
+ * @param	members	if not NULL, the nmembers users collapsed into user,
+ *			for the lines which have to be written for each of
+ *			them
+ * @return	0 on success
+ */
+static int write_contexts(genhomedircon_worker_t *w,
+			  const genhomedircon_tpl_t *tpl,
+			  const genhomedircon_user_entry_t *user,
+			  genhomedircon_user_entry_t *const *members,
+			  unsigned int nmembers)
 {
-	const replacement_pair_t repl[] = {
-		{.search_for = TEMPLATE_HOME_DIR,.replace_with = user->home},
-		{.search_for = TEMPLATE_ROLE,.replace_with = user->prefix},
-		{NULL, NULL}
-	};
-
-	if (strcmp(user->name, FALLBACK_NAME) == 0) {
-		if (fprintf(out, COMMENT_USER_HOME_CONTEXT, FALLBACK_SENAME) < 0)
-			return STATUS_ERR;
-	} else {
-		if (fprintf(out, COMMENT_USER_HOME_CONTEXT, user->name) < 0)
+	const unsigned int per_user = FIELD_BIT(FIELD_USERNAME) |
+		FIELD_BIT(FIELD_USERID);
+	unsigned int i, j;
+
+	for (i = 0; i < tpl->nlines; i++) {
+		/* the names and uids of several users cannot be
+		 * matched in the same line as separate alternatives */
+		if (members && (tpl->lines[i].fields & per_user) == per_user) {
+			for (j = 0; j < nmembers; j++) {
+				if (write_context_line(w, &tpl->lines[i],
+						       members[j]) < 0)
+					return STATUS_ERR;
+			}
+			continue;
+		}
+
+		if (write_context_line(w, &tpl->lines[i], user) < 0)
 			return STATUS_ERR;
 	}
 
-	return write_contexts(s, out, tpl, repl, user);
+	return STATUS_SUCCESS;
+}
+
+static int write_home_dir_context(genhomedircon_worker_t *w,
+				  const genhomedircon_user_entry_t *user)
+{
+	const char *name = user->name;
+
+	if (strcmp(name, FALLBACK_NAME) == 0)
+		name = FALLBACK_SENAME;
+	if (buf_printf(&w->out, COMMENT_USER_HOME_CONTEXT, name) < 0)
+		return STATUS_ERR;
+
+	return write_contexts(w, &w->s->homedir_tpl, user, NULL, 0);
 }
 
-static int write_home_root_context(genhomedircon_settings_t * s, FILE * out,
-				   semanage_list_t * tpl, const char *homedir)
+static int write_home_root_context(genhomedircon_worker_t *w,
+				   const char *homedir)
 {
-	const replacement_pair_t repl[] = {
-		{.search_for = TEMPLATE_HOME_ROOT,.replace_with = homedir},
-		{NULL, NULL}
-	};
+	const genhomedircon_tpl_t *tpl = &w->s->homeroot_tpl;
+	const char *values[FIELD_MAX] = { [FIELD_HOME_ROOT] = homedir };
+	unsigned int i;
+
+	for (i = 0; i < tpl->nlines; i++) {
+		w->line.len = 0;
+		if (tpl_render(&w->line, &tpl->lines[i], values) < 0)
+			return STATUS_ERR;
+		if (check_line(w->s, w->line.data) == STATUS_SUCCESS) {
+			if (buf_append(&w->out, w->line.data, w->line.len) < 0 ||
+			    buf_append(&w->out, "\n", 1) < 0)
+				return STATUS_ERR;
+		}
+	}
 
-	return write_replacements(s, out, tpl, repl);
+	return STATUS_SUCCESS;
 }
 
-static int write_username_context(genhomedircon_settings_t * s, FILE * out,
-				  semanage_list_t * tpl,
+static int write_username_context(genhomedircon_worker_t *w,
 				  const genhomedircon_user_entry_t *user)
 {
-	const replacement_pair_t repl[] = {
-		{.search_for = TEMPLATE_USERNAME,.replace_with = user->name},
-		{.search_for = TEMPLATE_USERID,.replace_with = user->uid},
-		{.search_for = TEMPLATE_ROLE,.replace_with = user->prefix},
-		{NULL, NULL}
-	};
+	return write_contexts(w, &w->s->username_tpl, user, NULL, 0);
+}
 
-	return write_contexts(s, out, tpl, repl, user);
+static int write_user_context(genhomedircon_worker_t *w,
+			      const genhomedircon_user_entry_t *user)
+{
+	return write_contexts(w, &w->s->user_tpl, user, NULL, 0);
 }
 
-static int write_user_context(genhomedircon_settings_t * s, FILE * out,
-			      semanage_list_t * tpl, const genhomedircon_user_entry_t *user)
+static int write_user(genhomedircon_worker_t *w,
+		      const genhomedircon_user_entry_t *user)
 {
-	const replacement_pair_t repl[] = {
-		{.search_for = TEMPLATE_USER,.replace_with = user->name},
-		{.search_for = TEMPLATE_ROLE,.replace_with = user->prefix},
-		{NULL, NULL}
-	};
+	if (write_home_dir_context(w, user) < 0 ||
+	    write_username_context(w, user) < 0 ||
+	    write_user_context(w, user) < 0)
+		return STATUS_ERR;
 
-	return write_contexts(s, out, tpl, repl, user);
+	return STATUS_SUCCESS;
 }
 
 static int seuser_sort_func(const void *arg1, const void *arg2)
@@ -813,21 +1196,28 @@ static int push_user_entry(genhomedircon_user_entry_t ** list, const char *n,
 	name = strdup(n);
 	if (!name)
 		goto cleanup;
-	uid = strdup(u);
-	if (!uid)
-		goto cleanup;
-	gid = strdup(g);
-	if (!gid)
-		goto cleanup;
+	/* the ids and home of a user are not known until it is looked up */
+	if (u) {
+		uid = strdup(u);
+		if (!uid)
+			goto cleanup;
+	}
+	if (g) {
+		gid = strdup(g);
+		if (!gid)
+			goto cleanup;
+	}
 	sename = strdup(sen);
 	if (!sename)
 		goto cleanup;
 	prefix = strdup(pre);
 	if (!prefix)
 		goto cleanup;
-	home = strdup(h);
-	if (!home)
-		goto cleanup;
+	if (h) {
+		home = strdup(h);
+		if (!home)
+			goto cleanup;
+	}
 	level = strdup(l);
 	if (!level)
 		goto cleanup;
@@ -849,6 +1239,8 @@ static int push_user_entry(genhomedircon_user_entry_t ** list, const char *n,
 	temp->level = level;
 	temp->login = lname;
 	temp->homedir_role = homedir_role;
+	temp->conflict = NULL;
+	temp->state = h ? USER_FOUND : USER_PENDING;
 	temp->next = (*list);
 	(*list) = temp;
 
@@ -886,6 +1278,7 @@ static void pop_user_entry(genhomedircon_user_entry_t ** list)
 	free(temp->level);
 	free(temp->login);
 	free(temp->homedir_role);
+	free(temp->conflict);
 	free(temp);
 }
 
@@ -957,50 +1350,90 @@ static int setup_fallback_user(genhomedircon_settings_t * s)
 	return errors;
 }
 
-static genhomedircon_user_entry_t *find_user(genhomedircon_user_entry_t *head,
+static int user_name_cmp(const void *arg1, const void *arg2)
+{
+	const genhomedircon_user_entry_t *user1 = arg1;
+	const genhomedircon_user_entry_t *user2 = arg2;
+
+	return strcmp(user1->name, user2->name);
+}
+
+static void user_name_keep(void *node __attribute__ ((unused)))
+{
+	/* the entries are freed with the list */
+}
+
+/* find_user
+ * @param	names	tsearch() tree of the users found so far
+ * @param	name	login name to look for
+ * @return	the user entry of name, or NULL
+ */
+static genhomedircon_user_entry_t *find_user(void *const *names,
 					     const char *name)
 {
-	for(; head; head = head->next) {
-		if (strcmp(head->name, name) == 0) {
-			return head;
-		}
-	}
+	genhomedircon_user_entry_t key = { .name = (char *) name };
+	void *node;
 
-	return NULL;
+	node = tfind(&key, names, user_name_cmp);
+	if (node == NULL)
+		return NULL;
+
+	return *(genhomedircon_user_entry_t **) node;
 }
 
-static int add_user(genhomedircon_settings_t * s,
-		    genhomedircon_user_entry_t **head,
-		    semanage_user_t *user,
-		    const char *name,
-		    const char *sename,
-		    const char *selogin)
+/* Fills in the home directory and ids of user from its password
+ * entry, unless the home directory is not to be labeled. */
+static int set_user_passwd(genhomedircon_user_entry_t *user,
+			   struct passwd *pwent)
 {
-	if (selogin[0] == '%') {
-		genhomedircon_user_entry_t *orig = find_user(*head, name);
-		if (orig != NULL && orig->login[0] == '%') {
-			ERR(s->h_semanage, "User %s is already mapped to"
-			    " group %s, but also belongs to group %s. Add an"
-			    " explicit mapping for this user to"
-			    " override group mappings.",
-			    name, orig->login + 1, selogin + 1);
-			return STATUS_ERR;
-		} else if (orig != NULL) {
-			// user mappings take precedence
-			return STATUS_SUCCESS;
-		}
+	char uid[11];
+	char gid[11];
+	int len;
+
+	len = strlen(pwent->pw_dir) -1;
+	for(; len > 0 && pwent->pw_dir[len] == '/'; len--) {
+		pwent->pw_dir[len] = '\0';
 	}
 
-	int retval = STATUS_ERR;
+	if (strcmp(pwent->pw_dir, "/") == 0) {
+		/* don't relabel / genhomdircon checked to see if root
+		 * was the user and if so, set his home directory to
+		 * /root */
+		user->state = USER_SKIPPED;
+		return STATUS_SUCCESS;
+	}
+
+	if (ignore(pwent->pw_dir)) {
+		user->state = USER_SKIPPED;
+		return STATUS_SUCCESS;
+	}
+
+	len = snprintf(uid, sizeof(uid), "%u", pwent->pw_uid);
+	if (len < 0 || len >= (int)sizeof(uid))
+		return STATUS_ERR;
+
+	len = snprintf(gid, sizeof(gid), "%u", pwent->pw_gid);
+	if (len < 0 || len >= (int)sizeof(gid))
+		return STATUS_ERR;
+
+	user->uid = strdup(uid);
+	user->gid = strdup(gid);
+	user->home = strdup(pwent->pw_dir);
+	if (!user->uid || !user->gid || !user->home)
+		return STATUS_ERR;
+
+	user->state = USER_FOUND;
+	return STATUS_SUCCESS;
+}
 
+/* Looks up the password entry of user. This runs in the worker
+ * threads, so it must not use the handle. */
+static int resolve_user(genhomedircon_user_entry_t *user)
+{
+	int retval = STATUS_ERR;
 	char *rbuf = NULL;
 	long rbuflen;
 	struct passwd pwstorage, *pwent = NULL;
-	const char *prefix = NULL;
-	const char *level = NULL;
-	const char *homedir_role = NULL;
-	char uid[11];
-	char gid[11];
 
 	errno = 0;
 	/* Allocate space for the getpwnam_r buffer */
@@ -1011,28 +1444,12 @@ static int add_user(genhomedircon_settings_t * s,
 	else if (rbuflen <= 0)
 		goto cleanup;
 
-	if (user) {
-		prefix = semanage_user_get_prefix(user);
-		level = semanage_user_get_mlslevel(user);
-
-		if (!level) {
-			level = FALLBACK_LEVEL;
-		}
-	} else {
-		prefix = name;
-		level = FALLBACK_LEVEL;
-	}
-
-	if (prefix_is_homedir_role(user, prefix)) {
-		homedir_role = prefix;
-	}
-
 retry:
 	rbuf = malloc(rbuflen);
 	if (rbuf == NULL)
 		goto cleanup;
 
-	retval = getpwnam_r(name, &pwstorage, rbuf, rbuflen, &pwent);
+	retval = getpwnam_r(user->name, &pwstorage, rbuf, rbuflen, &pwent);
 	if (retval == ERANGE && rbuflen < LONG_MAX / 2) {
 		free(rbuf);
 		rbuflen *= 2;
@@ -1040,52 +1457,104 @@ retry:
 	}
 	if (retval != 0 || pwent == NULL) {
 		if (retval != 0 && retval != ENOENT) {
+			retval = STATUS_ERR;
 			goto cleanup;
 		}
 
-		WARN(s->h_semanage,
-		     "user %s not in password file", name);
+		user->state = USER_MISSING;
 		retval = STATUS_SUCCESS;
 		goto cleanup;
 	}
 
-	int len = strlen(pwent->pw_dir) -1;
-	for(; len > 0 && pwent->pw_dir[len] == '/'; len--) {
-		pwent->pw_dir[len] = '\0';
-	}
+	retval = set_user_passwd(user, pwent);
+cleanup:
+	if (retval < 0)
+		user->state = USER_FAILED;
+	free(rbuf);
+	return retval;
+}
 
-	if (strcmp(pwent->pw_dir, "/") == 0) {
-		/* don't relabel / genhomdircon checked to see if root
-		 * was the user and if so, set his home directory to
-		 * /root */
-		retval = STATUS_SUCCESS;
-		goto cleanup;
+/* add_user
+ * @param	s	settings structure
+ * @param	head	list to add the user to
+ * @param	names	tsearch() tree of the users in head
+ * @param	user	SELinux user of the login, or NULL
+ * @param	name	login name
+ * @param	sename	name of the SELinux user
+ * @param	selogin	the seuser mapping name came from
+ * @param	pwent	password entry of name if already known, or NULL
+ *			to look it up later
+ * @return	0 on success
+ */
+static int add_user(genhomedircon_settings_t * s,
+		    genhomedircon_user_entry_t **head,
+		    void **names,
+		    semanage_user_t *user,
+		    const char *name,
+		    const char *sename,
+		    const char *selogin,
+		    struct passwd *pwent)
+{
+	if (selogin[0] == '%') {
+		genhomedircon_user_entry_t *orig = find_user(names, name);
+		if (orig != NULL && orig->login[0] == '%') {
+			/* only an error if the user has a home directory
+			 * to label, which is not known until it has been
+			 * looked up, so write_gen_home_dir_context()
+			 * fails the commit then */
+			if (orig->conflict == NULL &&
+			    strcmp(orig->login, selogin) != 0) {
+				orig->conflict = strdup(selogin);
+				if (orig->conflict == NULL)
+					return STATUS_ERR;
+			}
+			return STATUS_SUCCESS;
+		} else if (orig != NULL) {
+			// user mappings take precedence
+			return STATUS_SUCCESS;
+		}
 	}
 
-	if (ignore(pwent->pw_dir)) {
-		retval = STATUS_SUCCESS;
-		goto cleanup;
-	}
+	const char *prefix = NULL;
+	const char *level = NULL;
+	const char *homedir_role = NULL;
 
-	len = snprintf(uid, sizeof(uid), "%u", pwent->pw_uid);
-	if (len < 0 || len >= (int)sizeof(uid)) {
-		goto cleanup;
+	if (user) {
+		prefix = semanage_user_get_prefix(user);
+		level = semanage_user_get_mlslevel(user);
+
+		if (!level) {
+			level = FALLBACK_LEVEL;
+		}
+	} else {
+		prefix = name;
+		level = FALLBACK_LEVEL;
 	}
 
-	len = snprintf(gid, sizeof(gid), "%u", pwent->pw_gid);
-	if (len < 0 || len >= (int)sizeof(gid)) {
-		goto cleanup;
+	if (prefix_is_homedir_role(user, prefix)) {
+		homedir_role = prefix;
 	}
 
-	retval = push_user_entry(head, name, uid, gid, sename, prefix,
-				pwent->pw_dir, level, selogin, homedir_role);
-cleanup:
-	free(rbuf);
-	return retval;
+	if (push_user_entry(head, name, NULL, NULL, sename, prefix,
+			    NULL, level, selogin, homedir_role) < 0)
+		goto oom;
+
+	if (tsearch(*head, names, user_name_cmp) == NULL)
+		goto oom;
+
+	if (pwent != NULL && set_user_passwd(*head, pwent) < 0)
+		goto oom;
+
+	return STATUS_SUCCESS;
+
+oom:
+	ERR(s->h_semanage, "Out of memory!");
+	return STATUS_ERR;
 }
 
 static int get_group_users(genhomedircon_settings_t * s,
 			  genhomedircon_user_entry_t **head,
+			  void **names,
 			  semanage_user_t *user,
 			  const char *sename,
 			  const char *selogin)
@@ -1097,6 +1566,7 @@ static int get_group_users(genhomedircon_settings_t * s,
 	char *grbuf = NULL;
 	struct group grstorage, *group = NULL;
 	struct passwd *pw = NULL;
+	genhomedircon_user_entry_t *orig;
 
 	errno = 0;
 	grbuflen = sysconf(_SC_GETGR_R_SIZE_MAX);
@@ -1135,18 +1605,11 @@ static int get_group_users(genhomedircon_settings_t * s,
 		goto cleanup;
 	}
 
-	size_t nmembers = 0;
-	char **members = group->gr_mem;
-
-	while (*members != NULL) {
-		nmembers++;
-		members++;
-	}
-
-	for (i = 0; i < nmembers; i++) {
+	for (i = 0; group->gr_mem[i] != NULL; i++) {
 		const char *uname = group->gr_mem[i];
 
-		if (add_user(s, head, user, uname, sename, selogin) < 0) {
+		if (add_user(s, head, names, user, uname, sename, selogin,
+			     NULL) < 0) {
 			goto cleanup;
 		}
 	}
@@ -1159,14 +1622,16 @@ static int get_group_users(genhomedircon_settings_t * s,
 			break;
 		// skip users who also have this group as their
 		// primary group
-		if (lfind(pw->pw_name, group->gr_mem, &nmembers,
-			  sizeof(char *), &STR_COMPARATOR)) {
+		orig = find_user(names, pw->pw_name);
+		if (orig != NULL && strcmp(orig->login, selogin) == 0) {
 			continue;
 		}
 
+		/* the password entry is at hand, so it does not have
+		 * to be looked up again */
 		if (group->gr_gid == pw->pw_gid) {
-			if (add_user(s, head, user, pw->pw_name,
-				     sename, selogin) < 0) {
+			if (add_user(s, head, names, user, pw->pw_name,
+				     sename, selogin, pw) < 0) {
 				goto cleanup;
 			}
 		}
@@ -1184,6 +1649,7 @@ static genhomedircon_user_entry_t *get_users(genhomedircon_settings_t * s,
 					     int *errors)
 {
 	genhomedircon_user_entry_t *head = NULL;
+	void *names = NULL;
 	semanage_seuser_t **seuser_list = NULL;
 	unsigned int nseusers = 0;
 	semanage_user_t **user_list = NULL;
@@ -1221,11 +1687,11 @@ static genhomedircon_user_entry_t *get_users(genhomedircon_settings_t * s,
 
 		/* %groupname syntax */
 		if (name[0] == '%') {
-			retval = get_group_users(s, &head, *u, seuname,
+			retval = get_group_users(s, &head, &names, *u, seuname,
 						name);
 		} else {
-			retval = add_user(s, &head, *u, name,
-					  seuname, name);
+			retval = add_user(s, &head, &names, *u, name,
+					  seuname, name, NULL);
 		}
 
 		if (retval != 0) {
@@ -1235,6 +1701,7 @@ static genhomedircon_user_entry_t *get_users(genhomedircon_settings_t * s,
 	}
 
       cleanup:
+	tdestroy(names, user_name_keep);
 	if (*errors) {
 		for (; head; pop_user_entry(&head)) {
 			/* the pop function takes care of all the cleanup
@@ -1254,36 +1721,351 @@ static genhomedircon_user_entry_t *get_users(genhomedircon_settings_t * s,
 	return head;
 }
 
+/* Returns how many threads should look up and write the users. */
+static unsigned int genhomedircon_threads(unsigned int nusers)
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (ncpus > GENHOMEDIRCON_MAX_THREADS)
+		ncpus = GENHOMEDIRCON_MAX_THREADS;
+	if (ncpus > nusers / GENHOMEDIRCON_MIN_USERS)
+		ncpus = nusers / GENHOMEDIRCON_MIN_USERS;
+
+	return ncpus > 1 ? ncpus : 1;
+}
+
+static void *resolve_users(void *arg)
+{
+	genhomedircon_worker_t *w = arg;
+	unsigned int i;
+
+	for (i = w->start; i < w->end; i++) {
+		if (w->users[i]->state == USER_PENDING &&
+		    resolve_user(w->users[i]) < 0) {
+			w->retval = STATUS_ERR;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void *write_users(void *arg)
+{
+	genhomedircon_worker_t *w = arg;
+	unsigned int i;
+
+	for (i = w->start; i < w->end; i++) {
+		if (w->users[i]->state == USER_FOUND &&
+		    write_user(w, w->users[i]) < 0) {
+			w->retval = STATUS_ERR;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/* Splits users start to end between the workers and runs fn for each
+ * of them, the first one in the calling thread. */
+static int run_workers(genhomedircon_worker_t *workers, unsigned int nworkers,
+		       genhomedircon_user_entry_t **users,
+		       unsigned int start, unsigned int end,
+		       void *(*fn) (void *))
+{
+	pthread_t threads[GENHOMEDIRCON_MAX_THREADS];
+	unsigned long long n = end - start;
+	unsigned int i, started;
+	int retval = STATUS_SUCCESS;
+
+	for (i = 0; i < nworkers; i++) {
+		workers[i].users = users;
+		workers[i].start = start + n * i / nworkers;
+		workers[i].end = start + n * (i + 1) / nworkers;
+		workers[i].retval = STATUS_SUCCESS;
+	}
+
+	for (started = 1; started < nworkers; started++) {
+		if (pthread_create(&threads[started], NULL, fn,
+				   &workers[started]) != 0)
+			break;
+	}
+	/* whatever could not be started is done here */
+	for (i = started; i < nworkers; i++)
+		fn(&workers[i]);
+	fn(&workers[0]);
+
+	for (i = 1; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < nworkers; i++) {
+		if (workers[i].retval < 0)
+			retval = STATUS_ERR;
+	}
+
+	return retval;
+}
+
+static size_t home_root_len(const char *home)
+{
+	const char *p = strrchr(home, '/');
+
+	return p ? (size_t) (p - home) : 0;
+}
+
+static int strcmp_null(const char *str1, const char *str2)
+{
+	if (!str1 || !str2)
+		return (str1 != NULL) - (str2 != NULL);
+
+	return strcmp(str1, str2);
+}
+
+/* Users can share an entry if their home directories are in the same
+ * directory and their files get the same SELinux user, level and role */
+static int collapse_key_cmp(const genhomedircon_user_entry_t *user1,
+			    const genhomedircon_user_entry_t *user2)
+{
+	size_t len1 = home_root_len(user1->home);
+	size_t len2 = home_root_len(user2->home);
+	int rc;
+
+	if (len1 != len2)
+		return len1 < len2 ? -1 : 1;
+
+	rc = memcmp(user1->home, user2->home, len1);
+	if (rc == 0)
+		rc = strcmp(user1->sename, user2->sename);
+	if (rc == 0)
+		rc = strcmp(user1->level, user2->level);
+	if (rc == 0)
+		rc = strcmp(user1->prefix, user2->prefix);
+	if (rc == 0)
+		rc = strcmp_null(user1->homedir_role, user2->homedir_role);
+
+	return rc;
+}
+
+static int collapse_sort_func(const void *arg1, const void *arg2)
+{
+	const genhomedircon_user_entry_t *const *user1 = arg1;
+	const genhomedircon_user_entry_t *const *user2 = arg2;
+	int rc;
+
+	rc = collapse_key_cmp(*user1, *user2);
+	if (rc == 0)
+		rc = strcmp((*user1)->name, (*user2)->name);
+
+	return rc;
+}
+
+static int buf_append_regex(genhomedircon_buf_t *buf, const char *str)
+{
+	for (; *str; str++) {
+		if (strchr(".^$?*+|[](){}\\", *str) &&
+		    buf_append(buf, "\\", 1) < 0)
+			return STATUS_ERR;
+		if (buf_append(buf, str, 1) < 0)
+			return STATUS_ERR;
+	}
+
+	return STATUS_SUCCESS;
+}
+
+/* write_collapsed_user
+ * @param	w	worker to append the lines to
+ * @param	members	users sharing their collapse key
+ * @param	n	number of members
+ * @return	0 on success
+ *
+ * Writes one entry matching the names, ids and home directories of
+ * all of the members as alternatives.
+ */
+static int write_collapsed_user(genhomedircon_worker_t *w,
+				genhomedircon_user_entry_t *const *members,
+				unsigned int n)
+{
+	genhomedircon_user_entry_t user = *members[0];
+	genhomedircon_buf_t names = {}, uids = {}, home = {}, comment = {};
+	size_t root_len = home_root_len(members[0]->home);
+	const char *base;
+	unsigned int i;
+	int retval = STATUS_ERR;
+
+	if (n == 1)
+		return write_user(w, members[0]);
+
+	if (buf_append(&home, members[0]->home, root_len) < 0 ||
+	    buf_puts(&home, "/(") < 0 ||
+	    buf_puts(&names, "(") < 0 ||
+	    buf_puts(&uids, "(") < 0)
+		goto done;
+
+	for (i = 0; i < n; i++) {
+		base = members[i]->home + root_len;
+		if (*base == '/')
+			base++;
+
+		if (i > 0 &&
+		    (buf_puts(&home, "|") < 0 ||
+		     buf_puts(&names, "|") < 0 ||
+		     buf_puts(&uids, "|") < 0 ||
+		     buf_puts(&comment, " ") < 0))
+			goto done;
+		if (buf_append_regex(&home, base) < 0 ||
+		    buf_append_regex(&names, members[i]->name) < 0 ||
+		    buf_puts(&uids, members[i]->uid) < 0 ||
+		    buf_puts(&comment, members[i]->name) < 0)
+			goto done;
+	}
+
+	if (buf_puts(&home, ")") < 0 ||
+	    buf_puts(&names, ")") < 0 ||
+	    buf_puts(&uids, ")") < 0)
+		goto done;
+
+	user.home = home.data;
+	user.name = names.data;
+	user.uid = uids.data;
+
+	if (buf_printf(&w->out, COMMENT_USERS_HOME_CONTEXT, comment.data) < 0 ||
+	    write_contexts(w, &w->s->homedir_tpl, &user, members, n) < 0 ||
+	    write_contexts(w, &w->s->username_tpl, &user, members, n) < 0 ||
+	    write_contexts(w, &w->s->user_tpl, &user, members, n) < 0)
+		goto done;
+
+	retval = STATUS_SUCCESS;
+
+done:
+	buf_destroy(&names);
+	buf_destroy(&uids);
+	buf_destroy(&home);
+	buf_destroy(&comment);
+	return retval;
+}
+
+/* Writes the users that were found with up to GENHOMEDIRCON_COLLAPSE_MAX
+ * of them sharing each entry. */
+static int write_collapsed_users(genhomedircon_worker_t *w, FILE *out,
+				 genhomedircon_user_entry_t **users,
+				 unsigned int nusers)
+{
+	genhomedircon_user_entry_t **found;
+	unsigned int i, j, n = 0;
+	int retval = STATUS_ERR;
+
+	found = calloc(nusers ? nusers : 1, sizeof(*found));
+	if (found == NULL)
+		return STATUS_ERR;
+
+	for (i = 0; i < nusers; i++) {
+		if (users[i]->state == USER_FOUND)
+			found[n++] = users[i];
+	}
+
+	qsort(found, n, sizeof(*found), collapse_sort_func);
+
+	for (i = 0; i < n; i = j) {
+		for (j = i + 1; j < n && j - i < GENHOMEDIRCON_COLLAPSE_MAX &&
+			     collapse_key_cmp(found[i], found[j]) == 0; j++)
+			;
+
+		if (write_collapsed_user(w, &found[i], j - i) < 0 ||
+		    flush_worker(w, out) < 0)
+			goto done;
+	}
+
+	retval = STATUS_SUCCESS;
+
+done:
+	free(found);
+	return retval;
+}
+
 static int write_gen_home_dir_context(genhomedircon_settings_t * s, FILE * out,
-				      semanage_list_t * username_context_tpl,
-				      semanage_list_t * user_context_tpl,
-				      semanage_list_t * homedir_context_tpl)
+				      genhomedircon_worker_t *workers)
 {
-	genhomedircon_user_entry_t *users;
+	genhomedircon_user_entry_t *head, *user;
+	genhomedircon_user_entry_t **users = NULL;
+	unsigned int i, n = 0, nworkers, start, end;
 	int errors = 0;
+	int retval = STATUS_ERR;
 
-	users = get_users(s, &errors);
-	if (!users && errors) {
+	head = get_users(s, &errors);
+	if (!head && errors) {
 		return STATUS_ERR;
 	}
 
-	for (; users; pop_user_entry(&users)) {
-		if (write_home_dir_context(s, out, homedir_context_tpl, users))
-			goto err;
-		if (write_username_context(s, out, username_context_tpl, users))
-			goto err;
-		if (write_user_context(s, out, user_context_tpl, users))
+	for (user = head; user; user = user->next)
+		n++;
+
+	users = calloc(n ? n : 1, sizeof(*users));
+	if (users == NULL)
+		goto err;
+	for (i = 0, user = head; user; user = user->next)
+		users[i++] = user;
+
+	/* Looking up the users can take a long time with a directory
+	 * service, so it is done in parallel for all of them first. */
+	nworkers = genhomedircon_threads(n);
+	if (run_workers(workers, nworkers, users, 0, n, resolve_users) < 0) {
+		for (i = 0; i < n && users[i]->state != USER_FAILED; i++)
+			;
+		if (i < n)
+			ERR(s->h_semanage, "Could not look up user %s",
+			    users[i]->name);
+		goto err;
+	}
+
+	/* the users were found in the reverse order of the list */
+	for (i = n; i-- > 0;) {
+		user = users[i];
+		if (user->state == USER_MISSING) {
+			WARN(s->h_semanage,
+			     "user %s not in password file", user->name);
+		} else if (user->state == USER_FOUND) {
+			if (user->conflict) {
+				ERR(s->h_semanage, "User %s is already mapped to"
+				    " group %s, but also belongs to group %s. Add an"
+				    " explicit mapping for this user to"
+				    " override group mappings.",
+				    user->name, user->login + 1,
+				    user->conflict + 1);
+				goto err;
+			}
+			s->nusers++;
+		}
+	}
+
+	if (s->collapse) {
+		if (write_collapsed_users(&workers[0], out, users, n) < 0)
 			goto err;
+	} else {
+		for (start = 0; start < n; start = end) {
+			end = start + nworkers * GENHOMEDIRCON_ROUND;
+			if (end > n)
+				end = n;
+
+			if (run_workers(workers, nworkers, users, start, end,
+					write_users) < 0)
+				goto err;
+
+			for (i = 0; i < nworkers; i++) {
+				if (flush_worker(&workers[i], out) < 0)
+					goto err;
+			}
+		}
 	}
 
-	return STATUS_SUCCESS;
+	retval = STATUS_SUCCESS;
 err:
-	for (; users; pop_user_entry(&users)) {
+	free(users);
+	for (; head; pop_user_entry(&head)) {
 	/* the pop function takes care of all the cleanup
 	 * so the loop body is just empty */
 	}
 
-	return STATUS_ERR;
+	return retval;
 }
 
 /**
@@ -1299,8 +2081,15 @@ static int write_context_file(genhomedircon_settings_t * s, FILE * out)
 	semanage_list_t *homeroot_context_tpl = NULL;
 	semanage_list_t *username_context_tpl = NULL;
 	semanage_list_t *user_context_tpl = NULL;
+	genhomedircon_worker_t workers[GENHOMEDIRCON_MAX_THREADS];
+	genhomedircon_worker_t *w = &workers[0];
+	unsigned int i;
 	int retval = STATUS_SUCCESS;
 
+	memset(workers, 0, sizeof(workers));
+	for (i = 0; i < GENHOMEDIRCON_MAX_THREADS; i++)
+		workers[i].s = s;
+
 	homedir_context_tpl = make_template(s, &HOME_DIR_PRED);
 	homeroot_context_tpl = make_template(s, &HOME_ROOT_PRED);
 	username_context_tpl = make_template(s, &USERNAME_CONTEXT_PRED);
@@ -1312,6 +2101,18 @@ static int write_context_file(genhomedircon_settings_t * s, FILE * out)
 	 && !user_context_tpl)
 		goto done;
 
+	if (tpl_compile(&s->homedir_tpl, homedir_context_tpl,
+			homedir_fields) < 0
+	 || tpl_compile(&s->homeroot_tpl, homeroot_context_tpl,
+			homeroot_fields) < 0
+	 || tpl_compile(&s->username_tpl, username_context_tpl,
+			username_fields) < 0
+	 || tpl_compile(&s->user_tpl, user_context_tpl, user_fields) < 0) {
+		ERR(s->h_semanage, "Out of memory!");
+		retval = STATUS_ERR;
+		goto done;
+	}
+
 	if (write_file_context_header(out) != STATUS_SUCCESS) {
 		retval = STATUS_ERR;
 		goto done;
@@ -1341,16 +2142,13 @@ static int write_context_file(genhomedircon_settings_t * s, FILE * out)
 			free(s->fallback->home);
 			s->fallback->home = temp;
 
-			if (write_home_dir_context(s, out, homedir_context_tpl,
-						   s->fallback) != STATUS_SUCCESS) {
+			if (write_home_dir_context(w, s->fallback) != STATUS_SUCCESS) {
 				free(temp);
 				s->fallback->home = NULL;
 				retval = STATUS_ERR;
 				goto done;
 			}
-			if (write_home_root_context(s, out,
-						    homeroot_context_tpl,
-						    h->data) != STATUS_SUCCESS) {
+			if (write_home_root_context(w, h->data) != STATUS_SUCCESS) {
 				free(temp);
 				s->fallback->home = NULL;
 				retval = STATUS_ERR;
@@ -1362,27 +2160,38 @@ static int write_context_file(genhomedircon_settings_t * s, FILE * out)
 		}
 	}
 	if (user_context_tpl || username_context_tpl) {
-		if (write_username_context(s, out, username_context_tpl,
-					   s->fallback) != STATUS_SUCCESS) {
+		if (write_username_context(w, s->fallback) != STATUS_SUCCESS) {
 			retval = STATUS_ERR;
 			goto done;
 		}
 
-		if (write_user_context(s, out, user_context_tpl,
-				       s->fallback) != STATUS_SUCCESS) {
+		if (write_user_context(w, s->fallback) != STATUS_SUCCESS) {
 			retval = STATUS_ERR;
 			goto done;
 		}
 
-		if (write_gen_home_dir_context(s, out, username_context_tpl,
-					       user_context_tpl, homedir_context_tpl)
+		if (flush_worker(w, out) != STATUS_SUCCESS) {
+			retval = STATUS_ERR;
+			goto done;
+		}
+
+		if (write_gen_home_dir_context(s, out, workers)
 				!= STATUS_SUCCESS) {
 			retval = STATUS_ERR;
 		}
 	}
 
 done:
+	if (retval == STATUS_SUCCESS && flush_worker(w, out) != STATUS_SUCCESS)
+		retval = STATUS_ERR;
+
 	/* Cleanup */
+	for (i = 0; i < GENHOMEDIRCON_MAX_THREADS; i++)
+		worker_destroy(&workers[i]);
+	tpl_destroy(&s->homedir_tpl);
+	tpl_destroy(&s->homeroot_tpl);
+	tpl_destroy(&s->username_tpl);
+	tpl_destroy(&s->user_tpl);
 	semanage_list_destroy(&homedirs);
 	semanage_list_destroy(&username_context_tpl);
 	semanage_list_destroy(&user_context_tpl);
@@ -1397,12 +2206,16 @@ int semanage_genhomedircon(semanage_handle_t * sh,
 			   int usepasswd,
 			   char *ignoredirs)
 {
-	genhomedircon_settings_t s;
+	genhomedircon_settings_t s = {};
+	struct timespec start, end;
 	FILE *out = NULL;
 	int retval = 0;
 
 	assert(sh);
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_mutex_init(&s.lock, NULL);
+
 	s.homedir_template_path =
 	    semanage_path(SEMANAGE_TMP, SEMANAGE_HOMEDIR_TMPL);
 	s.fcfilepath =
@@ -1429,6 +2242,7 @@ int semanage_genhomedircon(semanage_handle_t * sh,
 	if (ignoredirs) ignore_setup(ignoredirs);
 
 	s.usepasswd = usepasswd;
+	s.collapse = sh->conf->genhomedircon_scalable;
 	s.h_semanage = sh;
 	s.policydb = policydb;
 
@@ -1450,6 +2264,14 @@ done:
 		pop_user_entry(&(s.fallback));
 
 	ignore_free();
+	pthread_mutex_destroy(&s.lock);
+
+	if (retval == STATUS_SUCCESS && s.collapse) {
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		INFO(sh, "%u users processed in %.3f seconds.", s.nusers,
+		     (end.tv_sec - start.tv_sec) +
+		     (end.tv_nsec - start.tv_nsec) / 1e9);
+	}
 
 	return retval;
 }
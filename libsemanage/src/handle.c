@@ -33,6 +33,7 @@
 
 #include "direct_api.h"
 #include "handle.h"
+#include "polserv.h"
 #include "debug.h"
 #include "semanage_conf.h"
 #include "semanage_store.h"
@@ -288,6 +289,7 @@ int semanage_is_managed(semanage_handle_t * sh)
 	}
 	switch (sh->conf->store_type) {
 	case SEMANAGE_CON_DIRECT:
+	case SEMANAGE_CON_POLSERV_LOCAL:
 		return semanage_direct_is_managed(sh);
 	default:
 		ERR(sh,
@@ -302,6 +304,7 @@ int semanage_mls_enabled(semanage_handle_t * sh)
 	assert(sh != NULL);
 	switch (sh->conf->store_type) {
 	case SEMANAGE_CON_DIRECT:
+	case SEMANAGE_CON_POLSERV_LOCAL:
 		return semanage_direct_mls_enabled(sh);
 	default:
 		ERR(sh,
@@ -321,6 +324,12 @@ int semanage_connect(semanage_handle_t * sh)
 			}
 			break;
 		}
+	case SEMANAGE_CON_POLSERV_LOCAL:{
+			if (semanage_polserv_connect(sh) < 0) {
+				return -1;
+			}
+			break;
+		}
 	default:{
 			ERR(sh,
 			    "The connection type specified within your semanage.conf file has not been implemented yet.");
@@ -336,6 +345,7 @@ int semanage_access_check(semanage_handle_t * sh)
 	assert(sh != NULL);
 	switch (sh->conf->store_type) {
 	case SEMANAGE_CON_DIRECT:
+	case SEMANAGE_CON_POLSERV_LOCAL:
 		return semanage_direct_access_check(sh);
 	default:
 		return -1;
@@ -22,6 +22,7 @@ typedef semanage_ibendport_key_t record_key_t;
 #include "ibendport_internal.h"
 #include "handle.h"
 #include "database.h"
+#include "utilities.h"
 
 int semanage_ibendport_compare(const semanage_ibendport_t *ibendport,
 			       const semanage_ibendport_key_t *key)
@@ -130,6 +131,18 @@ void semanage_ibendport_free(semanage_ibendport_t *ibendport)
 }
 
 
+static unsigned int semanage_ibendport_key_hash(const semanage_ibendport_key_t *key)
+{
+	const char *ibdev_name;
+	int port;
+	unsigned int hash;
+
+	sepol_ibendport_key_unpack(key, &ibdev_name, &port);
+	hash = semanage_hash_str(SEMANAGE_HASH_INIT, ibdev_name);
+	return semanage_hash_bytes(hash, &port, sizeof(port));
+}
+
+
 /*key base functions */
 const record_table_t SEMANAGE_IBENDPORT_RTABLE = {
 	.create = semanage_ibendport_create,
@@ -140,4 +153,5 @@ const record_table_t SEMANAGE_IBENDPORT_RTABLE = {
 	.compare2 = semanage_ibendport_compare2,
 	.compare2_qsort = semanage_ibendport_compare2_qsort,
 	.free = semanage_ibendport_free,
+	.hash = semanage_ibendport_key_hash,
 };
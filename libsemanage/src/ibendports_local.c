@@ -31,6 +31,24 @@ int semanage_ibendport_del_local(semanage_handle_t *handle,
 	return dbase_del(handle, dconfig, key);
 }
 
+int semanage_ibendport_modify_local_batch(semanage_handle_t * handle,
+					  semanage_ibendport_t * const *records,
+					  unsigned int count)
+{
+
+	dbase_config_t *dconfig = semanage_ibendport_dbase_local(handle);
+	return dbase_modify_batch(handle, dconfig, records, count);
+}
+
+int semanage_ibendport_del_local_batch(semanage_handle_t * handle,
+				       semanage_ibendport_key_t * const *keys,
+				       unsigned int count)
+{
+
+	dbase_config_t *dconfig = semanage_ibendport_dbase_local(handle);
+	return dbase_del_batch(handle, dconfig, keys, count);
+}
+
 int semanage_ibendport_query_local(semanage_handle_t *handle,
 				   const semanage_ibendport_key_t *key,
 				   semanage_ibendport_t **response)
@@ -22,6 +22,7 @@ typedef semanage_ibpkey_key_t record_key_t;
 #include "ibpkey_internal.h"
 #include "handle.h"
 #include "database.h"
+#include "utilities.h"
 
 int semanage_ibpkey_compare(const semanage_ibpkey_t *ibpkey,
 			    const semanage_ibpkey_key_t *key)
@@ -154,6 +155,19 @@ void semanage_ibpkey_free(semanage_ibpkey_t *ibpkey)
 }
 
 
+static unsigned int semanage_ibpkey_key_hash(const semanage_ibpkey_key_t *key)
+{
+	uint64_t subnet_prefix;
+	int range[2];
+	unsigned int hash;
+
+	sepol_ibpkey_key_unpack(key, &subnet_prefix, &range[0], &range[1]);
+	hash = semanage_hash_bytes(SEMANAGE_HASH_INIT, &subnet_prefix,
+				   sizeof(subnet_prefix));
+	return semanage_hash_bytes(hash, range, sizeof(range));
+}
+
+
 /* key base functions */
 const record_table_t SEMANAGE_IBPKEY_RTABLE = {
 	.create = semanage_ibpkey_create,
@@ -164,4 +178,5 @@ const record_table_t SEMANAGE_IBPKEY_RTABLE = {
 	.compare2 = semanage_ibpkey_compare2,
 	.compare2_qsort = semanage_ibpkey_compare2_qsort,
 	.free = semanage_ibpkey_free,
+	.hash = semanage_ibpkey_key_hash,
 };
@@ -22,6 +22,7 @@ typedef sepol_iface_key_t record_key_t;
 #include "iface_internal.h"
 #include "handle.h"
 #include "database.h"
+#include "utilities.h"
 
 /* Key */
 int semanage_iface_compare(const semanage_iface_t * iface,
@@ -145,6 +146,15 @@ void semanage_iface_free(semanage_iface_t * iface)
 }
 
 
+static unsigned int semanage_iface_key_hash(const semanage_iface_key_t * key)
+{
+
+	const char *name;
+	sepol_iface_key_unpack(key, &name);
+	return semanage_hash_str(SEMANAGE_HASH_INIT, name);
+}
+
+
 /* Record base functions */
 const record_table_t SEMANAGE_IFACE_RTABLE = {
 	.create = semanage_iface_create,
@@ -155,4 +165,5 @@ const record_table_t SEMANAGE_IFACE_RTABLE = {
 	.compare2 = semanage_iface_compare2,
 	.compare2_qsort = semanage_iface_compare2_qsort,
 	.free = semanage_iface_free,
+	.hash = semanage_iface_key_hash,
 };
@@ -23,6 +23,7 @@ typedef semanage_node_key_t record_key_t;
 #include "node_internal.h"
 #include "handle.h"
 #include "database.h"
+#include "utilities.h"
 
 /* Key */
 int semanage_node_compare(const semanage_node_t * node,
@@ -208,6 +209,21 @@ void semanage_node_free(semanage_node_t * node)
 }
 
 
+/* The key does not expose the address size, which is at least 4 bytes
+ * for either protocol; nodes comparing equal share all of them. */
+static unsigned int semanage_node_key_hash(const semanage_node_key_t * key)
+{
+
+	const char *addr, *mask;
+	int proto;
+	unsigned int hash;
+
+	sepol_node_key_unpack(key, &addr, &mask, &proto);
+	hash = semanage_hash_bytes(SEMANAGE_HASH_INIT, addr, 4);
+	return semanage_hash_bytes(hash, mask, 4);
+}
+
+
 /* Port base functions */
 const record_table_t SEMANAGE_NODE_RTABLE = {
 	.create = semanage_node_create,
@@ -218,4 +234,5 @@ const record_table_t SEMANAGE_NODE_RTABLE = {
 	.compare2 = semanage_node_compare2,
 	.compare2_qsort = semanage_node_compare2_qsort,
 	.free = semanage_node_free,
+	.hash = semanage_node_key_hash,
 };
@@ -27,6 +27,24 @@ int semanage_node_del_local(semanage_handle_t * handle,
 	return dbase_del(handle, dconfig, key);
 }
 
+int semanage_node_modify_local_batch(semanage_handle_t * handle,
+				     semanage_node_t * const *records,
+				     unsigned int count)
+{
+
+	dbase_config_t *dconfig = semanage_node_dbase_local(handle);
+	return dbase_modify_batch(handle, dconfig, records, count);
+}
+
+int semanage_node_del_local_batch(semanage_handle_t * handle,
+				  semanage_node_key_t * const *keys,
+				  unsigned int count)
+{
+
+	dbase_config_t *dconfig = semanage_node_dbase_local(handle);
+	return dbase_del_batch(handle, dconfig, keys, count);
+}
+
 int semanage_node_query_local(semanage_handle_t * handle,
 			      const semanage_node_key_t * key,
 			      semanage_node_t ** response)
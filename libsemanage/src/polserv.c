@@ -0,0 +1,735 @@
+/*
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* A local policy server keeps one direct connection to the store open
+ * for as long as it runs, so that its configuration, its record
+ * databases and the linked policy of the last commit stay in memory.
+ *
+ * Clients connect over a Unix stream socket and read the store
+ * directly.  When a client begins a transaction the server takes the
+ * transaction lock and creates the sandbox; the client then modifies
+ * the sandbox as it would for a direct store and asks the server to
+ * commit it.  Requests and replies are single lines of text:
+ *
+ *   HELLO <directory>          check that both sides use the same store
+ *   BEGIN                      wait for and take the transaction lock
+ *   COMMIT <modified> <flags>  commit the sandbox
+ *   ABORT                      drop the sandbox
+ *
+ * The flags of a commit carry the settings of the client's handle that
+ * affect a commit; the server applies them for that commit only.
+ *
+ * Each request is answered by any number of "MSG <level> <text>" lines
+ * carrying the server's messages, followed by either "OK <n>", where n
+ * is the result of the request, or "ERR".  Closing the connection
+ * aborts any transaction of the client.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <sepol/handle.h>
+
+#include "database_llist.h"
+#include "debug.h"
+#include "direct_api.h"
+#include "handle.h"
+#include "polserv.h"
+#include "semanage_store.h"
+
+#define POLSERV_LINE_MAX	4096
+#define POLSERV_MAX_CLIENTS	64
+#define POLSERV_BACKLOG		16
+
+/* Unread input of a connection */
+typedef struct polserv_buf {
+	size_t len;
+	char data[POLSERV_LINE_MAX];
+} polserv_buf_t;
+
+#ifdef __GNUC__
+__attribute__ ((format(printf, 2, 3)))
+#endif
+static int polserv_send(int fd, const char *fmt, ...)
+{
+	va_list ap;
+	char *line = NULL;
+	ssize_t n;
+	int len, off = 0;
+
+	va_start(ap, fmt);
+	len = vasprintf(&line, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return -1;
+
+	/* Lines never contain a newline of their own */
+	line[strcspn(line, "\n")] = '\0';
+	len = strlen(line);
+	line[len++] = '\n';
+
+	while (off < len) {
+		n = send(fd, line + off, len - off, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			free(line);
+			return -1;
+		}
+		off += n;
+	}
+
+	free(line);
+	return 0;
+}
+
+/* Moves the next complete line out of buf.  Returns 1 if there was
+ * one, 0 if more input is needed and -1 if the line is too long. */
+static int polserv_take_line(polserv_buf_t *buf, char *line)
+{
+	char *end = memchr(buf->data, '\n', buf->len);
+	size_t len;
+
+	if (end == NULL)
+		return buf->len == sizeof(buf->data) ? -1 : 0;
+
+	len = end - buf->data;
+	memcpy(line, buf->data, len);
+	line[len] = '\0';
+	buf->len -= len + 1;
+	memmove(buf->data, end + 1, buf->len);
+	return 1;
+}
+
+/* Reads more input into buf.  Returns 0 at end of file. */
+static ssize_t polserv_fill(int fd, polserv_buf_t *buf)
+{
+	ssize_t n;
+
+	do {
+		n = read(fd, buf->data + buf->len, sizeof(buf->data) - buf->len);
+	} while (n < 0 && errno == EINTR);
+
+	if (n > 0)
+		buf->len += n;
+	return n;
+}
+
+/* ================ Client ================ */
+
+#ifdef __GNUC__
+__attribute__ ((format(printf, 2, 3)))
+#endif
+static int polserv_request(semanage_handle_t *sh, const char *fmt, ...)
+{
+	int fd = sh->u.direct.server_fd;
+	polserv_buf_t buf = { .len = 0 };
+	char line[POLSERV_LINE_MAX];
+	char *request = NULL;
+	va_list ap;
+	int level, len, result;
+
+	va_start(ap, fmt);
+	len = vasprintf(&request, fmt, ap);
+	va_end(ap);
+	if (len < 0) {
+		ERR(sh, "Out of memory!");
+		return -1;
+	}
+	if (polserv_send(fd, "%s", request) < 0) {
+		ERR(sh, "Could not send request to the policy server.");
+		free(request);
+		return -1;
+	}
+	free(request);
+
+	for (;;) {
+		switch (polserv_take_line(&buf, line)) {
+		case 0:
+			if (polserv_fill(fd, &buf) <= 0) {
+				ERR(sh, "Lost connection to the policy server.");
+				return -1;
+			}
+			continue;
+		case -1:
+			ERR(sh, "Invalid reply from the policy server.");
+			return -1;
+		}
+
+		if (sscanf(line, "MSG %d %n", &level, &len) == 1) {
+			if (level != SEMANAGE_MSG_ERR &&
+			    level != SEMANAGE_MSG_WARN)
+				level = SEMANAGE_MSG_INFO;
+			msg_write(sh, level, "libsemanage", __FUNCTION__,
+				  "%s", line + len);
+		} else if (sscanf(line, "OK %d", &result) == 1) {
+			return result;
+		} else if (strcmp(line, "ERR") == 0) {
+			return -1;
+		} else {
+			ERR(sh, "Invalid reply from the policy server.");
+			return -1;
+		}
+	}
+}
+
+int semanage_polserv_connect(semanage_handle_t *sh)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	const char *path = sh->conf->server_path;
+	int fd = -1;
+
+	if (path == NULL || strlen(path) >= sizeof(addr.sun_path)) {
+		ERR(sh, "Invalid policy server socket %s.", path ? path : "");
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	if (semanage_direct_connect(sh) < 0)
+		return -1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		ERR(sh, "Could not connect to the policy server at %s.", path);
+		goto err;
+	}
+	sh->u.direct.server_fd = fd;
+
+	/* The directory covers the root, the store root and the store */
+	if (polserv_request(sh, "HELLO %s",
+			    semanage_path(SEMANAGE_ACTIVE, SEMANAGE_TOPLEVEL)) < 0)
+		goto err;
+
+	return STATUS_SUCCESS;
+
+      err:
+	if (fd >= 0)
+		close(fd);
+	sh->u.direct.server_fd = -1;
+	(void) semanage_direct_disconnect(sh);
+	return STATUS_ERR;
+}
+
+int semanage_polserv_disconnect(semanage_handle_t *sh)
+{
+	int retval;
+
+	/* The sandbox belongs to the server, which drops it when the
+	 * connection is closed in the middle of a transaction. */
+	sh->is_in_transaction = 0;
+	retval = semanage_direct_disconnect(sh);
+
+	if (sh->u.direct.server_fd >= 0)
+		close(sh->u.direct.server_fd);
+	sh->u.direct.server_fd = -1;
+
+	return retval;
+}
+
+int semanage_polserv_begintrans(semanage_handle_t *sh)
+{
+	if (polserv_request(sh, "BEGIN") < 0)
+		return -1;
+	return 0;
+}
+
+int semanage_polserv_commit(semanage_handle_t *sh)
+{
+	dbase_config_t *users = semanage_user_dbase_local(sh);
+	unsigned int i, modified = 0;
+	int retval;
+
+	/* Write the local modifications to the sandbox, where the server
+	 * reads the ones it is told about. */
+	if (users->dtable->is_modified(users->dbase) &&
+	    users->dtable->flush(sh, users->dbase) < 0)
+		goto err;
+
+	for (i = 0; i <= DBASE_LOCAL_IBENDPORTS; i++) {
+		dbase_config_t *dconfig = &sh->dbase[i];
+
+		if (i == DBASE_LOCAL_USERS ||
+		    !dconfig->dtable->is_modified(dconfig->dbase))
+			continue;
+
+		if (dconfig->dtable->flush(sh, dconfig->dbase) < 0)
+			goto err;
+		modified |= 1U << i;
+	}
+
+	retval = polserv_request(sh, "COMMIT %u %d %d %d %d %d %d %d %d",
+				 modified, sh->modules_modified, sh->do_rebuild,
+				 sh->do_reload, sh->check_ext_changes,
+				 sh->do_check_contexts,
+				 sepol_get_disable_dontaudit(sh->sepolh),
+				 sepol_get_preserve_tunables(sh->sepolh),
+				 sh->conf->ignore_module_cache);
+	if (retval < 0)
+		sh->commit_err = retval;
+
+	/* Reread whatever the commit left in the store */
+	for (i = 0; i <= DBASE_LOCAL_IBENDPORTS; i++)
+		sh->dbase[i].dtable->drop_cache(sh->dbase[i].dbase);
+
+	return retval;
+
+      err:
+	ERR(sh, "Could not write local modifications for the policy server.");
+	(void) polserv_request(sh, "ABORT");
+	return -1;
+}
+
+/* ================ Server ================ */
+
+typedef struct polserv_client {
+	int fd;
+	int greeted;
+	/* Position in the queue for the transaction lock, 0 if none */
+	unsigned long ticket;
+	polserv_buf_t buf;
+} polserv_client_t;
+
+typedef struct polserv_server {
+	semanage_handle_t *sh;
+	polserv_client_t clients[POLSERV_MAX_CLIENTS];
+	/* Client holding the transaction, -1 if none */
+	int owner;
+	unsigned long next_ticket;
+
+	/* Message handler of the server itself */
+#ifdef __GNUC__
+	__attribute__ ((format(printf, 3, 4)))
+#endif
+	void (*msg_callback) (void *varg,
+			      semanage_handle_t * handle, const char *fmt, ...);
+	void *msg_callback_arg;
+
+	/* Settings of the server itself, restored after each commit */
+	int do_rebuild;
+	int do_reload;
+	int check_ext_changes;
+	int do_check_contexts;
+	int disable_dontaudit;
+	int preserve_tunables;
+	int ignore_module_cache;
+} polserv_server_t;
+
+#ifdef __GNUC__
+__attribute__ ((format(printf, 3, 4)))
+#endif
+static void polserv_msg(void *varg, semanage_handle_t *sh,
+			const char *fmt, ...)
+{
+	polserv_client_t *client = varg;
+	char *msg = NULL;
+	va_list ap;
+	char *p;
+	int len;
+
+	va_start(ap, fmt);
+	len = vasprintf(&msg, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+
+	for (p = msg; *p; p++)
+		if (*p == '\n')
+			*p = ' ';
+
+	(void) polserv_send(client->fd, "MSG %d %s", sh->msg_level, msg);
+	free(msg);
+}
+
+/* Runs a request of client, relaying the messages it produces.  If
+ * result is not NULL it receives the result of the request.  Returns -1
+ * if the reply could not be sent. */
+static int polserv_run(polserv_server_t *srv, polserv_client_t *client,
+		       int (*func) (polserv_server_t *, const char *),
+		       const char *args, int *result)
+{
+	semanage_handle_t *sh = srv->sh;
+	int retval;
+
+	sh->msg_callback = polserv_msg;
+	sh->msg_callback_arg = client;
+	retval = func(srv, args);
+	sh->msg_callback = srv->msg_callback;
+	sh->msg_callback_arg = srv->msg_callback_arg;
+
+	if (result)
+		*result = retval;
+	if (retval < 0)
+		return polserv_send(client->fd, "ERR");
+	return polserv_send(client->fd, "OK %d", retval);
+}
+
+static int polserv_hello(polserv_server_t *srv, const char *args)
+{
+	semanage_handle_t *sh = srv->sh;
+	const char *dir = semanage_path(SEMANAGE_ACTIVE, SEMANAGE_TOPLEVEL);
+
+	if (strcmp(args, dir) != 0) {
+		ERR(sh, "The policy server manages the store in %s.", dir);
+		return -1;
+	}
+	return 0;
+}
+
+static int polserv_begin(polserv_server_t *srv,
+			 const char *args __attribute__ ((unused)))
+{
+	srv->sh->commit_err = 0;
+	return semanage_begin_transaction(srv->sh);
+}
+
+static int polserv_commit(polserv_server_t *srv, const char *args)
+{
+	semanage_handle_t *sh = srv->sh;
+	unsigned int i, modified;
+	int modules_modified, do_rebuild, do_reload, check_ext_changes,
+	    do_check_contexts, disable_dontaudit, preserve_tunables,
+	    ignore_module_cache;
+	int retval;
+
+	if (sscanf(args, "%u %d %d %d %d %d %d %d %d", &modified,
+		   &modules_modified, &do_rebuild, &do_reload,
+		   &check_ext_changes, &do_check_contexts,
+		   &disable_dontaudit, &preserve_tunables,
+		   &ignore_module_cache) != 9) {
+		ERR(sh, "Invalid commit request.");
+		semanage_direct_abort(sh);
+		return -1;
+	}
+
+	/* Pick up the local modifications the client wrote to the
+	 * sandbox.  All local databases are file backed lists. */
+	for (i = 0; i <= DBASE_LOCAL_IBENDPORTS; i++) {
+		dbase_config_t *dconfig = &sh->dbase[i];
+
+		dconfig->dtable->drop_cache(dconfig->dbase);
+		if (i == DBASE_LOCAL_USERS || !(modified & (1U << i)))
+			continue;
+
+		if (dconfig->dtable->cache(sh, dconfig->dbase) < 0) {
+			semanage_direct_abort(sh);
+			return -1;
+		}
+		dbase_llist_set_modified((dbase_llist_t *) dconfig->dbase, 1);
+	}
+
+	sh->modules_modified = modules_modified;
+	sh->do_rebuild = do_rebuild;
+	sh->do_reload = do_reload;
+	sh->check_ext_changes = check_ext_changes;
+	sh->do_check_contexts = do_check_contexts;
+	sepol_set_disable_dontaudit(sh->sepolh, disable_dontaudit);
+	sepol_set_preserve_tunables(sh->sepolh, preserve_tunables);
+	sh->conf->ignore_module_cache = ignore_module_cache;
+
+	retval = semanage_commit(sh);
+
+	sh->do_rebuild = srv->do_rebuild;
+	sh->do_reload = srv->do_reload;
+	sh->check_ext_changes = srv->check_ext_changes;
+	sh->do_check_contexts = srv->do_check_contexts;
+	sepol_set_disable_dontaudit(sh->sepolh, srv->disable_dontaudit);
+	sepol_set_preserve_tunables(sh->sepolh, srv->preserve_tunables);
+	sh->conf->ignore_module_cache = srv->ignore_module_cache;
+
+	return retval;
+}
+
+static int polserv_abort(polserv_server_t *srv,
+			 const char *args __attribute__ ((unused)))
+{
+	semanage_direct_abort(srv->sh);
+	return 0;
+}
+
+static void polserv_drop(polserv_server_t *srv, int i)
+{
+	polserv_client_t *client = &srv->clients[i];
+
+	if (srv->owner == i) {
+		semanage_direct_abort(srv->sh);
+		srv->owner = -1;
+	}
+
+	close(client->fd);
+	client->fd = -1;
+}
+
+/* Hands the transaction lock to the client that has waited longest. */
+static void polserv_grant(polserv_server_t *srv)
+{
+	polserv_client_t *client;
+	int i, next;
+
+	while (srv->owner < 0) {
+		next = -1;
+		for (i = 0; i < POLSERV_MAX_CLIENTS; i++) {
+			client = &srv->clients[i];
+			if (client->fd >= 0 && client->ticket != 0 &&
+			    (next < 0 ||
+			     client->ticket < srv->clients[next].ticket))
+				next = i;
+		}
+		if (next < 0)
+			return;
+
+		client = &srv->clients[next];
+		client->ticket = 0;
+		if (polserv_run(srv, client, polserv_begin, "", NULL) < 0)
+			polserv_drop(srv, next);
+		else if (srv->sh->is_in_transaction)
+			srv->owner = next;
+	}
+}
+
+static int polserv_handle(polserv_server_t *srv, int i, char *line)
+{
+	polserv_client_t *client = &srv->clients[i];
+	const char *args = strchr(line, ' ');
+	int result;
+
+	args = args ? args + 1 : "";
+
+	if (!client->greeted) {
+		if (strncmp(line, "HELLO ", 6) != 0 ||
+		    polserv_run(srv, client, polserv_hello, args, &result) < 0 ||
+		    result < 0)
+			return -1;
+		client->greeted = 1;
+		return 0;
+	}
+
+	if (strcmp(line, "BEGIN") == 0) {
+		if (srv->owner == i)
+			return polserv_send(client->fd, "OK 0");
+		if (client->ticket == 0)
+			client->ticket = ++srv->next_ticket;
+		return 0;
+	}
+
+	if (strncmp(line, "COMMIT ", 7) == 0 && srv->owner == i) {
+		srv->owner = -1;
+		return polserv_run(srv, client, polserv_commit, args, NULL);
+	}
+
+	if (strcmp(line, "ABORT") == 0 && srv->owner == i) {
+		srv->owner = -1;
+		return polserv_run(srv, client, polserv_abort, args, NULL);
+	}
+
+	return polserv_send(client->fd, "ERR");
+}
+
+static void polserv_accept(polserv_server_t *srv, int listen_fd)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	int fd, i;
+
+	fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	/* Only the server's own user and root may manage the policy */
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 ||
+	    (cred.uid != 0 && cred.uid != geteuid())) {
+		close(fd);
+		return;
+	}
+
+	for (i = 0; i < POLSERV_MAX_CLIENTS; i++) {
+		polserv_client_t *client = &srv->clients[i];
+
+		if (client->fd < 0) {
+			client->fd = fd;
+			client->greeted = 0;
+			client->ticket = 0;
+			client->buf.len = 0;
+			return;
+		}
+	}
+
+	ERR(srv->sh, "Too many policy server clients.");
+	close(fd);
+}
+
+static void polserv_read(polserv_server_t *srv, int i)
+{
+	polserv_client_t *client = &srv->clients[i];
+	char line[POLSERV_LINE_MAX];
+	int rc;
+
+	if (polserv_fill(client->fd, &client->buf) <= 0) {
+		polserv_drop(srv, i);
+		return;
+	}
+
+	while ((rc = polserv_take_line(&client->buf, line)) > 0) {
+		if (polserv_handle(srv, i, line) < 0) {
+			polserv_drop(srv, i);
+			return;
+		}
+	}
+	if (rc < 0)
+		polserv_drop(srv, i);
+}
+
+static int polserv_listen(semanage_handle_t *sh, const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct stat sb;
+	mode_t mask;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		ERR(sh, "Invalid policy server socket %s.", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	/* Replace the socket of a previous server */
+	if (lstat(path, &sb) == 0 && S_ISSOCK(sb.st_mode))
+		unlink(path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		ERR(sh, "Could not create policy server socket.");
+		return -1;
+	}
+
+	mask = umask(0077);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(fd, POLSERV_BACKLOG) < 0) {
+		umask(mask);
+		ERR(sh, "Could not listen on %s.", path);
+		close(fd);
+		return -1;
+	}
+	umask(mask);
+
+	return fd;
+}
+
+int semanage_serve(semanage_handle_t *sh, const char *path)
+{
+	polserv_server_t srv = { .sh = sh, .owner = -1 };
+	struct pollfd fds[POLSERV_MAX_CLIENTS + 1];
+	int slots[POLSERV_MAX_CLIENTS + 1];
+	sigset_t block, orig;
+	int listen_fd, retval = -1;
+	int i, n;
+
+	assert(sh != NULL);
+
+	if (sh->is_connected) {
+		ERR(sh, "Already connected.");
+		return -1;
+	}
+
+	if (path == NULL)
+		path = sh->conf->server_path;
+	if (path == NULL) {
+		ERR(sh, "No policy server socket was given.");
+		return -1;
+	}
+
+	/* The server itself manipulates the store directly */
+	sh->conf->store_type = SEMANAGE_CON_DIRECT;
+	if (semanage_connect(sh) < 0)
+		return -1;
+	sh->u.direct.keep_policydb = 1;
+
+	srv.msg_callback = sh->msg_callback;
+	srv.msg_callback_arg = sh->msg_callback_arg;
+	srv.do_rebuild = sh->do_rebuild;
+	srv.do_reload = sh->do_reload;
+	srv.check_ext_changes = sh->check_ext_changes;
+	srv.do_check_contexts = sh->do_check_contexts;
+	srv.disable_dontaudit = sepol_get_disable_dontaudit(sh->sepolh);
+	srv.preserve_tunables = sepol_get_preserve_tunables(sh->sepolh);
+	srv.ignore_module_cache = sh->conf->ignore_module_cache;
+	for (i = 0; i < POLSERV_MAX_CLIENTS; i++)
+		srv.clients[i].fd = -1;
+
+	listen_fd = polserv_listen(sh, path);
+	if (listen_fd < 0)
+		goto out;
+
+	/* Termination signals are only delivered while waiting for
+	 * requests, so that they never interrupt a commit. */
+	sigemptyset(&block);
+	sigaddset(&block, SIGTERM);
+	sigaddset(&block, SIGINT);
+	sigaddset(&block, SIGHUP);
+	sigprocmask(SIG_BLOCK, &block, &orig);
+
+	for (;;) {
+		n = 0;
+		fds[n].fd = listen_fd;
+		fds[n].events = POLLIN;
+		slots[n++] = -1;
+		for (i = 0; i < POLSERV_MAX_CLIENTS; i++) {
+			if (srv.clients[i].fd < 0)
+				continue;
+			fds[n].fd = srv.clients[i].fd;
+			fds[n].events = POLLIN;
+			slots[n++] = i;
+		}
+
+		if (ppoll(fds, n, NULL, &orig) < 0) {
+			if (errno == EINTR)
+				retval = 0;
+			else
+				ERR(sh, "Could not wait for policy server clients.");
+			break;
+		}
+
+		for (i = 1; i < n; i++)
+			if (fds[i].revents &&
+			    srv.clients[slots[i]].fd == fds[i].fd)
+				polserv_read(&srv, slots[i]);
+		if (fds[0].revents & POLLIN)
+			polserv_accept(&srv, listen_fd);
+
+		polserv_grant(&srv);
+	}
+
+	sigprocmask(SIG_SETMASK, &orig, NULL);
+
+	for (i = 0; i < POLSERV_MAX_CLIENTS; i++)
+		if (srv.clients[i].fd >= 0)
+			polserv_drop(&srv, i);
+	close(listen_fd);
+	unlink(path);
+
+      out:
+	semanage_disconnect(sh);
+	return retval;
+}
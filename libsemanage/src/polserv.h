@@ -0,0 +1,35 @@
+/*
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _SEMANAGE_POLSERV_H_
+#define _SEMANAGE_POLSERV_H_
+
+/* Circular dependency */
+struct semanage_handle;
+
+/* Connects to the local policy server listening on the socket given
+ * by the module-store setting.  The connection uses the direct store
+ * for everything but transactions, which the server takes and commits
+ * on behalf of the client. */
+int semanage_polserv_connect(struct semanage_handle *sh);
+
+int semanage_polserv_disconnect(struct semanage_handle *sh);
+
+int semanage_polserv_begintrans(struct semanage_handle *sh);
+
+int semanage_polserv_commit(struct semanage_handle *sh);
+
+#endif
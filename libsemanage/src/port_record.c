@@ -22,6 +22,7 @@ typedef semanage_port_key_t record_key_t;
 #include "port_internal.h"
 #include "handle.h"
 #include "database.h"
+#include "utilities.h"
 
 /* Key */
 int semanage_port_compare(const semanage_port_t * port,
@@ -164,6 +165,15 @@ void semanage_port_free(semanage_port_t * port)
 }
 
 
+static unsigned int semanage_port_key_hash(const semanage_port_key_t * key)
+{
+
+	int data[3];
+	sepol_port_key_unpack(key, &data[0], &data[1], &data[2]);
+	return semanage_hash_bytes(SEMANAGE_HASH_INIT, data, sizeof(data));
+}
+
+
 /* Port base functions */
 const record_table_t SEMANAGE_PORT_RTABLE = {
 	.create = semanage_port_create,
@@ -174,4 +184,5 @@ const record_table_t SEMANAGE_PORT_RTABLE = {
 	.compare2 = semanage_port_compare2,
 	.compare2_qsort = semanage_port_compare2_qsort,
 	.free = semanage_port_free,
+	.hash = semanage_port_key_hash,
 };
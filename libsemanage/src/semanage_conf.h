@@ -29,9 +29,17 @@
  *  - external programs to execute whenever a policy is to be loaded
  */
 
+/* how modules are compressed in the store */
+enum semanage_compression {
+	SEMANAGE_COMPRESS_BZIP2,
+	SEMANAGE_COMPRESS_ZSTD,
+	SEMANAGE_COMPRESS_NONE
+};
+
 typedef struct semanage_conf {
 	enum semanage_connect_type store_type;
-	char *store_path;	/* used for both socket path and policy dir */
+	char *store_path;	/* used for both server name and policy dir */
+	char *server_path;	/* socket of the local policy server */
 	char *compiler_directory_path;
 	int server_port;
 	int policyvers;		/* version for server generated policies */
@@ -41,11 +49,15 @@ typedef struct semanage_conf {
 	int save_linked;
 	int disable_genhomedircon;
 	int usepasswd;
+	int genhomedircon_scalable;	/* collapse users with the same home root */
 	int handle_unknown;
 	mode_t file_mode;
 	int bzip_blocksize;
 	int bzip_small;
+	enum semanage_compression compression;
+	int zstd_level;
 	int remove_hll;
+	int compiler_jobs;	/* 0 means one per online CPU */
 	int ignore_module_cache;
 	int optimize_policy;
 	int multiple_decls;
@@ -53,6 +65,8 @@ typedef struct semanage_conf {
 	struct external_prog *load_policy;
 	struct external_prog *setfiles;
 	struct external_prog *sefcontext_compile;
+	int setfiles_configured;	/* run setfiles instead of checking in-process */
+	int sefcontext_compile_configured;	/* likewise for sefcontext_compile */
 	struct external_prog *mod_prog, *linked_prog, *kernel_prog;
 	char *store_root_path;
 } semanage_conf_t;
@@ -36,8 +36,10 @@ typedef struct dbase_policydb dbase_t;
 #include "database_policydb.h"
 #include "handle.h"
 
+#include <selinux/label.h>
 #include <selinux/restorecon.h>
 #include <selinux/selinux.h>
+#include <sepol/context.h>
 #include <sepol/policydb.h>
 #include <sepol/module.h>
 
@@ -48,19 +50,27 @@ typedef struct dbase_policydb dbase_t;
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdio_ext.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/file.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <limits.h>
 #include <libgen.h>
+#include <pthread.h>
 
 #include "debug.h"
 #include "utilities.h"
 #include "compressed_file.h"
+#include "sha256.h"
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
 
 #define SEMANAGE_CONF_FILE "semanage.conf"
 /* relative path names to enum semanage_paths to special files and
@@ -115,6 +125,7 @@ static const char *const semanage_sandbox_paths[SEMANAGE_STORE_NUM_PATHS] = {
 	"/preserve_tunables",
 	"/modules/disabled",
 	"/modules_checksum",
+	"/modules_digests",
 	"/policy.kern",
 	"/file_contexts.local",
 	"/file_contexts.homedirs",
@@ -131,27 +142,21 @@ static char *semanage_final[SEMANAGE_FINAL_NUM] = { NULL };
 static char *semanage_final_suffix[SEMANAGE_FINAL_PATH_NUM] = { NULL };
 static char *semanage_final_paths[SEMANAGE_FINAL_NUM][SEMANAGE_FINAL_PATH_NUM] = {{ NULL }};
 
-/* A node used in a linked list of file contexts; used for sorting.
+/* An entry of the file contexts being sorted.  The strings point into
+ * the buffer being sorted and are not NUL terminated.
  */
-typedef struct semanage_file_context_node {
-	char *path;
-	char *file_type;
-	char *context;
+typedef struct semanage_file_context {
+	const char *path;
+	const char *file_type;	/* NULL if none */
+	const char *context;
 	size_t path_len;
-	size_t effective_len;
 	size_t type_len;
 	size_t context_len;
-	int meta;		/* position of first meta char in path, -1 if none */
-	struct semanage_file_context_node *next;
-} semanage_file_context_node_t;
-
-/* A node used in a linked list of buckets that contain
- *  semanage_file_context_node lists.  Used for sorting.
- */
-typedef struct semanage_file_context_bucket {
-	semanage_file_context_node_t *data;
-	struct semanage_file_context_bucket *next;
-} semanage_file_context_bucket_t;
+	/* Sort keys computed once per entry, see semanage_fc_compare() */
+	size_t stem_key;
+	size_t len_key;
+	size_t index;		/* position in the input, keeps the sort stable */
+} semanage_file_context_t;
 
 /* A node used in a linked list of netfilter rules.
  */
@@ -656,7 +661,18 @@ int semanage_store_access_check(void)
 
 /********************* other I/O functions *********************/
 
+/* flags for semanage_copy_dir_flags() */
+#define SEMANAGE_COPY_FILES		0x1	/* copy regular files as well */
+#define SEMANAGE_COPY_LINK		0x2	/* hard link regular files where possible */
+#define SEMANAGE_COPY_LINK_MODULES	0x4	/* hard link the module directory only */
+
 static int semanage_copy_dir_flags(semanage_handle_t * sh, const char *src, const char *dst, int flag);
+static int semanage_module_digests_verify(semanage_handle_t *sh,
+					  enum semanage_store_defs store,
+					  semanage_module_digests_t **digests);
+static void semanage_module_digests_refresh(semanage_handle_t *sh,
+					    enum semanage_store_defs store,
+					    semanage_module_digests_t *digests);
 
 /* Callback used by scandir() to select files. */
 static int semanage_filename_select(const struct dirent *d)
@@ -698,20 +714,24 @@ int semanage_copy_file(semanage_handle_t *sh, const char *src, const char *dst,
 		goto out;
 	}
 	umask(mask);
-	while ((amount_read = read(in, buf, sizeof(buf))) > 0) {
-		if (write_full(out, buf, amount_read) == -1) {
-			if (errno)
-				errsv = errno;
-			else
-				errsv = EIO;
+	/* Share the data with the source if the filesystem supports
+	 * reflinks; the blocks are copied when either file is written. */
+	if (ioctl(out, FICLONE, in) != 0) {
+		while ((amount_read = read(in, buf, sizeof(buf))) > 0) {
+			if (write_full(out, buf, amount_read) == -1) {
+				if (errno)
+					errsv = errno;
+				else
+					errsv = EIO;
+				retval = -1;
+				break;
+			}
+		}
+		if (amount_read < 0) {
+			errsv = errno;
 			retval = -1;
-			break;
 		}
 	}
-	if (amount_read < 0) {
-		errsv = errno;
-		retval = -1;
-	}
 	close(in);
 	if (syncrequired && fsync(out) < 0) {
 		errsv = errno;
@@ -741,25 +761,22 @@ static int semanage_rename(semanage_handle_t * sh, const char *src, const char *
 	/* we can't use rename() due to filesystem limitation, lets try to copy files manually */
 	WARN(sh, "WARNING: rename(%s, %s) failed: %m, fall back to non-atomic semanage_copy_dir_flags()",
 		 src, dst);
-	if (semanage_copy_dir_flags(sh, src, dst, 1) == -1) {
+	if (semanage_copy_dir_flags(sh, src, dst, SEMANAGE_COPY_FILES) == -1) {
 		return -1;
 	}
 	return semanage_remove_directory(src);
 }
 
-/* Copies all of the files from src to dst, recursing into
- * subdirectories.  Returns 0 on success, -1 on error. */
-static int semanage_copy_dir(semanage_handle_t * sh, const char *src, const char *dst)
-{
-	return semanage_copy_dir_flags(sh, src, dst, 1);
-}
-
 /* Copies all of the dirs from src to dst, recursing into
- * subdirectories. If flag == 1, then copy regular files as
- * well. Returns 0 on success, -1 on error. */
+ * subdirectories. If SEMANAGE_COPY_FILES is set in flag, then copy
+ * regular files as well. With SEMANAGE_COPY_LINK, files are hard linked
+ * instead of copied where possible; SEMANAGE_COPY_LINK_MODULES does so
+ * only below the module directory of the active store. Linked files must
+ * never be written to in place. Returns 0 on success, -1 on error. */
 static int semanage_copy_dir_flags(semanage_handle_t * sh, const char *src, const char *dst, int flag)
 {
 	int i, len = 0, rc, retval = -1;
+	int subflag;
 	struct stat sb;
 	struct dirent **names = NULL;
 	char path[PATH_MAX], path2[PATH_MAX];
@@ -799,15 +816,21 @@ static int semanage_copy_dir_flags(semanage_handle_t * sh, const char *src, cons
 			goto cleanup;
 		}
 		if (S_ISDIR(sb.st_mode)) {
+			subflag = flag;
+			if ((flag & SEMANAGE_COPY_LINK_MODULES) &&
+			    strcmp(path, semanage_path(SEMANAGE_ACTIVE, SEMANAGE_MODULES)) == 0)
+				subflag |= SEMANAGE_COPY_LINK;
 			mask = umask(0077);
 			if (mkdir(path2, 0700) == -1 ||
-			    semanage_copy_dir_flags(sh, path, path2, flag) == -1) {
+			    semanage_copy_dir_flags(sh, path, path2, subflag) == -1) {
 				umask(mask);
 				goto cleanup;
 			}
 			umask(mask);
 			semanage_setfiles(sh, path2);
-		} else if (S_ISREG(sb.st_mode) && flag == 1) {
+		} else if (S_ISREG(sb.st_mode) && (flag & SEMANAGE_COPY_FILES)) {
+			if ((flag & SEMANAGE_COPY_LINK) && link(path, path2) == 0)
+				continue;
 			mask = umask(0077);
 			if (semanage_copy_file(sh, path, path2, sb.st_mode,
 						false) < 0) {
@@ -931,17 +954,30 @@ cleanup:
 
 /* Creates a sandbox for a single client. Returns 0 if a
  * sandbox was created, -1 on error.
+ *
+ * The module files are hard linked from the active store rather than
+ * copied, so everything writing to the module directory replaces files
+ * instead of overwriting them (see write_compressed_file()). Other files
+ * are copied, using reflinks where the filesystem supports them.
  */
 int semanage_make_sandbox(semanage_handle_t * sh)
 {
 	const char *sandbox = semanage_path(SEMANAGE_TMP, SEMANAGE_TOPLEVEL);
+	semanage_module_digests_t *digests = NULL;
 	struct stat buf;
 	int errsv;
 	mode_t mask;
 
+	/* Linking the module files into the sandbox, or unlinking them from
+	 * an old one, moves their change times, so the digest index has to
+	 * be checked first. */
+	if (semanage_module_digests_verify(sh, SEMANAGE_ACTIVE, &digests) < 0)
+		digests = NULL;
+
 	if (stat(sandbox, &buf) == -1) {
 		if (errno != ENOENT) {
 			ERR(sh, "Error scanning directory %s.", sandbox);
+			semanage_module_digests_destroy(digests);
 			return -1;
 		}
 		errno = 0;
@@ -950,28 +986,58 @@ int semanage_make_sandbox(semanage_handle_t * sh)
 		if (semanage_remove_directory(sandbox) != 0) {
 			ERR(sh, "Error removing old sandbox directory %s.",
 			    sandbox);
+			semanage_module_digests_destroy(digests);
 			return -1;
 		}
 	}
 
 	mask = umask(0077);
 	if (mkdir(sandbox, S_IRWXU) == -1 ||
-	    semanage_copy_dir(sh, semanage_path(SEMANAGE_ACTIVE, SEMANAGE_TOPLEVEL),
-			      sandbox) == -1) {
+	    semanage_copy_dir_flags(sh, semanage_path(SEMANAGE_ACTIVE, SEMANAGE_TOPLEVEL),
+				    sandbox, SEMANAGE_COPY_FILES | SEMANAGE_COPY_LINK_MODULES) == -1) {
 		umask(mask);
 		ERR(sh, "Could not copy files to sandbox %s.", sandbox);
 		goto cleanup;
 	}
+	if (digests)
+		semanage_module_digests_refresh(sh, SEMANAGE_TMP, digests);
+	else
+		unlink(semanage_path(SEMANAGE_TMP, SEMANAGE_MODULES_DIGESTS));
+	semanage_module_digests_destroy(digests);
 	umask(mask);
 	return 0;
 
       cleanup:
 	errsv = errno;
 	semanage_remove_directory(sandbox);
+	semanage_module_digests_destroy(digests);
 	errno = errsv;
 	return -1;
 }
 
+/* Removes the sandbox of a transaction that was not committed. Its
+ * module files are hard linked into the active store, so the digest
+ * index of the active store is refreshed afterwards. Returns 0 on
+ * success, -1 on error.
+ */
+int semanage_remove_sandbox(semanage_handle_t *sh)
+{
+	const char *sandbox = semanage_path(SEMANAGE_TMP, SEMANAGE_TOPLEVEL);
+	semanage_module_digests_t *digests = NULL;
+	int retval;
+
+	if (access(sandbox, F_OK) == 0 &&
+	    semanage_module_digests_verify(sh, SEMANAGE_TMP, &digests) < 0)
+		digests = NULL;
+
+	retval = semanage_remove_directory(sandbox);
+	if (retval == 0 && digests)
+		semanage_module_digests_refresh(sh, SEMANAGE_ACTIVE, digests);
+
+	semanage_module_digests_destroy(digests);
+	return retval;
+}
+
 /* Create final temporary space. Returns -1 on error 0 on success. */
 int semanage_make_final(semanage_handle_t *sh)
 {
@@ -1546,7 +1612,32 @@ int semanage_split_fc(semanage_handle_t * sh)
 
 }
 
-static int sefcontext_compile(semanage_handle_t * sh, const char *path) {
+struct semanage_fc_check {
+	semanage_handle_t *sh;
+	const sepol_policydb_t *policydb;
+};
+
+/* Validation callback for selabel_file_compile_parallel(). */
+static int semanage_fc_check_context(const char *context, void *arg)
+{
+	const struct semanage_fc_check *check = arg;
+	sepol_context_t *con = NULL;
+	int rc;
+
+	if (sepol_context_from_string(check->sh->sepolh, context, &con) < 0)
+		return -1;
+
+	rc = sepol_context_check(check->sh->sepolh, check->policydb, con);
+	sepol_context_free(con);
+	return rc;
+}
+
+/* Compile a file contexts file into its .bin form.  Unless an external
+ * sefcontext_compile is configured this is done in-process, and if
+ * check is not NULL the contexts are validated in the same pass.
+ */
+static int sefcontext_compile(semanage_handle_t * sh, const char *path,
+			      struct semanage_fc_check *check) {
 
 	int r;
 	struct stat sb;
@@ -1560,6 +1651,19 @@ static int sefcontext_compile(semanage_handle_t * sh, const char *path) {
 		return 0;
 	}
 
+	if (!sh->conf->sefcontext_compile_configured) {
+		/* Only the regexes are compiled in parallel, the contexts
+		 * are still checked from this thread. */
+		if (selabel_file_compile_parallel(path, NULL,
+						  check ? &semanage_fc_check_context : NULL,
+						  check, 0, 0) < 0) {
+			ERR(sh, "Could not compile %s.", path);
+			return -1;
+		}
+
+		return 0;
+	}
+
 	if ((r = semanage_exec_prog(sh, sh->conf->sefcontext_compile, path, "")) != 0) {
 		ERR(sh, "sefcontext_compile returned error code %d. Compiling %s", r, path);
 		return -1;
@@ -1568,39 +1672,66 @@ static int sefcontext_compile(semanage_handle_t * sh, const char *path) {
 	return 0;
 }
 
-static int semanage_validate_and_compile_fcontexts(semanage_handle_t * sh)
+/* Validate the file contexts of the final tmp against policydb and compile
+ * them.  The contexts are checked in-process when policydb is given and
+ * neither setfiles nor sefcontext_compile were explicitly configured,
+ * otherwise setfiles -c is run on the kernel policy.
+ */
+int semanage_validate_and_compile_fcontexts(semanage_handle_t * sh,
+					    sepol_policydb_t * policydb)
 {
 	int status = -1;
+	struct semanage_fc_check check = { sh, policydb };
+	struct semanage_fc_check *fc_check = NULL;
+
+	if (sh->conf->setfiles == NULL) {
+		ERR(sh, "No setfiles program specified in configuration file.");
+		goto cleanup;
+	}
+
+	if (sh->conf->sefcontext_compile == NULL) {
+		ERR(sh, "No sefcontext_compile program specified in configuration file.");
+		goto cleanup;
+	}
 
 	if (sh->do_check_contexts) {
 		int ret;
-		ret = semanage_exec_prog(
-			sh,
-			sh->conf->setfiles,
-			semanage_final_path(SEMANAGE_FINAL_TMP,
-					    SEMANAGE_KERNEL),
-			semanage_final_path(SEMANAGE_FINAL_TMP,
-					    SEMANAGE_FC));
-		if (ret != 0) {
-			ERR(sh, "setfiles returned error code %d.", ret);
-			goto cleanup;
+
+		if (policydb && !sh->conf->setfiles_configured &&
+		    !sh->conf->sefcontext_compile_configured) {
+			fc_check = &check;
+		} else {
+			ret = semanage_exec_prog(
+				sh,
+				sh->conf->setfiles,
+				semanage_final_path(SEMANAGE_FINAL_TMP,
+						    SEMANAGE_KERNEL),
+				semanage_final_path(SEMANAGE_FINAL_TMP,
+						    SEMANAGE_FC));
+			if (ret != 0) {
+				ERR(sh, "setfiles returned error code %d.", ret);
+				goto cleanup;
+			}
 		}
 	}
 
 	if (sefcontext_compile(sh,
-		    semanage_final_path(SEMANAGE_FINAL_TMP, SEMANAGE_FC)) != 0) {
+		    semanage_final_path(SEMANAGE_FINAL_TMP, SEMANAGE_FC),
+		    fc_check) != 0) {
 		goto cleanup;
 	}
 	semanage_setfiles(sh, semanage_final_path(SEMANAGE_FINAL_TMP, SEMANAGE_FC_BIN));
 
 	if (sefcontext_compile(sh,
-		    semanage_final_path(SEMANAGE_FINAL_TMP, SEMANAGE_FC_LOCAL)) != 0) {
+		    semanage_final_path(SEMANAGE_FINAL_TMP, SEMANAGE_FC_LOCAL),
+		    NULL) != 0) {
 		goto cleanup;
 	}
 	semanage_setfiles(sh, semanage_final_path(SEMANAGE_FINAL_TMP, SEMANAGE_FC_LOCAL_BIN));
 
 	if (sefcontext_compile(sh,
-		    semanage_final_path(SEMANAGE_FINAL_TMP, SEMANAGE_FC_HOMEDIRS)) != 0) {
+		    semanage_final_path(SEMANAGE_FINAL_TMP, SEMANAGE_FC_HOMEDIRS),
+		    NULL) != 0) {
 		goto cleanup;
 	}
 	semanage_setfiles(sh, semanage_final_path(SEMANAGE_FINAL_TMP, SEMANAGE_FC_HOMEDIRS_BIN));
@@ -1713,6 +1844,7 @@ static int semanage_commit_sandbox(semanage_handle_t * sh)
 	const char *sandbox = semanage_path(SEMANAGE_TMP, SEMANAGE_TOPLEVEL);
 	struct stat buf;
 	struct selabel_handle *sehandle;
+	semanage_module_digests_t *digests = NULL;
 
 	/* update the commit number */
 	if ((commit_number = semanage_direct_get_serial(sh)) < 0) {
@@ -1756,7 +1888,12 @@ static int semanage_commit_sandbox(semanage_handle_t * sh)
 
 	retval = commit_number;
 
+	/* removing the previous store unlinks the module files */
+	if (semanage_module_digests_verify(sh, SEMANAGE_TMP, &digests) < 0)
+		digests = NULL;
+
 	if (semanage_get_active_lock(sh) < 0) {
+		semanage_module_digests_destroy(digests);
 		return -1;
 	}
 	/* make the backup of the current active directory */
@@ -1821,7 +1958,11 @@ static int semanage_commit_sandbox(semanage_handle_t * sh)
 		errno = errsv;
 	}
 
+	if (digests)
+		semanage_module_digests_refresh(sh, SEMANAGE_ACTIVE, digests);
+
       cleanup:
+	semanage_module_digests_destroy(digests);
 	semanage_release_active_lock(sh);
 	sehandle = selinux_restorecon_default_handle();
 	selinux_restorecon_set_sehandle(sehandle);
@@ -1830,7 +1971,9 @@ static int semanage_commit_sandbox(semanage_handle_t * sh)
 
 /* Takes the kernel policy in a sandbox, move it to the active
  * directory, copy it to the binary policy path, then load it.	Upon
- * error move the active directory back to the sandbox.	 This function
+ * error move the active directory back to the sandbox.	 The file
+ * contexts must already have been compiled by
+ * semanage_validate_and_compile_fcontexts().  This function
  * should be placed within a mutex lock to ensure that it runs
  * atomically.	Returns commit number on success, -1 on error.
  */
@@ -1843,18 +1986,6 @@ int semanage_install_sandbox(semanage_handle_t * sh)
 		    "No load_policy program specified in configuration file.");
 		goto cleanup;
 	}
-	if (sh->conf->setfiles == NULL) {
-		ERR(sh, "No setfiles program specified in configuration file.");
-		goto cleanup;
-	}
-
-	if (sh->conf->sefcontext_compile == NULL) {
-		ERR(sh, "No sefcontext_compile program specified in configuration file.");
-		goto cleanup;
-	}
-
-	if (semanage_validate_and_compile_fcontexts(sh) < 0)
-		goto cleanup;
 
 	if ((commit_num = semanage_commit_sandbox(sh)) < 0) {
 		retval = commit_num;
@@ -2055,31 +2186,597 @@ int semanage_direct_get_serial(semanage_handle_t * sh)
 	return commit_number;
 }
 
+/* MODULE DIGEST INDEX */
+
+/* The digest index remembers the SHA-256 of the (decompressed) CIL of
+ * every module, together with the size, modification and change times,
+ * device and inode the file had when it was hashed. A commit only needs
+ * to decompress modules whose metadata no longer matches their entry.
+ * Paths are relative to the top of the store, so entries can be moved
+ * between stores.
+ *
+ * As in git's index, an entry is only trusted if the file was last
+ * modified before the index was written. Otherwise the file could have
+ * been written again within the granularity of its timestamps after it
+ * was hashed, without any visible change to its metadata.
+ *
+ * Module files are hard linked between the active store, the sandbox and
+ * the previous store, and every link and unlink moves their change time.
+ * The entries are therefore checked before libsemanage links or unlinks
+ * the files itself, and only the change time is taken over afterwards.
+ *
+ * The index is stored as text, one module per line:
+ *   <hex digest> <size> <mtime sec> <mtime nsec> <ctime sec> <ctime nsec>
+ *   <device> <inode> <path>
+ */
+
+#define SEMANAGE_DIGESTS_HEADER "semanage module digests 2"
+
+struct semanage_module_digest {
+	char *path;
+	off_t size;
+	struct timespec mtime;
+	struct timespec ctime;
+	dev_t dev;
+	ino_t ino;
+	uint8_t digest[SHA256_HASH_SIZE];
+};
+
+struct semanage_module_digests {
+	struct semanage_module_digest *entries;
+	size_t num;
+	size_t alloc;
+	int sorted;
+	/* modification time of the index file it was read from */
+	struct timespec stamp;
+};
+
+static int semanage_module_digest_cmp(const void *a, const void *b)
+{
+	const struct semanage_module_digest *da = a;
+	const struct semanage_module_digest *db = b;
+
+	return strcmp(da->path, db->path);
+}
+
+static int semanage_timespec_cmp(const struct timespec *a,
+				 const struct timespec *b)
+{
+	if (a->tv_sec != b->tv_sec)
+		return a->tv_sec < b->tv_sec ? -1 : 1;
+	if (a->tv_nsec != b->tv_nsec)
+		return a->tv_nsec < b->tv_nsec ? -1 : 1;
+	return 0;
+}
+
+/* Returns whether the file still has the contents it had when its entry
+ * was recorded, ignoring its change time. */
+static int semanage_module_digest_same_file(const struct semanage_module_digest *entry,
+					    const struct stat *sb)
+{
+	return entry->size == sb->st_size &&
+	       semanage_timespec_cmp(&entry->mtime, &sb->st_mtim) == 0 &&
+	       entry->dev == sb->st_dev &&
+	       entry->ino == sb->st_ino;
+}
+
+static int semanage_module_digest_matches(const semanage_module_digests_t *digests,
+					  const struct semanage_module_digest *entry,
+					  const struct stat *sb)
+{
+	return semanage_module_digest_same_file(entry, sb) &&
+	       semanage_timespec_cmp(&entry->ctime, &sb->st_ctim) == 0 &&
+	       /* written before the index, so not racily clean */
+	       semanage_timespec_cmp(&entry->mtime, &digests->stamp) < 0;
+}
+
+int semanage_module_digests_create(semanage_module_digests_t **digests)
+{
+	*digests = calloc(1, sizeof(**digests));
+	if (*digests == NULL)
+		return -1;
+	(*digests)->sorted = 1;
+
+	return 0;
+}
+
+void semanage_module_digests_destroy(semanage_module_digests_t *digests)
+{
+	size_t i;
+
+	if (digests == NULL)
+		return;
+
+	for (i = 0; i < digests->num; i++)
+		free(digests->entries[i].path);
+	free(digests->entries);
+	free(digests);
+}
+
+static int semanage_module_digests_append(semanage_module_digests_t *digests,
+					  const char *path,
+					  const struct stat *sb,
+					  const uint8_t *digest)
+{
+	struct semanage_module_digest *entry;
+
+	if (digests->num == digests->alloc) {
+		size_t alloc = digests->alloc ? digests->alloc * 2 : 64;
+
+		entry = reallocarray(digests->entries, alloc, sizeof(*entry));
+		if (entry == NULL)
+			return -1;
+		digests->entries = entry;
+		digests->alloc = alloc;
+	}
+
+	entry = &digests->entries[digests->num];
+	entry->path = strdup(path);
+	if (entry->path == NULL)
+		return -1;
+	entry->size = sb->st_size;
+	entry->mtime = sb->st_mtim;
+	entry->ctime = sb->st_ctim;
+	entry->dev = sb->st_dev;
+	entry->ino = sb->st_ino;
+	memcpy(entry->digest, digest, SHA256_HASH_SIZE);
+
+	digests->num++;
+	digests->sorted = 0;
+
+	return 0;
+}
+
+/* Returns the path of a file in the given store relative to the top of
+ * that store, or NULL if the file lies outside of it.
+ */
+static const char *semanage_module_digest_relpath(enum semanage_store_defs store,
+						  const char *path)
+{
+	const char *top = semanage_path(store, SEMANAGE_TOPLEVEL);
+	size_t len = strlen(top);
+
+	if (strncmp(path, top, len) != 0 || path[len] != '/')
+		return NULL;
+
+	return path + len;
+}
+
+static int semanage_module_digest_parse_hex(const char *hex, uint8_t *digest)
+{
+	unsigned int byte;
+	int i;
+
+	for (i = 0; i < SHA256_HASH_SIZE; i++) {
+		if (!isxdigit((unsigned char)hex[2 * i]) ||
+		    !isxdigit((unsigned char)hex[2 * i + 1]) ||
+		    sscanf(&hex[2 * i], "%2x", &byte) != 1)
+			return -1;
+		digest[i] = byte;
+	}
+
+	return 0;
+}
+
+/* Reads the digest index of the given store. A missing or unreadable
+ * index is not an error, it just results in an empty one.
+ */
+int semanage_module_digests_read(semanage_handle_t *sh,
+				 enum semanage_store_defs store,
+				 semanage_module_digests_t **digests)
+{
+	const char *path = semanage_path(store, SEMANAGE_MODULES_DIGESTS);
+	char hex[2 * SHA256_HASH_SIZE + 1];
+	char *line = NULL;
+	size_t line_len = 0;
+	long long size, mtime_sec, ctime_sec;
+	unsigned long long dev, ino;
+	long mtime_nsec, ctime_nsec;
+	uint8_t digest[SHA256_HASH_SIZE];
+	struct stat sb = {};
+	FILE *fp = NULL;
+	int offset;
+	int retval = -1;
+
+	if (semanage_module_digests_create(digests) < 0) {
+		ERR(sh, "Out of memory!");
+		return -1;
+	}
+
+	fp = fopen(path, "re");
+	if (fp == NULL) {
+		if (errno != ENOENT)
+			WARN(sh, "Unable to open %s, ignoring it.", path);
+		return 0;
+	}
+	__fsetlocking(fp, FSETLOCKING_BYCALLER);
+
+	if (fstat(fileno(fp), &sb) != 0) {
+		WARN(sh, "Unable to access %s, ignoring it.", path);
+		retval = 0;
+		goto cleanup;
+	}
+	(*digests)->stamp = sb.st_mtim;
+
+	if (getline(&line, &line_len, fp) < 0 ||
+	    strcmp(line, SEMANAGE_DIGESTS_HEADER "\n") != 0) {
+		WARN(sh, "Module digest index %s has an unknown format, ignoring it.", path);
+		retval = 0;
+		goto cleanup;
+	}
+
+	while (getline(&line, &line_len, fp) > 0) {
+		line[strcspn(line, "\n")] = '\0';
+
+		offset = 0;
+		if (sscanf(line, "%64s %lld %lld %ld %lld %ld %llu %llu %n", hex,
+			   &size, &mtime_sec, &mtime_nsec, &ctime_sec, &ctime_nsec,
+			   &dev, &ino, &offset) != 8 ||
+		    offset == 0 || line[offset] != '/' ||
+		    strlen(hex) != 2 * SHA256_HASH_SIZE ||
+		    semanage_module_digest_parse_hex(hex, digest) < 0) {
+			WARN(sh, "Module digest index %s is corrupted, ignoring it.", path);
+			semanage_module_digests_destroy(*digests);
+			retval = semanage_module_digests_create(digests);
+			if (retval < 0)
+				ERR(sh, "Out of memory!");
+			goto cleanup;
+		}
+
+		sb.st_size = size;
+		sb.st_mtim.tv_sec = mtime_sec;
+		sb.st_mtim.tv_nsec = mtime_nsec;
+		sb.st_ctim.tv_sec = ctime_sec;
+		sb.st_ctim.tv_nsec = ctime_nsec;
+		sb.st_dev = dev;
+		sb.st_ino = ino;
+		if (semanage_module_digests_append(*digests, &line[offset], &sb, digest) < 0) {
+			ERR(sh, "Out of memory!");
+			goto cleanup;
+		}
+	}
+
+	retval = 0;
+
+cleanup:
+	free(line);
+	fclose(fp);
+	if (retval < 0) {
+		semanage_module_digests_destroy(*digests);
+		*digests = NULL;
+	}
+	return retval;
+}
+
+/* Writes the digest index into the given store. */
+int semanage_module_digests_write(semanage_handle_t *sh,
+				  enum semanage_store_defs store,
+				  semanage_module_digests_t *digests)
+{
+	const char *path = semanage_path(store, SEMANAGE_MODULES_DIGESTS);
+	const struct semanage_module_digest *entry;
+	FILE *fp;
+	size_t i;
+	int fd, j;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (fd == -1 || (fp = fdopen(fd, "w")) == NULL) {
+		ERR(sh, "Could not open %s for writing.", path);
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+	__fsetlocking(fp, FSETLOCKING_BYCALLER);
+
+	fprintf(fp, SEMANAGE_DIGESTS_HEADER "\n");
+	for (i = 0; i < digests->num; i++) {
+		entry = &digests->entries[i];
+		for (j = 0; j < SHA256_HASH_SIZE; j++)
+			fprintf(fp, "%02x", entry->digest[j]);
+		fprintf(fp, " %lld %lld %ld %lld %ld %llu %llu %s\n",
+			(long long)entry->size,
+			(long long)entry->mtime.tv_sec, entry->mtime.tv_nsec,
+			(long long)entry->ctime.tv_sec, entry->ctime.tv_nsec,
+			(unsigned long long)entry->dev,
+			(unsigned long long)entry->ino, entry->path);
+	}
+
+	if (ferror(fp) || fclose(fp) == EOF) {
+		ERR(sh, "Error while writing to %s.", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Looks up the digest of a module file in the sandbox. Returns 1 and
+ * fills in digest if the file still matches its entry, 0 otherwise.
+ */
+int semanage_module_digests_lookup(semanage_module_digests_t *digests,
+				   const char *path,
+				   const struct stat *sb,
+				   uint8_t *digest)
+{
+	struct semanage_module_digest key, *entry;
+
+	key.path = (char *)semanage_module_digest_relpath(SEMANAGE_TMP, path);
+	if (key.path == NULL || digests->num == 0)
+		return 0;
+
+	if (!digests->sorted) {
+		qsort(digests->entries, digests->num, sizeof(*digests->entries),
+		      semanage_module_digest_cmp);
+		digests->sorted = 1;
+	}
+
+	entry = bsearch(&key, digests->entries, digests->num,
+			sizeof(*digests->entries), semanage_module_digest_cmp);
+	if (entry == NULL || !semanage_module_digest_matches(digests, entry, sb))
+		return 0;
+
+	memcpy(digest, entry->digest, SHA256_HASH_SIZE);
+	return 1;
+}
+
+/* Records the digest of a module file in the sandbox. */
+int semanage_module_digests_add(semanage_handle_t *sh,
+				semanage_module_digests_t *digests,
+				const char *path,
+				const struct stat *sb,
+				const uint8_t *digest)
+{
+	const char *relpath = semanage_module_digest_relpath(SEMANAGE_TMP, path);
+
+	if (relpath == NULL)
+		return 0;
+
+	if (semanage_module_digests_append(digests, relpath, sb, digest) < 0) {
+		ERR(sh, "Out of memory!");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Reads the digest index of the given store and keeps only the entries
+ * of files that still match them. This must be done before libsemanage
+ * links or unlinks the module files, see semanage_module_digests_refresh().
+ * Sets digests to NULL if the store has no index.
+ */
+static int semanage_module_digests_verify(semanage_handle_t *sh,
+					  enum semanage_store_defs store,
+					  semanage_module_digests_t **digests)
+{
+	const char *top = semanage_path(store, SEMANAGE_TOPLEVEL);
+	struct semanage_module_digest *entry;
+	char path[PATH_MAX];
+	struct stat sb;
+	size_t i, num = 0;
+	int n;
+
+	*digests = NULL;
+	if (access(semanage_path(store, SEMANAGE_MODULES_DIGESTS), F_OK) != 0)
+		return 0;
+
+	if (semanage_module_digests_read(sh, store, digests) < 0)
+		return -1;
+
+	for (i = 0; i < (*digests)->num; i++) {
+		entry = &(*digests)->entries[i];
+
+		n = snprintf(path, sizeof(path), "%s%s", top, entry->path);
+		if (n < 0 || n >= (int)sizeof(path) || stat(path, &sb) != 0 ||
+		    !semanage_module_digest_matches(*digests, entry, &sb)) {
+			free(entry->path);
+			continue;
+		}
+
+		(*digests)->entries[num++] = *entry;
+	}
+	(*digests)->num = num;
+
+	return 0;
+}
+
+/* Writes the entries kept by semanage_module_digests_verify() into the
+ * index of the given store, which now holds the same module files, and
+ * takes over the change times libsemanage gave them by linking or
+ * unlinking them since. On error the index of the store is removed, as
+ * it is only an optimization and a commit without it just rebuilds it.
+ */
+static void semanage_module_digests_refresh(semanage_handle_t *sh,
+					    enum semanage_store_defs store,
+					    semanage_module_digests_t *digests)
+{
+	const char *top = semanage_path(store, SEMANAGE_TOPLEVEL);
+	struct semanage_module_digest *entry;
+	char path[PATH_MAX];
+	struct stat sb;
+	size_t i, num = 0;
+	int n;
+
+	for (i = 0; i < digests->num; i++) {
+		entry = &digests->entries[i];
+
+		n = snprintf(path, sizeof(path), "%s%s", top, entry->path);
+		if (n < 0 || n >= (int)sizeof(path) || stat(path, &sb) != 0 ||
+		    !semanage_module_digest_same_file(entry, &sb)) {
+			free(entry->path);
+			continue;
+		}
+
+		entry->ctime = sb.st_ctim;
+		digests->entries[num++] = *entry;
+	}
+	digests->num = num;
+
+	if (semanage_module_digests_write(sh, store, digests) < 0)
+		unlink(semanage_path(store, SEMANAGE_MODULES_DIGESTS));
+}
+
 /* HIGHER LEVEL COMMIT FUNCTIONS */
 
-int semanage_load_files(semanage_handle_t * sh, cil_db_t *cildb, char **filenames, int numfiles)
+/* Modules are decompressed by worker threads ahead of the (serial) CIL
+ * parser, at most SEMANAGE_LOAD_WINDOW files per thread in advance.
+ */
+#define SEMANAGE_LOAD_MAX_THREADS 8
+#define SEMANAGE_LOAD_WINDOW 4
+
+struct semanage_load_slot {
+	struct file_contents contents;
+	const char *err;
+	int retval;
+	int done;
+};
+
+struct semanage_load_ctx {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	char **filenames;
+	struct semanage_load_slot *slots;
+	int numfiles;
+	int next;
+	int consumed;
+	int window;
+	int stop;
+	int bzip_small;
+};
+
+static void *semanage_load_worker(void *arg)
+{
+	struct semanage_load_ctx *ctx = arg;
+	struct semanage_load_slot *slot;
+	int i;
+
+	pthread_mutex_lock(&ctx->lock);
+	while (!ctx->stop && ctx->next < ctx->numfiles) {
+		if (ctx->next - ctx->consumed >= ctx->window) {
+			pthread_cond_wait(&ctx->cond, &ctx->lock);
+			continue;
+		}
+
+		i = ctx->next++;
+		slot = &ctx->slots[i];
+		pthread_mutex_unlock(&ctx->lock);
+
+		slot->retval = read_compressed_file(ctx->filenames[i], ctx->bzip_small,
+						    &slot->contents, &slot->err);
+
+		pthread_mutex_lock(&ctx->lock);
+		slot->done = 1;
+		pthread_cond_broadcast(&ctx->cond);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+
+	return NULL;
+}
+
+/* Returns how many threads should decompress the modules. */
+static int semanage_load_threads(int numfiles)
 {
-	int i, retval;
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (ncpus > SEMANAGE_LOAD_MAX_THREADS)
+		ncpus = SEMANAGE_LOAD_MAX_THREADS;
+	if (ncpus > numfiles)
+		ncpus = numfiles;
+
+	return ncpus > 1 ? ncpus : 0;
+}
+
+/* Adds the modules to the CIL db. The modules are decompressed in
+ * parallel, but always added in the order given, and each is unmapped as
+ * soon as it has been added.
+ */
+int semanage_load_files(semanage_handle_t * sh, cil_db_t *cildb, char **filenames,
+			int numfiles)
+{
+	int i, retval = -1;
+	int num_threads, started = 0;
 	const char *filename;
 	struct file_contents contents = {};
+	struct semanage_load_ctx ctx = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+	};
+	pthread_t threads[SEMANAGE_LOAD_MAX_THREADS];
+
+	num_threads = semanage_load_threads(numfiles);
+	if (num_threads > 0) {
+		ctx.slots = calloc(numfiles, sizeof(*ctx.slots));
+		if (ctx.slots == NULL)
+			num_threads = 0;
+	}
+	if (num_threads > 0) {
+		ctx.filenames = filenames;
+		ctx.numfiles = numfiles;
+		ctx.window = num_threads * SEMANAGE_LOAD_WINDOW;
+		ctx.bzip_small = sh->conf->bzip_small;
+		for (started = 0; started < num_threads; started++) {
+			if (pthread_create(&threads[started], NULL,
+					   semanage_load_worker, &ctx) != 0)
+				break;
+		}
+	}
 
 	for (i = 0; i < numfiles; i++) {
 		filename = filenames[i];
 
-		retval = map_compressed_file(sh, filename, &contents);
-		if (retval < 0)
-			return -1;
+		if (started > 0) {
+			pthread_mutex_lock(&ctx.lock);
+			while (!ctx.slots[i].done)
+				pthread_cond_wait(&ctx.cond, &ctx.lock);
+			pthread_mutex_unlock(&ctx.lock);
+
+			if (ctx.slots[i].retval < 0) {
+				ERR(sh, "%s %s.", ctx.slots[i].err, filename);
+				retval = -1;
+				goto cleanup;
+			}
+			contents = ctx.slots[i].contents;
+			ctx.slots[i].contents = (struct file_contents){};
+		} else {
+			retval = map_compressed_file(sh, filename, &contents);
+			if (retval < 0)
+				goto cleanup;
+		}
+
+		if (started > 0) {
+			pthread_mutex_lock(&ctx.lock);
+			ctx.consumed = i + 1;
+			pthread_cond_broadcast(&ctx.cond);
+			pthread_mutex_unlock(&ctx.lock);
+		}
 
 		retval = cil_add_file(cildb, filename, contents.data, contents.len);
 		unmap_compressed_file(&contents);
+		contents = (struct file_contents){};
 
 		if (retval != SEPOL_OK) {
 			ERR(sh, "Error while reading from file %s.", filename);
-			return -1;
+			retval = -1;
+			goto cleanup;
 		}
 	}
 
-	return 0;
+	retval = 0;
+
+cleanup:
+	if (started > 0) {
+		pthread_mutex_lock(&ctx.lock);
+		ctx.stop = 1;
+		pthread_cond_broadcast(&ctx.cond);
+		pthread_mutex_unlock(&ctx.lock);
+		for (i = 0; i < started; i++)
+			pthread_join(threads[i], NULL);
+	}
+	for (i = 0; ctx.slots != NULL && i < numfiles; i++)
+		unmap_compressed_file(&ctx.slots[i].contents);
+	free(ctx.slots);
+	pthread_cond_destroy(&ctx.cond);
+	pthread_mutex_destroy(&ctx.lock);
+
+	return retval < 0 ? -1 : 0;
 }
 
 /*
@@ -2247,41 +2944,6 @@ int semanage_verify_kernel(semanage_handle_t * sh)
 
 /********************* functions that sort file contexts *********************/
 
-/* Free the given node. */
-static void semanage_fc_node_destroy(semanage_file_context_node_t * x)
-{
-	free(x->path);
-	free(x->file_type);
-	free(x->context);
-	free(x);
-}
-
-/* Free the linked list of nodes starting at the given node. */
-static void semanage_fc_node_list_destroy(semanage_file_context_node_t * x)
-{
-	semanage_file_context_node_t *temp;
-
-	while (x) {
-		temp = x;
-		x = x->next;
-		semanage_fc_node_destroy(temp);
-	}
-}
-
-/* Free the linked list of buckets (and their node lists)
- * starting at the given bucket. */
-static void semanage_fc_bucket_list_destroy(semanage_file_context_bucket_t * x)
-{
-	semanage_file_context_bucket_t *temp;
-
-	while (x) {
-		temp = x;
-		x = x->next;
-		semanage_fc_node_list_destroy(temp->data);
-		free(temp);
-	}
-}
-
 /* Compares two file contexts' regular expressions and returns:
  *    -1 if a is less specific than b
  *     0 if a and be are equally specific
@@ -2296,158 +2958,46 @@ static void semanage_fc_bucket_list_destroy(semanage_file_context_bucket_t * x)
  *      -> a is less specific than b.
  *     If a does not have a specified type and b does not,
  *      -> a is less specific than b.
+ * The first two are folded into stem_key and the last two into
+ *  len_key by semanage_fc_set_keys().  Equally specific entries keep
+ *  their order in the input.
  * FIXME: These heuristics are imperfect, but good enough for
  * now.  A proper comparison would determine which (if either)
  * regular expression is a subset of the other.
  */
-static int semanage_fc_compare(const semanage_file_context_node_t * a,
-			       const semanage_file_context_node_t * b)
+static int semanage_fc_compare(const void *p1, const void *p2)
 {
-	int a_has_meta = (a->meta >= 0);
-	int b_has_meta = (b->meta >= 0);
-
-	/* Check to see if either a or b are regexes
-	 *  and the other isn't. */
-	if (a_has_meta && !b_has_meta)
-		return -1;
-	if (b_has_meta && !a_has_meta)
-		return 1;
-
-	/* Check to see if either a or b have a shorter stem
-	 *  length than the other. */
-	if (a->meta < b->meta)
-		return -1;
-	if (b->meta < a->meta)
-		return 1;
-
-	/* Check to see if either a or b have a shorter string
-	 *  length than the other. */
-	if (a->effective_len < b->effective_len)
-		return -1;
-	if (b->effective_len < a->effective_len)
-		return 1;
-
-	/* Check to see if either a or b has a specified type
-	 *  and the other doesn't. */
-	if (!a->file_type && b->file_type)
-		return -1;
-	if (!b->file_type && a->file_type)
-		return 1;
+	const semanage_file_context_t *a = p1;
+	const semanage_file_context_t *b = p2;
 
-	/* If none of the above conditions were satisfied,
-	 * then a and b are equally specific. */
-	return 0;
+	if (a->stem_key != b->stem_key)
+		return a->stem_key < b->stem_key ? -1 : 1;
+	if (a->len_key != b->len_key)
+		return a->len_key < b->len_key ? -1 : 1;
+	return a->index < b->index ? -1 : 1;
 }
 
-/* Merges two sorted file context linked lists into a single sorted one.
- * The left list is assumed to represent nodes that came first in the original ordering.
- * The final sorted list is returned.
+/* Compute the sort keys of the given entry from its path, whose
+ *  effective length is path_len - escape_chars.
+ * The stem length is the position of the first regular expression
+ *  meta character in the path; entries without one are more
+ *  specific than any regular expression and sort last.
  */
-static semanage_file_context_node_t
-    * semanage_fc_merge(semanage_file_context_node_t * left,
-			semanage_file_context_node_t * right)
+static void semanage_fc_set_keys(semanage_file_context_t * fc,
+				 size_t escape_chars)
 {
-	semanage_file_context_node_t *head;
-	semanage_file_context_node_t *current;
-	semanage_file_context_node_t *tail;
-
-	if (!left)
-		return right;
+	size_t c = 0;
+	size_t skipped = 0;
 
-	if (!right)
-		return left;
+	fc->stem_key = SIZE_MAX;
+	fc->len_key = ((fc->path_len - escape_chars) << 1) |
+	    (fc->file_type != NULL);
 
-	if (semanage_fc_compare(left, right) == 1) {
-		head = tail = right;
-		right = right->next;
-	} else {
-		head = tail = left;
-		left = left->next;
-	}
-
-	while (left && right) {
-		/* if left was more specific than right,
-		 * insert right before left.  Otherwise leave order alone. */
-		if (semanage_fc_compare(left, right) == 1) {
-			current = right;
-			right = right->next;
-		} else {
-			current = left;
-			left = left->next;
-		}
-
-		tail = tail->next = current;
-	}
-
-	tail->next = (left != NULL) ? left : right;
-
-	return head;
-}
-
-/* Sorts file contexts from least specific to most specific.
- * A bucket linked list is passed in.  Upon completion,
- * there is only one bucket (pointed to by "main") that
- * contains a linked list of all the file contexts in sorted order.
- * Explanation of the algorithm:
- *  This is a stable implementation of an iterative merge sort.
- *  Each bucket initially has a linked list of file contexts
- *   that are 1 node long.
- *  Each pass, buckets (and the nodes they contain) are merged
- *   two at time.
- *  Buckets are merged until there is only one bucket left,
- *   containing the list of file contexts, sorted.
- */
-static void semanage_fc_merge_sort(semanage_file_context_bucket_t * main)
-{
-	semanage_file_context_bucket_t *current;
-	semanage_file_context_bucket_t *temp;
-
-	/* Loop until "main" is the only bucket left.
-	 * When we stop "main" contains the sorted list. */
-	while (main->next) {
-		current = main;
-
-		/* Merge buckets two-by-two.
-		 * If there is an odd number of buckets, the last
-		 * bucket will be left alone, which corresponds
-		 * to the operation of merging it with an empty bucket. */
-		while (current) {
-			if (current->next) {
-				current->data =
-				    semanage_fc_merge(current->data,
-						      current->next->data);
-				temp = current->next;
-				current->next = current->next->next;
-
-				/* Free the (now empty) second bucket.
-				 * (This does not touch the node list
-				 * in the bucket because it has been
-				 * shifted over to the first bucket. */
-				free(temp);
-			}
-			current = current->next;
-		}
-	}
-}
-
-/* Compute the location of the first regular expression
- *   meta character in the path of the given node, if it exists.
- * On return:
- *     fc_node->meta = position of meta character, if it exists
- *			(-1 corresponds to no character)
- */
-static void semanage_fc_find_meta(semanage_file_context_node_t * fc_node)
-{
-	int c = 0;
-	int escape_chars = 0;
-
-	fc_node->meta = -1;
-
-	/* Note: this while loop has been adapted from
+	/* Note: this loop has been adapted from
 	 *  spec_hasMetaChars in matchpathcon.c from
 	 *  libselinux-1.22. */
-	while (fc_node->path[c] != '\0') {
-		switch (fc_node->path[c]) {
+	while (c < fc->path_len) {
+		switch (fc->path[c]) {
 		case '.':
 		case '^':
 		case '$':
@@ -2458,13 +3008,13 @@ static void semanage_fc_find_meta(semanage_file_context_node_t * fc_node)
 		case '[':
 		case '(':
 		case '{':
-			fc_node->meta = c - escape_chars;
+			fc->stem_key = c - skipped;
 			return;
 		case '\\':
 			/* If an escape character is found,
 			 *  skip the next character. */
 			c++;
-			escape_chars++;
+			skipped++;
 			break;
 		}
 
@@ -2528,13 +3078,13 @@ int semanage_fc_sort(semanage_handle_t * sh, const char *buf, size_t buf_len,
 	ssize_t sanity_check;
 	const char *line_buf, *line_end;
 	char *sorted_buf_pos;
-	int escape_chars, just_saw_escape;
+	size_t escape_chars;
+	int just_saw_escape;
 
-	semanage_file_context_node_t *temp;
-	semanage_file_context_node_t *head;
-	semanage_file_context_node_t *current;
-	semanage_file_context_bucket_t *main;
-	semanage_file_context_bucket_t *bcurrent;
+	semanage_file_context_t *fcs = NULL;
+	semanage_file_context_t *fc;
+	semanage_file_context_t *tmp;
+	size_t nfcs = 0, fcs_size = 0;
 
 	if (sh == NULL) {
 		return -1;
@@ -2548,18 +3098,7 @@ int semanage_fc_sort(semanage_handle_t * sh, const char *buf, size_t buf_len,
 		return -1;
 	}
 
-	/* Initialize the head of the linked list
-	 * that will contain a node for each file context line. */
-	head = current =
-	    (semanage_file_context_node_t *) calloc(1,
-						    sizeof
-						    (semanage_file_context_node_t));
-	if (!head) {
-		ERR(sh, "Failure allocating memory.");
-		return -1;
-	}
-
-	/* Parse the char buffer into a semanage_file_context_node_t linked list. */
+	/* Parse the char buffer into an array of file contexts. */
 	line_buf = buf;
 	buf_remainder = buf_len;
 	while ((line_end = semanage_get_line_end(line_buf, buf_remainder))) {
@@ -2569,7 +3108,7 @@ int semanage_fc_sort(semanage_handle_t * sh, const char *buf, size_t buf_len,
 
 		if (sanity_check < 0) {
 			ERR(sh, "Failure parsing file context buffer.");
-			semanage_fc_node_list_destroy(head);
+			free(fcs);
 			return -1;
 		}
 
@@ -2596,17 +3135,18 @@ int semanage_fc_sort(semanage_handle_t * sh, const char *buf, size_t buf_len,
 			continue;
 		}
 
-		/* Allocate a new node. */
-		temp =
-		    (semanage_file_context_node_t *) calloc(1,
-							    sizeof
-							    (semanage_file_context_node_t));
-		if (!temp) {
-			ERR(sh, "Failure allocating memory.");
-			semanage_fc_node_list_destroy(head);
-			return -1;
+		/* Make room for a new entry. */
+		if (nfcs == fcs_size) {
+			fcs_size = fcs_size ? fcs_size * 2 : 1024;
+			tmp = reallocarray(fcs, fcs_size, sizeof(*fcs));
+			if (!tmp) {
+				ERR(sh, "Failure allocating memory.");
+				free(fcs);
+				return -1;
+			}
+			fcs = tmp;
 		}
-		temp->next = NULL;
+		fc = &fcs[nfcs];
 
 		/* Extract the regular expression from the line. */
 		escape_chars = 0;
@@ -2633,18 +3173,12 @@ int semanage_fc_sort(semanage_handle_t * sh, const char *buf, size_t buf_len,
 		if (regex_len == 0) {
 			ERR(sh,
 			    "WARNING: semanage_fc_sort: Regex of length 0.");
-			semanage_fc_node_destroy(temp);
 			line_buf = line_end + 1;
 			continue;
 		}
 
-		temp->path = strndup(&line_buf[start], regex_len);
-		if (!temp->path) {
-			ERR(sh, "Failure allocating memory.");
-			semanage_fc_node_destroy(temp);
-			semanage_fc_node_list_destroy(head);
-			return -1;
-		}
+		fc->path = &line_buf[start];
+		fc->path_len = regex_len;
 
 		/* Skip the whitespace after the regular expression. */
 		for (; i < line_len; i++) {
@@ -2653,8 +3187,8 @@ int semanage_fc_sort(semanage_handle_t * sh, const char *buf, size_t buf_len,
 		}
 		if (i == line_len) {
 			ERR(sh,
-			    "WARNING: semanage_fc_sort: Incomplete context. %s", temp->path);
-			semanage_fc_node_destroy(temp);
+			    "WARNING: semanage_fc_sort: Incomplete context. %.*s",
+			    (int)fc->path_len, fc->path);
 			line_buf = line_end + 1;
 			continue;
 		}
@@ -2665,21 +3199,14 @@ int semanage_fc_sort(semanage_handle_t * sh, const char *buf, size_t buf_len,
 
 			if (i + type_len >= line_len) {
 				ERR(sh,
-				    "WARNING: semanage_fc_sort: Incomplete context. %s", temp->path);
-				semanage_fc_node_destroy(temp);
+				    "WARNING: semanage_fc_sort: Incomplete context. %.*s",
+				    (int)fc->path_len, fc->path);
 				line_buf = line_end + 1;
 				continue;
 			}
 
 			/* Record the inode type. */
-			temp->file_type =
-			    strndup(&line_buf[i], type_len);
-			if (!temp->file_type) {
-				ERR(sh, "Failure allocating memory.");
-				semanage_fc_node_destroy(temp);
-				semanage_fc_node_list_destroy(head);
-				return -1;
-			}
+			fc->file_type = &line_buf[i];
 
 			i += type_len;
 
@@ -2690,13 +3217,14 @@ int semanage_fc_sort(semanage_handle_t * sh, const char *buf, size_t buf_len,
 			}
 			if (i == line_len) {
 				ERR(sh,
-				    "WARNING: semanage_fc_sort: Incomplete context. %s", temp->path);
-				semanage_fc_node_destroy(temp);
+				    "WARNING: semanage_fc_sort: Incomplete context. %.*s",
+				    (int)fc->path_len, fc->path);
 				line_buf = line_end + 1;
 				continue;
 			}
 		} else {
 			type_len = 0;	/* inode type did not exist in the file context */
+			fc->file_type = NULL;
 		}
 
 		/* Extract the context from the line. */
@@ -2706,128 +3234,67 @@ int semanage_fc_sort(semanage_handle_t * sh, const char *buf, size_t buf_len,
 		finish = i;
 		context_len = finish - start;
 
-		temp->context = strndup(&line_buf[start], context_len);
-		if (!temp->context) {
-			ERR(sh, "Failure allocating memory.");
-			semanage_fc_node_destroy(temp);
-			semanage_fc_node_list_destroy(head);
-			return -1;
-		}
-
 		/* Initialize the data about the file context. */
-		temp->path_len = regex_len;
-		temp->effective_len = regex_len - escape_chars;
-		temp->type_len = type_len;
-		temp->context_len = context_len;
-		semanage_fc_find_meta(temp);
-
-		/* Add this node to the end of the linked list. */
-		current->next = temp;
-		current = current->next;
+		fc->context = &line_buf[start];
+		fc->type_len = type_len;
+		fc->context_len = context_len;
+		fc->index = nfcs++;
+		semanage_fc_set_keys(fc, escape_chars);
 
 		line_buf = line_end + 1;
 	}
 
-	/* Create the bucket linked list from the node linked list. */
-	current = head->next;
-	bcurrent = main = (semanage_file_context_bucket_t *)
-	    calloc(1, sizeof(semanage_file_context_bucket_t));
-	if (!main) {
-		ERR(sh, "Failure allocating memory.");
-		semanage_fc_node_list_destroy(head);
-		return -1;
-	}
-
-	/* Free the head node, as it is no longer used. */
-	semanage_fc_node_destroy(head);
-	head = NULL;
-
-	/* Place each node into a bucket. */
-	while (current) {
-		bcurrent->data = current;
-		current = current->next;
-
-		/* Detach the node in the bucket from the old list. */
-		bcurrent->data->next = NULL;
-
-		/* If we need another bucket, add one to the end. */
-		if (current) {
-			bcurrent->next = (semanage_file_context_bucket_t *)
-			    calloc(1, sizeof(semanage_file_context_bucket_t));
-			if (!(bcurrent->next)) {
-				ERR(sh, "Failure allocating memory.");
-				semanage_fc_bucket_list_destroy(main);
-				return -1;
-			}
-
-			bcurrent = bcurrent->next;
-		}
-	}
-
-	/* Sort the bucket list. */
-	semanage_fc_merge_sort(main);
+	/* Sort the file contexts from least to most specific. */
+	if (nfcs > 1)
+		qsort(fcs, nfcs, sizeof(*fcs), semanage_fc_compare);
 
 	/* First, calculate how much space we'll need for
 	 * the newly sorted block of data.  (We don't just
 	 * use buf_len for this because we have extracted
 	 * comments and whitespace.) */
 	i = 0;
-	current = main->data;
-	while (current) {
-		i += current->path_len + 1;	/* +1 for a tab */
-		if (current->file_type) {
-			i += current->type_len + 1;	/* +1 for a tab */
+	for (fc = fcs; fc < fcs + nfcs; fc++) {
+		i += fc->path_len + 1;	/* +1 for a tab */
+		if (fc->file_type) {
+			i += fc->type_len + 1;	/* +1 for a tab */
 		}
-		i += current->context_len + 1;	/* +1 for a newline */
-		current = current->next;
+		i += fc->context_len + 1;	/* +1 for a newline */
 	}
 	i = i + 1;		/* +1 for trailing \0 */
 
 	/* Allocate the buffer for the sorted list. */
-	*sorted_buf = calloc(i, sizeof(char));
+	*sorted_buf = malloc(i);
 	if (!*sorted_buf) {
 		ERR(sh, "Failure allocating memory.");
-		semanage_fc_bucket_list_destroy(main);
+		free(fcs);
 		return -1;
 	}
 	*sorted_buf_len = i;
 
-	/* Output the sorted semanage_file_context linked list to the char buffer. */
+	/* Output the sorted file contexts to the char buffer. */
 	sorted_buf_pos = *sorted_buf;
-	current = main->data;
-	while (current) {
+	for (fc = fcs; fc < fcs + nfcs; fc++) {
 		/* Output the path. */
-		i = current->path_len + 1;	/* +1 for tab */
-		snprintf(sorted_buf_pos, i + 1, "%s\t", current->path);
-		sorted_buf_pos = sorted_buf_pos + i;
+		memcpy(sorted_buf_pos, fc->path, fc->path_len);
+		sorted_buf_pos += fc->path_len;
+		*sorted_buf_pos++ = '\t';
 
 		/* Output the type, if there is one. */
-		if (current->file_type) {
-			i = strlen(current->file_type) + 1;	/* +1 for tab */
-			snprintf(sorted_buf_pos, i + 1, "%s\t",
-				 current->file_type);
-			sorted_buf_pos = sorted_buf_pos + i;
+		if (fc->file_type) {
+			memcpy(sorted_buf_pos, fc->file_type, fc->type_len);
+			sorted_buf_pos += fc->type_len;
+			*sorted_buf_pos++ = '\t';
 		}
 
 		/* Output the context. */
-		i = strlen(current->context) + 1;	/* +1 for newline */
-		snprintf(sorted_buf_pos, i + 1, "%s\n", current->context);
-		sorted_buf_pos = sorted_buf_pos + i;
-
-		current = current->next;
+		memcpy(sorted_buf_pos, fc->context, fc->context_len);
+		sorted_buf_pos += fc->context_len;
+		*sorted_buf_pos++ = '\n';
 	}
+	*sorted_buf_pos = '\0';
 
 	/* Clean up. */
-	semanage_fc_bucket_list_destroy(main);
-
-	/* Sanity check. */
-	sorted_buf_pos++;
-	if ((sorted_buf_pos - *sorted_buf) != (ssize_t) * sorted_buf_len) {
-		ERR(sh, "Failure writing sorted buffer.");
-		free(*sorted_buf);
-		*sorted_buf = NULL;
-		return -1;
-	}
+	free(fcs);
 
 	return 0;
 }
@@ -25,6 +25,8 @@
 #define SEMANAGE_MODULE_STORE_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sepol/module.h>
 #include <sepol/cil/cil.h>
@@ -61,6 +63,7 @@ enum semanage_sandbox_defs {
 	SEMANAGE_PRESERVE_TUNABLES,
 	SEMANAGE_MODULES_DISABLED,
 	SEMANAGE_MODULES_CHECKSUM,
+	SEMANAGE_MODULES_DIGESTS,
 	SEMANAGE_STORE_KERNEL,
 	SEMANAGE_STORE_FC_LOCAL,
 	SEMANAGE_STORE_FC_HOMEDIRS,
@@ -115,6 +118,7 @@ int semanage_mkdir(semanage_handle_t *sh, const char *path);
 int semanage_mkpath(semanage_handle_t *sh, const char *path);
 
 int semanage_make_sandbox(semanage_handle_t * sh);
+int semanage_remove_sandbox(semanage_handle_t *sh);
 
 int semanage_make_final(semanage_handle_t * sh);
 
@@ -133,6 +137,25 @@ void semanage_release_trans_lock(semanage_handle_t * sh);
 void semanage_release_active_lock(semanage_handle_t * sh);
 int semanage_direct_get_serial(semanage_handle_t * sh);
 
+/* module digest index */
+typedef struct semanage_module_digests semanage_module_digests_t;
+
+int semanage_module_digests_create(semanage_module_digests_t **digests);
+void semanage_module_digests_destroy(semanage_module_digests_t *digests);
+int semanage_module_digests_read(semanage_handle_t *sh,
+				 enum semanage_store_defs store,
+				 semanage_module_digests_t **digests);
+int semanage_module_digests_write(semanage_handle_t *sh,
+				  enum semanage_store_defs store,
+				  semanage_module_digests_t *digests);
+int semanage_module_digests_lookup(semanage_module_digests_t *digests,
+				   const char *path, const struct stat *sb,
+				   uint8_t *digest);
+int semanage_module_digests_add(semanage_handle_t *sh,
+				semanage_module_digests_t *digests,
+				const char *path, const struct stat *sb,
+				const uint8_t *digest);
+
 int semanage_load_files(semanage_handle_t * sh,
 			    cil_db_t *cildb, char **filenames, int num_modules);
 
@@ -144,6 +167,9 @@ int semanage_write_policydb(semanage_handle_t * sh,
 			    sepol_policydb_t * policydb,
 			    enum semanage_sandbox_defs file);
 
+int semanage_validate_and_compile_fcontexts(semanage_handle_t * sh,
+					    sepol_policydb_t * policydb);
+
 int semanage_install_sandbox(semanage_handle_t * sh);
 
 int semanage_verify_modules(semanage_handle_t * sh,
@@ -21,6 +21,7 @@
 /** standard typemaps **/
 
 %header %{
+	#include <limits.h>
 	#include <stdlib.h>
 	#include <semanage/semanage.h>
 	#include <sys/mman.h>
@@ -92,6 +93,62 @@
 		free(arr);
 		return STATUS_ERR;
 	}
+
+	/* Converts a Python sequence of opaque pointers of the given
+	 * swig type into a newly allocated array, for the batch
+	 * functions. The objects are borrowed, only the array
+	 * itself must be freed by the caller. */
+
+	static int semanage_plist2array(
+		PyObject* seq,
+		swig_type_info* swig_type,
+		void*** arr,
+		unsigned int* asize) {
+
+		void** tmp = NULL;
+		Py_ssize_t len, i;
+
+		if (!PySequence_Check(seq)) {
+			PyErr_SetString(PyExc_TypeError, "expected a sequence");
+			return STATUS_ERR;
+		}
+
+		len = PySequence_Size(seq);
+		if (len < 0 || (size_t) len > UINT_MAX) {
+			PyErr_SetString(PyExc_ValueError, "invalid sequence length");
+			return STATUS_ERR;
+		}
+
+		tmp = calloc(len ? len : 1, sizeof(void*));
+		if (!tmp) {
+			PyErr_NoMemory();
+			return STATUS_ERR;
+		}
+
+		for (i = 0; i < len; i++) {
+			PyObject* obj = PySequence_GetItem(seq, i);
+			int rc;
+
+			if (!obj)
+				goto err;
+
+			rc = SWIG_ConvertPtr(obj, &tmp[i], swig_type, 0);
+			Py_DECREF(obj);
+			if (!SWIG_IsOK(rc)) {
+				PyErr_SetString(PyExc_TypeError,
+					"sequence item has the wrong type");
+				goto err;
+			}
+		}
+
+		*arr = tmp;
+		*asize = (unsigned int) len;
+		return STATUS_SUCCESS;
+
+		err:
+		free(tmp);
+		return STATUS_ERR;
+	}
 %}
 /* a few helpful typemaps are available in this library */
 %include <typemaps.i>
@@ -218,6 +275,28 @@
 	$1 = &temp;
 }
 
+/* the batch functions take a Python sequence in place of the
+   array and count parameters */
+%typemap(in) (semanage_bool_t* const* records, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_bool,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_bool_t* const* records, unsigned int count) {
+	free((void*) $1);
+}
+
+%typemap(in) (semanage_bool_key_t* const* keys, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_bool_key,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_bool_key_t* const* keys, unsigned int count) {
+	free((void*) $1);
+}
+
 /** fcontext typemaps **/
 
 /* the wrapper will setup this parameter for passing... the resulting python functions
@@ -261,6 +340,28 @@
         $1 = &temp;
 }
 
+/* the batch functions take a Python sequence in place of the
+   array and count parameters */
+%typemap(in) (semanage_fcontext_t* const* records, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_fcontext,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_fcontext_t* const* records, unsigned int count) {
+	free((void*) $1);
+}
+
+%typemap(in) (semanage_fcontext_key_t* const* keys, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_fcontext_key,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_fcontext_key_t* const* keys, unsigned int count) {
+	free((void*) $1);
+}
+
 /** interface typemaps **/
 
 /* the wrapper will setup this parameter for passing... the resulting python functions
@@ -305,6 +406,28 @@
 	$1 = &temp;
 }
 
+/* the batch functions take a Python sequence in place of the
+   array and count parameters */
+%typemap(in) (semanage_iface_t* const* records, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_iface,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_iface_t* const* records, unsigned int count) {
+	free((void*) $1);
+}
+
+%typemap(in) (semanage_iface_key_t* const* keys, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_iface_key,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_iface_key_t* const* keys, unsigned int count) {
+	free((void*) $1);
+}
+
 /** seuser typemaps **/
 
 /* the wrapper will setup this parameter for passing... the resulting python functions
@@ -435,6 +558,28 @@
 	$1 = &temp;
 }
 
+/* the batch functions take a Python sequence in place of the
+   array and count parameters */
+%typemap(in) (semanage_port_t* const* records, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_port,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_port_t* const* records, unsigned int count) {
+	free((void*) $1);
+}
+
+%typemap(in) (semanage_port_key_t* const* keys, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_port_key,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_port_key_t* const* keys, unsigned int count) {
+	free((void*) $1);
+}
+
 /** ibpkey typemaps **/
 
 /* the wrapper will setup this parameter for passing... the resulting python functions
@@ -478,6 +623,28 @@
 	$1 = &temp;
 }
 
+/* the batch functions take a Python sequence in place of the
+   array and count parameters */
+%typemap(in) (semanage_ibpkey_t* const* records, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_ibpkey,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_ibpkey_t* const* records, unsigned int count) {
+	free((void*) $1);
+}
+
+%typemap(in) (semanage_ibpkey_key_t* const* keys, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_ibpkey_key,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_ibpkey_key_t* const* keys, unsigned int count) {
+	free((void*) $1);
+}
+
 /** ibendport typemaps **/
 
 /* the wrapper will setup this parameter for passing... the resulting python functions
@@ -521,6 +688,28 @@
 	$1 = &temp;
 }
 
+/* the batch functions take a Python sequence in place of the
+   array and count parameters */
+%typemap(in) (semanage_ibendport_t* const* records, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_ibendport,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_ibendport_t* const* records, unsigned int count) {
+	free((void*) $1);
+}
+
+%typemap(in) (semanage_ibendport_key_t* const* keys, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_ibendport_key,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_ibendport_key_t* const* keys, unsigned int count) {
+	free((void*) $1);
+}
+
 /** node typemaps **/
 
 /* the wrapper will setup this parameter for passing... the resulting python functions
@@ -565,5 +754,27 @@
 	$1 = &temp;
 }
 
+/* the batch functions take a Python sequence in place of the
+   array and count parameters */
+%typemap(in) (semanage_node_t* const* records, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_node,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_node_t* const* records, unsigned int count) {
+	free((void*) $1);
+}
+
+%typemap(in) (semanage_node_key_t* const* keys, unsigned int count) {
+	if (semanage_plist2array($input, SWIGTYPE_p_semanage_node_key,
+		(void***) &$1, &$2) < 0)
+		SWIG_fail;
+}
+
+%typemap(freearg) (semanage_node_key_t* const* keys, unsigned int count) {
+	free((void*) $1);
+}
+
 %include "semanageswig_python_exception.i"
 %include "semanageswig.i"
@@ -1,4 +1,12 @@
 
+%exception semanage_serve {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
 %exception semanage_reload_policy {
   $action
   if (result < 0) {
@@ -1151,6 +1159,22 @@
   }
 }
 
+%exception semanage_bool_modify_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
+%exception semanage_bool_del_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
 %exception semanage_bool_query_local {
   $action
   if (result < 0) {
@@ -1463,6 +1487,22 @@
   }
 }
 
+%exception semanage_fcontext_modify_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
+%exception semanage_fcontext_del_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
 %exception semanage_fcontext_query_local {
   $action
   if (result < 0) {
@@ -1663,6 +1703,22 @@
   }
 }
 
+%exception semanage_port_modify_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
+%exception semanage_port_del_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
 %exception semanage_port_query_local {
   $action
   if (result < 0) {
@@ -1759,6 +1815,22 @@
   }
 }
 
+%exception semanage_ibpkey_modify_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
+%exception semanage_ibpkey_del_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
 %exception semanage_ibpkey_query_local {
   $action
   if (result < 0) {
@@ -1815,6 +1887,22 @@
   }
 }
 
+%exception semanage_ibendport_modify_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
+%exception semanage_ibendport_del_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
 %exception semanage_ibendport_query_local {
   $action
   if (result < 0) {
@@ -1951,6 +2039,22 @@
   }
 }
 
+%exception semanage_iface_modify_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
+%exception semanage_iface_del_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
 %exception semanage_iface_query_local {
   $action
   if (result < 0) {
@@ -2047,6 +2151,22 @@
   }
 }
 
+%exception semanage_node_modify_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
+%exception semanage_node_del_local_batch {
+  $action
+  if (result < 0) {
+     PyErr_SetFromErrno(PyExc_OSError);
+     SWIG_fail;
+  }
+}
+
 %exception semanage_node_query_local {
   $action
   if (result < 0) {
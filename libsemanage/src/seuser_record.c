@@ -18,6 +18,7 @@ typedef struct semanage_seuser_key record_key_t;
 #include "debug.h"
 #include <semanage/handle.h>
 #include "database.h"
+#include "utilities.h"
 
 struct semanage_seuser {
 	/* This user's name */
@@ -246,6 +247,13 @@ void semanage_seuser_free(semanage_seuser_t * seuser)
 }
 
 
+static unsigned int semanage_seuser_key_hash(const semanage_seuser_key_t * key)
+{
+
+	return semanage_hash_str(SEMANAGE_HASH_INIT, key->name);
+}
+
+
 /* Record base functions */
 const record_table_t SEMANAGE_SEUSER_RTABLE = {
 	.create = semanage_seuser_create,
@@ -256,4 +264,5 @@ const record_table_t SEMANAGE_SEUSER_RTABLE = {
 	.compare2 = semanage_seuser_compare2,
 	.compare2_qsort = semanage_seuser_compare2_qsort,
 	.free = semanage_seuser_free,
+	.hash = semanage_seuser_key_hash,
 };
@@ -181,4 +181,5 @@ const record_table_t SEMANAGE_USER_BASE_RTABLE = {
 	.compare2 = semanage_user_base_compare2,
 	.compare2_qsort = semanage_user_base_compare2_qsort,
 	.free = semanage_user_base_free,
+	.hash = semanage_user_key_hash,
 };
@@ -193,4 +193,5 @@ const record_table_t SEMANAGE_USER_EXTRA_RTABLE = {
 	.compare2 = semanage_user_extra_compare2,
 	.compare2_qsort = semanage_user_extra_compare2_qsort,
 	.free = semanage_user_extra_free,
+	.hash = semanage_user_key_hash,
 };
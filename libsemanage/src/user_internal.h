@@ -17,6 +17,9 @@ extern const record_table_t SEMANAGE_USER_BASE_RTABLE;
 /* USER EXTRA record: method table */
 extern const record_table_t SEMANAGE_USER_EXTRA_RTABLE;
 
+/* Key hash shared by the USER, USER BASE and USER EXTRA records */
+extern unsigned int semanage_user_key_hash(const semanage_user_key_t * key);
+
 /* ============ Init/Release functions ========== */
 
 /* USER BASE record, FILE backend */
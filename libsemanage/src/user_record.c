@@ -22,6 +22,7 @@ typedef semanage_user_key_t record_key_t;
 #include "handle.h"
 #include "database.h"
 #include "debug.h"
+#include "utilities.h"
 
 struct semanage_user {
 	char *name;
@@ -382,6 +383,14 @@ void semanage_user_free(semanage_user_t * user)
 	return STATUS_ERR;
 }
 
+unsigned int semanage_user_key_hash(const semanage_user_key_t * key)
+{
+
+	const char *name;
+	sepol_user_key_unpack(key, &name);
+	return semanage_hash_str(SEMANAGE_HASH_INIT, name);
+}
+
 /* Record base functions */
 const record_table_t SEMANAGE_USER_RTABLE = {
 	.create = semanage_user_create,
@@ -392,4 +401,5 @@ const record_table_t SEMANAGE_USER_RTABLE = {
 	.compare2 = semanage_user_compare2,
 	.compare2_qsort = semanage_user_compare2_qsort,
 	.free = semanage_user_free,
+	.hash = semanage_user_key_hash,
 };
@@ -214,6 +214,24 @@ size_t semanage_str_count(const char *data, char what)
 	return count;
 }
 
+unsigned int semanage_hash_bytes(unsigned int hash, const void *data,
+				 size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+unsigned int semanage_hash_str(unsigned int hash, const char *str)
+{
+	return semanage_hash_bytes(hash, str, strlen(str));
+}
+
 void semanage_rtrim(char *str, char trim_to)
 {
 	size_t len;
@@ -144,6 +144,25 @@ semanage_list_t *semanage_slurp_file_filter(FILE * file,
 					    int (*pred) (const char *))
     WARN_UNUSED;
 
+/* Initial value for semanage_hash_bytes() and semanage_hash_str() */
+#define SEMANAGE_HASH_INIT 2166136261U
+
+/**
+ * @param hash  hash to continue from, SEMANAGE_HASH_INIT for a new hash
+ * @param data  bytes to be hashed
+ * @param len   number of bytes
+ * @return      the (FNV-1a) hash of data, continuing from hash
+ */
+unsigned int semanage_hash_bytes(unsigned int hash, const void *data,
+				 size_t len);
+
+/**
+ * @param hash  hash to continue from, SEMANAGE_HASH_INIT for a new hash
+ * @param str   string to be hashed, excluding the terminating nul
+ * @return      the hash of str, continuing from hash
+ */
+unsigned int semanage_hash_str(unsigned int hash, const char *str);
+
 /**
  * Wrapper around write(2), which retries on short writes.
  *
@@ -30,6 +30,8 @@
 #include "test_port.h"
 #include "test_user.h"
 #include "test_other.h"
+#include "test_genhomedircon.h"
+#include "test_polserv.h"
 
 #include <CUnit/Basic.h>
 #include <CUnit/Console.h>
@@ -81,6 +83,8 @@ static bool do_tests(int interactive, int verbose)
 	DECLARE_SUITE(port);
 	DECLARE_SUITE(user);
 	DECLARE_SUITE(other);
+	DECLARE_SUITE(genhomedircon);
+	DECLARE_SUITE(polserv);
 
 	if (verbose)
 		CU_basic_set_mode(CU_BRM_VERBOSE);
@@ -18,6 +18,7 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+
 #include "utilities.h"
 #include "test_fcontext.h"
 
@@ -38,6 +39,8 @@ static const unsigned int FCONTEXTS_LEN = sizeof(FCONTEXTS);
 #define FCONTEXT_NONEXISTENT_EXPR "/asdf"
 #define FCONTEXT_NONEXISTENT_TYPE SEMANAGE_FCONTEXT_ALL
 
+#define FCONTEXT_BULK_COUNT 50000
+
 /* fcontext_record.h */
 static void test_fcontext_compare(void);
 static void test_fcontext_compare2(void);
@@ -64,6 +67,8 @@ static void test_fcontext_exists_local(void);
 static void test_fcontext_count_local(void);
 static void test_fcontext_iterate_local(void);
 static void test_fcontext_list_local(void);
+static void test_fcontext_modify_local_bulk(void);
+static void test_fcontext_modify_del_local_batch(void);
 
 static int write_file_contexts(const char *data, unsigned int data_len)
 {
@@ -151,6 +156,10 @@ int fcontext_add_tests(CU_pSuite suite)
 		    test_fcontext_iterate_local);
 	CU_add_test(suite, "test_fcontext_list_local",
 		    test_fcontext_list_local);
+	CU_add_test(suite, "test_fcontext_modify_local_bulk",
+		    test_fcontext_modify_local_bulk);
+	CU_add_test(suite, "test_fcontext_modify_del_local_batch",
+		    test_fcontext_modify_del_local_batch);
 
 	return 0;
 }
@@ -1035,3 +1044,130 @@ static void test_fcontext_list_local(void)
 	delete_local_fcontext(I_SECOND);
 	cleanup_handle(SH_TRANS);
 }
+
+/* Import of many local fcontexts, as done by semanage import */
+static void test_fcontext_modify_local_bulk(void)
+{
+	semanage_fcontext_t *fcontext;
+	semanage_fcontext_key_t *key;
+	semanage_fcontext_t **records;
+	unsigned int count;
+	char expr[32];
+	int exists;
+
+	/* setup */
+	setup_handle(SH_TRANS);
+	fcontext = get_fcontext_nth(I_FIRST);
+
+	/* test */
+	for (int i = 0; i < FCONTEXT_BULK_COUNT; i++) {
+		snprintf(expr, sizeof(expr), "/bulk/%d", i);
+		CU_ASSERT_FATAL(semanage_fcontext_set_expr(sh, fcontext, expr) >= 0);
+		CU_ASSERT_FATAL(semanage_fcontext_key_extract(sh, fcontext, &key) >= 0);
+		CU_ASSERT_FATAL(semanage_fcontext_modify_local(sh, key, fcontext) >= 0);
+		semanage_fcontext_key_free(key);
+	}
+
+	/* modifying existing records must not add new ones */
+	for (int i = 0; i < FCONTEXT_BULK_COUNT; i += 2) {
+		snprintf(expr, sizeof(expr), "/bulk/%d", i);
+		CU_ASSERT_FATAL(semanage_fcontext_set_expr(sh, fcontext, expr) >= 0);
+		CU_ASSERT_FATAL(semanage_fcontext_key_extract(sh, fcontext, &key) >= 0);
+		CU_ASSERT_FATAL(semanage_fcontext_modify_local(sh, key, fcontext) >= 0);
+		CU_ASSERT(semanage_fcontext_exists_local(sh, key, &exists) >= 0);
+		CU_ASSERT(exists == 1);
+		semanage_fcontext_key_free(key);
+	}
+
+	/* records are listed in insertion order */
+	CU_ASSERT(semanage_fcontext_list_local(sh, &records, &count) >= 0);
+	CU_ASSERT_FATAL(count == FCONTEXT_BULK_COUNT);
+	for (unsigned int i = 0; i < count; i++) {
+		snprintf(expr, sizeof(expr), "/bulk/%u", i);
+		CU_ASSERT_STRING_EQUAL(semanage_fcontext_get_expr(records[i]),
+				       expr);
+		semanage_fcontext_free(records[i]);
+	}
+	free(records);
+
+	for (int i = 0; i < FCONTEXT_BULK_COUNT; i++) {
+		snprintf(expr, sizeof(expr), "/bulk/%d", i);
+		key = get_fcontext_key_from_str(expr,
+					semanage_fcontext_get_type(fcontext));
+		CU_ASSERT_FATAL(semanage_fcontext_del_local(sh, key) >= 0);
+		semanage_fcontext_key_free(key);
+	}
+
+	CU_ASSERT(semanage_fcontext_count_local(sh, &count) >= 0);
+	CU_ASSERT(count == 0);
+
+	/* cleanup */
+	semanage_fcontext_free(fcontext);
+	cleanup_handle(SH_TRANS);
+}
+
+/* Function semanage_fcontext_modify_local_batch,
+ * semanage_fcontext_del_local_batch */
+#define FCONTEXT_BATCH_COUNT 3
+
+static void test_fcontext_modify_del_local_batch(void)
+{
+	semanage_fcontext_t *records[FCONTEXT_BATCH_COUNT];
+	semanage_fcontext_key_t *keys[FCONTEXT_BATCH_COUNT];
+	semanage_fcontext_t *dup[2];
+	semanage_fcontext_t *resp = NULL;
+	unsigned int count;
+	char expr[32];
+
+	/* setup */
+	setup_handle(SH_TRANS);
+
+	for (int i = 0; i < FCONTEXT_BATCH_COUNT; i++) {
+		records[i] = get_fcontext_nth(I_FIRST);
+		snprintf(expr, sizeof(expr), "/batch/%d", i);
+		CU_ASSERT_FATAL(semanage_fcontext_set_expr(sh, records[i],
+							   expr) >= 0);
+		CU_ASSERT_FATAL(semanage_fcontext_key_extract(sh, records[i],
+							      &keys[i]) >= 0);
+	}
+
+	/* test */
+	CU_ASSERT(semanage_fcontext_modify_local_batch(sh, records,
+			FCONTEXT_BATCH_COUNT) >= 0);
+	CU_ASSERT(semanage_fcontext_count_local(sh, &count) >= 0);
+	CU_ASSERT(count == FCONTEXT_BATCH_COUNT);
+
+	/* a second batch replaces the records in place */
+	CU_ASSERT(semanage_fcontext_modify_local_batch(sh, records,
+			FCONTEXT_BATCH_COUNT) >= 0);
+	CU_ASSERT(semanage_fcontext_count_local(sh, &count) >= 0);
+	CU_ASSERT(count == FCONTEXT_BATCH_COUNT);
+
+	for (int i = 0; i < FCONTEXT_BATCH_COUNT; i++) {
+		CU_ASSERT(semanage_fcontext_query_local(sh, keys[i],
+							&resp) >= 0);
+		CU_ASSERT(semanage_fcontext_compare2(resp, records[i]) == 0);
+		semanage_fcontext_free(resp);
+	}
+
+	CU_ASSERT(semanage_fcontext_modify_local_batch(sh, NULL, 0) >= 0);
+
+	CU_ASSERT(semanage_fcontext_del_local_batch(sh, keys,
+			FCONTEXT_BATCH_COUNT) >= 0);
+	CU_ASSERT(semanage_fcontext_count_local(sh, &count) >= 0);
+	CU_ASSERT(count == 0);
+
+	/* a key repeated within a batch is only stored once */
+	dup[0] = dup[1] = records[0];
+	CU_ASSERT(semanage_fcontext_modify_local_batch(sh, dup, 2) >= 0);
+	CU_ASSERT(semanage_fcontext_count_local(sh, &count) >= 0);
+	CU_ASSERT(count == 1);
+	CU_ASSERT(semanage_fcontext_del_local(sh, keys[0]) >= 0);
+
+	/* cleanup */
+	for (int i = 0; i < FCONTEXT_BATCH_COUNT; i++) {
+		semanage_fcontext_key_free(keys[i]);
+		semanage_fcontext_free(records[i]);
+	}
+	cleanup_handle(SH_TRANS);
+}
@@ -0,0 +1,262 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*  The purpose of this file is to provide unit tests of the functions in:
+ *
+ *  libsemanage/src/genhomedircon.c
+ *
+ */
+
+#include "utilities.h"
+#include "test_genhomedircon.h"
+
+#include <sepol/policydb.h>
+
+#include "genhomedircon.h"
+#include "semanage_store.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <grp.h>
+#include <pwd.h>
+#include <string.h>
+
+#define TEST_USER "semanage_test_user"
+#define TEST_HOME "/home/" TEST_USER
+
+static const char *const template =
+	"/genhomedircon_test/USER\tsystem_u:object_r:test_t:s0\n";
+
+/* The groups and the user mapped through them are not in the system
+ * databases, so the lookups of genhomedircon are answered here and
+ * everything else is passed on to the C library. */
+static char *group_members[] = { (char *) TEST_USER, NULL };
+
+int getgrnam_r(const char *name, struct group *grp, char *buf, size_t buflen,
+	       struct group **result)
+{
+	int (*next)(const char *, struct group *, char *, size_t,
+		    struct group **);
+
+	if (strcmp(name, "semanage_test_a") == 0 ||
+	    strcmp(name, "semanage_test_b") == 0) {
+		memset(grp, 0, sizeof(*grp));
+		grp->gr_name = (char *) name;
+		grp->gr_passwd = (char *) "x";
+		grp->gr_gid = name[sizeof("semanage_test_") - 1] == 'a' ?
+			      4000000001 : 4000000002;
+		grp->gr_mem = group_members;
+		*result = grp;
+		return 0;
+	}
+
+	next = dlsym(RTLD_NEXT, "getgrnam_r");
+	return next(name, grp, buf, buflen, result);
+}
+
+int getpwnam_r(const char *name, struct passwd *pwd, char *buf, size_t buflen,
+	       struct passwd **result)
+{
+	int (*next)(const char *, struct passwd *, char *, size_t,
+		    struct passwd **);
+
+	if (strcmp(name, TEST_USER) == 0) {
+		if (buflen < sizeof(TEST_HOME))
+			return ERANGE;
+		memset(pwd, 0, sizeof(*pwd));
+		strcpy(buf, TEST_HOME);
+		pwd->pw_name = (char *) TEST_USER;
+		pwd->pw_passwd = (char *) "x";
+		pwd->pw_uid = 4000000000;
+		pwd->pw_gid = 4000000000;
+		pwd->pw_dir = buf;
+		pwd->pw_shell = (char *) "/bin/sh";
+		*result = pwd;
+		return 0;
+	}
+
+	next = dlsym(RTLD_NEXT, "getpwnam_r");
+	return next(name, pwd, buf, buflen, result);
+}
+
+/* genhomedircon */
+static void test_genhomedircon_group(void);
+static void test_genhomedircon_group_conflict(void);
+static void test_genhomedircon_group_conflict_override(void);
+
+int genhomedircon_test_init(void)
+{
+	if (create_test_store() < 0) {
+		fprintf(stderr, "Could not create test store\n");
+		return 1;
+	}
+
+	if (write_test_policy_from_file("test_genhomedircon.policy") < 0) {
+		fprintf(stderr, "Could not write test policy\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+int genhomedircon_test_cleanup(void)
+{
+	if (destroy_test_store() < 0) {
+		fprintf(stderr, "Could not destroy test store\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+int genhomedircon_add_tests(CU_pSuite suite)
+{
+	CU_add_test(suite, "genhomedircon_group", test_genhomedircon_group);
+	CU_add_test(suite, "genhomedircon_group_conflict",
+		    test_genhomedircon_group_conflict);
+	CU_add_test(suite, "genhomedircon_group_conflict_override",
+		    test_genhomedircon_group_conflict_override);
+
+	return 0;
+}
+
+/* Helpers */
+
+static int write_file(const char *path, const char *data)
+{
+	FILE *fptr = fopen(path, "w");
+
+	if (!fptr)
+		return -1;
+
+	if (fputs(data, fptr) == EOF) {
+		fclose(fptr);
+		return -1;
+	}
+
+	return fclose(fptr);
+}
+
+static sepol_policydb_t *read_test_policy(void)
+{
+	sepol_policy_file_t *pf = NULL;
+	sepol_policydb_t *p = NULL;
+	FILE *fptr;
+
+	fptr = fopen("test_genhomedircon.policy", "rb");
+	if (!fptr)
+		return NULL;
+
+	if (sepol_policy_file_create(&pf) < 0 ||
+	    sepol_policydb_create(&p) < 0)
+		goto err;
+
+	sepol_policy_file_set_fp(pf, fptr);
+	if (sepol_policydb_read(p, pf) < 0)
+		goto err;
+
+	sepol_policy_file_free(pf);
+	fclose(fptr);
+	return p;
+
+err:
+	sepol_policydb_free(p);
+	sepol_policy_file_free(pf);
+	fclose(fptr);
+	return NULL;
+}
+
+/* Runs genhomedircon in a new transaction with the given login
+ * mappings and returns its result. */
+static int run_genhomedircon(const char *seusers)
+{
+	sepol_policydb_t *p;
+	int rc;
+
+	setup_handle(SH_TRANS);
+
+	CU_ASSERT(write_file(semanage_path(SEMANAGE_TMP,
+					   SEMANAGE_HOMEDIR_TMPL),
+			     template) == 0);
+	CU_ASSERT(write_file(semanage_path(SEMANAGE_TMP,
+					   SEMANAGE_STORE_SEUSERS),
+			     seusers) == 0);
+
+	p = read_test_policy();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(p);
+
+	rc = semanage_genhomedircon(sh, p, 0, NULL);
+
+	sepol_policydb_free(p);
+	return rc;
+}
+
+/* Returns whether the generated file contexts contain line. */
+static int homedirs_contain(const char *line)
+{
+	char buf[BUFSIZ];
+	FILE *fptr;
+	int found = 0;
+
+	fptr = fopen(semanage_path(SEMANAGE_TMP, SEMANAGE_STORE_FC_HOMEDIRS),
+		     "r");
+	if (!fptr)
+		return 0;
+
+	while (!found && fgets(buf, sizeof(buf), fptr))
+		found = strcmp(buf, line) == 0;
+
+	fclose(fptr);
+	return found;
+}
+
+/* Tests */
+
+/* Function semanage_genhomedircon, a login mapped through one group */
+static void test_genhomedircon_group(void)
+{
+	CU_ASSERT(run_genhomedircon("%semanage_test_a:first_u:s0\n") == 0);
+	CU_ASSERT(homedirs_contain("/genhomedircon_test/" TEST_USER
+				   "\tfirst_u:object_r:test_t:s0\n"));
+
+	helper_disconnect();
+	helper_handle_destroy();
+}
+
+/* Function semanage_genhomedircon, a login mapped through two groups
+ * must fail, as it is not known which SELinux user it gets */
+static void test_genhomedircon_group_conflict(void)
+{
+	CU_ASSERT(run_genhomedircon("%semanage_test_a:first_u:s0\n"
+				    "%semanage_test_b:second_u:s0\n") < 0);
+
+	helper_disconnect();
+	helper_handle_destroy();
+}
+
+/* Function semanage_genhomedircon, a mapping of the login itself takes
+ * precedence over the groups */
+static void test_genhomedircon_group_conflict_override(void)
+{
+	CU_ASSERT(run_genhomedircon("%semanage_test_a:first_u:s0\n"
+				    "%semanage_test_b:second_u:s0\n"
+				    TEST_USER ":second_u:s0\n") == 0);
+	CU_ASSERT(homedirs_contain("/genhomedircon_test/" TEST_USER
+				   "\tsecond_u:object_r:test_t:s0\n"));
+
+	helper_disconnect();
+	helper_handle_destroy();
+}
@@ -21,11 +21,16 @@
 #include "utilities.h"
 #include "test_handle.h"
 
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
 static void test_handle_create(void);
 static void test_connect(void);
 static void test_disconnect(void);
 static void test_transaction(void);
 static void test_commit(void);
+static void test_commit_corrupt_module(void);
 static void test_is_connected(void);
 static void test_access_check(void);
 static void test_is_managed(void);
@@ -66,6 +71,8 @@ int handle_add_tests(CU_pSuite suite)
 	CU_add_test(suite, "test_disconnect", test_disconnect);
 	CU_add_test(suite, "test_transaction", test_transaction);
 	CU_add_test(suite, "test_commit", test_commit);
+	CU_add_test(suite, "test_commit_corrupt_module",
+		    test_commit_corrupt_module);
 	CU_add_test(suite, "test_is_connected", test_is_connected);
 	CU_add_test(suite, "test_access_check", test_access_check);
 	CU_add_test(suite, "test_is_managed", test_is_managed);
@@ -146,6 +153,50 @@ static void test_commit(void)
 	cleanup_handle(SH_CONNECT);
 }
 
+static int install_module(const char *name, const char *cil)
+{
+	return semanage_module_install(sh, (char *)cil, strlen(cil),
+				       name, "cil");
+}
+
+/* Function semanage_commit, with a module that cannot be decompressed */
+static void test_commit_corrupt_module(void)
+{
+	const char *path = "test-policy/store/active/modules/400/"
+			   "test_handle_a/cil";
+	FILE *f;
+
+	/* install the base and two more modules, loaded after it */
+	setup_handle(SH_TRANS);
+	CU_ASSERT(semanage_module_install_file(sh, "test_handle.cil") >= 0);
+	CU_ASSERT(install_module("test_handle_a",
+				 "(type a_t)(roletype object_r a_t)") >= 0);
+	CU_ASSERT(install_module("test_handle_b",
+				 "(type b_t)(roletype object_r b_t)") >= 0);
+	CU_ASSERT(semanage_commit(sh) >= 0);
+	cleanup_handle(SH_CONNECT);
+
+	/* truncate the bzip2 archive of the second module */
+	CU_ASSERT(unlink(path) == 0);
+	f = fopen(path, "w");
+	CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+	fputs("BZh91AY&SY", f);
+	CU_ASSERT(fclose(f) == 0);
+
+	/* test rebuild, which has to load every module */
+	setup_handle(SH_TRANS);
+	semanage_set_rebuild(sh, 1);
+	semanage_set_ignore_module_cache(sh, 1);
+	CU_ASSERT(semanage_commit(sh) < 0);
+	cleanup_handle(SH_CONNECT);
+
+	/* test the store is usable again without the module */
+	setup_handle(SH_TRANS);
+	CU_ASSERT(semanage_module_remove(sh, "test_handle_a") >= 0);
+	CU_ASSERT(semanage_commit(sh) >= 0);
+	cleanup_handle(SH_CONNECT);
+}
+
 /* Function semanage_is_connected */
 static void test_is_connected(void)
 {
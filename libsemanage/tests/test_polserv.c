@@ -0,0 +1,449 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*  The purpose of this file is to provide unit tests of the functions in:
+ *
+ *  libsemanage/src/polserv.c
+ *
+ */
+
+#include "utilities.h"
+#include "test_polserv.h"
+
+#include "semanage_store.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define BOOL_NAME "polserv_bool"
+
+static char socket_dir[] = "/tmp/semanage-polserv-XXXXXX";
+static char socket_path[sizeof(socket_dir) + sizeof("/socket")];
+static pid_t server_pid = -1;
+
+/* polserv.c */
+static void test_polserv_hello(void);
+static void test_polserv_hello_wrong_store(void);
+static void test_polserv_requests(void);
+static void test_polserv_commit(void);
+static void test_polserv_commit_flags(void);
+
+static void server_signal(int sig __attribute__ ((unused)))
+{
+}
+
+/* Runs the policy server on the test store until it is terminated. */
+static void __attribute__ ((__noreturn__)) run_server(void)
+{
+	struct sigaction sa = { .sa_handler = server_signal };
+	semanage_handle_t *server;
+	int rc;
+
+	sigaction(SIGTERM, &sa, NULL);
+
+	server = semanage_handle_create();
+	if (!server)
+		_exit(1);
+
+	semanage_msg_set_callback(server, test_msg_handler, NULL);
+	semanage_set_reload(server, 0);
+	semanage_set_store_root(server, "");
+	semanage_select_store(server, "store", SEMANAGE_CON_DIRECT);
+
+	rc = semanage_serve(server, socket_path);
+	semanage_handle_destroy(server);
+	_exit(rc < 0 ? 1 : 0);
+}
+
+static int connect_server(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	/* Fail instead of hanging on a missing reply */
+	struct timeval timeout = { .tv_sec = 30 };
+	int fd;
+
+	strcpy(addr.sun_path, socket_path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+		       sizeof(timeout)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int write_conf(void)
+{
+	FILE *fptr = fopen("test-policy/etc/selinux/semanage.conf", "w");
+
+	if (!fptr)
+		return -1;
+
+	fprintf(fptr, "module-store = %s\n", socket_path);
+	return fclose(fptr);
+}
+
+/* Installs the test policy as the only module of the store. */
+static int install_policy(void)
+{
+	int rc = -1;
+
+	semanage_set_root("test-policy");
+	sh = semanage_handle_create();
+	if (!sh)
+		return -1;
+
+	semanage_msg_set_callback(sh, test_msg_handler, NULL);
+	semanage_set_create_store(sh, 1);
+	semanage_set_reload(sh, 0);
+	semanage_set_store_root(sh, "");
+	semanage_select_store(sh, "store", SEMANAGE_CON_DIRECT);
+
+	if (semanage_connect(sh) >= 0) {
+		if (semanage_begin_transaction(sh) >= 0 &&
+		    semanage_module_install_file(sh, "test_polserv.cil") >= 0 &&
+		    semanage_commit(sh) >= 0)
+			rc = 0;
+		semanage_disconnect(sh);
+	}
+
+	semanage_handle_destroy(sh);
+	sh = NULL;
+	return rc;
+}
+
+int polserv_test_init(void)
+{
+	int i, fd;
+
+	if (!mkdtemp(socket_dir)) {
+		fprintf(stderr, "Could not create socket directory\n");
+		return 1;
+	}
+	snprintf(socket_path, sizeof(socket_path), "%s/socket", socket_dir);
+
+	if (create_test_store() < 0 || write_conf() < 0) {
+		fprintf(stderr, "Could not create test store\n");
+		return 1;
+	}
+
+	if (write_test_policy_from_file("test_polserv.policy") < 0) {
+		fprintf(stderr, "Could not write test policy\n");
+		return 1;
+	}
+
+	if (install_policy() < 0) {
+		fprintf(stderr, "Could not install test policy\n");
+		return 1;
+	}
+
+	server_pid = fork();
+	if (server_pid < 0) {
+		fprintf(stderr, "Could not start the policy server\n");
+		return 1;
+	}
+	if (server_pid == 0)
+		run_server();
+
+	/* Wait for the server to listen */
+	for (i = 0; i < 100; i++) {
+		fd = connect_server();
+		if (fd >= 0) {
+			close(fd);
+			return 0;
+		}
+		usleep(50000);
+	}
+
+	fprintf(stderr, "The policy server did not start\n");
+	return 1;
+}
+
+int polserv_test_cleanup(void)
+{
+	int status, rc = 0;
+
+	if (server_pid > 0) {
+		kill(server_pid, SIGTERM);
+		if (waitpid(server_pid, &status, 0) < 0 ||
+		    !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			fprintf(stderr, "The policy server failed\n");
+			rc = 1;
+		}
+		server_pid = -1;
+	}
+
+	unlink(socket_path);
+	rmdir(socket_dir);
+
+	if (destroy_test_store() < 0) {
+		fprintf(stderr, "Could not destroy test store\n");
+		return 1;
+	}
+
+	return rc;
+}
+
+int polserv_add_tests(CU_pSuite suite)
+{
+	CU_add_test(suite, "polserv_hello", test_polserv_hello);
+	CU_add_test(suite, "polserv_hello_wrong_store",
+		    test_polserv_hello_wrong_store);
+	CU_add_test(suite, "polserv_requests", test_polserv_requests);
+	CU_add_test(suite, "polserv_commit", test_polserv_commit);
+	CU_add_test(suite, "polserv_commit_flags", test_polserv_commit_flags);
+
+	return 0;
+}
+
+/* Helpers */
+
+static int send_line(int fd, const char *line)
+{
+	size_t len = strlen(line);
+
+	if (send(fd, line, len, MSG_NOSIGNAL) != (ssize_t) len ||
+	    send(fd, "\n", 1, MSG_NOSIGNAL) != 1)
+		return -1;
+	return 0;
+}
+
+/* Reads the reply to a request, skipping any messages.  Returns the
+ * result of an "OK" reply, -1 for "ERR" and -2 if the connection was
+ * closed or the reply is invalid. */
+static int read_reply(int fd)
+{
+	char line[4096];
+	size_t len = 0;
+	int result;
+	char c;
+
+	for (;;) {
+		if (read(fd, &c, 1) != 1)
+			return -2;
+
+		if (c != '\n') {
+			if (len == sizeof(line) - 1)
+				return -2;
+			line[len++] = c;
+			continue;
+		}
+		line[len] = '\0';
+		len = 0;
+
+		if (strncmp(line, "MSG ", 4) == 0)
+			continue;
+		if (sscanf(line, "OK %d", &result) == 1)
+			return result;
+		if (strcmp(line, "ERR") == 0)
+			return -1;
+		return -2;
+	}
+}
+
+/* Returns a connection that has been greeted by the server. */
+static int connect_greeted(void)
+{
+	char hello[PATH_MAX + sizeof("HELLO ")];
+	int fd;
+
+	/* A direct connection sets up the path of the store */
+	setup_handle(SH_CONNECT);
+	snprintf(hello, sizeof(hello), "HELLO %s",
+		 semanage_path(SEMANAGE_ACTIVE, SEMANAGE_TOPLEVEL));
+	cleanup_handle(SH_CONNECT);
+
+	fd = connect_server();
+	CU_ASSERT_FATAL(fd >= 0);
+	CU_ASSERT(send_line(fd, hello) == 0);
+	CU_ASSERT(read_reply(fd) == 0);
+
+	return fd;
+}
+
+/* Connects a handle of the policy server's clients to sh. */
+static void setup_polserv_handle(void)
+{
+	helper_handle_create();
+	semanage_select_store(sh, "store", SEMANAGE_CON_POLSERV_LOCAL);
+	helper_connect();
+}
+
+static int set_bool(int value)
+{
+	semanage_bool_key_t *key = NULL;
+	semanage_bool_t *boolean = NULL;
+	int rc = -1;
+
+	if (semanage_bool_key_create(sh, BOOL_NAME, &key) >= 0 &&
+	    semanage_bool_create(sh, &boolean) >= 0 &&
+	    semanage_bool_set_name(sh, boolean, BOOL_NAME) >= 0) {
+		semanage_bool_set_value(boolean, value);
+		rc = semanage_bool_modify_local(sh, key, boolean);
+	}
+
+	semanage_bool_free(boolean);
+	semanage_bool_key_free(key);
+	return rc;
+}
+
+/* Returns the value of the local boolean, or -1 if there is none. */
+static int get_bool(void)
+{
+	semanage_bool_key_t *key = NULL;
+	semanage_bool_t *boolean = NULL;
+	int value = -1;
+
+	if (semanage_bool_key_create(sh, BOOL_NAME, &key) >= 0 &&
+	    semanage_bool_query_local(sh, key, &boolean) >= 0)
+		value = semanage_bool_get_value(boolean);
+
+	semanage_bool_free(boolean);
+	semanage_bool_key_free(key);
+	return value;
+}
+
+/* Tests */
+
+/* A client must greet the server before anything else */
+static void test_polserv_hello(void)
+{
+	int fd = connect_server();
+
+	CU_ASSERT_FATAL(fd >= 0);
+	CU_ASSERT(send_line(fd, "BEGIN") == 0);
+	CU_ASSERT(read_reply(fd) == -2);
+	close(fd);
+
+	fd = connect_greeted();
+	close(fd);
+}
+
+/* A client of another store is turned away */
+static void test_polserv_hello_wrong_store(void)
+{
+	int fd = connect_server();
+
+	CU_ASSERT_FATAL(fd >= 0);
+	CU_ASSERT(send_line(fd, "HELLO /nonexistent/store/active") == 0);
+	CU_ASSERT(read_reply(fd) == -1);
+	(void) send_line(fd, "ABORT");
+	CU_ASSERT(read_reply(fd) == -2);
+	close(fd);
+}
+
+/* Transaction requests are only served in order */
+static void test_polserv_requests(void)
+{
+	int fd = connect_greeted();
+
+	CU_ASSERT(send_line(fd, "COMMIT 0 0 0 0 0 0 0 0 0") == 0);
+	CU_ASSERT(read_reply(fd) == -1);
+	CU_ASSERT(send_line(fd, "ABORT") == 0);
+	CU_ASSERT(read_reply(fd) == -1);
+	CU_ASSERT(send_line(fd, "UNKNOWN") == 0);
+	CU_ASSERT(read_reply(fd) == -1);
+
+	CU_ASSERT(send_line(fd, "BEGIN") == 0);
+	CU_ASSERT(read_reply(fd) == 0);
+	CU_ASSERT(access("test-policy/store/tmp", F_OK) == 0);
+
+	/* A commit with missing flags drops the transaction */
+	CU_ASSERT(send_line(fd, "COMMIT 0 0") == 0);
+	CU_ASSERT(read_reply(fd) == -1);
+	CU_ASSERT(access("test-policy/store/tmp", F_OK) != 0);
+
+	CU_ASSERT(send_line(fd, "BEGIN") == 0);
+	CU_ASSERT(read_reply(fd) == 0);
+	CU_ASSERT(send_line(fd, "ABORT") == 0);
+	CU_ASSERT(read_reply(fd) == 0);
+	CU_ASSERT(access("test-policy/store/tmp", F_OK) != 0);
+
+	/* Closing the connection drops its transaction */
+	CU_ASSERT(send_line(fd, "BEGIN") == 0);
+	CU_ASSERT(read_reply(fd) == 0);
+	close(fd);
+
+	fd = connect_greeted();
+	CU_ASSERT(send_line(fd, "BEGIN") == 0);
+	CU_ASSERT(read_reply(fd) == 0);
+	CU_ASSERT(send_line(fd, "ABORT") == 0);
+	CU_ASSERT(read_reply(fd) == 0);
+	close(fd);
+}
+
+/* Local modifications of a client are committed by the server */
+static void test_polserv_commit(void)
+{
+	setup_polserv_handle();
+	helper_begin_transaction();
+	CU_ASSERT(set_bool(1) >= 0);
+	CU_ASSERT(semanage_commit(sh) > 0);
+	helper_disconnect();
+	helper_handle_destroy();
+
+	setup_handle(SH_CONNECT);
+	CU_ASSERT(get_bool() == 1);
+	cleanup_handle(SH_CONNECT);
+
+	/* Changes of an aborted transaction are dropped */
+	setup_polserv_handle();
+	helper_begin_transaction();
+	CU_ASSERT(set_bool(0) >= 0);
+	helper_disconnect();
+	helper_handle_destroy();
+
+	setup_handle(SH_CONNECT);
+	CU_ASSERT(get_bool() == 1);
+	cleanup_handle(SH_CONNECT);
+}
+
+/* The settings of the client's handle apply to its commits only */
+static void test_polserv_commit_flags(void)
+{
+	const char *flag = "test-policy/store/active/disable_dontaudit";
+
+	setup_polserv_handle();
+	semanage_set_disable_dontaudit(sh, 1);
+	helper_begin_transaction();
+	CU_ASSERT(semanage_commit(sh) > 0);
+	CU_ASSERT(access(flag, F_OK) == 0);
+	helper_disconnect();
+	helper_handle_destroy();
+
+	/* The flag is read back on connect, so it has to be cleared */
+	setup_polserv_handle();
+	CU_ASSERT(semanage_get_disable_dontaudit(sh) == 1);
+	semanage_set_disable_dontaudit(sh, 0);
+	semanage_set_ignore_module_cache(sh, 1);
+	helper_begin_transaction();
+	CU_ASSERT(semanage_commit(sh) > 0);
+	CU_ASSERT(access(flag, F_OK) != 0);
+	helper_disconnect();
+	helper_handle_destroy();
+}
@@ -146,6 +146,12 @@ int semanage_store_add_tests(CU_pSuite suite)
 		return CU_get_error();
 	}
 
+	if (NULL ==
+	    CU_add_test(suite, "semanage_fc_sort", test_semanage_fc_sort)) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
 	return 0;
 }
 
@@ -372,3 +378,54 @@ void test_semanage_nc_sort(void)
 	munmap(source_buf, source_buf_len);
 	close(sourcefd);
 }
+
+/* Tests the semanage_fc_sort function in semanage_store.c
+ */
+void test_semanage_fc_sort(void)
+{
+	char *source_buf, *sorted_buf = NULL, *good_buf;
+	size_t source_buf_len, sorted_buf_len, good_buf_len;
+	int sourcefd, goodfd, err;
+	struct stat sb;
+
+	/* open source file */
+	sourcefd = open("fc_sort_unsorted", O_RDONLY);
+	if (sourcefd < 0) {
+		CU_FAIL("Missing fc_sort_unsorted test file.");
+		return;
+	}
+	fstat(sourcefd, &sb);
+	source_buf_len = sb.st_size;
+	source_buf =
+	    (char *)mmap(NULL, source_buf_len, PROT_READ, MAP_PRIVATE, sourcefd,
+			 0);
+
+	/* open good result file */
+	goodfd = open("fc_sort_sorted", O_RDONLY);
+	if (goodfd < 0) {
+		CU_FAIL("Missing fc_sort_sorted test file.");
+		goto out;
+	}
+	fstat(goodfd, &sb);
+	good_buf_len = sb.st_size;
+	good_buf =
+	    (char *)mmap(NULL, good_buf_len, PROT_READ, MAP_PRIVATE, goodfd, 0);
+
+	/* sort test file, the output must match byte for byte */
+	err =
+	    semanage_fc_sort(sh, source_buf, source_buf_len, &sorted_buf,
+			     &sorted_buf_len);
+	CU_ASSERT_FALSE(err);
+	CU_ASSERT_EQUAL(sorted_buf_len, good_buf_len + 1);
+	if (sorted_buf_len == good_buf_len + 1)
+		CU_ASSERT_EQUAL(memcmp(sorted_buf, good_buf, good_buf_len), 0);
+	CU_ASSERT_EQUAL(sorted_buf[sorted_buf_len - 1], '\0');
+
+	free(sorted_buf);
+
+	munmap(good_buf, good_buf_len);
+	close(goodfd);
+      out:
+	munmap(source_buf, source_buf_len);
+	close(sourcefd);
+}
@@ -30,5 +30,6 @@ int semanage_store_add_tests(CU_pSuite suite);
 void test_semanage_store_access_check(void);
 void test_semanage_get_lock(void);
 void test_semanage_nc_sort(void);
+void test_semanage_fc_sort(void);
 
 #endif
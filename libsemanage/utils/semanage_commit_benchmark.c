@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <semanage/semanage.h>
+
+/* Types declared by each generated module, set with -t */
+static unsigned long types_per_module = 20;
+
+/* HLL compiler of the generated modules set with -c, and the number of
+ * compilers run at once set with -j */
+static const char *compiler;
+static int compiler_jobs;
+
+static __attribute__ ((__noreturn__)) void usage(const char *progname)
+{
+	fprintf(stderr,
+		"usage: %s [-n modules] [-t types] [-r rounds] [-d]\n"
+		"       [-c compiler [-j jobs]] dir\n\n"
+		"Where:\n\t"
+		"-n  Number of modules to install besides the base (defaults\n\t"
+		"    to 400).\n\t"
+		"-t  Number of types declared by each module, which sets its\n\t"
+		"    size (defaults to 20).\n\t"
+		"-r  Number of times each kind of commit is timed (defaults\n\t"
+		"    to 5).\n\t"
+		"-d  Remove the module digest index of the store before each\n\t"
+		"    commit, so every module has to be decompressed again.\n\t"
+		"-c  Install the generated modules as HLL modules compiled by\n\t"
+		"    the given program, which reads the module on stdin and\n\t"
+		"    writes CIL on stdout. /bin/cat passes the CIL through.\n\t"
+		"-j  Number of compilers run at once (compiler-jobs, defaults\n\t"
+		"    to one per CPU).\n\t"
+		"dir  Empty directory to create a policy store below.\n\n"
+		"Reports the time of a no-op commit checking the modules for\n"
+		"external changes and of one that changes one of the modules.\n"
+		"With -c, also reports the time of a rebuild compiling every\n"
+		"module again.\n\n"
+		"Example:\n\t"
+		"%s -n 400 /var/tmp/store\n\t"
+		"taskset -c 0-3 %s -n 400 -c /bin/cat -j 4 /var/tmp/store\n",
+		progname, progname, progname);
+	exit(1);
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) +
+	       (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void msg_handler(void *varg __attribute__ ((unused)),
+			semanage_handle_t *handle,
+			const char *fmt, ...)
+{
+	va_list ap;
+
+	if (semanage_msg_get_level(handle) != SEMANAGE_MSG_ERR)
+		return;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+static char base_cil[] =
+	"(handleunknown allow)\n"
+	"(mls true)\n"
+	"(sid kernel)\n"
+	"(sidorder (kernel))\n"
+	"(sensitivity s0)\n"
+	"(sensitivityorder (s0))\n"
+	"(user system_u)\n"
+	"(userrole system_u object_r)\n"
+	"(userrole system_u system_r)\n"
+	"(userlevel system_u (s0))\n"
+	"(userrange system_u ((s0) (s0)))\n"
+	"(userprefix system_u object_r)\n"
+	"(selinuxuser __default__ system_u ((s0) (s0)))\n"
+	"(role object_r)\n"
+	"(role system_r)\n"
+	"(type base_t)\n"
+	"(roletype object_r base_t)\n"
+	"(roletype system_r base_t)\n"
+	"(sidcontext kernel (system_u system_r base_t ((s0) (s0))))\n"
+	"(class file (read write getattr))\n"
+	"(class process (transition))\n"
+	"(classorder (file process))\n"
+	"(allow base_t self (file (read)))\n";
+
+/* Returns the CIL of a generated module. Different generations of the
+ * same module differ in their rules, but not in their size. */
+static char *module_cil(unsigned long n, unsigned long generation, size_t *len)
+{
+	char *buf = NULL;
+	size_t size = 0;
+	FILE *f;
+	unsigned long i;
+
+	f = open_memstream(&buf, &size);
+	if (f == NULL)
+		return NULL;
+
+	for (i = 0; i < types_per_module; i++) {
+		fprintf(f, "(type bench%05lu_%03lu_t)\n", n, i);
+		fprintf(f, "(roletype object_r bench%05lu_%03lu_t)\n", n, i);
+		fprintf(f, "(allow bench%05lu_%03lu_t base_t (file (read getattr)))\n",
+			n, i);
+		fprintf(f, "(allow base_t bench%05lu_%03lu_t (file (%s)))\n",
+			n, i, (generation + i) % 2 ? "read" : "getattr");
+	}
+
+	if (fclose(f) != 0) {
+		free(buf);
+		return NULL;
+	}
+
+	*len = size;
+	return buf;
+}
+
+static semanage_handle_t *connect_store(const char *dir)
+{
+	semanage_handle_t *sh;
+
+	if (semanage_set_root(dir) < 0)
+		return NULL;
+
+	sh = semanage_handle_create();
+	if (sh == NULL)
+		return NULL;
+
+	semanage_msg_set_callback(sh, msg_handler, NULL);
+	semanage_set_create_store(sh, 1);
+	semanage_set_reload(sh, 0);
+	semanage_set_store_root(sh, "");
+	semanage_select_store(sh, "store", SEMANAGE_CON_DIRECT);
+
+	if (semanage_connect(sh) < 0) {
+		semanage_handle_destroy(sh);
+		return NULL;
+	}
+
+	return sh;
+}
+
+static int create_store(const char *dir)
+{
+	char path[PATH_MAX];
+	char hll[PATH_MAX];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/etc", dir);
+	if (mkdir(path, 0755) < 0 && errno != EEXIST)
+		return -1;
+	snprintf(path, sizeof(path), "%s/etc/selinux", dir);
+	if (mkdir(path, 0755) < 0 && errno != EEXIST)
+		return -1;
+
+	if (compiler != NULL) {
+		if (realpath(dir, path) == NULL)
+			return -1;
+		if (snprintf(hll, sizeof(hll), "%s/hll", path) >= (int)sizeof(hll) ||
+		    snprintf(path, sizeof(path), "%s/bench", hll) >= (int)sizeof(path)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		if (mkdir(hll, 0755) < 0 && errno != EEXIST)
+			return -1;
+		if (symlink(compiler, path) < 0 && errno != EEXIST)
+			return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s/etc/selinux/semanage.conf", dir);
+	f = fopen(path, "w");
+	if (f == NULL)
+		return -1;
+
+	if (compiler != NULL) {
+		fprintf(f, "compiler-directory = %s\n", hll);
+		fprintf(f, "compiler-jobs = %d\n", compiler_jobs);
+	}
+
+	return fclose(f);
+}
+
+static int install_module(semanage_handle_t *sh, unsigned long n,
+			  unsigned long generation)
+{
+	char name[32];
+	char *cil;
+	size_t len;
+	int rc;
+
+	cil = module_cil(n, generation, &len);
+	if (cil == NULL)
+		return -1;
+
+	snprintf(name, sizeof(name), "bench%05lu", n);
+	rc = semanage_module_install(sh, cil, len, name,
+				     compiler != NULL ? "bench" : "cil");
+	free(cil);
+	return rc;
+}
+
+static void remove_digests(const char *dir)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/store/active/modules_digests", dir);
+	if (unlink(path) < 0 && errno != ENOENT) {
+		perror(path);
+		exit(1);
+	}
+}
+
+/* Times a rebuild that compiles every HLL module again */
+static double timed_rebuild(semanage_handle_t *sh)
+{
+	struct timespec start;
+	int rc;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (semanage_begin_transaction(sh) < 0)
+		goto err;
+
+	semanage_set_rebuild(sh, 1);
+	semanage_set_ignore_module_cache(sh, 1);
+	rc = semanage_commit(sh);
+	semanage_set_ignore_module_cache(sh, 0);
+	semanage_set_rebuild(sh, 0);
+	if (rc < 0)
+		goto err;
+
+	return elapsed(&start);
+
+err:
+	fprintf(stderr, "Could not rebuild the policy\n");
+	exit(1);
+}
+
+/* Times either a commit that changes nothing, but has the installed
+ * modules checked for changes made outside of libsemanage, or one that
+ * changes one module. */
+static double timed_commit(semanage_handle_t *sh, const char *dir,
+			   int drop_digests, unsigned long module,
+			   unsigned long round)
+{
+	struct timespec start;
+	int rc;
+
+	if (drop_digests)
+		remove_digests(dir);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (semanage_begin_transaction(sh) < 0)
+		goto err;
+
+	if (module == ULONG_MAX) {
+		semanage_set_check_ext_changes(sh, 1);
+		rc = semanage_commit(sh);
+		semanage_set_check_ext_changes(sh, 0);
+	} else {
+		rc = install_module(sh, module, round + 1);
+		if (rc >= 0)
+			rc = semanage_commit(sh);
+	}
+	if (rc < 0)
+		goto err;
+
+	return elapsed(&start);
+
+err:
+	fprintf(stderr, "Could not commit the transaction\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long modules = 400, rounds = 5, i;
+	int opt, drop_digests = 0;
+	semanage_handle_t *sh;
+	struct timespec start;
+	double t, noop = 0, changed = 0, rebuild = 0;
+	const char *dir;
+
+	while ((opt = getopt(argc, argv, "n:t:r:dc:j:")) > 0) {
+		switch (opt) {
+		case 'n':
+			modules = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			types_per_module = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 10);
+			if (rounds == 0)
+				usage(argv[0]);
+			break;
+		case 'd':
+			drop_digests = 1;
+			break;
+		case 'c':
+			compiler = optarg;
+			break;
+		case 'j':
+			compiler_jobs = atoi(optarg);
+			if (compiler_jobs < 0 || compiler_jobs > 1024)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1 || modules == 0 || types_per_module == 0)
+		usage(argv[0]);
+	dir = argv[optind];
+
+	if (create_store(dir) < 0) {
+		fprintf(stderr, "Could not create the store below %s: %s\n",
+			dir, strerror(errno));
+		return 1;
+	}
+
+	sh = connect_store(dir);
+	if (sh == NULL) {
+		fprintf(stderr, "Could not connect to the store below %s\n", dir);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (semanage_begin_transaction(sh) < 0 ||
+	    semanage_module_install(sh, base_cil, sizeof(base_cil) - 1,
+				    "base", "cil") < 0) {
+		fprintf(stderr, "Could not install the base module\n");
+		return 1;
+	}
+	for (i = 0; i < modules; i++) {
+		if (install_module(sh, i, 0) < 0) {
+			fprintf(stderr, "Could not install module %lu\n", i);
+			return 1;
+		}
+	}
+	if (semanage_commit(sh) < 0) {
+		fprintf(stderr, "Could not commit the modules\n");
+		return 1;
+	}
+	printf("install of %lu modules: %.3f seconds\n", modules + 1,
+	       elapsed(&start));
+
+	for (i = 0; i < rounds; i++) {
+		t = timed_commit(sh, dir, drop_digests, ULONG_MAX, i);
+		noop += t;
+		t = timed_commit(sh, dir, drop_digests, (i * 7919) % modules, i);
+		changed += t;
+		if (compiler != NULL)
+			rebuild += timed_rebuild(sh);
+	}
+
+	printf("no-op with external change check: %.3f seconds per commit\n",
+	       noop / rounds);
+	printf("1 of %lu modules changed: %.3f seconds per commit\n",
+	       modules + 1, changed / rounds);
+	if (compiler != NULL)
+		printf("rebuild compiling %lu modules: %.3f seconds per commit\n",
+		       modules, rebuild / rounds);
+
+	semanage_disconnect(sh);
+	semanage_handle_destroy(sh);
+	return 0;
+}
@@ -465,6 +465,10 @@ void cil_db_init(struct cil_db **db)
 	(*db)->qualified_names = CIL_FALSE;
 	(*db)->target_platform = SEPOL_TARGET_SELINUX;
 	(*db)->policy_version = POLICYDB_VERSION_MAX;
+	(*db)->avrule_threads = 1;
+	(*db)->name_cache = NULL;
+	(*db)->name_cache_hits = 0;
+	(*db)->name_cache_misses = 0;
 }
 
 static void cil_declared_strings_list_destroy(struct cil_list **strings)
@@ -541,30 +545,22 @@ void cil_root_destroy(struct cil_root *root)
 
 int cil_add_file(cil_db_t *db, const char *name, const char *data, size_t size)
 {
-	char *buffer = NULL;
 	int rc;
 
 	cil_log(CIL_INFO, "Parsing %s\n", name);
 
-	buffer = cil_malloc(size + 2);
-	memcpy(buffer, data, size);
-	memset(buffer + size, 0, 2);
+	if (size > UINT32_MAX) {
+		cil_log(CIL_ERR, "File %s is too large to parse\n", name);
+		return SEPOL_ERR;
+	}
 
-	rc = cil_parser(name, buffer, size + 2, &db->parse);
+	rc = cil_parser(name, data, size, &db->parse);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_INFO, "Failed to parse %s\n", name);
-		goto exit;
+		return rc;
 	}
 
-	free(buffer);
-	buffer = NULL;
-
-	rc = SEPOL_OK;
-
-exit:
-	free(buffer);
-
-	return rc;
+	return SEPOL_OK;
 }
 
 int cil_compile(struct cil_db *db)
@@ -1938,6 +1934,11 @@ void cil_set_attrs_expand_size(struct cil_db *db, unsigned attrs_expand_size)
 	db->attrs_expand_size = attrs_expand_size;
 }
 
+void cil_set_avrule_threads(struct cil_db *db, unsigned avrule_threads)
+{
+	db->avrule_threads = avrule_threads ? avrule_threads : 1;
+}
+
 void cil_set_preserve_tunables(struct cil_db *db, int preserve_tunables)
 {
 	db->preserve_tunables = preserve_tunables;
@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #ifndef IPPROTO_DCCP
 #define IPPROTO_DCCP 33
 #endif
@@ -72,6 +73,7 @@ struct cil_args_binary {
 	hashtab_t role_trans_table;
 	struct cil_args_xperm_tables avrulex_xperm_tables;
 	void **type_value_to_cil;
+	struct cil_list *avrules;
 };
 
 struct cil_args_booleanif {
@@ -1350,43 +1352,80 @@ exit:
 	return rc;
 }
 
-static int __cil_insert_avrule(policydb_t *pdb, uint32_t kind, uint32_t src, uint32_t tgt, uint32_t obj, uint32_t data, cond_node_t *cond_node, enum cil_flavor cond_flavor)
+struct cil_avrule_entry {
+	avtab_key_t key;
+	uint32_t data;
+};
+
+/* Unconditional av rules collected by a worker thread, in rule order. */
+struct cil_avrule_buffer {
+	struct cil_avrule_entry *entries;
+	uint32_t count;
+	uint32_t alloc;
+};
+
+static int __cil_avrule_key_init(avtab_key_t *avtab_key, uint32_t kind, uint32_t src, uint32_t tgt, uint32_t obj)
 {
-	int rc = SEPOL_OK;
-	avtab_key_t avtab_key;
-	avtab_datum_t avtab_datum = { .data = data, .xperms = NULL };
-	avtab_datum_t *avtab_dup = NULL;
+	avtab_key->source_type = src;
+	avtab_key->target_type = tgt;
+	avtab_key->target_class = obj;
 
-	avtab_key.source_type = src;
-	avtab_key.target_type = tgt;
-	avtab_key.target_class = obj;
-	
 	switch (kind) {
 	case CIL_AVRULE_ALLOWED:
-		avtab_key.specified = AVTAB_ALLOWED;
+		avtab_key->specified = AVTAB_ALLOWED;
 		break;
 	case CIL_AVRULE_AUDITALLOW:
-		avtab_key.specified = AVTAB_AUDITALLOW;
+		avtab_key->specified = AVTAB_AUDITALLOW;
 		break;
 	case CIL_AVRULE_DONTAUDIT:
-		avtab_key.specified = AVTAB_AUDITDENY;
+		avtab_key->specified = AVTAB_AUDITDENY;
 		break;
 	default:
-		rc = SEPOL_ERR;
+		return SEPOL_ERR;
+	}
+
+	return SEPOL_OK;
+}
+
+static int __cil_insert_avtab_entry(policydb_t *pdb, avtab_key_t *avtab_key, uint32_t data)
+{
+	avtab_datum_t avtab_datum = { .data = data, .xperms = NULL };
+	avtab_datum_t *avtab_dup = NULL;
+
+	avtab_dup = avtab_search(&pdb->te_avtab, avtab_key);
+	if (!avtab_dup) {
+		return avtab_insert(&pdb->te_avtab, avtab_key, &avtab_datum);
+	}
+
+	if (avtab_key->specified == AVTAB_AUDITDENY)
+		avtab_dup->data &= data;
+	else
+		avtab_dup->data |= data;
+
+	return SEPOL_OK;
+}
+
+static int __cil_insert_avrule(policydb_t *pdb, uint32_t kind, uint32_t src, uint32_t tgt, uint32_t obj, uint32_t data, cond_node_t *cond_node, enum cil_flavor cond_flavor, struct cil_avrule_buffer *buf)
+{
+	int rc = SEPOL_OK;
+	avtab_key_t avtab_key;
+	avtab_datum_t avtab_datum = { .data = data, .xperms = NULL };
+
+	rc = __cil_avrule_key_init(&avtab_key, kind, src, tgt, obj);
+	if (rc != SEPOL_OK) {
 		goto exit;
-		break;
 	}
 
-	if (!cond_node) {
-		avtab_dup = avtab_search(&pdb->te_avtab, &avtab_key);
-		if (!avtab_dup) {
-			rc = avtab_insert(&pdb->te_avtab, &avtab_key, &avtab_datum);
-		} else {
-			if (kind == CIL_AVRULE_DONTAUDIT)
-				avtab_dup->data &= data;
-			else
-				avtab_dup->data |= data;
+	if (buf) {
+		if (buf->count == buf->alloc) {
+			buf->alloc = buf->alloc ? buf->alloc * 2 : 1024;
+			buf->entries = cil_realloc(buf->entries, buf->alloc * sizeof(*buf->entries));
 		}
+		buf->entries[buf->count].key = avtab_key;
+		buf->entries[buf->count].data = data;
+		buf->count++;
+	} else if (!cond_node) {
+		rc = __cil_insert_avtab_entry(pdb, &avtab_key, data);
 	} else {
 		rc = __cil_cond_insert_rule(&pdb->te_cond_avtab, &avtab_key, &avtab_datum, cond_node, cond_flavor);
 	}
@@ -1395,7 +1434,7 @@ exit:
 	return rc;
 }
 
-static int __cil_avrule_expand_helper(policydb_t *pdb, uint16_t kind, struct cil_symtab_datum *src, struct cil_symtab_datum *tgt, struct cil_classperms *cp, cond_node_t *cond_node, enum cil_flavor cond_flavor)
+static int __cil_avrule_expand_helper(policydb_t *pdb, uint16_t kind, struct cil_symtab_datum *src, struct cil_symtab_datum *tgt, struct cil_classperms *cp, cond_node_t *cond_node, enum cil_flavor cond_flavor, struct cil_avrule_buffer *buf)
 {
 	int rc = SEPOL_ERR;
 	type_datum_t *sepol_src = NULL;
@@ -1424,7 +1463,7 @@ static int __cil_avrule_expand_helper(policydb_t *pdb, uint16_t kind, struct cil
 	rc = __cil_get_sepol_type_datum(pdb, tgt, &sepol_tgt);
 	if (rc != SEPOL_OK) goto exit;
 
-	rc = __cil_insert_avrule(pdb, kind, sepol_src->s.value, sepol_tgt->s.value, sepol_class->s.value, data, cond_node, cond_flavor);
+	rc = __cil_insert_avrule(pdb, kind, sepol_src->s.value, sepol_tgt->s.value, sepol_class->s.value, data, cond_node, cond_flavor, buf);
 	if (rc != SEPOL_OK) {
 		goto exit;
 	}
@@ -1436,7 +1475,7 @@ exit:
 }
 
 
-static int __cil_avrule_expand(policydb_t *pdb, uint16_t kind, struct cil_symtab_datum *src, struct cil_symtab_datum *tgt, struct cil_list *classperms, cond_node_t *cond_node, enum cil_flavor cond_flavor)
+static int __cil_avrule_expand(policydb_t *pdb, uint16_t kind, struct cil_symtab_datum *src, struct cil_symtab_datum *tgt, struct cil_list *classperms, cond_node_t *cond_node, enum cil_flavor cond_flavor, struct cil_avrule_buffer *buf)
 {
 	int rc = SEPOL_ERR;
 	struct cil_list_item *curr;
@@ -1445,7 +1484,7 @@ static int __cil_avrule_expand(policydb_t *pdb, uint16_t kind, struct cil_symtab
 		if (curr->flavor == CIL_CLASSPERMS) {
 			struct cil_classperms *cp = curr->data;
 			if (FLAVOR(cp->class) == CIL_CLASS) {
-				rc = __cil_avrule_expand_helper(pdb, kind, src, tgt, cp, cond_node, cond_flavor);
+				rc = __cil_avrule_expand_helper(pdb, kind, src, tgt, cp, cond_node, cond_flavor, buf);
 				if (rc != SEPOL_OK) {
 					goto exit;
 				}
@@ -1453,7 +1492,7 @@ static int __cil_avrule_expand(policydb_t *pdb, uint16_t kind, struct cil_symtab
 				struct cil_list_item *i = NULL;
 				cil_list_for_each(i, cp->perms) {
 					struct cil_perm *cmp = i->data;
-					rc = __cil_avrule_expand(pdb, kind, src, tgt, cmp->classperms, cond_node, cond_flavor);
+					rc = __cil_avrule_expand(pdb, kind, src, tgt, cmp->classperms, cond_node, cond_flavor, buf);
 					if (rc != SEPOL_OK) {
 						goto exit;
 					}
@@ -1462,7 +1501,7 @@ static int __cil_avrule_expand(policydb_t *pdb, uint16_t kind, struct cil_symtab
 		} else { /* SET */
 			struct cil_classperms_set *cp_set = curr->data;
 			struct cil_classpermission *cp = cp_set->set;
-			rc = __cil_avrule_expand(pdb, kind, src, tgt, cp->classperms, cond_node, cond_flavor);
+			rc = __cil_avrule_expand(pdb, kind, src, tgt, cp->classperms, cond_node, cond_flavor, buf);
 			if (rc != SEPOL_OK) {
 				goto exit;
 			}
@@ -1491,7 +1530,7 @@ static int __cil_should_expand_attribute( const struct cil_db *db, struct cil_sy
 	return !attr->keep || (ebitmap_cardinality(attr->types) < db->attrs_expand_size);
 }
 
-static int __cil_avrule_to_avtab(policydb_t *pdb, const struct cil_db *db, struct cil_avrule *cil_avrule, cond_node_t *cond_node, enum cil_flavor cond_flavor)
+static int __cil_avrule_to_avtab(policydb_t *pdb, const struct cil_db *db, struct cil_avrule *cil_avrule, cond_node_t *cond_node, enum cil_flavor cond_flavor, struct cil_avrule_buffer *buf)
 {
 	int rc = SEPOL_ERR;
 	uint16_t kind = cil_avrule->rule_kind;
@@ -1519,7 +1558,7 @@ static int __cil_avrule_to_avtab(policydb_t *pdb, const struct cil_db *db, struc
 
 		ebitmap_for_each_positive_bit(&src_bitmap, snode, s) {
 			src = DATUM(db->val_to_type[s]);
-			rc = __cil_avrule_expand(pdb, kind, src, src, classperms, cond_node, cond_flavor);
+			rc = __cil_avrule_expand(pdb, kind, src, src, classperms, cond_node, cond_flavor, buf);
 			if (rc != SEPOL_OK) {
 				ebitmap_destroy(&src_bitmap);
 				goto exit;
@@ -1537,7 +1576,7 @@ static int __cil_avrule_to_avtab(policydb_t *pdb, const struct cil_db *db, struc
 			for (t = 0; t < (unsigned int)db->num_types; t++) {
 				if (s != t) {
 					tgt = DATUM(db->val_to_type[t]);
-					rc = __cil_avrule_expand(pdb, kind, src, tgt, classperms, cond_node, cond_flavor);
+					rc = __cil_avrule_expand(pdb, kind, src, tgt, classperms, cond_node, cond_flavor, buf);
 					if (rc != SEPOL_OK) {
 						ebitmap_destroy(&src_bitmap);
 						goto exit;
@@ -1557,7 +1596,7 @@ static int __cil_avrule_to_avtab(policydb_t *pdb, const struct cil_db *db, struc
 			ebitmap_for_each_positive_bit(&src_bitmap, tnode, t) {
 				if (s != t) {
 					tgt = DATUM(db->val_to_type[t]);
-					rc = __cil_avrule_expand(pdb, kind, src, tgt, classperms, cond_node, cond_flavor);
+					rc = __cil_avrule_expand(pdb, kind, src, tgt, classperms, cond_node, cond_flavor, buf);
 					if (rc != SEPOL_OK) {
 						ebitmap_destroy(&src_bitmap);
 						goto exit;
@@ -1570,7 +1609,7 @@ static int __cil_avrule_to_avtab(policydb_t *pdb, const struct cil_db *db, struc
 		int expand_src = __cil_should_expand_attribute(db, src);
 		int expand_tgt = __cil_should_expand_attribute(db, tgt);
 		if (!expand_src && !expand_tgt) {
-			rc = __cil_avrule_expand(pdb, kind, src, tgt, classperms, cond_node, cond_flavor);
+			rc = __cil_avrule_expand(pdb, kind, src, tgt, classperms, cond_node, cond_flavor, buf);
 			if (rc != SEPOL_OK) {
 				goto exit;
 			}
@@ -1591,7 +1630,7 @@ static int __cil_avrule_to_avtab(policydb_t *pdb, const struct cil_db *db, struc
 				ebitmap_for_each_positive_bit(&tgt_bitmap, tnode, t) {
 					tgt = DATUM(db->val_to_type[t]);
 
-					rc = __cil_avrule_expand(pdb, kind, src, tgt, classperms, cond_node, cond_flavor);
+					rc = __cil_avrule_expand(pdb, kind, src, tgt, classperms, cond_node, cond_flavor, buf);
 					if (rc != SEPOL_OK) {
 						ebitmap_destroy(&src_bitmap);
 						ebitmap_destroy(&tgt_bitmap);
@@ -1610,7 +1649,7 @@ static int __cil_avrule_to_avtab(policydb_t *pdb, const struct cil_db *db, struc
 			ebitmap_for_each_positive_bit(&src_bitmap, snode, s) {
 				src = DATUM(db->val_to_type[s]);
 
-				rc = __cil_avrule_expand(pdb, kind, src, tgt, classperms, cond_node, cond_flavor);
+				rc = __cil_avrule_expand(pdb, kind, src, tgt, classperms, cond_node, cond_flavor, buf);
 				if (rc != SEPOL_OK) {
 					ebitmap_destroy(&src_bitmap);
 					goto exit;
@@ -1626,7 +1665,7 @@ static int __cil_avrule_to_avtab(policydb_t *pdb, const struct cil_db *db, struc
 			ebitmap_for_each_positive_bit(&tgt_bitmap, tnode, t) {
 				tgt = DATUM(db->val_to_type[t]);
 
-				rc = __cil_avrule_expand(pdb, kind, src, tgt, classperms, cond_node, cond_flavor);
+				rc = __cil_avrule_expand(pdb, kind, src, tgt, classperms, cond_node, cond_flavor, buf);
 				if (rc != SEPOL_OK) {
 					ebitmap_destroy(&tgt_bitmap);
 					goto exit;
@@ -1644,7 +1683,7 @@ exit:
 
 int cil_avrule_to_policydb(policydb_t *pdb, const struct cil_db *db, struct cil_avrule *cil_avrule)
 {
-	return __cil_avrule_to_avtab(pdb, db, cil_avrule, NULL, CIL_FALSE);
+	return __cil_avrule_to_avtab(pdb, db, cil_avrule, NULL, CIL_FALSE, NULL);
 }
 
 // Copied from checkpolicy/policy_define.c
@@ -2130,7 +2169,7 @@ static int __cil_cond_to_policydb_helper(struct cil_tree_node *node, __attribute
 		break;
 	case CIL_AVRULE:
 		cil_avrule = node->data;
-		rc = __cil_avrule_to_avtab(pdb, db, cil_avrule, cond_node, cond_flavor);
+		rc = __cil_avrule_to_avtab(pdb, db, cil_avrule, cond_node, cond_flavor, NULL);
 		if (rc != SEPOL_OK) {
 			cil_tree_log(node, CIL_ERR, "Failed to insert avrule into avtab");
 			goto exit;
@@ -4187,7 +4226,12 @@ static int __cil_node_to_policydb(struct cil_tree_node *node, void *extra_args)
 		case CIL_AVRULE: {
 				struct cil_avrule *rule = node->data;
 				if (rule->rule_kind != CIL_AVRULE_NEVERALLOW) {
-					rc = cil_avrule_to_policydb(pdb, db, node->data);
+					if (args->avrules) {
+						/* Expanded later by worker threads */
+						cil_list_append(args->avrules, CIL_NODE, node);
+					} else {
+						rc = cil_avrule_to_policydb(pdb, db, node->data);
+					}
 				}
 			}
 			break;
@@ -4215,6 +4259,130 @@ exit:
 	return rc;
 }
 
+struct cil_avrule_worker {
+	const struct cil_db *db;
+	policydb_t *pdb;
+	struct cil_tree_node **nodes;
+	uint32_t start;
+	uint32_t end;
+	struct cil_avrule_buffer buf;
+	struct cil_tree_node *failed;
+	int rc;
+};
+
+static void *__cil_avrule_worker(void *data)
+{
+	struct cil_avrule_worker *w = data;
+	uint32_t i;
+
+	for (i = w->start; i < w->end; i++) {
+		w->rc = __cil_avrule_to_avtab(w->pdb, w->db, w->nodes[i]->data, NULL, CIL_FALSE, &w->buf);
+		if (w->rc != SEPOL_OK) {
+			w->failed = w->nodes[i];
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/* Expand the unconditional av rules on multiple threads. Every thread
+ * expands a contiguous range of rules into its own buffer, the buffers
+ * are then inserted into the avtab in rule order, so the resulting avtab
+ * is identical to the one created by cil_avrule_to_policydb().
+ */
+static int __cil_avrules_to_policydb_parallel(policydb_t *pdb, const struct cil_db *db, struct cil_list *avrules)
+{
+	int rc = SEPOL_OK;
+	struct cil_list_item *item;
+	struct cil_tree_node **nodes = NULL;
+	struct cil_avrule_worker *workers = NULL;
+	pthread_t *threads = NULL;
+	int *started = NULL;
+	uint32_t num_nodes = 0;
+	uint32_t num_workers = db->avrule_threads;
+	uint32_t i, j, chunk;
+
+	cil_list_for_each(item, avrules) {
+		num_nodes++;
+	}
+	if (num_nodes == 0) {
+		return SEPOL_OK;
+	}
+
+	nodes = cil_malloc(num_nodes * sizeof(*nodes));
+	i = 0;
+	cil_list_for_each(item, avrules) {
+		nodes[i++] = item->data;
+	}
+
+	if (num_workers > num_nodes) {
+		num_workers = num_nodes;
+	}
+	chunk = (num_nodes + num_workers - 1) / num_workers;
+
+	workers = cil_calloc(num_workers, sizeof(*workers));
+	threads = cil_calloc(num_workers, sizeof(*threads));
+	started = cil_calloc(num_workers, sizeof(*started));
+
+	for (i = 0; i < num_workers; i++) {
+		workers[i].db = db;
+		workers[i].pdb = pdb;
+		workers[i].nodes = nodes;
+		workers[i].start = i * chunk;
+		workers[i].end = workers[i].start + chunk;
+		if (workers[i].start > num_nodes) {
+			workers[i].start = num_nodes;
+		}
+		if (workers[i].end > num_nodes) {
+			workers[i].end = num_nodes;
+		}
+		workers[i].rc = SEPOL_OK;
+	}
+
+	/* The calling thread handles the first range itself */
+	for (i = 1; i < num_workers; i++) {
+		started[i] = pthread_create(&threads[i], NULL, __cil_avrule_worker, &workers[i]) == 0;
+	}
+	__cil_avrule_worker(&workers[0]);
+	for (i = 1; i < num_workers; i++) {
+		if (started[i]) {
+			pthread_join(threads[i], NULL);
+		} else {
+			__cil_avrule_worker(&workers[i]);
+		}
+	}
+
+	for (i = 0; i < num_workers; i++) {
+		if (workers[i].rc != SEPOL_OK) {
+			rc = workers[i].rc;
+			cil_tree_log(workers[i].failed, CIL_ERR, "Binary policy creation failed");
+			goto exit;
+		}
+	}
+
+	for (i = 0; i < num_workers; i++) {
+		struct cil_avrule_buffer *buf = &workers[i].buf;
+		for (j = 0; j < buf->count; j++) {
+			rc = __cil_insert_avtab_entry(pdb, &buf->entries[j].key, buf->entries[j].data);
+			if (rc != SEPOL_OK) {
+				cil_log(CIL_ERR, "Failed to insert av rule into avtab\n");
+				goto exit;
+			}
+		}
+	}
+
+exit:
+	for (i = 0; i < num_workers; i++) {
+		free(workers[i].buf.entries);
+	}
+	free(started);
+	free(threads);
+	free(workers);
+	free(nodes);
+	return rc;
+}
+
 static int __cil_binary_create_helper(struct cil_tree_node *node, uint32_t *finished, void *extra_args)
 {
 	int rc = SEPOL_ERR;
@@ -5268,6 +5436,7 @@ int cil_binary_create_allocated_pdb(const struct cil_db *db, sepol_policydb_t *p
 	struct cil_args_booleanif booleanif_args;
 	policydb_t *pdb = &policydb->p;
 	struct cil_list *neverallows = NULL;
+	struct cil_list *avrules = NULL;
 	hashtab_t role_trans_table = NULL;
 	hashtab_t avrulex_ioctl_table = NULL;
 	hashtab_t avrulex_nlmsg_table = NULL;
@@ -5333,6 +5502,10 @@ int cil_binary_create_allocated_pdb(const struct cil_db *db, sepol_policydb_t *p
 	extra_args.avrulex_xperm_tables.ioctl = avrulex_ioctl_table;
 	extra_args.avrulex_xperm_tables.nlmsg = avrulex_nlmsg_table;
 	extra_args.type_value_to_cil = type_value_to_cil;
+	if (db->avrule_threads > 1) {
+		cil_list_init(&avrules, CIL_NODE);
+	}
+	extra_args.avrules = avrules;
 
 	booleanif_args.db = db;
 	booleanif_args.pdb = pdb;
@@ -5357,6 +5530,13 @@ int cil_binary_create_allocated_pdb(const struct cil_db *db, sepol_policydb_t *p
 		}
 
 		if (i == 3) {
+			if (avrules) {
+				rc = __cil_avrules_to_policydb_parallel(pdb, db, avrules);
+				if (rc != SEPOL_OK) {
+					cil_log(CIL_INFO, "Failure creating av rules\n");
+					goto exit;
+				}
+			}
 			rc = hashtab_map(avrulex_ioctl_table, __cil_avrulex_ioctl_to_policydb, &booleanif_args);
 			if (rc != SEPOL_OK) {
 				cil_log(CIL_INFO, "Failure creating avrulex rules\n");
@@ -5452,6 +5632,7 @@ exit:
 		free(perm_value_to_cil);
 	}
 	cil_list_destroy(&neverallows, CIL_FALSE);
+	cil_list_destroy(&avrules, CIL_FALSE);
 
 	return rc;
 }
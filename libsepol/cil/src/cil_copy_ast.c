@@ -48,6 +48,53 @@ struct cil_args_copy {
 	struct cil_db *db;
 };
 
+/* Lists of names and operators that are never modified after the AST is
+ * built can be shared between the original and its copies instead of
+ * being duplicated for every call and blockinherit.
+ */
+static int cil_list_is_shareable(struct cil_list *list)
+{
+	struct cil_list_item *curr;
+
+	cil_list_for_each(curr, list) {
+		switch (curr->flavor) {
+		case CIL_STRING:
+		case CIL_OP:
+		case CIL_CONS_OPERAND:
+			break;
+		case CIL_LIST:
+			if (!cil_list_is_shareable(curr->data)) {
+				return CIL_FALSE;
+			}
+			break;
+		default:
+			return CIL_FALSE;
+		}
+	}
+
+	return CIL_TRUE;
+}
+
+static void cil_copy_str_list(struct cil_list *orig, struct cil_list **copy)
+{
+	if (orig != NULL && cil_list_is_shareable(orig)) {
+		*copy = cil_list_share(orig);
+	} else if (orig != NULL) {
+		cil_copy_list(orig, copy);
+	} else {
+		*copy = NULL;
+	}
+}
+
+static void cil_copy_str_expr(struct cil_db *db, struct cil_list *orig, struct cil_list **copy)
+{
+	if (orig != NULL && cil_list_is_shareable(orig)) {
+		*copy = cil_list_share(orig);
+	} else {
+		cil_copy_expr(db, orig, copy);
+	}
+}
+
 void cil_copy_list(struct cil_list *data, struct cil_list **copy)
 {
 	struct cil_list *new;
@@ -210,7 +257,7 @@ void cil_copy_classperms(struct cil_classperms *orig, struct cil_classperms **ne
 {
 	cil_classperms_init(new);
 	(*new)->class_str = orig->class_str;
-	cil_copy_list(orig->perm_strs, &((*new)->perm_strs));
+	cil_copy_str_list(orig->perm_strs, &((*new)->perm_strs));
 }
 
 void cil_copy_classperms_set(struct cil_classperms_set *orig, struct cil_classperms_set **new)
@@ -422,7 +469,7 @@ int cil_copy_userattributeset(struct cil_db *db, void *data, void **copy, __attr
 
 	new->attr_str = orig->attr_str;
 
-	cil_copy_expr(db, orig->str_expr, &new->str_expr);
+	cil_copy_str_expr(db, orig->str_expr, &new->str_expr);
 	cil_copy_expr(db, orig->datum_expr, &new->datum_expr);
 
 	*copy = new;
@@ -561,7 +608,7 @@ int cil_copy_roleattributeset(struct cil_db *db, void *data, void **copy, __attr
 
 	new->attr_str = orig->attr_str;
 	
-	cil_copy_expr(db, orig->str_expr, &new->str_expr);
+	cil_copy_str_expr(db, orig->str_expr, &new->str_expr);
 	cil_copy_expr(db, orig->datum_expr, &new->datum_expr);
 
 	*copy = new;
@@ -627,7 +674,7 @@ int cil_copy_typeattributeset(struct cil_db *db, void *data, void **copy, __attr
 
 	new->attr_str = orig->attr_str;
 
-	cil_copy_expr(db, orig->str_expr, &new->str_expr);
+	cil_copy_str_expr(db, orig->str_expr, &new->str_expr);
 	cil_copy_expr(db, orig->datum_expr, &new->datum_expr);
 
 	*copy = new;
@@ -924,7 +971,7 @@ int cil_copy_cat(__attribute__((unused)) struct cil_db *db, void *data, void **c
 static void cil_copy_cats(struct cil_db *db, struct cil_cats *orig, struct cil_cats **new)
 {
 	cil_cats_init(new);
-	cil_copy_expr(db, orig->str_expr, &(*new)->str_expr);
+	cil_copy_str_expr(db, orig->str_expr, &(*new)->str_expr);
 	cil_copy_expr(db, orig->datum_expr, &(*new)->datum_expr);
 }
 
@@ -1426,7 +1473,7 @@ int cil_copy_constrain(struct cil_db *db, void *data, void **copy, __attribute__
 	cil_constrain_init(&new);
 	cil_copy_classperms_list(orig->classperms, &new->classperms);
 
-	cil_copy_expr(db, orig->str_expr, &new->str_expr);
+	cil_copy_str_expr(db, orig->str_expr, &new->str_expr);
 	cil_copy_expr(db, orig->datum_expr, &new->datum_expr);
 
 	*copy = new;
@@ -1443,7 +1490,7 @@ int cil_copy_validatetrans(struct cil_db *db, void *data, void **copy, __attribu
 
 	new->class_str = orig->class_str;
 
-	cil_copy_expr(db, orig->str_expr, &new->str_expr);
+	cil_copy_str_expr(db, orig->str_expr, &new->str_expr);
 	cil_copy_expr(db, orig->datum_expr, &new->datum_expr);
 
 	*copy = new;
@@ -1564,7 +1611,7 @@ int cil_copy_boolif(struct cil_db *db, void *data, void **copy, __attribute__((u
 
 	cil_boolif_init(&new);
 
-	cil_copy_expr(db, orig->str_expr, &new->str_expr);
+	cil_copy_str_expr(db, orig->str_expr, &new->str_expr);
 	cil_copy_expr(db, orig->datum_expr, &new->datum_expr);
 	new->preserved_tunable = orig->preserved_tunable;
 
@@ -1580,7 +1627,7 @@ static int cil_copy_tunif(struct cil_db *db, void *data, void **copy, __attribut
 
 	cil_tunif_init(&new);
 
-	cil_copy_expr(db, orig->str_expr, &new->str_expr);
+	cil_copy_str_expr(db, orig->str_expr, &new->str_expr);
 	cil_copy_expr(db, orig->datum_expr, &new->datum_expr);
 
 	*copy = new;
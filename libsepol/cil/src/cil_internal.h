@@ -335,6 +335,10 @@ struct cil_db {
 	int qualified_names;
 	int target_platform;
 	int policy_version;
+	unsigned avrule_threads;
+	hashtab_t name_cache;
+	uint32_t name_cache_hits;
+	uint32_t name_cache_misses;
 };
 
 struct cil_root {
@@ -0,0 +1,189 @@
+/*
+ * Copyright 2011 Tresys Technology, LLC. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY TRESYS TECHNOLOGY, LLC ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL TRESYS TECHNOLOGY, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of Tresys Technology, LLC.
+ */
+
+#include <stdint.h>
+#include <sepol/errcodes.h>
+#include "cil_internal.h"
+#include "cil_lexer.h"
+#include "cil_log.h"
+#include "cil_strpool.h"
+
+/*
+ * A hand-written scanner working directly on the caller's buffer. Tokens
+ * point into the buffer and carry their length and string pool hash, so
+ * nothing is copied or hashed a second time while building the parse tree.
+ *
+ * It accepts exactly what the previous flex lexer accepted:
+ *   symbol   letters, digits and the punctuation in cil_lexer_is_symbol()
+ *   qstring  "[^"\n\0]*"
+ *   hll_lm   ;;* at the beginning of a line
+ *   comment  ;
+ *   newline  \n or \r (both count as a line)
+ *   white    space or tab (skipped)
+ * Any other character, including an unterminated quote, is UNKNOWN.
+ */
+
+static inline int cil_lexer_is_white(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static inline int cil_lexer_is_symbol(char c)
+{
+	if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+		return 1;
+	}
+
+	switch (c) {
+	case '[': case ']': case '.': case '@': case '=': case '/': case '*':
+	case '-': case '_': case '$': case '%': case '+': case '!': case '|':
+	case '&': case '^': case ':': case '~': case '`': case '#': case '{':
+	case '}': case '\'': case '<': case '>': case '?': case ',':
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static const char *cil_lexer_start = NULL;
+static const char *cil_lexer_pos = NULL;
+static const char *cil_lexer_end = NULL;
+static uint32_t line = 1;
+
+int cil_lexer_setup(const char *buffer, uint32_t size)
+{
+	if (buffer == NULL && size != 0) {
+		cil_log(CIL_INFO, "Lexer failed to setup buffer\n");
+		return SEPOL_ERR;
+	}
+
+	cil_lexer_start = buffer;
+	cil_lexer_pos = buffer;
+	cil_lexer_end = buffer + size;
+	line = 1;
+
+	return SEPOL_OK;
+}
+
+void cil_lexer_destroy(void)
+{
+	cil_lexer_start = NULL;
+	cil_lexer_pos = NULL;
+	cil_lexer_end = NULL;
+}
+
+int cil_lexer_next(struct token *tok)
+{
+	const char *pos = cil_lexer_pos;
+	const char *end = cil_lexer_end;
+	const char *start;
+	unsigned int hash;
+
+	while (pos < end && cil_lexer_is_white(*pos)) {
+		pos++;
+	}
+
+	tok->value = pos;
+	tok->len = 1;
+	tok->hash = 0;
+
+	if (pos == end) {
+		tok->type = END_OF_FILE;
+		tok->len = 0;
+		goto exit;
+	}
+
+	switch (*pos) {
+	case '\n':
+	case '\r':
+		line++;
+		tok->type = NEWLINE;
+		pos++;
+		break;
+	case '(':
+		tok->type = OPAREN;
+		pos++;
+		break;
+	case ')':
+		tok->type = CPAREN;
+		pos++;
+		break;
+	case ';':
+		if ((pos == cil_lexer_start || pos[-1] == '\n') &&
+		    end - pos >= 3 && pos[1] == ';' && pos[2] == '*') {
+			tok->type = HLL_LINEMARK;
+			tok->len = 3;
+			pos += 3;
+		} else {
+			tok->type = COMMENT;
+			pos++;
+		}
+		break;
+	case '"':
+		start = pos + 1;
+		hash = CIL_STRPOOL_HASH_INIT;
+		while (start < end && *start != '"' && *start != '\n' && *start != '\0') {
+			hash = cil_strpool_hash_step(hash, *start);
+			start++;
+		}
+		if (start < end && *start == '"') {
+			tok->type = QSTRING;
+			tok->value = pos + 1;
+			tok->len = start - (pos + 1);
+			tok->hash = hash;
+			pos = start + 1;
+		} else {
+			tok->type = UNKNOWN;
+			pos++;
+		}
+		break;
+	default:
+		if (!cil_lexer_is_symbol(*pos)) {
+			tok->type = UNKNOWN;
+			pos++;
+			break;
+		}
+		start = pos;
+		hash = CIL_STRPOOL_HASH_INIT;
+		do {
+			hash = cil_strpool_hash_step(hash, *pos);
+			pos++;
+		} while (pos < end && cil_lexer_is_symbol(*pos));
+		tok->type = SYMBOL;
+		tok->len = pos - start;
+		tok->hash = hash;
+		break;
+	}
+
+exit:
+	tok->line = line;
+	cil_lexer_pos = pos;
+
+	return SEPOL_OK;
+}
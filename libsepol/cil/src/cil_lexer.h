@@ -44,11 +44,13 @@
 
 struct token {
 	uint32_t type;
-	char * value;
+	const char *value;
+	uint32_t len;
+	unsigned int hash;
 	uint32_t line;
 };
 
-int cil_lexer_setup(char *buffer, uint32_t size);
+int cil_lexer_setup(const char *buffer, uint32_t size);
 void cil_lexer_destroy(void);
 int cil_lexer_next(struct token *tok);
 
@@ -50,6 +50,7 @@ void cil_list_init(struct cil_list **list, enum cil_flavor flavor)
 	new_list->head = NULL;
 	new_list->tail = NULL;
 	new_list->flavor = flavor;
+	new_list->shared = 0;
 	*list = new_list;
 }
 
@@ -61,6 +62,13 @@ void cil_list_destroy(struct cil_list **list, unsigned destroy_data)
 		return;
 	}
 
+	if ((*list)->shared > 0) {
+		/* Still referenced by another owner */
+		(*list)->shared--;
+		*list = NULL;
+		return;
+	}
+
 	item = (*list)->head;
 	while (item != NULL)
 	{
@@ -77,6 +85,16 @@ void cil_list_destroy(struct cil_list **list, unsigned destroy_data)
 	*list = NULL;
 }
 
+/* Returns list with an additional owner. The list is only destroyed
+ * once every owner has called cil_list_destroy() on it, so a shared list
+ * must never be modified.
+ */
+struct cil_list *cil_list_share(struct cil_list *list)
+{
+	list->shared++;
+	return list;
+}
+
 void cil_list_item_init(struct cil_list_item **item)
 {
 	struct cil_list_item *new_item = cil_malloc(sizeof(*new_item));
@@ -36,6 +36,7 @@ struct cil_list {
 	struct cil_list_item *head;
 	struct cil_list_item *tail;
 	enum cil_flavor flavor;
+	unsigned shared; /* number of additional owners, see cil_list_share() */
 };
 
 struct cil_list_item {
@@ -53,6 +54,7 @@ struct cil_list_item {
 
 void cil_list_init(struct cil_list **list, enum cil_flavor flavor);
 void cil_list_destroy (struct cil_list **list, unsigned destroy_data);
+struct cil_list *cil_list_share(struct cil_list *list);
 void cil_list_item_init(struct cil_list_item **item);
 void cil_list_item_destroy(struct cil_list_item **item, unsigned destroy_data);
 void cil_list_append(struct cil_list *list, enum cil_flavor flavor, void *data);
@@ -105,7 +105,7 @@ static int add_hll_linemark(struct cil_tree_node **current, uint32_t *hll_offset
 		cil_log(CIL_ERR, "Invalid line mark syntax\n");
 		goto exit;
 	}
-	hll_type = cil_strpool_add(tok.value);
+	hll_type = cil_strpool_addn(tok.value, tok.len, tok.hash);
 	if (hll_type != CIL_KEY_SRC_HLL_LME && hll_type != CIL_KEY_SRC_HLL_LMS && hll_type != CIL_KEY_SRC_HLL_LMX) {
 		cil_log(CIL_ERR, "Invalid line mark syntax\n");
 		goto exit;
@@ -152,7 +152,7 @@ static int add_hll_linemark(struct cil_tree_node **current, uint32_t *hll_offset
 			goto exit;
 		}
 
-		create_node(&node, *current, tok.line, *hll_offset, cil_strpool_add(tok.value));
+		create_node(&node, *current, tok.line, *hll_offset, cil_strpool_addn(tok.value, tok.len, tok.hash));
 		insert_node(node, *current);
 
 		cil_lexer_next(&tok);
@@ -161,12 +161,7 @@ static int add_hll_linemark(struct cil_tree_node **current, uint32_t *hll_offset
 			goto exit;
 		}
 
-		if (tok.type == QSTRING) {
-			tok.value[strlen(tok.value) - 1] = '\0';
-			tok.value = tok.value+1;
-		}
-
-		create_node(&node, *current, tok.line, *hll_offset, cil_strpool_add(tok.value));
+		create_node(&node, *current, tok.line, *hll_offset, cil_strpool_addn(tok.value, tok.len, tok.hash));
 		insert_node(node, *current);
 
 		*hll_expand = (hll_type == CIL_KEY_SRC_HLL_LMX) ? 1 : 0;
@@ -211,7 +206,7 @@ static void add_cil_path(struct cil_tree_node **current, char *path)
 	insert_node(node, *current);
 }
 
-int cil_parser(const char *_path, char *buffer, uint32_t size, struct cil_tree **parse_tree)
+int cil_parser(const char *_path, const char *buffer, uint32_t size, struct cil_tree **parse_tree)
 {
 
 	int paren_count = 0;
@@ -263,16 +258,13 @@ int cil_parser(const char *_path, char *buffer, uint32_t size, struct cil_tree *
 			current = current->parent;
 			break;
 		case QSTRING:
-			tok.value[strlen(tok.value) - 1] = '\0';
-			tok.value = tok.value+1;
-			/* FALLTHRU */
 		case SYMBOL:
 			if (paren_count == 0) {
 				cil_log(CIL_ERR, "Symbol not inside parenthesis at line %d of %s\n", tok.line, path);
 				goto exit;
 			}
 
-			create_node(&node, current, tok.line, hll_offset, cil_strpool_add(tok.value));
+			create_node(&node, current, tok.line, hll_offset, cil_strpool_addn(tok.value, tok.len, tok.hash));
 			insert_node(node, current);
 			break;
 		case NEWLINE :
@@ -303,7 +295,7 @@ int cil_parser(const char *_path, char *buffer, uint32_t size, struct cil_tree *
 			}
 			break;
 		case UNKNOWN:
-			cil_log(CIL_ERR, "Invalid token '%s' at line %d of %s\n", tok.value, tok.line, path);
+			cil_log(CIL_ERR, "Invalid token '%.*s' at line %d of %s\n", (int)tok.len, tok.value, tok.line, path);
 			goto exit;
 		default:
 			cil_log(CIL_ERR, "Unknown token type '%d' at line %d of %s\n", tok.type, tok.line, path);
@@ -3981,6 +3981,71 @@ exit:
 	return rc;
 }
 
+#define CIL_NAME_CACHE_SIZE (1 << 13)
+
+struct cil_name_cache_key {
+	struct cil_tree_node *scope;
+	char *name;
+	enum cil_sym_index sym_index;
+};
+
+static unsigned int cil_name_cache_hash(hashtab_t h, const_hashtab_key_t key)
+{
+	const struct cil_name_cache_key *k = (const struct cil_name_cache_key *)key;
+	uintptr_t hash = (uintptr_t)k->scope;
+
+	hash = (hash >> 4) ^ (hash * 31);
+	hash ^= ((uintptr_t)k->name >> 3) * 2654435761U;
+	hash += k->sym_index;
+
+	return (unsigned int)hash & (h->size - 1);
+}
+
+static int cil_name_cache_compare(hashtab_t h __attribute__ ((unused)), const_hashtab_key_t key1, const_hashtab_key_t key2)
+{
+	const struct cil_name_cache_key *k1 = (const struct cil_name_cache_key *)key1;
+	const struct cil_name_cache_key *k2 = (const struct cil_name_cache_key *)key2;
+
+	if (k1->scope != k2->scope || k1->name != k2->name || k1->sym_index != k2->sym_index) {
+		return 1;
+	}
+
+	return 0;
+}
+
+static void cil_name_cache_init(struct cil_db *db)
+{
+	if (db->name_cache != NULL) {
+		return;
+	}
+
+	db->name_cache = hashtab_create(cil_name_cache_hash, cil_name_cache_compare, CIL_NAME_CACHE_SIZE);
+	if (db->name_cache == NULL) {
+		cil_log(CIL_ERR, "Failed to allocate memory\n");
+		exit(1);
+	}
+}
+
+static int __cil_name_cache_destroy_helper(hashtab_key_t k, __attribute__((unused)) hashtab_datum_t d, __attribute__((unused)) void *args)
+{
+	free(k);
+	return SEPOL_OK;
+}
+
+/* The cache holds pointers to tree nodes and datums, so it must be flushed
+ * whenever nodes are destroyed or declarations are reset.
+ */
+static void cil_name_cache_destroy(struct cil_db *db)
+{
+	if (db->name_cache == NULL) {
+		return;
+	}
+
+	hashtab_map(db->name_cache, __cil_name_cache_destroy_helper, NULL);
+	hashtab_destroy(db->name_cache);
+	db->name_cache = NULL;
+}
+
 int cil_resolve_ast(struct cil_db *db, struct cil_tree_node *current)
 {
 	int rc = SEPOL_ERR;
@@ -4019,8 +4084,17 @@ int cil_resolve_ast(struct cil_db *db, struct cil_tree_node *current)
 	cil_list_init(&extra_args.in_list_after, CIL_IN);
 	cil_list_init(&extra_args.abstract_blocks, CIL_NODE);
 
+	db->name_cache_hits = 0;
+	db->name_cache_misses = 0;
+
 	for (pass = CIL_PASS_TIF; pass < CIL_PASS_NUM; pass++) {
 		extra_args.pass = pass;
+		if (pass >= CIL_PASS_ALIAS1) {
+			/* No more declarations are copied into the AST after the
+			 * call passes, so name lookups can be memoized from here on.
+			 */
+			cil_name_cache_init(db);
+		}
 		rc = cil_tree_walk(current, __cil_resolve_ast_node_helper, __cil_resolve_ast_first_child_helper, __cil_resolve_ast_last_child_helper, &extra_args);
 		if (rc != SEPOL_OK) {
 			cil_log(CIL_INFO, "Pass %i of resolution failed\n", pass);
@@ -4102,6 +4176,7 @@ int cil_resolve_ast(struct cil_db *db, struct cil_tree_node *current)
 
 		if (changed) {
 			struct cil_list_item *item;
+			cil_name_cache_destroy(db);
 			if (pass > CIL_PASS_CALL1) {
 				int has_decls = CIL_FALSE;
 
@@ -4161,8 +4236,11 @@ int cil_resolve_ast(struct cil_db *db, struct cil_tree_node *current)
 		goto exit;
 	}
 
+	cil_log(CIL_INFO, "Name resolution cache: %u hits, %u misses\n", db->name_cache_hits, db->name_cache_misses);
+
 	rc = SEPOL_OK;
 exit:
+	cil_name_cache_destroy(db);
 	cil_list_destroy(&extra_args.sidorder_lists, CIL_FALSE);
 	cil_list_destroy(&extra_args.classorder_lists, CIL_FALSE);
 	cil_list_destroy(&extra_args.catorder_lists, CIL_FALSE);
@@ -4249,14 +4327,42 @@ exit:
 	return rc;
 }
 
+/* The name cache is keyed by the address of name, so name must have been
+ * interned with cil_strpool_add(). A temporary string could be freed and its
+ * address reused for a different name, which would then hit the old entry.
+ */
 static int __cil_resolve_name_helper(struct cil_db *db, struct cil_tree_node *node, char *name, enum cil_sym_index sym_index, struct cil_symtab_datum **datum)
 {
 	int rc = SEPOL_ERR;
+	struct cil_name_cache_key key;
+	struct cil_name_cache_key *new_key;
+
+	if (db->name_cache != NULL) {
+		key.scope = node;
+		key.name = name;
+		key.sym_index = sym_index;
+		*datum = hashtab_search(db->name_cache, (hashtab_key_t)&key);
+		if (*datum != NULL) {
+			db->name_cache_hits++;
+			return SEPOL_OK;
+		}
+		db->name_cache_misses++;
+	}
 
 	rc = __cil_resolve_name_with_parents(node, name, sym_index, datum);
 	if (rc != SEPOL_OK) {
 		rc = __cil_resolve_name_with_root(db, name, sym_index, datum);
 	}
+
+	/* Only successful lookups are cached */
+	if (rc == SEPOL_OK && db->name_cache != NULL) {
+		new_key = cil_malloc(sizeof(*new_key));
+		*new_key = key;
+		if (hashtab_insert(db->name_cache, (hashtab_key_t)new_key, *datum) != SEPOL_OK) {
+			free(new_key);
+		}
+	}
+
 	return rc;
 }
 
@@ -4325,7 +4431,8 @@ int cil_resolve_name_keep_aliases(struct cil_tree_node *ast_node, char *name, en
 			/* Leading '.' */
 			symtab = &((struct cil_root *)db->ast->root->data)->symtab[CIL_SYM_BLOCKS];
 		} else {
-			rc = __cil_resolve_name_helper(db, node->parent, current, CIL_SYM_BLOCKS, datum);
+			/* current points into name_dup, which is freed below */
+			rc = __cil_resolve_name_helper(db, node->parent, cil_strpool_add(current), CIL_SYM_BLOCKS, datum);
 			if (rc != SEPOL_OK) {
 				free(name_dup);
 				goto exit;
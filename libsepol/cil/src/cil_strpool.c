@@ -37,66 +37,104 @@
 #include "cil_log.h"
 #define CIL_STRPOOL_TABLE_SIZE 1 << 15
 
+/* The string is allocated together with its entry. The full hash is kept,
+ * so lookups only compare strings with the same hash and length, and the
+ * table can grow without hashing the strings again.
+ */
 struct cil_strpool_entry {
-	char *str;
+	struct cil_strpool_entry *next;
+	unsigned int hash;
+	size_t len;
+	char str[];
 };
 
 static pthread_mutex_t cil_strpool_mutex = PTHREAD_MUTEX_INITIALIZER;
 static unsigned int cil_strpool_readers = 0;
-static hashtab_t cil_strpool_tab = NULL;
+static struct cil_strpool_entry **cil_strpool_tab = NULL;
+static unsigned int cil_strpool_size = 0;
+static unsigned int cil_strpool_nel = 0;
 
-static unsigned int cil_strpool_hash(hashtab_t h, const_hashtab_key_t key)
+unsigned int cil_strpool_hash(const char *str, size_t len)
 {
-	unsigned int hash = 5381;
-	unsigned char c;
+	unsigned int hash = CIL_STRPOOL_HASH_INIT;
+	size_t i;
 
-	while ((c = *(unsigned const char *)key++))
-		hash = ((hash << 5) + hash) ^ c;
+	for (i = 0; i < len; i++)
+		hash = cil_strpool_hash_step(hash, str[i]);
 
-	return hash & (h->size - 1);
+	return hash;
 }
 
-static int cil_strpool_compare(hashtab_t h __attribute__ ((unused)), const_hashtab_key_t key1, const_hashtab_key_t key2)
+static void cil_strpool_grow(void)
 {
-	return strcmp(key1, key2);
+	struct cil_strpool_entry **new_tab;
+	struct cil_strpool_entry *cur, *next;
+	unsigned int new_size = cil_strpool_size << 1;
+	unsigned int i, idx;
+
+	new_tab = cil_calloc(new_size, sizeof(*new_tab));
+
+	for (i = 0; i < cil_strpool_size; i++) {
+		for (cur = cil_strpool_tab[i]; cur; cur = next) {
+			next = cur->next;
+			idx = cur->hash & (new_size - 1);
+			cur->next = new_tab[idx];
+			new_tab[idx] = cur;
+		}
+	}
+
+	free(cil_strpool_tab);
+	cil_strpool_tab = new_tab;
+	cil_strpool_size = new_size;
 }
 
-char *cil_strpool_add(const char *str)
+char *cil_strpool_addn(const char *str, size_t len, unsigned int hash)
 {
 	struct cil_strpool_entry *strpool_ref = NULL;
+	unsigned int idx;
 
 	pthread_mutex_lock(&cil_strpool_mutex);
 
-	strpool_ref = hashtab_search(cil_strpool_tab, str);
-	if (strpool_ref == NULL) {
-		int rc;
-		strpool_ref = cil_malloc(sizeof(*strpool_ref));
-		strpool_ref->str = cil_strdup(str);
-		rc = hashtab_insert(cil_strpool_tab, strpool_ref->str, strpool_ref);
-		if (rc != SEPOL_OK) {
+	idx = hash & (cil_strpool_size - 1);
+	for (strpool_ref = cil_strpool_tab[idx]; strpool_ref; strpool_ref = strpool_ref->next) {
+		if (strpool_ref->hash == hash && strpool_ref->len == len &&
+		    memcmp(strpool_ref->str, str, len) == 0) {
 			pthread_mutex_unlock(&cil_strpool_mutex);
-			cil_log(CIL_ERR, "Failed to allocate memory\n");
-			exit(1);
+			return strpool_ref->str;
 		}
 	}
 
+	strpool_ref = cil_malloc(sizeof(*strpool_ref) + len + 1);
+	strpool_ref->hash = hash;
+	strpool_ref->len = len;
+	memcpy(strpool_ref->str, str, len);
+	strpool_ref->str[len] = '\0';
+	strpool_ref->next = cil_strpool_tab[idx];
+	cil_strpool_tab[idx] = strpool_ref;
+
+	cil_strpool_nel++;
+	if (cil_strpool_nel > cil_strpool_size) {
+		cil_strpool_grow();
+	}
+
 	pthread_mutex_unlock(&cil_strpool_mutex);
 	return strpool_ref->str;
 }
 
-static int cil_strpool_entry_destroy(hashtab_key_t k __attribute__ ((unused)), hashtab_datum_t d, void *args __attribute__ ((unused)))
+char *cil_strpool_add(const char *str)
 {
-	struct cil_strpool_entry *strpool_ref = (struct cil_strpool_entry*)d;
-	free(strpool_ref->str);
-	free(strpool_ref);
-	return SEPOL_OK;
+	size_t len = strlen(str);
+
+	return cil_strpool_addn(str, len, cil_strpool_hash(str, len));
 }
 
 void cil_strpool_init(void)
 {
 	pthread_mutex_lock(&cil_strpool_mutex);
 	if (cil_strpool_tab == NULL) {
-		cil_strpool_tab = hashtab_create(cil_strpool_hash, cil_strpool_compare, CIL_STRPOOL_TABLE_SIZE);
+		cil_strpool_size = CIL_STRPOOL_TABLE_SIZE;
+		cil_strpool_nel = 0;
+		cil_strpool_tab = calloc(cil_strpool_size, sizeof(*cil_strpool_tab));
 		if (cil_strpool_tab == NULL) {
 			pthread_mutex_unlock(&cil_strpool_mutex);
 			cil_log(CIL_ERR, "Failed to allocate memory\n");
@@ -109,12 +147,22 @@ void cil_strpool_init(void)
 
 void cil_strpool_destroy(void)
 {
+	struct cil_strpool_entry *cur, *next;
+	unsigned int i;
+
 	pthread_mutex_lock(&cil_strpool_mutex);
 	cil_strpool_readers--;
 	if (cil_strpool_readers == 0) {
-		hashtab_map(cil_strpool_tab, cil_strpool_entry_destroy, NULL);
-		hashtab_destroy(cil_strpool_tab);
+		for (i = 0; i < cil_strpool_size; i++) {
+			for (cur = cil_strpool_tab[i]; cur; cur = next) {
+				next = cur->next;
+				free(cur);
+			}
+		}
+		free(cil_strpool_tab);
 		cil_strpool_tab = NULL;
+		cil_strpool_size = 0;
+		cil_strpool_nel = 0;
 	}
 	pthread_mutex_unlock(&cil_strpool_mutex);
 }
@@ -30,9 +30,15 @@
 #ifndef CIL_STRPOOL_H_
 #define CIL_STRPOOL_H_
 
+#include <stddef.h>
 #include <sepol/policydb/hashtab.h>
 
+#define CIL_STRPOOL_HASH_INIT 5381
+#define cil_strpool_hash_step(hash, c) ((((hash) << 5) + (hash)) ^ (unsigned char)(c))
+
+unsigned int cil_strpool_hash(const char *str, size_t len);
 char *cil_strpool_add(const char *str);
+char *cil_strpool_addn(const char *str, size_t len, unsigned int hash);
 void cil_strpool_init(void);
 void cil_strpool_destroy(void);
 #endif /* CIL_STRPOOL_H_ */
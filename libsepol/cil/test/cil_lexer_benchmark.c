@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "cil_lexer.h"
+
+static __attribute__ ((__noreturn__)) void usage(const char *progname)
+{
+	fprintf(stderr,
+		"usage: %s [-f file | -s megabytes] [-r rounds]\n\n"
+		"Where:\n\t"
+		"-f  CIL file to tokenize.\n\t"
+		"-s  Size of the generated CIL to tokenize instead (defaults\n\t"
+		"    to 64).\n\t"
+		"-r  Number of times the input is tokenized (defaults to 5).\n\n"
+		"Reports how fast the CIL lexer tokenizes its input.\n\n"
+		"Example:\n\t"
+		"%s -f /var/lib/selinux/targeted/active/modules/100/base/cil\n",
+		progname, progname);
+	exit(1);
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) +
+	       (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Returns a buffer of at least size bytes of CIL resembling a compiled
+ * module, with every kind of token the lexer knows. */
+static char *generate_cil(size_t size, size_t *len)
+{
+	char *buf = NULL;
+	size_t buf_size = 0;
+	unsigned long n;
+	FILE *f;
+
+	f = open_memstream(&buf, &buf_size);
+	if (f == NULL)
+		return NULL;
+
+	for (n = 0; ftell(f) < (long)size; n++) {
+		if (n % 100 == 0)
+			fprintf(f, ";;* lmx %lu bench.te\n", n);
+		fprintf(f, "; module %lu\n", n);
+		fprintf(f, "(type bench%lu_t)\n", n);
+		fprintf(f, "(roletype object_r bench%lu_t)\n", n);
+		fprintf(f, "(typeattributeset cil_gen_require bench%lu_t)\n", n);
+		fprintf(f, "(allow bench%lu_t self (file (read write getattr open)))\n", n);
+		fprintf(f, "(typetransition bench%lu_t tmp_t file \"bench%lu\" bench%lu_t)\n",
+			n, n, n);
+		fprintf(f, "(booleanif (and bench_bool (not other_bool))\n"
+			"\t(true\n"
+			"\t\t(allow bench%lu_t tmp_t (dir (search)))\n"
+			"\t)\n"
+			")\n", n);
+		fprintf(f, "(filecon \"/opt/bench%lu(/.*)?\" any "
+			"(system_u object_r bench%lu_t ((s0) (s0))))\n", n, n);
+	}
+
+	if (fclose(f) != 0) {
+		free(buf);
+		return NULL;
+	}
+
+	*len = buf_size;
+	return buf;
+}
+
+static char *read_cil(const char *path, size_t *len)
+{
+	struct stat sb;
+	char *buf;
+	FILE *f;
+
+	f = fopen(path, "re");
+	if (f == NULL)
+		return NULL;
+
+	if (fstat(fileno(f), &sb) != 0) {
+		fclose(f);
+		return NULL;
+	}
+
+	buf = malloc(sb.st_size + 1);
+	if (buf == NULL || fread(buf, 1, sb.st_size, f) != (size_t)sb.st_size) {
+		free(buf);
+		fclose(f);
+		return NULL;
+	}
+	fclose(f);
+
+	*len = sb.st_size;
+	return buf;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long megabytes = 64, rounds = 5, i;
+	const char *file = NULL;
+	struct token tok;
+	struct timespec start;
+	size_t len, tokens = 0;
+	double secs;
+	char *buf;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:s:r:")) > 0) {
+		switch (opt) {
+		case 'f':
+			file = optarg;
+			break;
+		case 's':
+			megabytes = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc || megabytes == 0 || rounds == 0)
+		usage(argv[0]);
+
+	if (file) {
+		buf = read_cil(file, &len);
+		if (buf == NULL) {
+			fprintf(stderr, "Could not read %s: %s\n", file,
+				strerror(errno));
+			return 1;
+		}
+	} else {
+		buf = generate_cil(megabytes << 20, &len);
+		if (buf == NULL) {
+			fprintf(stderr, "Could not generate the input: %s\n",
+				strerror(errno));
+			return 1;
+		}
+	}
+
+	if (len > UINT32_MAX) {
+		fprintf(stderr, "Input of %zu bytes is too large\n", len);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < rounds; i++) {
+		cil_lexer_setup(buf, len);
+		do {
+			cil_lexer_next(&tok);
+			tokens++;
+		} while (tok.type != END_OF_FILE);
+		cil_lexer_destroy();
+	}
+	secs = elapsed(&start);
+
+	printf("tokens: %zu of %zu bytes in %.3f s, %.1f MB/s\n",
+	       tokens / rounds, len, secs / rounds,
+	       secs > 0 ? (double)len * rounds / secs / (1 << 20) : 0.0);
+
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ *      This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License as
+ *      published by the Free Software Foundation, version 2.
+ */
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <semanage/handle.h>
+
+static void usage(const char *progname)
+{
+	printf("usage:  %s [-hv] [-s SOCKET]\n", progname);
+	printf("Options:\n");
+	printf("  -s,--socket=SOCKET  listen on SOCKET instead of the module-store socket\n");
+	printf("  -v,--verbose        be verbose\n");
+	printf("  -h,--help           print this message and quit\n");
+}
+
+/* Signal handlers. */
+static void handle_signal(int sig_num __attribute__ ((unused)))
+{
+	/* semanage_serve() returns once interrupted */
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option opts[] = {
+		{"socket", required_argument, NULL, 's'},
+		{"verbose", no_argument, NULL, 'v'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	struct sigaction sa;
+	semanage_handle_t *sh;
+	const char *path = NULL;
+	int verbose = 0;
+	int c, rc;
+
+	while ((c = getopt_long(argc, argv, "s:vh", opts, NULL)) != -1) {
+		switch (c) {
+		case 's':
+			path = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+		default:
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (optind < argc) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+
+	sh = semanage_handle_create();
+	if (!sh) {
+		fprintf(stderr, "%s:  Could not create semanage handle\n",
+			argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	if (verbose)
+		printf("Serving the policy store on %s.\n",
+		       path ? path : "the module-store socket");
+
+	rc = semanage_serve(sh, path);
+	if (rc < 0)
+		fprintf(stderr, "%s:  Could not run the policy server.\n",
+			argv[0]);
+	else if (verbose)
+		printf("Policy server stopped.\n");
+
+	semanage_handle_destroy(sh);
+	exit(rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -24,10 +24,11 @@ void restore_init(struct restore_opts *opts)
 	struct selinux_opt selinux_opts[] = {
 		{ SELABEL_OPT_VALIDATE, opts->selabel_opt_validate },
 		{ SELABEL_OPT_PATH, opts->selabel_opt_path },
-		{ SELABEL_OPT_DIGEST, opts->selabel_opt_digest }
+		{ SELABEL_OPT_DIGEST, opts->selabel_opt_digest },
+		{ SELABEL_OPT_PROFILE, opts->selabel_opt_profile }
 	};
 
-	opts->hnd = selabel_open(SELABEL_CTX_FILE, selinux_opts, 3);
+	opts->hnd = selabel_open(SELABEL_CTX_FILE, selinux_opts, 4);
 	if (!opts->hnd) {
 		perror(opts->selabel_opt_path ? opts->selabel_opt_path : selinux_file_context_path());
 		exit(1);
@@ -44,6 +44,7 @@ struct restore_opts {
 	const char *selabel_opt_validate;
 	const char *selabel_opt_path;
 	const char *selabel_opt_digest;
+	const char *selabel_opt_profile;
 	int debug;
 };
 
@@ -7,6 +7,7 @@
 #include <regex.h>
 #include <sys/vfs.h>
 #include <libgen.h>
+#include <time.h>
 #ifdef USE_AUDIT
 #include <libaudit.h>
 
@@ -19,6 +20,8 @@ static char *policyfile;
 static int warn_no_match;
 static int null_terminated;
 static int request_digest;
+static const char *stamp_file;
+static const char *profile_file;
 static struct restore_opts r_opts;
 
 #define STAT_BLOCK_SIZE 1
@@ -35,13 +38,13 @@ static __attribute__((__noreturn__)) void usage(const char *const name)
 {
 	if (iamrestorecon) {
 		fprintf(stderr,
-			"usage:  %s [-iIDFmnprRv0xT] [-e excludedir] pathname...\n"
-			"usage:  %s [-iIDFmnprRv0xT] [-e excludedir] -f filename\n",
+			"usage:  %s [-iIDFmnprRv0xT] [-e excludedir] [-N stamp_file] [-P profile_file] pathname...\n"
+			"usage:  %s [-iIDFmnprRv0xT] [-e excludedir] [-N stamp_file] [-P profile_file] -f filename\n",
 			name, name);
 	} else {
 		fprintf(stderr,
-			"usage:  %s [-diIDlmnpqvCEFWT] [-e excludedir] [-r alt_root_path] [-c policyfile] spec_file pathname...\n"
-			"usage:  %s [-diIDlmnpqvCEFWT] [-e excludedir] [-r alt_root_path] [-c policyfile] spec_file -f filename\n"
+			"usage:  %s [-diIDlmnpqvCEFWT] [-e excludedir] [-r alt_root_path] [-c policyfile] [-N stamp_file] [-P profile_file] spec_file pathname...\n"
+			"usage:  %s [-diIDlmnpqvCEFWT] [-e excludedir] [-r alt_root_path] [-c policyfile] [-N stamp_file] [-P profile_file] spec_file -f filename\n"
 			"usage:  %s -s [-diIDlmnpqvFWT] spec_file\n",
 			name, name, name);
 	}
@@ -65,6 +68,144 @@ static void set_rootpath(const char *arg)
 	}
 }
 
+/*
+ * The stamp file records what the last run checked: the digest of the
+ * specs, the options that select and relabel files, and the paths. Its
+ * modification time is the start of that run. Files outside of what was
+ * checked may be older and still wrong, so the stamp is only relied on by
+ * a run that checks the same.
+ */
+static char *stamp_key(char **paths, int npaths)
+{
+	const unsigned int key_flags = SELINUX_RESTORECON_RECURSE |
+				       SELINUX_RESTORECON_XDEV |
+				       SELINUX_RESTORECON_REALPATH |
+				       SELINUX_RESTORECON_SET_SPECFILE_CTX |
+				       SELINUX_RESTORECON_IGNORE_MOUNTS;
+	unsigned char *digest;
+	char **specfiles;
+	size_t digest_len, num_specfiles, len, i;
+	char *key = NULL;
+	FILE *f;
+	int n;
+
+	if (selabel_digest(r_opts.hnd, &digest, &digest_len, &specfiles,
+			   &num_specfiles) < 0)
+		return NULL;
+
+	f = open_memstream(&key, &len);
+	if (!f)
+		return NULL;
+
+	fprintf(f, "%s stamp 1\ndigest ", SETFILES);
+	for (i = 0; i < digest_len; i++)
+		fprintf(f, "%02x", digest[i]);
+	fprintf(f, "\nflags %#x\n", r_opts.restorecon_flags & key_flags);
+	if (r_opts.rootpath)
+		fprintf(f, "root %zu %s\n", strlen(r_opts.rootpath),
+			r_opts.rootpath);
+	for (i = 0; exclude_list && exclude_list[i]; i++)
+		fprintf(f, "exclude %zu %s\n", strlen(exclude_list[i]),
+			exclude_list[i]);
+	for (n = 0; n < npaths; n++)
+		fprintf(f, "path %zu %s\n", strlen(paths[n]), paths[n]);
+
+	if (fclose(f) != 0) {
+		free(key);
+		return NULL;
+	}
+	return key;
+}
+
+/*
+ * Only check files changed since the last run, if it checked what this
+ * one checks. Otherwise check everything.
+ */
+static void read_stamp(const char *key)
+{
+	struct stat sb;
+	size_t len = strlen(key);
+	char *buf;
+	FILE *f;
+	int same;
+
+	f = fopen(stamp_file, "re");
+	if (!f) {
+		if (errno == ENOENT)
+			return;
+		fprintf(stderr, "%s:  Could not open %s: %s\n",
+			r_opts.progname, stamp_file, strerror(errno));
+		exit(-1);
+	}
+
+	if (fstat(fileno(f), &sb) < 0) {
+		fprintf(stderr, "%s:  stat(%s) failed: %s\n",
+			r_opts.progname, stamp_file, strerror(errno));
+		exit(-1);
+	}
+
+	buf = malloc(len + 1);
+	if (!buf) {
+		fprintf(stderr, "%s:  Out of memory!\n", r_opts.progname);
+		exit(-1);
+	}
+	same = fread(buf, 1, len + 1, f) == len && !memcmp(buf, key, len);
+	free(buf);
+	fclose(f);
+
+	if (!same) {
+		if (r_opts.verbose)
+			printf("%s:  %s was written by a run checking other files or specs, checking all files\n",
+			       r_opts.progname, stamp_file);
+		return;
+	}
+
+	r_opts.restorecon_flags |= SELINUX_RESTORECON_CHANGED_SINCE;
+	selinux_restorecon_set_changed_since(&sb.st_mtim);
+}
+
+static int write_stamp(const char *key, const struct timespec *start)
+{
+	struct timespec times[2] = { *start, *start };
+	size_t len = strlen(key);
+	int fd;
+
+	fd = open(stamp_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0 || write(fd, key, len) != (ssize_t)len ||
+	    futimens(fd, times) < 0) {
+		fprintf(stderr, "%s:  Could not update %s: %s\n",
+			r_opts.progname, stamp_file, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	close(fd);
+	return 0;
+}
+
+/* Write how often each specification matched and how long its regex took */
+static int write_profile(void)
+{
+	FILE *fp;
+	int rc;
+
+	fp = fopen(profile_file, "we");
+	if (!fp) {
+		fprintf(stderr, "%s:  Could not open %s: %s\n",
+			r_opts.progname, profile_file, strerror(errno));
+		return -1;
+	}
+
+	rc = selabel_profile_dump(r_opts.hnd, fp);
+	if (fclose(fp) == EOF)
+		rc = -1;
+	if (rc < 0)
+		fprintf(stderr, "%s:  Could not write %s: %s\n",
+			r_opts.progname, profile_file, strerror(errno));
+	return rc;
+}
+
 static int canoncon(char **contextp)
 {
 	char *context = *contextp, *tmpcon;
@@ -146,11 +287,13 @@ int main(int argc, char **argv)
 	size_t buf_len, nthreads = 1;
 	const char *base;
 	int errors = 0;
-	const char *ropts = "e:f:hiIDlmno:pqrsvFRW0xT:";
-	const char *sopts = "c:de:f:hiIDlmno:pqr:svCEFR:W0T:";
+	const char *ropts = "e:f:hiIDlmnN:o:P:pqrsvFRW0xT:";
+	const char *sopts = "c:de:f:hiIDlmnN:o:P:pqr:svCEFR:W0T:";
 	const char *opts;
 	union selinux_callback cb;
 	long unsigned skipped_errors;
+	struct timespec start;
+	char *stamp = NULL;
 
 	/* Initialize variables */
 	memset(&r_opts, 0, sizeof(r_opts));
@@ -159,6 +302,8 @@ int main(int argc, char **argv)
 	warn_no_match = 0;
 	request_digest = 0;
 	policyfile = NULL;
+	stamp_file = NULL;
+	profile_file = NULL;
 	skipped_errors = 0;
 
 	if (!argv[0]) {
@@ -305,6 +450,12 @@ int main(int argc, char **argv)
 		case 'n':
 			r_opts.nochange = SELINUX_RESTORECON_NOCHANGE;
 			break;
+		case 'N':
+			stamp_file = optarg;
+			break;
+		case 'P':
+			profile_file = optarg;
+			break;
 		case 'o': /* Deprecated */
 			fprintf(stderr, "%s: -o option no longer supported\n",
 				r_opts.progname);
@@ -377,6 +528,13 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (stamp_file && use_input_file) {
+		fprintf(stderr,
+			"%s:  -N needs the pathnames on the command line\n",
+			r_opts.progname);
+		usage(argv[0]);
+	}
+
 	for (i = optind; i < argc; i++) {
 		if (!strcmp(argv[i], "/"))
 			r_opts.mass_relabel = SELINUX_RESTORECON_MASS_RELABEL;
@@ -423,11 +581,33 @@ int main(int argc, char **argv)
 
 	/* Set selabel_open options. */
 	r_opts.selabel_opt_validate = (ctx_validate ? (char *)1 : NULL);
-	r_opts.selabel_opt_digest = (request_digest ? (char *)1 : NULL);
+	/* The digest of the specs is part of the stamp */
+	r_opts.selabel_opt_digest = (request_digest || stamp_file ?
+				     (char *)1 : NULL);
 	r_opts.selabel_opt_path = altpath;
+	r_opts.selabel_opt_profile = (profile_file ? (char *)1 : NULL);
 
 	restore_init(&r_opts);
 
+	if (stamp_file) {
+		/* Only -D and -I use the directory digests */
+		if (!request_digest)
+			r_opts.restorecon_flags |= SELINUX_RESTORECON_SKIP_DIGEST;
+
+		stamp = stamp_key(&argv[optind], argc - optind);
+		if (!stamp) {
+			fprintf(stderr, "%s:  Could not compute the contents of %s: %s\n",
+				r_opts.progname, stamp_file, strerror(errno));
+			exit(-1);
+		}
+		read_stamp(stamp);
+		/*
+		 * The coarse clock is the one file timestamps are taken from,
+		 * so files changed from now on are not older than this.
+		 */
+		clock_gettime(CLOCK_REALTIME_COARSE, &start);
+	}
+
 	if (use_input_file) {
 		FILE *f = stdin;
 		ssize_t len;
@@ -460,12 +640,19 @@ int main(int argc, char **argv)
 					       &skipped_errors) < 0;
 	}
 
+	if (stamp_file && !errors && !skipped_errors && !r_opts.nochange)
+		errors |= write_stamp(stamp, &start) < 0;
+	free(stamp);
+
 	if (r_opts.mass_relabel && !r_opts.nochange)
 		audit_mass_relabel(errors);
 
 	if (warn_no_match)
 		selabel_stats(r_opts.hnd);
 
+	if (profile_file)
+		errors |= write_profile() < 0;
+
 	selabel_close(r_opts.hnd);
 	restore_finish();
 